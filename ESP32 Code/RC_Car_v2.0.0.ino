@@ -11,12 +11,19 @@
  * - Starts a WebSocket server (port 81) for real-time communication (commands, telemetry).
  * - Controls two DC motors via an L298N motor driver for movement (forward, backward, left, right, stop).
  * - Implements basic obstacle avoidance using an HC-SR04 ultrasonic sensor.
- * - Uses an MFRC522 RFID reader to scan RFID tags/cards for user authorization.
- * - Requires authorization via RFID before accepting movement commands.
+ * - Uses an MFRC522 RFID reader to scan RFID tags/cards for user authorization,
+ *   probed at an adaptive cadence by a low-priority task.
+ * - Requires authorization via RFID before accepting movement commands; each scan opens
+ *   a session bound to one WebSocket client, resumable with its token after a reconnect.
  * - Implements an authorization timeout.
  * - Sends telemetry data (RSSI, authorization status, distance, etc.) back to the client via WebSocket.
  * - Handles WebSocket PING/PONG for connection keep-alive.
+ * - Times each drive command from receipt to actuation and reports latency histograms on request (STATS).
  * - Includes logic for checking and re-establishing WiFi connection.
+ * - Runs motor actuation and obstacle avoidance in a fixed-rate FreeRTOS control task
+ *   on core 0, fed by a lock-free command queue from the network loop on core 1.
+ * - Ramps the motors down from a timer-driven deadman watchdog when the driver's
+ *   dashboard stops re-sending its held command (frozen tab, lost link, stuck loop).
  *
  * Hardware Connections:
  * - L298N Motor Driver: ENA -> GPIO 13, IN1 -> GPIO 15, IN2 -> GPIO 14, ENB -> GPIO 27, IN3 -> GPIO 26, IN4 -> GPIO 25
@@ -27,9 +34,16 @@
  * - WiFi.h (ESP32 Core)
  * - WebSocketServer.h (Requires a WebSocket library, e.g., arduinoWebSockets or similar adapted)
  * - index.h (Contains the HTML/JS for the web interface, stored as a C++ string literal)
+ * - index_gz.h (Gzipped copy of index.h with its ETag, generated by Website/build_index_gz.py)
  * - SPI.h (ESP32 Core)
  * - MFRC522.h (Requires MFRC522 library by miguelbalboa)
  * - ArduinoJson.h (Requires ArduinoJson library by bblanchon)
+ * - command_frame.h (Command codes and frame parsers, in this folder)
+ * - control_queue.h (Lock-free control task handoff, in this folder)
+ * - ranging.h (Ultrasonic timing, echo conversion and the range/TTC filter, in this folder)
+ * - telemetry_encoder.h (Telemetry field table and encoders, in this folder)
+ * - http_server.h (Non-blocking HTTP connection table, in this folder)
+ * - Preferences.h (ESP32 Core, NVS storage for the authorized cards)
  * - Arduino.h (ESP32 Core)
  */
 
@@ -39,19 +53,23 @@
 #include <WiFi.h>             // For WiFi connectivity
 #include "WebSocketServer.h"  // For WebSocket communication (replace with your actual library header if different)
 #include "index.h"            // Contains the HTML/JS content for the web UI
+#include "index_gz.h"         // Pre-gzipped web UI and its ETag (generated by Website/build_index_gz.py)
 #include <SPI.h>              // For SPI communication (used by RFID)
 #include <MFRC522.h>          // For RFID reader interaction
 #include <ArduinoJson.h>      // For easy JSON creation and parsing
+#include <Preferences.h>      // For the RFID card store in NVS
 #include <Arduino.h>          // Core Arduino framework functions
-
-// =============================================================================
-// Command Definitions
-// =============================================================================
-#define CMD_STOP 0      ///< Command code to stop the car.
-#define CMD_FORWARD 1   ///< Command code to move the car forward.
-#define CMD_BACKWARD 2  ///< Command code to move the car backward.
-#define CMD_LEFT 4      ///< Command code to turn the car left.
-#define CMD_RIGHT 8     ///< Command code to turn the car right.
+#include <atomic>             // For lock-free handoff between the network loop and the control task
+#include <esp_timer.h>        // For the deadman watchdog timer
+#include "command_frame.h"    // Command codes and the binary frame parsers (shared with the host tests)
+#include "control_queue.h"    // Lock-free command/event rings between the network loop and the control task
+#include "ranging.h"          // HC-SR04 timing, echo conversion and range filter (shared with the host tests)
+#include "telemetry_encoder.h" // Telemetry field table and reused-buffer encoders (shared with the host tests)
+#include "http_server.h"      // Non-blocking HTTP connection table (shared with the host load test)
+#include "card_store.h"       // Authorized RFID card table in NVS (shared with the host test)
+#include "rfid_probe.h"       // RFID presence probe and cadence (shared with the host test)
+#include "wifi_link.h"        // WiFi reconnect state machine (shared with the host link-flap harness)
+#include "deadman.h"          // Deadman watchdog tick (shared with the host test)
 
 // =============================================================================
 // Motor Control Pin Definitions & Configuration
@@ -76,7 +94,7 @@ const int echoPin = 32; ///< GPIO pin connected to the ECHO pin of the HC-SR04 s
 // =============================================================================
 // Obstacle Avoidance State Variables
 // =============================================================================
-const int STOP_DISTANCE = 100; ///< Minimum distance (cm) before obstacle avoidance triggers or forward motion is blocked.
+// STOP_DISTANCE and TTC_THRESHOLD are defined in ranging.h.
 
 /**
  * @enum ObstacleAvoidanceState
@@ -87,12 +105,18 @@ enum ObstacleAvoidanceState {
   BACKING_UP,     ///< The car is currently moving backward as part of the avoidance maneuver.
   COMPLETING      ///< The car is finishing the avoidance maneuver (e.g., pausing briefly).
 };
-ObstacleAvoidanceState avoidanceState = IDLE; ///< Current state of the obstacle avoidance state machine.
+// The variables below are written only by the control task and read by the network loop
+// (telemetry, early rejection). Aligned 32-bit accesses are atomic on the ESP32.
+volatile ObstacleAvoidanceState avoidanceState = IDLE; ///< Current state of the obstacle avoidance state machine.
 unsigned long avoidanceStateStartTime = 0; ///< Timestamp (millis) when the current avoidance state began.
-bool avoidingObstacle = false; ///< Flag indicating if the obstacle avoidance routine is currently active.
-int lastDistance = 100; ///< Last measured distance from the ultrasonic sensor (cm). Initialized to a safe value.
+volatile bool avoidingObstacle = false; ///< Flag indicating if the obstacle avoidance routine is currently active.
+volatile int lastDistance = 100; ///< Filtered distance from the ultrasonic sensor (cm). Initialized to a safe value.
+volatile int closingSpeed = 0; ///< Filtered speed (cm/s) at which the obstacle ahead is approaching (negative = receding).
+volatile long timeToCollision = -1; ///< Predicted time-to-collision (ms) at the current closing speed, or -1 if not closing.
 unsigned long lastAvoidanceTime = 0; ///< Timestamp (millis) of the last time avoidance was active (can be used for debouncing or timing).
-int lastSentCommand = CMD_STOP; ///< Stores the last valid command received via WebSocket, used for state management.
+volatile int lastSentCommand = CMD_STOP; ///< Last command applied by the control task, used for state management.
+uint16_t lastDriveSequence = 0; ///< Sequence number of the last accepted binary drive frame.
+bool driveSequenceValid = false; ///< True once a binary drive frame has been accepted.
 
 // =============================================================================
 // WiFi Configuration
@@ -101,6 +125,15 @@ const char *ssid = " ";   ///< Your WiFi network SSID (Network Name).
 const char *password = " ";  ///< Your WiFi network password.
 // Note: Hardcoding credentials is not recommended for production. Consider using WiFiManager or other secure methods.
 
+// Link supervision is event driven: the WiFi event handler (running in the system
+// event task) only records the new link state, and on a disconnect also requests a
+// stop, so the car halts within one control cycle of losing the link. The network
+// loop runs the reconnect state machine in wifi_link.h (checkWiFiConnection()), which
+// never waits. The driver's own auto-reconnect is disabled so only it retries.
+std::atomic<bool> wifiConnected(false);          ///< Written by the WiFi event handler.
+std::atomic<uint32_t> wifiDrops(0);              ///< Link losses since boot.
+WiFiLink wifiLink;                               ///< Reconnect state machine; owned by the network loop.
+
 // =============================================================================
 // RFID Configuration
 // =============================================================================
@@ -117,9 +150,8 @@ MFRC522 rfid(RFID_SS_PIN, RFID_RST_PIN);
 // =============================================================================
 // Authorization State Variables
 // =============================================================================
-bool isAuthorized = false; ///< Flag indicating if a valid RFID tag has been scanned and the session is active.
-String authorizedUser = ""; ///< Stores the name of the currently authorized user.
-unsigned long lastAuthorizedActivity = 0; ///< Timestamp (millis) of the last authorized command or RFID scan.
+// Authorization is per connection: see "Authorization Sessions".
+bool isAuthorized = false; ///< True while any client has an active session (reported in telemetry).
 const unsigned long AUTH_TIMEOUT = 300000; ///< Authorization timeout duration in milliseconds (5 minutes).
 
 // =============================================================================
@@ -128,42 +160,365 @@ const unsigned long AUTH_TIMEOUT = 300000; ///< Authorization timeout duration i
 WiFiServer httpServer(80); ///< HTTP server instance listening on port 80.
 net::WebSocketServer webSocket(81); ///< WebSocket server instance listening on port 81. (Note: 'net::' prefix depends on the specific library used)
 
+// =============================================================================
+// HTTP Connection Table
+// =============================================================================
+// The non-blocking HTTP state machine is defined in http_server.h.
+HttpConnection httpConnections[HTTP_CONNECTION_SLOTS]; ///< The HTTP connection table (serving + refusal slots).
+const HttpPage dashboardPage = { HTML_CONTENT_GZ, HTML_CONTENT_GZ_LENGTH, HTML_CONTENT_GZ_ETAG, HTML_CONTENT }; ///< The page served on GET.
+
+// =============================================================================
+// Connection Table
+// =============================================================================
+// Every WebSocket client has a slot with its role, activity and traffic counters.
+//
+// Driving is arbitrated by a lease: only the client holding it (the driver) may send
+// drive commands; everyone else is a read-only spectator. Only a client with an active
+// authorization session can hold it: an authorized drive command while the lease is
+// free takes it, and OP_LEASE requests or releases it explicitly. A STOP from a client
+// without a session still stops the car but neither takes nor refreshes the lease. A request
+// while another client holds the lease is granted (handover) only if the car is
+// stopped and the holder has not sent a drive command for LEASE_HANDOVER_IDLE ms.
+// The lease lapses after LEASE_TIMEOUT ms without drive commands while stopped,
+// and when the driver disconnects (the car is stopped then). Drive messages from
+// spectators are recognised by their first byte and dropped before any parsing.
+// Every client is told of lease changes with "LEASE:{"driver":bool,"held":bool}".
+//
+// Spectators get a message budget per window: messages beyond it are dropped right
+// after the cheap in-place parse, so a chatty spectator cannot keep the network loop
+// busy while the driver's commands wait. While a lease is held, the driver gets
+// telemetry every tick and spectators get a full-level keyframe every
+// SPECTATOR_TELEMETRY_DIVIDER ticks, encoded once per format and shared by all of them.
+const int MAX_WS_CLIENTS = 12; ///< Table size; the mWebSockets MAX_CONNECTIONS (config.h, 4 by default) must be raised to use it all.
+const int SPECTATOR_MESSAGE_BUDGET = 20;          ///< Messages a spectator may send per budget window.
+const unsigned long CLIENT_BUDGET_WINDOW = 1000;  ///< Length of a budget window (ms).
+const unsigned long LEASE_TIMEOUT = 15000;        ///< Stopped and no drive command for this long: the lease lapses (ms).
+const unsigned long LEASE_HANDOVER_IDLE = 3000;   ///< A stopped driver idle this long hands over on request (ms).
+const unsigned long LEASE_NOTICE_INTERVAL = 1000; ///< Minimum time between lease notices to a rejected spectator (ms).
+const uint8_t SPECTATOR_TELEMETRY_DIVIDER = 5;    ///< Spectators get telemetry every Nth tick (2 Hz).
+
+/**
+ * @enum ClientRole
+ * @brief What a connected client is doing.
+ */
+enum ClientRole : uint8_t {
+  ROLE_SPECTATOR = 0, ///< Read-only: receives reduced-rate telemetry.
+  ROLE_DRIVER = 1     ///< Holds the driving lease.
+};
+
+/**
+ * @enum TelemetryFormat
+ * @brief Telemetry encodings a client can opt into with OP_TELEMETRY_MODE.
+ */
+enum TelemetryFormat : uint8_t {
+  TELEMETRY_JSON = 0,   ///< "TELEMETRY:{...}" text (default, for compatibility).
+  TELEMETRY_BINARY = 1  ///< Compact OP_TELEMETRY binary record.
+};
+
+/**
+ * @struct ClientInfo
+ * @brief Per-connection state kept for each connected WebSocket client.
+ */
+struct ClientInfo {
+  net::WebSocket *socket;          ///< The client's socket, or NULL if the slot is free.
+  TelemetryFormat telemetryFormat; ///< Encoding this client receives telemetry in.
+  TelemetryLevel telemetryLevel;   ///< Which fields this client receives.
+  bool telemetryDeltas;            ///< True once negotiated: send only changed fields between keyframes.
+  bool needsKeyframe;              ///< Send a full keyframe to this client on the next tick.
+  bool clockSynced;                ///< True once the client has sent OP_CLOCK_OFFSET.
+  int64_t clockOffset;             ///< Client clock minus device clock (us).
+  ClientRole role;                 ///< Driver or spectator.
+  unsigned long connectedAt;       ///< millis() when the client connected.
+  unsigned long lastActivity;      ///< millis() of the last message received.
+  uint32_t bytesIn;                ///< Payload bytes received.
+  uint32_t bytesOut;               ///< Payload bytes sent.
+  uint32_t messagesDropped;        ///< Messages dropped for exceeding the spectator budget.
+  uint32_t commandsRejected;       ///< Drive messages rejected because the client does not hold the lease.
+  unsigned long lastLeaseNotice;   ///< millis() of the last lease notice sent after a rejection.
+  uint16_t budgetUsed;             ///< Messages received in the current budget window.
+  unsigned long budgetWindowStart; ///< millis() the current budget window started.
+  int8_t session;                  ///< Index of the client's AuthSession, or -1.
+  unsigned long authRequestedAt;   ///< millis() a drive command was last refused for missing authorization (0 = never).
+};
+ClientInfo clients[MAX_WS_CLIENTS]; ///< Slot table of connected clients.
+int telemetryRoundRobin = 0;        ///< Slot the next telemetry tick starts its spectator pass at.
+int leaseHolder = -1;               ///< Slot holding the driving lease, or -1.
+unsigned long leaseLastCommand = 0; ///< millis() of the lease holder's last drive command.
+
+// =============================================================================
+// Telemetry Encoding
+// =============================================================================
+// The field table, TelemetryLevel masks and the encoders are defined in telemetry_encoder.h.
+char telemetryText[TELEMETRY_TEXT_SIZE];       ///< Reused buffer for the "TELEMETRY:{...}" text form.
+uint8_t telemetryBinary[TELEMETRY_BINARY_SIZE]; ///< Reused buffer for the binary form.
+TelemetrySnapshot previousTelemetry;           ///< Snapshot sent on the previous tick, for deltas.
+char noticeText[96];                           ///< Reused buffer for "OBSTACLE:" notices from the network loop.
+uint16_t telemetrySequence = 0;                ///< Incremented on every telemetry tick.
+
 // =============================================================================
 // Authorized RFID Users Definition
 // =============================================================================
+// The card table (hashed lookup in RAM, persisted in NVS) lives in card_store.h.
 /**
- * @struct AuthorizedUser
- * @brief Structure to hold the UID and name of an authorized RFID user.
+ * @brief Cards written to the store on first boot. Ensure UIDs match your specific RFID tags/cards.
+ * Later changes go through OP_RFID_ADMIN; editing this array does not touch an existing store.
  */
-struct AuthorizedUser {
-  byte uid[4];  ///< 4-byte Unique Identifier (UID) of the RFID tag/card.
-  String name;  ///< Name associated with the UID.
+const DefaultUser defaultUsers[] = {
+  {4, {0x4B, 0x17, 0xE2, 0x00}, RFID_FLAG_ADMIN, "User 1"},
+  {4, {0x63, 0xED, 0x38, 0x2D}, 0, "User 2"}
+  // Add users here in the format: {4, {0xXX, 0xXX, 0xXX, 0xXX}, flags, "User Name"}
 };
 
+CardStore cardStore;                       ///< Authorized cards and their NVS handle.
+
+// =============================================================================
+// Authorization Sessions
+// =============================================================================
+// A card scan opens a session bound to one WebSocket client, which alone may drive
+// with it. The scan goes to the client most recently refused for missing
+// authorization (within AUTH_CLAIM_WINDOW), else the lease holder, else the only
+// connected client. If none of these exists the session waits unclaimed for
+// AUTH_CLAIM_WINDOW and the next client to send a drive command claims it.
+//
+// The bound client receives a random 128-bit token in its "RFID:" notice. When the
+// connection drops the session is detached, not ended: a new connection presenting
+// the token with OP_AUTH_RESUME within AUTH_RESUME_GRACE takes it over without a
+// re-scan and gets a fresh token. Tokens are compared in constant time against every
+// session slot. Every drive command is checked against the sender's own session;
+// a session ends after AUTH_TIMEOUT without commands, when it is not resumed in
+// time, or when its card is revoked. The driving lease is bound to the driver's
+// session: it moves with the session on a resume and is released when it ends.
+const int MAX_AUTH_SESSIONS = 4;                  ///< Sessions kept at once (bound, detached or unclaimed).
+const unsigned long AUTH_RESUME_GRACE = 30000;    ///< A detached session can be resumed for this long (ms).
+const unsigned long AUTH_CLAIM_WINDOW = 30000;    ///< Pairing window between a refused command and a scan (ms).
+
 /**
- * @brief Array defining the list of authorized users.
- * Add or remove users by modifying this array. Ensure UIDs match your specific RFID tags/cards.
+ * @struct AuthSession
+ * @brief An authorized card session and the client it is bound to.
  */
-const AuthorizedUser authorizedUsers[] = {
-  {{0x4B, 0x17, 0xE2, 0x00}, "User 1"}, 
-  {{0x63, 0xED, 0x38, 0x2D}, "User 2"}
-  // Add authorized users here in the format: {{0xXX, 0xXX, 0xXX, 0xXX}, "User Name"}
+struct AuthSession {
+  bool active;                       ///< Slot in use.
+  int8_t slot;                       ///< Bound client slot, or -1 while detached or unclaimed.
+  bool claimable;                    ///< Unclaimed: the next client sending a drive command takes it.
+  bool admin;                        ///< Opened with a card flagged RFID_FLAG_ADMIN.
+  uint8_t token[AUTH_TOKEN_LENGTH];  ///< Bearer token for OP_AUTH_RESUME.
+  uint8_t uidLength;                 ///< Length of `uid`.
+  uint8_t uid[RFID_UID_MAX];         ///< Card that opened the session.
+  char user[RFID_NAME_MAX + 1];      ///< Card holder's name.
+  unsigned long lastActivity;        ///< millis() of the last drive command or scan.
+  unsigned long detachedAt;          ///< millis() the session lost (or has not had) its client.
 };
+AuthSession authSessions[MAX_AUTH_SESSIONS]; ///< Session table.
+
+// =============================================================================
+// Control Task & Command Queue
+// =============================================================================
+// Motor actuation and the obstacle avoidance FSM run in a dedicated task pinned to
+// CONTROL_TASK_CORE. The Arduino loop (WiFi, RFID, HTTP, WebSocket) runs on the other
+// core and hands commands over through a single-producer/single-consumer ring buffer.
+// Only the control task may call the CAR_* functions once it has been started.
+// SpscRing and the records it carries live in control_queue.h.
+const int CONTROL_TASK_CORE = 0;              ///< Core for the control task (Arduino loop runs on core 1).
+const int CONTROL_TASK_PRIORITY = 5;          ///< Above the Arduino loop task (1), below the WiFi driver.
+const uint32_t CONTROL_TASK_STACK = 4096;     ///< Stack size (bytes) of the control task.
+const TickType_t CONTROL_PERIOD_MS = 10;      ///< Control loop period (100 Hz).
+
+SpscRing<ControlCommand, 16> commandQueue; ///< Network loop -> control task.
+SpscRing<ControlEvent, 8> eventQueue;      ///< Control task -> network loop.
+std::atomic<bool> stopRequested(false);    ///< Out-of-band stop, honored even if the command queue is full.
+TaskHandle_t controlTaskHandle = NULL;     ///< Handle of the running control task.
+
+// =============================================================================
+// Deadman Watchdog
+// =============================================================================
+// The ramp-down decision is in deadman.h. Its tick runs in the esp_timer task (above the
+// control task and loop()), so a frozen tab, a dropped link or a stuck loop() all end the
+// same way. It is the one exception to the control task owning the motors, and it only
+// ever lowers the duty.
+std::atomic<uint32_t> lastDriverFrame(0);  ///< millis() when the last driver drive frame was accepted.
+std::atomic<uint32_t> deadmanTrips(0);     ///< Ramp-downs since boot.
+esp_timer_handle_t deadmanTimer = NULL;    ///< Periodic watchdog timer.
+DeadmanRamp deadmanRamp;                   ///< Ramp-down state (timer callback only).
 
 // =============================================================================
-// Concurrency Control
+// RFID Task
 // =============================================================================
+// The MFRC522 belongs to this task, never to the Arduino loop. Why it probes with a
+// bare REQA at an adaptive cadence instead of polling the reader is in rfid_probe.h.
+const int RFID_TASK_PRIORITY = 1;             ///< Below the control task; runs while it sleeps.
+const uint32_t RFID_TASK_STACK = 3072;        ///< Stack size (bytes) of the RFID task.
+
+SpscRing<RfidEvent, 4> rfidEventQueue;     ///< RFID task -> network loop.
+TaskHandle_t rfidTaskHandle = NULL;        ///< Handle of the running RFID task.
+std::atomic<uint32_t> rfidProbes(0);       ///< REQA probes sent (each ~7 register accesses).
+std::atomic<uint32_t> rfidCardReads(0);    ///< Probes answered by a card (full UID read).
+
+// =============================================================================
+// Command Latency Instrumentation
+// =============================================================================
+// Each drive command is timestamped (micros) as it passes through the pipeline:
+//
+//   received -> parsed -> auth checked -> queued -> actuated (CAR_* pins written)
+//
+// and the time spent in each stage is recorded in an HDR-style histogram: values are
+// bucketed by power of two, then linearly into LATENCY_SUB_BUCKETS within each power,
+// so every bucket is accurate to 1/8 (12.5%) of its value with a fixed 144-entry table.
+// "received" is when the mWebSockets callback runs, after the frame has been read.
+//
+// The parse/auth/queue histograms are written by the network loop and the actuate/total
+// histograms by the control task; each has a single writer. Reports read them without
+// locking, so a report taken mid-update may be off by one sample.
+const int LATENCY_SUB_BUCKET_BITS = 3;                          ///< log2 of the sub-buckets per power of two.
+const int LATENCY_SUB_BUCKETS = 1 << LATENCY_SUB_BUCKET_BITS;  ///< Linear sub-buckets per power of two.
+const int LATENCY_MAX_BITS = 20;                                ///< Values are clamped below 2^20 us (~1 s).
+const int LATENCY_BUCKETS = (LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS;
+
+/**
+ * @enum LatencyStage
+ * @brief Pipeline stages timed for every drive command.
+ */
+enum LatencyStage {
+  STAGE_PARSE,    ///< Received -> parsed into a CommandFrame.
+  STAGE_AUTH,     ///< Parsed -> validated, sequence and authorization checked.
+  STAGE_QUEUE,    ///< Auth checked -> pushed to the command queue.
+  STAGE_ACTUATE,  ///< Queued -> motor pins written by the control task.
+  STAGE_TOTAL,    ///< Received -> motor pins written.
+  LATENCY_STAGE_COUNT
+};
+
+const char *const LATENCY_STAGE_NAMES[LATENCY_STAGE_COUNT] = {
+  "parse", "auth", "queue", "actuate", "total"
+};
+
 /**
- * @brief Simple mutex flag to prevent race conditions when updating shared state variables,
- * particularly between the WebSocket handler and the obstacle avoidance logic.
+ * @struct LatencyHistogram
+ * @brief Fixed-size log-linear histogram of durations in microseconds.
  */
-bool stateUpdateInProgress = false;
+struct LatencyHistogram {
+  uint32_t counts[LATENCY_BUCKETS]; ///< Samples per bucket.
+  uint32_t samples;                 ///< Total number of samples.
+  uint32_t minValue;                ///< Smallest recorded value (us).
+  uint32_t maxValue;                ///< Largest recorded value (us).
+  uint64_t sum;                     ///< Sum of all recorded values (us), for the mean.
+
+  /// @brief Adds one sample.
+  void record(uint32_t value) {
+    if (value >= (1UL << LATENCY_MAX_BITS)) {
+      value = (1UL << LATENCY_MAX_BITS) - 1;
+    }
+    int index;
+    if (value < (uint32_t)LATENCY_SUB_BUCKETS) {
+      index = value;
+    } else {
+      int shift = (31 - __builtin_clz(value)) - LATENCY_SUB_BUCKET_BITS;
+      index = (shift + 1) * LATENCY_SUB_BUCKETS + ((value >> shift) & (LATENCY_SUB_BUCKETS - 1));
+    }
+    counts[index]++;
+    if (samples == 0 || value < minValue) {
+      minValue = value;
+    }
+    if (value > maxValue) {
+      maxValue = value;
+    }
+    sum += value;
+    samples++;
+  }
+
+  /// @return The highest value that falls in the same bucket as `index`.
+  static uint32_t bucketUpperBound(int index) {
+    if (index < LATENCY_SUB_BUCKETS) {
+      return index;
+    }
+    int shift = index / LATENCY_SUB_BUCKETS - 1;
+    uint32_t lower = (uint32_t)(LATENCY_SUB_BUCKETS + index % LATENCY_SUB_BUCKETS) << shift;
+    return lower + (1UL << shift) - 1;
+  }
+
+  /// @return The value (us) at or below which `percentile` percent of the samples lie.
+  uint32_t valueAtPercentile(float percentile) const {
+    if (samples == 0) {
+      return 0;
+    }
+    uint32_t target = (uint32_t)(percentile / 100.0f * samples + 0.5f);
+    if (target < 1) {
+      target = 1;
+    }
+    uint32_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+      seen += counts[i];
+      if (seen >= target) {
+        uint32_t bound = bucketUpperBound(i);
+        return bound < maxValue ? bound : maxValue;
+      }
+    }
+    return maxValue;
+  }
+
+  void reset() {
+    memset(this, 0, sizeof(*this));
+  }
+};
+
+LatencyHistogram latencyHistograms[LATENCY_STAGE_COUNT]; ///< One histogram per LatencyStage.
+std::atomic<bool> latencyResetRequested(false);          ///< Asks the control task to clear its histograms.
+char statsText[768 + MAX_WS_CLIENTS * 128];              ///< Reused buffer for the STATS report (histograms + client table).
 
 // =============================================================================
 // Ultrasonic Sensor Timing
 // =============================================================================
 unsigned long lastUltrasonicTrigger = 0; ///< Timestamp (millis) of the last ultrasonic sensor trigger.
-const unsigned long ULTRASONIC_INTERVAL = 200; ///< Minimum interval (ms) between ultrasonic measurements to avoid echo interference and reduce load.
+// ULTRASONIC_INTERVAL and ULTRASONIC_ECHO_TIMEOUT are defined in ranging.h.
+
+// =============================================================================
+// Ultrasonic Filtering & Time-To-Collision
+// =============================================================================
+// The median + alpha-beta filter (RangeFilter, rangeFilterUpdate) is defined in ranging.h.
+RangeFilter rangeFilter = {};          ///< The single filter instance for the front sensor.
+uint32_t rangeOutliersRejected = 0;    ///< Number of samples discarded by the outlier gate.
+uint32_t rangeTimeouts = 0;            ///< Number of triggers that never produced an echo.
+
+// =============================================================================
+// Interrupt-Driven Ultrasonic Ranging
+// =============================================================================
+// The echo pin raises an interrupt on both edges. The ISR timestamps the rising edge,
+// turns the pulse width into a distance on the falling edge, and publishes it together
+// with the time it was taken. Nothing waits for the echo, so ranging never blocks.
+
+/**
+ * @struct RangeReading
+ * @brief One published ultrasonic measurement.
+ */
+struct RangeReading {
+  int distance;            ///< Measured distance (cm).
+  unsigned long timestamp; ///< millis() when the echo completed; age = millis() - timestamp.
+  uint32_t sequence;       ///< Incremented for every published reading (0 = none yet).
+};
+
+portMUX_TYPE rangeMux = portMUX_INITIALIZER_UNLOCKED; ///< Guards `latestRange` between the ISR and readers.
+RangeReading latestRange = { 100, 0, 0 };               ///< Latest valid reading, written by `echoISR`.
+volatile uint32_t echoRiseMicros = 0;                   ///< micros() of the pending echo's rising edge (0 = none).
+volatile bool echoPending = false;                      ///< True between a trigger pulse and its echo (or timeout).
+uint32_t lastConsumedRangeSequence = 0;                 ///< Sequence of the reading last folded into `lastDistance`.
+
+/**
+ * @brief Checks a binary drive frame's sequence number against the last accepted one.
+ * @details Uses wrap-around arithmetic so the 16-bit counter can roll over. A sequence
+ * of 0 restarts the window, which is what a freshly connected client sends first.
+ * Frames without a sequence (ASCII commands) are always accepted.
+ * @return True if the frame is newer than the last accepted drive frame.
+ */
+bool acceptDriveSequence(uint32_t sequence) {
+    if (sequence == FRAME_NO_SEQUENCE) {
+        return true;
+    }
+    uint16_t seq = (uint16_t)sequence;
+    if (seq != 0 && driveSequenceValid && (int16_t)(seq - lastDriveSequence) <= 0) {
+        return false; // Duplicate or reordered (stale) frame
+    }
+    lastDriveSequence = seq;
+    driveSequenceValid = true;
+    return true;
+}
 
 // =============================================================================
 // WebSocket Message Handling Function
@@ -175,296 +530,773 @@ const unsigned long ULTRASONIC_INTERVAL = 200; ///< Minimum interval (ms) betwee
  * @param message Pointer to the message payload.
  * @param length Length of the message payload.
  *
- * @details Parses incoming text messages. Handles PING requests. Validates commands.
- * Checks authorization status before executing movement commands.
+ * @details Rejects drive messages from clients that do not hold the driving lease
+ * before parsing them. Parses incoming binary frames, or legacy text commands, in
+ * place without heap allocation. Handles PING (including the four-timestamp clock
+ * exchange), clock offset, STATS, LEASE, RFID admin and session resume requests.
+ * Validates commands. Updates the sender's connection table slot and drops spectator
+ * messages over the budget (except stops). Checks the sender's own authorization
+ * session before executing movement commands.
  * Interacts with the obstacle avoidance system to prevent forward motion if blocked.
  * Sends feedback messages (errors, RFID requests, obstacle notifications) to the client.
  */
 void handleWebSocketMessage(net::WebSocket &client, net::WebSocket::DataType dataType, const char *message, uint16_t length) {
-    // Only process text messages
-    if (dataType == net::WebSocket::DataType::TEXT) {
-        // Convert the received message payload to an Arduino String
-        String cmd_str = "";
-        for (uint16_t i = 0; i < length; i++) {
-            cmd_str += (char)message[i];
+    int64_t receivedTime = esp_timer_get_time(); // T2 of the clock exchange
+    uint32_t receivedMicros = (uint32_t)receivedTime;
+    ClientInfo *sender = findClient(client);
+
+    // Spectators may not drive: reject on the first byte, before any parsing
+    if ((sender == NULL || (leaseHolder >= 0 && sender->role != ROLE_DRIVER)) &&
+        isDriveMessage(dataType, message, length)) {
+        if (sender) {
+            sender->bytesIn += length;
+            sender->commandsRejected++;
+            unsigned long now = millis();
+            if (now - sender->lastLeaseNotice >= LEASE_NOTICE_INTERVAL) {
+                sender->lastLeaseNotice = now;
+                sendLeaseNotice(*sender);
+            }
+        }
+        return;
+    }
+
+    CommandFrame frame;
+    bool parsed = false;
+
+    if (dataType == net::WebSocket::DataType::BINARY) {
+        parsed = parseBinaryCommand(message, length, frame);
+    } else if (dataType == net::WebSocket::DataType::TEXT) {
+        parsed = parseAsciiCommand(message, length, frame);
+    }
+
+    if (sender && !chargeClientMessage(*sender, length) && !(parsed && frame.opcode == OP_DRIVE && frame.command == CMD_STOP)) {
+        sender->messagesDropped++; // Over the spectator budget; a stop still goes through
+        return;
+    }
+
+    if (!parsed) {
+        sendToClient(client, net::WebSocket::DataType::TEXT, "ERROR:Invalid command", 21);
+        return;
+    }
+
+    // Switch this client's telemetry encoding
+    if (frame.opcode == OP_TELEMETRY_MODE) {
+        ClientInfo *info = sender;
+        if (info) {
+            info->telemetryFormat = (frame.payload[0] == TELEMETRY_BINARY) ? TELEMETRY_BINARY : TELEMETRY_JSON;
+            if (frame.payloadLength >= 2 && frame.payload[1] <= TELEMETRY_LEVEL_DEBUG) {
+                info->telemetryLevel = (TelemetryLevel)frame.payload[1];
+            }
+            info->telemetryDeltas = true;
+            info->needsKeyframe = true; // Deltas are only meaningful after a keyframe in the new encoding
         }
+        return;
+    }
 
-        // Handle PING messages for keep-alive
-        if (cmd_str.startsWith("PING")) {
-            String pongMessage = "PONG:" + String(millis());
-            client.send(net::WebSocket::DataType::TEXT, pongMessage.c_str(), pongMessage.length());
-            return; // Exit after handling PING
+    // Store the client's clock offset for timestamping its telemetry
+    if (frame.opcode == OP_CLOCK_OFFSET) {
+        ClientInfo *info = sender;
+        if (info) {
+            info->clockOffset = (int64_t)readUint64(frame.payload);
+            info->clockSynced = true;
         }
+        return;
+    }
 
-        // Attempt to convert the command string to an integer
-        int command = cmd_str.toInt();
+    // Handle PING messages for keep-alive
+    if (frame.opcode == OP_PING) {
+        uint32_t now = millis();
+        if (frame.payloadLength >= CLOCK_TIMESTAMP_LENGTH) {
+            // Four-timestamp exchange: echo T1, add T2 (receive) and T3 (transmit)
+            char pongFrame[FRAME_HEADER_LENGTH + 3 * CLOCK_TIMESTAMP_LENGTH];
+            pongFrame[0] = (char)OP_PONG;
+            pongFrame[1] = (char)(frame.sequence & 0xFF);
+            pongFrame[2] = (char)(frame.sequence >> 8);
+            memcpy(pongFrame + FRAME_HEADER_LENGTH, frame.payload, CLOCK_TIMESTAMP_LENGTH);
+            writeUint64((uint8_t *)pongFrame + FRAME_HEADER_LENGTH + CLOCK_TIMESTAMP_LENGTH, (uint64_t)receivedTime);
+            writeUint64((uint8_t *)pongFrame + FRAME_HEADER_LENGTH + 2 * CLOCK_TIMESTAMP_LENGTH, (uint64_t)esp_timer_get_time());
+            sendToClient(client, net::WebSocket::DataType::BINARY, pongFrame, sizeof(pongFrame));
+        } else if (frame.sequence == FRAME_NO_SEQUENCE) {
+            char pongMessage[16];
+            int pongLength = snprintf(pongMessage, sizeof(pongMessage), "PONG:%lu", (unsigned long)now);
+            sendToClient(client, net::WebSocket::DataType::TEXT, pongMessage, pongLength);
+        } else {
+            char pongFrame[FRAME_HEADER_LENGTH + 4] = {
+                (char)OP_PONG, (char)(frame.sequence & 0xFF), (char)(frame.sequence >> 8),
+                (char)(now & 0xFF), (char)(now >> 8), (char)(now >> 16), (char)(now >> 24)
+            };
+            sendToClient(client, net::WebSocket::DataType::BINARY, pongFrame, sizeof(pongFrame));
+        }
+        return; // Exit after handling PING
+    }
 
-        // Validate if the command is one of the recognized movement/stop commands
-        bool validCommand = (command == CMD_STOP || command == CMD_FORWARD ||
-                           command == CMD_BACKWARD || command == CMD_LEFT || command == CMD_RIGHT);
+    // Report the command latency histograms
+    if (frame.opcode == OP_STATS) {
+        int statsLength = encodeLatencyStats();
+        sendToClient(client, net::WebSocket::DataType::TEXT, statsText, statsLength);
+        if (frame.payloadLength >= 1 && frame.payload[0] == 1) {
+            resetLatencyStats();
+        }
+        return;
+    }
 
-        // If the command is invalid, send an error message and exit
-        if (!validCommand) {
-            client.send(net::WebSocket::DataType::TEXT, "ERROR:Invalid command", 23); // 23 is length of "ERROR:Invalid command"
-            return;
+    // Take over an authorization session after a reconnect
+    if (frame.opcode == OP_AUTH_RESUME) {
+        if (sender) {
+            resumeSession(*sender, frame.payload);
         }
+        return;
+    }
 
-        Serial.print("Received command: ");
-        Serial.println(command);
+    // Add or revoke an authorized card
+    if (frame.opcode == OP_RFID_ADMIN) {
+        handleCardAdmin(client, sender, frame);
+        return;
+    }
 
-        // If the user is authorized, update their last activity timestamp to prevent timeout
-        if (isAuthorized) {
-            lastAuthorizedActivity = millis();
+    // Request or give up the driving lease
+    if (frame.opcode == OP_LEASE) {
+        if (sender) {
+            if (frame.payload[0] == 1 && sessionFor(sender) == NULL) {
+                sender->authRequestedAt = millis() | 1; // The next scan is for this client
+                wakeRfidTask();
+                sendLeaseNotice(*sender);
+                sendAuthNotice(sender, NULL, "Authentication required", false);
+            } else if (frame.payload[0] == 1) {
+                bool alreadyDriver = sender->role == ROLE_DRIVER;
+                if (!requestLease(*sender) || alreadyDriver) {
+                    sendLeaseNotice(*sender); // Denied, or already held (a grant is broadcast)
+                }
+            } else if (sender->role == ROLE_DRIVER) {
+                releaseLease(true);
+            }
         }
+        return;
+    }
+
+    uint32_t parsedMicros = micros();
 
-        // If the command is a movement command but the user is not authorized
-        if (!isAuthorized && command != CMD_STOP) {
-            Serial.println("Command rejected: Not authorized");
+    int command = frame.command;
 
-            // Prepare a JSON response indicating authorization is required
-            StaticJsonDocument<128> doc; // Use StaticJsonDocument for fixed buffer size on ESP32
-            doc["authorized"] = false;
-            doc["message"] = "Authentication required";
+    // Validate if the command is one of the recognized movement/stop commands
+    bool validCommand = (command == CMD_STOP || command == CMD_FORWARD ||
+                       command == CMD_BACKWARD || command == CMD_LEFT || command == CMD_RIGHT);
 
-            String authJson;
-            serializeJson(doc, authJson); // Convert JSON object to string
+    // If the command is invalid, send an error message and exit
+    if (!validCommand) {
+        sendToClient(client, net::WebSocket::DataType::TEXT, "ERROR:Invalid command", 21);
+        return;
+    }
+
+    // Drop duplicated or out-of-order binary frames silently
+    if (!acceptDriveSequence(frame.sequence)) {
+        return;
+    }
 
-            // Prefix the message for client-side parsing
-            String authMessage = "RFID:" + authJson;
+    // Commands are checked against the sender's own session; a scanned card waiting
+    // for its client is claimed by the first one that tries to drive
+    AuthSession *session = sessionFor(sender);
+    if (session == NULL && sender && command != CMD_STOP) {
+        session = claimSession(*sender);
+    }
 
-            // Send the authorization request message
-            client.send(net::WebSocket::DataType::TEXT, authMessage.c_str(), authMessage.length());
-            return; // Exit, do not process the movement command
+    // If the user is authorized, update their last activity timestamp to prevent timeout
+    if (session) {
+        session->lastActivity = millis();
+    }
+
+    // If the command is a movement command but the user is not authorized
+    if (session == NULL && command != CMD_STOP) {
+        Serial.println("Command rejected: Not authorized");
+        if (sender) {
+            sender->authRequestedAt = millis() | 1; // The next scan is for this client (0 means never)
         }
+        wakeRfidTask(); // The driver is probably about to scan a card
 
-        // --- Critical Section Check ---
-        // Wait if the obstacle avoidance routine is currently modifying state
-        while (stateUpdateInProgress) {
-            yield(); // Allow other tasks (like background WiFi) to run
+        // Tell the client authorization is required (a constant, so nothing to format)
+        static const char authRequired[] = "RFID:{\"authorized\":false,\"message\":\"Authentication required\"}";
+        sendToClient(client, net::WebSocket::DataType::TEXT, authRequired, sizeof(authRequired) - 1);
+        return; // Exit, do not process the movement command
+    }
+
+    // Reject movement cheaply while the control task is running an avoidance maneuver
+    if (avoidingObstacle && command != CMD_STOP) {
+        int noticeLength = formatObstacleNotice(true, lastDistance, "Obstacle avoidance in progress");
+        sendToClient(client, net::WebSocket::DataType::TEXT, noticeText, noticeLength);
+        return;
+    }
+
+    uint32_t authMicros = micros();
+
+    // Feed the deadman watchdog before the control task can act on the command
+    lastDriverFrame.store(millis(), std::memory_order_release);
+
+    // Hand the command over to the control task
+    ControlCommand controlCommand = { (uint8_t)command, frame.speed, receivedMicros, 0 };
+    controlCommand.queuedMicros = micros();
+    bool queued = commandQueue.push(controlCommand);
+    if (sender && session) { // A STOP without a session stops the car but does not drive it
+        if (sender->role != ROLE_DRIVER) {
+            grantLease(*sender); // The lease was free
         }
-        // --- End Critical Section Check ---
-
-        // Process the command if obstacle avoidance is NOT active OR if the command is STOP
-        if (!avoidingObstacle || command == CMD_STOP) {
-            lastSentCommand = command; // Store the latest valid command
-
-            switch (command) {
-                case CMD_STOP:
-                    Serial.println("Stop");
-                    CAR_stop(); // Execute stop motor function
-                    break;
-                case CMD_FORWARD:
-                    // Only move forward if the path is clear
-                    if (lastDistance > STOP_DISTANCE) {
-                        Serial.println("Move Forward");
-                        CAR_moveForward(); // Execute forward motor function
-                    } else {
-                        // Path is blocked, notify the client
-                        StaticJsonDocument<128> doc;
-                        doc["active"] = true;       // Indicate obstacle detection is active
-                        doc["distance"] = lastDistance; // Send the current distance
-
-                        String obstacleJson;
-                        serializeJson(doc, obstacleJson);
-
-                        // Prefix the message
-                        String obstacleMessage = "OBSTACLE:" + obstacleJson;
-                        client.send(net::WebSocket::DataType::TEXT, obstacleMessage.c_str(), obstacleMessage.length());
-
-                        // Override command to STOP and log the blockage
-                        lastSentCommand = CMD_STOP;
-                        Serial.println("Forward blocked by obstacle");
-                        CAR_stop();
-
-                        // Explicitly trigger the obstacle avoidance state machine
-                        // This ensures avoidance starts even if the command was initially blocked here
-                        avoidingObstacle = true;
-                        avoidanceState = BACKING_UP; // Start by backing up
-                        avoidanceStateStartTime = millis();
-                    }
-                    break;
-                case CMD_BACKWARD:
-                    Serial.println("Move Backward");
-                    CAR_moveBackward(); // Execute backward motor function
-                    break;
-                case CMD_LEFT:
-                    Serial.println("Turn Left");
-                    CAR_turnLeft(); // Execute left turn motor function
-                    break;
-                case CMD_RIGHT:
-                    Serial.println("Turn Right");
-                    CAR_turnRight(); // Execute right turn motor function
-                    break;
-            }
+        leaseLastCommand = millis();
+    }
+    if (queued) {
+        latencyHistograms[STAGE_PARSE].record(parsedMicros - receivedMicros);
+        latencyHistograms[STAGE_AUTH].record(authMicros - parsedMicros);
+        latencyHistograms[STAGE_QUEUE].record(micros() - authMicros);
+    } else {
+        if (command == CMD_STOP) {
+            requestStop(); // A stop must never be lost to a full queue
         } else {
-            // If trying to move while obstacle avoidance is active, notify the client
-            StaticJsonDocument<128> doc;
-            doc["active"] = true;
-            doc["distance"] = lastDistance;
-            doc["message"] = "Obstacle avoidance in progress";
-
-            String avoidanceJson;
-            serializeJson(doc, avoidanceJson);
-
-            // Prefix the message
-            String avoidanceMessage = "OBSTACLE:" + avoidanceJson;
-            client.send(net::WebSocket::DataType::TEXT, avoidanceMessage.c_str(), avoidanceMessage.length());
+            Serial.println("Command dropped: control queue full");
+            sendToClient(client, net::WebSocket::DataType::TEXT, "ERROR:Busy", 10);
         }
     }
 }
 
 // =============================================================================
-// Ultrasonic Sensor Reading Function
+// Ultrasonic Sensor Reading Functions
 // =============================================================================
 /**
- * @brief Measures the distance using the HC-SR04 ultrasonic sensor.
- * @details Triggers the sensor, reads the echo pulse duration, and calculates
- * the distance in centimeters. Includes a non-blocking delay (`ULTRASONIC_INTERVAL`)
- * between measurements and basic filtering for unreasonable values. Updates the
- * global `lastDistance` variable. Uses a timeout for `pulseIn` for robustness.
+ * @brief Echo pin interrupt handler (both edges).
+ * @details Records the rising edge time, and on the falling edge converts the pulse
+ * width into centimeters and publishes it with a timestamp. Readings outside the
+ * plausible range (0-400 cm) are discarded.
+ */
+void IRAM_ATTR echoISR() {
+  uint32_t now = micros();
+
+  if (digitalRead(echoPin) == HIGH) {
+    echoRiseMicros = now;
+    return;
+  }
+
+  if (echoRiseMicros == 0) {
+    return; // Falling edge without a matching rising edge
+  }
+
+  int distance = echoDistanceCm(now - echoRiseMicros);
+  echoRiseMicros = 0;
+  echoPending = false;
+
+  if (distance > 0) {
+    portENTER_CRITICAL_ISR(&rangeMux);
+    latestRange.distance = distance;
+    latestRange.timestamp = millis();
+    latestRange.sequence++;
+    portEXIT_CRITICAL_ISR(&rangeMux);
+  }
+}
+
+/**
+ * @brief Returns a consistent copy of the latest published ultrasonic reading.
+ * @details Safe to call from any task. Check `sequence` for "no reading yet" and
+ * `millis() - timestamp` for the reading's age.
+ */
+RangeReading getLatestRange() {
+  portENTER_CRITICAL(&rangeMux);
+  RangeReading reading = latestRange;
+  portEXIT_CRITICAL(&rangeMux);
+  return reading;
+}
+
+/**
+ * @brief Folds one raw reading into the range filter and publishes distance, closing speed and TTC.
+ * @param rawDistance Raw distance (cm) from `echoISR`.
+ * @param timestamp millis() at which the reading was taken.
+ * @details Updates the globals `lastDistance`, `closingSpeed` and `timeToCollision`.
+ */
+void updateRangeFilter(int rawDistance, unsigned long timestamp) {
+  RangeEstimate estimate;
+  if (!rangeFilterUpdate(rangeFilter, rawDistance, timestamp, estimate)) {
+    rangeOutliersRejected++;
+    return;
+  }
+  lastDistance = estimate.distance;
+  closingSpeed = estimate.closingSpeed;
+  timeToCollision = estimate.timeToCollision;
+}
+
+/**
+ * @brief Drives the HC-SR04 without blocking.
+ * @details Called every control cycle. Emits a 10 us trigger pulse every
+ * `ULTRASONIC_INTERVAL` (unless an echo is still pending), abandons echoes that do
+ * not arrive within `ULTRASONIC_ECHO_TIMEOUT`, and feeds new readings published by
+ * `echoISR` through `updateRangeFilter`. On a timeout the filtered values retain
+ * their previous state.
  */
 void updateUltrasonicSensor() {
   unsigned long currentMillis = millis();
 
+  // Give up on an echo that never came back (no obstacle in range, or a lost pulse)
+  if (echoPending && currentMillis - lastUltrasonicTrigger > ULTRASONIC_ECHO_TIMEOUT) {
+    echoPending = false;
+    echoRiseMicros = 0;
+    rangeTimeouts++;
+  }
+
+  // Pick up the reading published by the ISR, if there is a new one, and filter it
+  RangeReading reading = getLatestRange();
+  if (reading.sequence != lastConsumedRangeSequence) {
+    lastConsumedRangeSequence = reading.sequence;
+    updateRangeFilter(reading.distance, reading.timestamp);
+  }
+
   // Throttle sensor readings to avoid interference and reduce processing load
-  if (currentMillis - lastUltrasonicTrigger < ULTRASONIC_INTERVAL) {
+  if (echoPending || currentMillis - lastUltrasonicTrigger < ULTRASONIC_INTERVAL) {
     return; // Not time to measure yet
   }
 
   lastUltrasonicTrigger = currentMillis; // Record the time of this trigger
+  echoRiseMicros = 0;
+  echoPending = true;
 
-  // Generate the ultrasonic trigger pulse (10 microseconds HIGH)
+  // Generate the ultrasonic trigger pulse (10 microseconds HIGH); the echo is timed by echoISR
   digitalWrite(trigPin, LOW);
   delayMicroseconds(2); // Short low pulse to ensure clean rising edge
   digitalWrite(trigPin, HIGH);
   delayMicroseconds(10);
   digitalWrite(trigPin, LOW);
+}
+
 
-  // Measure the duration of the echo pulse (HIGH state)
-  // pulseIn returns the duration in microseconds or 0 if timeout occurs.
-  // Timeout (30000 us = 30 ms) prevents blocking if no echo is received.
-  unsigned long duration = pulseIn(echoPin, HIGH, 30000);
+// =============================================================================
+// RFID Card Store Functions
+// =============================================================================
+/**
+ * @brief Answers an OP_RFID_ADMIN frame with "RFIDADMIN:{...}".
+ * @details Only a client holding an admin card's session may change the store, and
+ * only if it is the driver while a driving lease is held.
+ */
+void handleCardAdmin(net::WebSocket &client, ClientInfo *sender, const CommandFrame &frame) {
+    CardResult result = CARD_INVALID;
+    uint8_t action = frame.payload[0];
+    uint8_t length = frame.payload[1];
+    const uint8_t *uid = frame.payload + 2;
+
+    AuthSession *session = sessionFor(sender);
+    if (session == NULL || !session->admin || (leaseHolder >= 0 && sender->role != ROLE_DRIVER)) {
+        result = CARD_DENIED;
+    } else if (action == RFID_ADMIN_ADD && frame.payloadLength >= 3 + length) {
+        const char *name = (const char *)frame.payload + 3 + length;
+        result = addCard(cardStore, uid, length, frame.payload[2 + length], name, frame.payloadLength - 3 - length, true);
+    } else if (action == RFID_ADMIN_REVOKE) {
+        result = revokeCard(cardStore, uid, length);
+        if (result != CARD_NOT_FOUND) {
+            endSessionsForCard(uid, length, "Card revoked");
+        }
+    }
+    Serial.printf("RFID admin: action %u -> %s (%u cards)\n", action, CARD_RESULT_NAMES[result], cardStore.count);
 
-  // Calculate distance if a valid pulse was received
-  if (duration > 0) {
-    // Distance (cm) = (Duration (us) * Speed of Sound (cm/us)) / 2
-    // Speed of sound ~ 0.0343 cm/us
-    int distance = (duration * 0.0343) / 2;
+    char reply[80];
+    int replyLength = snprintf(reply, sizeof(reply), "RFIDADMIN:{\"result\":\"%s\",\"count\":%u,\"capacity\":%u}",
+                               CARD_RESULT_NAMES[result], cardStore.count, RFID_MAX_CARDS);
+    sendToClient(client, net::WebSocket::DataType::TEXT, reply, replyLength);
+}
 
-    // Basic filter: Only update if the distance is within a plausible range (e.g., > 0 and < 400 cm)
-    if (distance > 0 && distance < 400) {
-      lastDistance = distance;
+// =============================================================================
+// RFID Task Functions
+// =============================================================================
+/**
+ * @brief Makes the RFID task probe at the fast cadence, e.g. when someone is about to scan.
+ */
+void wakeRfidTask() {
+    if (rfidTaskHandle != NULL) {
+        xTaskNotifyGive(rfidTaskHandle);
     }
-    // Optionally, add more sophisticated filtering (e.g., moving average) here
-  }
-  // If duration is 0 (timeout), lastDistance retains its previous value.
 }
 
+/**
+ * @brief RFID task: probes for cards at an adaptive cadence and posts read UIDs to the loop.
+ * @details See startCardProbe() and finishCardProbe() in rfid_probe.h.
+ */
+void rfidTask(void *parameter) {
+    unsigned long lastActivity = millis();
+    for (;;) {
+        startCardProbe(rfid);
+        rfidProbes.fetch_add(1, std::memory_order_relaxed);
+        vTaskDelay(pdMS_TO_TICKS(RFID_PROBE_WAIT_MS));
+        RfidEvent event;
+        if (finishCardProbe(rfid, event)) {
+            rfidCardReads.fetch_add(1, std::memory_order_relaxed);
+            rfidEventQueue.push(event); // A full queue means the loop has four scans pending already
+            lastActivity = millis();
+        }
+
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(rfidProbePeriod(millis(), lastActivity)))) {
+            lastActivity = millis(); // wakeRfidTask()
+        }
+    }
+}
 
 // =============================================================================
 // RFID Checking Function
 // =============================================================================
 /**
- * @brief Checks for nearby RFID tags/cards using the MFRC522 reader.
- * @details If a new card is detected and read successfully, its UID is compared
- * against the `authorizedUsers` list. Updates the `isAuthorized` flag and
- * `authorizedUser` string accordingly. Records the `lastAuthorizedActivity` time
- * if authorization is successful. Broadcasts the authorization status (success/failure
- * and username) to all connected WebSocket clients in JSON format, prefixed with "RFID:".
+ * @brief Authorizes the cards read by the RFID task.
+ * @details Each UID (4, 7 or 10 bytes) posted by `rfidTask` is looked up in the hashed
+ * card table (see findCard()). A known card opens a session for the client the scan
+ * is meant for (see "Authorization Sessions"), which is sent its token in an "RFID:"
+ * notice; an unknown card is reported as denied.
+ * Called from the network loop only; it never touches the reader.
  */
 void checkRFID() {
-    // Check if a new RFID tag/card is present in the reader's field
-    if (!rfid.PICC_IsNewCardPresent()) {
-        return; // No new card, exit function
+    RfidEvent event;
+    while (rfidEventQueue.pop(event)) {
+        authorizeCard(event.uid, event.uidLength);
     }
+}
 
-    // Try to read the serial number (UID) of the card
-    if (!rfid.PICC_ReadCardSerial()) {
-        return; // Failed to read card, exit function
-    }
-
-    // Card detected and read successfully
-
-    // Store the UID (typically 4 bytes for Mifare Classic)
-    byte cardUID[4];
-    for (byte i = 0; i < sizeof(cardUID); i++) {
-        cardUID[i] = rfid.uid.uidByte[i];
-    }
+/**
+ * @brief Looks up one scanned card and updates and broadcasts the authorization state.
+ */
+void authorizeCard(const byte *cardUID, byte uidLength) {
 
     // Print the scanned UID to the Serial monitor for debugging
     Serial.print("Scanned UID: ");
-    for (byte i = 0; i < sizeof(cardUID); i++) {
+    for (byte i = 0; i < uidLength; i++) {
         Serial.print(cardUID[i], HEX); // Print in hexadecimal format
         Serial.print(" ");
     }
     Serial.println();
 
-    bool foundMatch = false;        // Flag to indicate if the scanned UID matches an authorized user
-    String userName = "Unauthorized User"; // Default username if no match is found
-
-    // Iterate through the list of authorized users
-    for (byte i = 0; i < sizeof(authorizedUsers) / sizeof(authorizedUsers[0]); i++) {
-        bool match = true; // Assume match until proven otherwise
-        // Compare the scanned UID byte-by-byte with the current authorized user's UID
-        for (byte j = 0; j < sizeof(cardUID); j++) {
-            if (cardUID[j] != authorizedUsers[i].uid[j]) {
-                match = false; // Mismatch found
-                break;         // No need to compare further bytes for this user
+    // O(1) lookup in the card table
+    const CardRecord *card = findCard(cardStore, cardUID, uidLength);
+    ClientInfo *target = scanTarget();
+
+    if (card == NULL) {
+        // Tell the client waiting for the scan, or everyone without a session
+        for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+            ClientInfo &info = clients[i];
+            if (info.socket != NULL && (target ? &info == target : sessionFor(&info) == NULL)) {
+                sendAuthNotice(&info, NULL, "Invalid Card", false);
             }
         }
-        // If all bytes matched
-        if (match) {
-            foundMatch = true;
-            userName = authorizedUsers[i].name; // Get the name of the authorized user
-            break; // Exit the loop, user found
+        Serial.println("Authorization denied");
+        return;
+    }
+
+    // Open a session for the client the scan belongs to (it alone receives the token)
+    int index = openSession(*card, target);
+    if (target) {
+        sendAuthNotice(target, &authSessions[index], NULL, false);
+        Serial.printf("Authorization granted to: %s (client %d)\n", authSessions[index].user, (int)(target - clients));
+    } else {
+        Serial.printf("Authorization granted to: %s (waiting for a client to claim it)\n", authSessions[index].user);
+    }
+}
+
+/**
+ * @brief Picks the client a card scan is meant for (see "Authorization Sessions").
+ * @return The client, or NULL if it is ambiguous.
+ */
+ClientInfo *scanTarget() {
+    ClientInfo *claimant = NULL;
+    ClientInfo *only = NULL;
+    int connected = 0;
+    unsigned long now = millis();
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        ClientInfo &info = clients[i];
+        if (info.socket == NULL) {
+            continue;
+        }
+        connected++;
+        only = &info;
+        if (info.authRequestedAt != 0 && now - info.authRequestedAt <= AUTH_CLAIM_WINDOW &&
+            (claimant == NULL || info.authRequestedAt - claimant->authRequestedAt < 0x80000000UL)) {
+            claimant = &info; // Most recent refusal wins
         }
     }
+    if (claimant) {
+        return claimant;
+    }
+    if (leaseHolder >= 0) {
+        return &clients[leaseHolder];
+    }
+    return connected == 1 ? only : NULL;
+}
 
-    // Update the global authorization state based on whether a match was found
-    isAuthorized = foundMatch;
-    authorizedUser = userName; // Update the global authorized user name
+// =============================================================================
+// Connection Table Functions
+// =============================================================================
+/**
+ * @brief Returns the registry slot of a connected client, or NULL if it is not registered.
+ */
+ClientInfo *findClient(net::WebSocket &client) {
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        if (clients[i].socket == &client) {
+            return &clients[i];
+        }
+    }
+    return NULL;
+}
 
-    // If authorization was successful, update the last activity timestamp
-    if (isAuthorized) {
-        lastAuthorizedActivity = millis();
+/**
+ * @brief Adds a newly connected client to the table as a spectator with default (full JSON) telemetry.
+ * @return The slot, or NULL if the table is full.
+ */
+ClientInfo *registerClient(net::WebSocket &client) {
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        if (clients[i].socket == NULL) {
+            clients[i].socket = &client;
+            clients[i].telemetryFormat = TELEMETRY_JSON;
+            clients[i].telemetryLevel = TELEMETRY_LEVEL_FULL;
+            clients[i].telemetryDeltas = false; // Legacy clients get full frames until they negotiate
+            clients[i].needsKeyframe = true;
+            clients[i].clockSynced = false;
+            clients[i].clockOffset = 0;
+            clients[i].role = ROLE_SPECTATOR;
+            clients[i].connectedAt = millis();
+            clients[i].lastActivity = clients[i].connectedAt;
+            clients[i].bytesIn = 0;
+            clients[i].bytesOut = 0;
+            clients[i].messagesDropped = 0;
+            clients[i].commandsRejected = 0;
+            clients[i].lastLeaseNotice = 0;
+            clients[i].budgetUsed = 0;
+            clients[i].budgetWindowStart = clients[i].connectedAt;
+            clients[i].session = -1;
+            clients[i].authRequestedAt = 0;
+            return &clients[i];
+        }
     }
+    Serial.println("WARNING: Client registry full");
+    return NULL;
+}
 
-    // Prepare JSON response to send via WebSocket
-    StaticJsonDocument<128> doc; // Adjust size as needed
-    doc["authorized"] = foundMatch;
-    doc["user"] = userName;
+/**
+ * @brief WebSocket close callback: frees the client's slot.
+ */
+void handleWebSocketClose(net::WebSocket &client, net::WebSocket::CloseCode code, const char *reason, uint16_t length) {
+    ClientInfo *info = findClient(client);
+    if (info) {
+        Serial.printf("WebSocket client disconnected (%s, %lu bytes in / %lu out, %lu dropped)\n",
+                      info->role == ROLE_DRIVER ? "driver" : "spectator", (unsigned long)info->bytesIn,
+                      (unsigned long)info->bytesOut, (unsigned long)info->messagesDropped);
+        detachSession(*info); // Resumable with its token for AUTH_RESUME_GRACE
+        info->socket = NULL;
+        if (info->role == ROLE_DRIVER) {
+            releaseLease(true); // Nobody is steering any more
+        }
+    } else {
+        Serial.println("WebSocket client disconnected");
+    }
+}
 
-    String authJson;
-    serializeJson(doc, authJson); // Serialize the JSON object to a string
+/**
+ * @brief Records a received message and applies the spectator budget.
+ * @param info The sender's slot.
+ * @param length Message length in bytes.
+ * @return False if a spectator has used up its budget for this window.
+ */
+bool chargeClientMessage(ClientInfo &info, uint16_t length) {
+    unsigned long now = millis();
+    info.lastActivity = now;
+    info.bytesIn += length;
+    if (now - info.budgetWindowStart >= CLIENT_BUDGET_WINDOW) {
+        info.budgetWindowStart = now;
+        info.budgetUsed = 0;
+    }
+    bool allowed = info.budgetUsed < SPECTATOR_MESSAGE_BUDGET; // Checked before counting: 20 means 20
+    if (allowed) {
+        info.budgetUsed++;
+    }
+    return info.role == ROLE_DRIVER || allowed;
+}
 
-    // Prefix the JSON string for client-side identification
-    String rfidMessage = "RFID:" + authJson;
+/**
+ * @brief Tells one client whether it holds the driving lease and whether anyone does,
+ * plus the deadman timeout its held commands must be re-sent within.
+ */
+void sendLeaseNotice(ClientInfo &info) {
+    char notice[64];
+    int length = snprintf(notice, sizeof(notice), "LEASE:{\"driver\":%s,\"held\":%s,\"deadman\":%lu}",
+                          info.role == ROLE_DRIVER ? "true" : "false", leaseHolder >= 0 ? "true" : "false",
+                          (unsigned long)DEADMAN_TIMEOUT_MS);
+    info.bytesOut += length;
+    info.socket->send(net::WebSocket::DataType::TEXT, notice, length);
+}
 
-    // Broadcast the authorization status to all connected WebSocket clients
-    webSocket.broadcast(net::WebSocket::DataType::TEXT, rfidMessage.c_str(), rfidMessage.length());
+/**
+ * @brief Sends every connected client its lease notice.
+ */
+void broadcastLeaseState() {
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        if (clients[i].socket != NULL) {
+            sendLeaseNotice(clients[i]);
+        }
+    }
+}
 
-    // Halt communication with the current PICC (RFID tag/card)
-    rfid.PICC_HaltA();
-    // Stop encryption (relevant for Mifare Classic)
-    rfid.PCD_StopCrypto1();
+/**
+ * @brief Gives the driving lease to a client; the previous holder becomes a spectator.
+ * @details The caller has checked that the client has an active session.
+ */
+void grantLease(ClientInfo &info) {
+    if (leaseHolder >= 0) {
+        clients[leaseHolder].role = ROLE_SPECTATOR;
+    }
+    leaseHolder = &info - clients;
+    info.role = ROLE_DRIVER;
+    info.needsKeyframe = true; // Back to full-rate (delta) telemetry
+    leaseLastCommand = millis();
+    driveSequenceValid = false; // The new driver's frames start their own sequence
+    Serial.printf("Client %d holds the driving lease\n", leaseHolder);
+    broadcastLeaseState();
+}
 
-    // Log the authorization result to the Serial monitor
-    if (foundMatch) {
-        Serial.print("Authorization granted to: ");
-        Serial.println(userName);
-    } else {
-        Serial.println("Authorization denied");
+/**
+ * @brief Frees the driving lease.
+ * @param stopCar True to stop the car as well (driver left or gave up control).
+ */
+void releaseLease(bool stopCar) {
+    if (leaseHolder < 0) {
+        return;
+    }
+    clients[leaseHolder].role = ROLE_SPECTATOR;
+    leaseHolder = -1;
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        clients[i].needsKeyframe = true; // Spectators go back to per-tick (delta) telemetry
+    }
+    if (stopCar) {
+        requestStop();
+    }
+    Serial.println("Driving lease released");
+    broadcastLeaseState();
+}
+
+/**
+ * @brief Handles an OP_LEASE request: grants the lease if free, or hands it over from
+ * a driver that has left the car stopped for LEASE_HANDOVER_IDLE ms.
+ * @return True if the client holds the lease afterwards; always false without an
+ * active authorization session.
+ */
+bool requestLease(ClientInfo &info) {
+    if (sessionFor(&info) == NULL) {
+        return false;
+    }
+    if (info.role == ROLE_DRIVER) {
+        return true;
+    }
+    if (leaseHolder >= 0 && !(lastSentCommand == CMD_STOP && millis() - leaseLastCommand >= LEASE_HANDOVER_IDLE)) {
+        return false; // The driver is active
+    }
+    grantLease(info);
+    return true;
+}
+
+/**
+ * @brief Lets the lease lapse once the car has been stopped with no drive command for LEASE_TIMEOUT ms,
+ * and releases it (stopping the car) if the driver no longer has an active session.
+ */
+void checkLeaseTimeout() {
+    if (leaseHolder >= 0 && sessionFor(&clients[leaseHolder]) == NULL) {
+        releaseLease(true); // Backstop: endSession() normally releases it first
+    } else if (leaseHolder >= 0 && lastSentCommand == CMD_STOP && millis() - leaseLastCommand >= LEASE_TIMEOUT) {
+        releaseLease(false);
+    }
+}
+
+/**
+ * @brief Recognises a drive command from its first byte, without parsing it.
+ */
+bool isDriveMessage(net::WebSocket::DataType dataType, const char *message, uint16_t length) {
+    if (length == 0) {
+        return false;
+    }
+    if (dataType == net::WebSocket::DataType::BINARY) {
+        return (uint8_t)message[0] == OP_DRIVE;
+    }
+    return message[0] >= '0' && message[0] <= '9'; // Legacy ASCII command code
+}
+
+/**
+ * @brief Sends to one client and counts the bytes against its slot.
+ */
+void sendToClient(net::WebSocket &client, net::WebSocket::DataType dataType, const char *message, uint16_t length) {
+    ClientInfo *info = findClient(client);
+    if (info) {
+        info->bytesOut += length;
+    }
+    client.send(dataType, message, length);
+}
+
+/**
+ * @brief Sends to every connected client, counting bytes per slot.
+ */
+void broadcastToClients(net::WebSocket::DataType dataType, const char *message, uint16_t length) {
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        if (clients[i].socket != NULL) {
+            clients[i].bytesOut += length;
+            clients[i].socket->send(dataType, message, length);
+        }
+    }
+}
+
+/**
+ * @brief Appends the connection table to a JSON report as `,"clients":[...]`.
+ * @return The new length of the text in `buffer`.
+ */
+int encodeClientTable(char *buffer, int length, int size) {
+    unsigned long now = millis();
+    length += snprintf(buffer + length, size - length, ",\"clients\":[");
+    bool first = true;
+    for (int i = 0; i < MAX_WS_CLIENTS && length < size - 1; i++) {
+        const ClientInfo &info = clients[i];
+        if (info.socket == NULL) {
+            continue;
+        }
+        length += snprintf(buffer + length, size - length,
+                           "%s{\"slot\":%d,\"role\":\"%s\",\"age\":%lu,\"idle\":%lu,\"in\":%lu,\"out\":%lu,\"dropped\":%lu,\"rejected\":%lu}",
+                           first ? "" : ",", i, info.role == ROLE_DRIVER ? "driver" : "spectator",
+                           (now - info.connectedAt) / 1000, now - info.lastActivity,
+                           (unsigned long)info.bytesIn, (unsigned long)info.bytesOut,
+                           (unsigned long)info.messagesDropped, (unsigned long)info.commandsRejected);
+        first = false;
+    }
+    if (length < size - 1) {
+        length += snprintf(buffer + length, size - length, "]");
     }
+    return min(length, size - 1);
 }
 
 // =============================================================================
-// Telemetry Sending Function
+// Telemetry Sending Functions
 // =============================================================================
+/**
+ * @brief Samples every telemetry value once for this tick.
+ */
+void captureTelemetry(TelemetrySnapshot &snapshot, unsigned long currentMillis) {
+    RangeReading range = getLatestRange();
+    long ttc = timeToCollision;
+    snapshot.values[TF_RSSI] = WiFi.RSSI();
+    snapshot.values[TF_AUTHORIZED] = isAuthorized;
+    snapshot.values[TF_DISTANCE] = lastDistance;
+    snapshot.values[TF_DISTANCE_AGE] = range.sequence ? (long)min(currentMillis - range.timestamp, 0xFFFEUL) : -1;
+    snapshot.values[TF_CLOSING_SPEED] = closingSpeed;
+    snapshot.values[TF_TTC] = (ttc < 0) ? -1 : min(ttc, 0xFFFEL);
+    snapshot.values[TF_OBSTACLE_AVOIDANCE] = avoidingObstacle;
+    snapshot.values[TF_CURRENT_COMMAND] = lastSentCommand;
+    snapshot.values[TF_AVOIDANCE_STATE] = (int)avoidanceState;
+    snapshot.captureTime = esp_timer_get_time();
+}
+
 /**
  * @brief Periodically sends telemetry data to all connected WebSocket clients.
  * @details Gathers data like WiFi RSSI, authorization status, ultrasonic distance,
- * obstacle avoidance status, last command, and avoidance state. Formats the data
- * into a JSON string, prefixed with "TELEMETRY:", and broadcasts it.
+ * obstacle avoidance status, last command, and avoidance state once per tick.
+ * Each client receives the fields of its subscription level, in its chosen encoding
+ * ("TELEMETRY:{...}" JSON or an OP_TELEMETRY record). Clients that negotiated deltas
+ * only receive fields that changed since the previous tick, plus a full keyframe every
+ * `TELEMETRY_KEYFRAME_INTERVAL` ticks (or right after they (re)negotiate); a tick with
+ * nothing new for a client sends nothing to it. Clients that shared their clock offset
+ * get the capture time in their own clock. Encodings are written into fixed,
+ * reused buffers and re-encoded only when the next client needs a different
+ * format/field set, so no heap allocation happens per tick. The driver is served
+ * first; spectators follow in an order that rotates every tick. While the driving
+ * lease is held, spectators only get a shared full keyframe every
+ * `SPECTATOR_TELEMETRY_DIVIDER` ticks.
  * Runs approximately every 100ms (controlled by `lastUpdate` check).
  */
 void sendTelemetryData() {
@@ -475,31 +1307,99 @@ void sendTelemetryData() {
     if (currentMillis - lastUpdate < 100) { // 100ms interval
         return; // Not time to send yet
     }
+    lastUpdate = currentMillis; // Record the time of this update
+    telemetrySequence++;
+
+    TelemetrySnapshot snapshot;
+    captureTelemetry(snapshot, currentMillis);
+    uint16_t changed = changedTelemetryFields(snapshot, previousTelemetry);
+    bool keyframeTick = (telemetrySequence % TELEMETRY_KEYFRAME_INTERVAL) == 0;
+    bool spectatorTick = (telemetrySequence % SPECTATOR_TELEMETRY_DIVIDER) == 0;
+    bool leaseHeld = leaseHolder >= 0;
+
+    // Last encoding held in each buffer, so clients sharing a format and field set reuse it
+    int32_t textKey = -1, binaryKey = -1;
+    int textLength = 0, binaryLength = 0;
+
+    // Driver first, then spectators starting one slot further each tick
+    int order[MAX_WS_CLIENTS];
+    int count = 0;
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        if (clients[i].socket != NULL && clients[i].role == ROLE_DRIVER) {
+            order[count++] = i;
+        }
+    }
+    for (int n = 0; n < MAX_WS_CLIENTS; n++) {
+        int i = (telemetryRoundRobin + n) % MAX_WS_CLIENTS;
+        if (clients[i].socket != NULL && clients[i].role != ROLE_DRIVER) {
+            order[count++] = i;
+        }
+    }
+    telemetryRoundRobin = (telemetryRoundRobin + 1) % MAX_WS_CLIENTS;
 
-    // Prepare JSON document
-    StaticJsonDocument<256> doc; // Allocate enough space for telemetry data
-
-    // Add telemetry data points to the JSON document
-    doc["rssi"] = WiFi.RSSI();                // WiFi signal strength
-    doc["authorized"] = isAuthorized;         // Current authorization status
-    doc["distance"] = lastDistance;           // Last measured ultrasonic distance
-    doc["obstacleAvoidance"] = avoidingObstacle; // Is obstacle avoidance currently active?
-    doc["currentCommand"] = lastSentCommand;  // Last command received/being executed
-    doc["avoidanceState"] = (int)avoidanceState; // Current state of the avoidance FSM
+    for (int n = 0; n < count; n++) {
+        ClientInfo &info = clients[order[n]];
 
-    // Serialize JSON object to a string
-    String telemetryJson;
-    serializeJson(doc, telemetryJson);
+        if (leaseHeld && info.role != ROLE_DRIVER) {
+            // Spectators: one untimestamped full keyframe per format, shared by all of them
+            if (!spectatorTick) {
+                continue;
+            }
+            uint16_t mask = TELEMETRY_LEVEL_MASKS[TELEMETRY_LEVEL_FULL];
+            int32_t key = mask | 0x10000;
+            if (info.telemetryFormat == TELEMETRY_BINARY) {
+                if (binaryKey != key) {
+                    binaryLength = encodeTelemetryBinary(telemetryBinary, telemetrySequence, snapshot, mask, true, false);
+                    binaryKey = key;
+                }
+                info.bytesOut += binaryLength;
+                info.socket->send(net::WebSocket::DataType::BINARY, (const char *)telemetryBinary, binaryLength);
+            } else {
+                if (textKey != key) {
+                    textLength = encodeTelemetryJson(telemetryText, telemetrySequence, snapshot, mask, true);
+                    textKey = key;
+                }
+                int length = finishTelemetryJson(telemetryText, textLength, false, 0);
+                info.bytesOut += length;
+                info.socket->send(net::WebSocket::DataType::TEXT, telemetryText, length);
+            }
+            continue;
+        }
 
-    // Prefix the JSON string for client-side identification
-    String telemetryMessage = "TELEMETRY:" + telemetryJson;
+        bool keyframe = keyframeTick || info.needsKeyframe || !info.telemetryDeltas;
+        uint16_t mask = TELEMETRY_LEVEL_MASKS[info.telemetryLevel];
+        if (!keyframe) {
+            mask &= changed;
+            if (mask == 0) {
+                continue; // Nothing new for this client
+            }
+        }
+        info.needsKeyframe = false;
+        int32_t key = mask | (keyframe ? 0x10000 : 0) | (info.clockSynced ? 0x20000 : 0);
 
-    // Broadcast the telemetry message to all connected WebSocket clients
-    webSocket.broadcast(net::WebSocket::DataType::TEXT,
-                       telemetryMessage.c_str(),
-                       telemetryMessage.length());
+        if (info.telemetryFormat == TELEMETRY_BINARY) {
+            if (binaryKey != key) {
+                binaryLength = encodeTelemetryBinary(telemetryBinary, telemetrySequence, snapshot, mask, keyframe, info.clockSynced);
+                binaryKey = key;
+            }
+            if (info.clockSynced) {
+                writeUint64(telemetryBinary + TELEMETRY_TIMESTAMP_OFFSET, (uint64_t)(snapshot.captureTime + info.clockOffset));
+            }
+            info.bytesOut += binaryLength;
+            info.socket->send(net::WebSocket::DataType::BINARY, (const char *)telemetryBinary, binaryLength);
+        } else {
+            // The open JSON body is shared; only the per-client tail is rewritten
+            if (textKey != (key & 0x1FFFF)) {
+                textLength = encodeTelemetryJson(telemetryText, telemetrySequence, snapshot, mask, keyframe);
+                textKey = key & 0x1FFFF;
+            }
+            int length = finishTelemetryJson(telemetryText, textLength, info.clockSynced, snapshot.captureTime + info.clockOffset);
+            info.bytesOut += length;
+            info.socket->send(net::WebSocket::DataType::TEXT, telemetryText, length);
+        }
+    }
 
-    lastUpdate = currentMillis; // Record the time of this update
+    previousTelemetry = snapshot;
 }
 
 
@@ -508,45 +1408,37 @@ void sendTelemetryData() {
 // =============================================================================
 /**
  * @brief Manages the obstacle avoidance state machine.
- * @details This function is called repeatedly in the main loop.
- * 1. Sets a mutex (`stateUpdateInProgress`) to prevent conflicts with WebSocket commands.
- * 2. Updates the ultrasonic sensor reading (`updateUltrasonicSensor`).
- * 3. Checks if avoidance should be triggered (obstacle detected while moving forward).
- * 4. If triggered, sets `avoidingObstacle` flag, changes state to `BACKING_UP`,
- * notifies clients, and initiates backward movement.
- * 5. If avoidance is already active, progresses through the states (`BACKING_UP`, `COMPLETING`)
+ * @details This function is called once per cycle by the control task, which owns the
+ * motors, so no locking against the WebSocket handler is needed.
+ * 1. Updates the ultrasonic sensor reading (`updateUltrasonicSensor`).
+ * 2. Checks if avoidance should be triggered (obstacle detected while moving forward).
+ * 3. If triggered, sets `avoidingObstacle` flag, changes state to `BACKING_UP`,
+ * notifies clients (via the event queue), and initiates backward movement.
+ * 4. If avoidance is already active, progresses through the states (`BACKING_UP`, `COMPLETING`)
  * based on elapsed time (`avoidanceStateStartTime`).
- * 6. Controls motor actions (stop, back up) according to the current avoidance state.
- * 7. When the maneuver is complete, resets state to `IDLE`, clears the `avoidingObstacle` flag,
+ * 5. Controls motor actions (stop, back up) according to the current avoidance state.
+ * 6. When the maneuver is complete, resets state to `IDLE`, clears the `avoidingObstacle` flag,
  * stops the car, and notifies clients that avoidance is finished.
- * 8. Releases the mutex.
  */
 void handleObstacleAvoidance() {
-  // --- Enter Critical Section ---
-  stateUpdateInProgress = true; // Prevent WebSocket handler from changing motor state concurrently
-
   // Always get the latest distance reading at the start of the handler
   updateUltrasonicSensor();
 
   // --- Condition to START Obstacle Avoidance ---
   // Trigger avoidance ONLY if:
   // - Avoidance is not already active.
-  // - An obstacle is within the STOP_DISTANCE.
   // - The car was last commanded to move FORWARD.
-  if (!avoidingObstacle && lastDistance <= STOP_DISTANCE && lastSentCommand == CMD_FORWARD) {
+  // - The predicted time-to-collision is below TTC_THRESHOLD, or the obstacle is
+  //   already within the STOP_DISTANCE hard floor.
+  RangeEstimate current = { lastDistance, closingSpeed, timeToCollision };
+  if (!avoidingObstacle && lastSentCommand == CMD_FORWARD && rangeCollisionImminent(current)) {
     Serial.println("DETECTED Obstacle while moving forward! Starting avoidance sequence");
     avoidingObstacle = true;          // Set the flag
     avoidanceState = BACKING_UP;      // Set the initial state
     avoidanceStateStartTime = millis(); // Record the start time for this state
 
     // Notify clients that obstacle avoidance has started
-    StaticJsonDocument<128> doc;
-    doc["active"] = true;
-    doc["distance"] = lastDistance;
-    String obstacleJson;
-    serializeJson(doc, obstacleJson);
-    String obstacleMessage = "OBSTACLE:" + obstacleJson;
-    webSocket.broadcast(net::WebSocket::DataType::TEXT, obstacleMessage.c_str(), obstacleMessage.length());
+    postControlEvent(EVENT_OBSTACLE_ACTIVE, lastDistance);
 
     // Immediately start the first action of the avoidance sequence
     Serial.println("Starting backward movement for avoidance");
@@ -581,14 +1473,8 @@ void handleObstacleAvoidance() {
           avoidingObstacle = false;          // Clear the avoidance flag
           lastSentCommand = CMD_STOP;        // Reset last command to prevent immediate forward motion
 
-          // Notify clients that obstacle avoidance is finished
-          StaticJsonDocument<128> doc;
-          doc["active"] = false;             // Indicate avoidance is no longer active
-          doc["distance"] = lastDistance;    // Send final distance reading
-          String clearJson;
-          serializeJson(doc, clearJson);
-          String clearMessage = "OBSTACLE:" + clearJson;
-          webSocket.broadcast(net::WebSocket::DataType::TEXT, clearMessage.c_str(), clearMessage.length());
+          // Notify clients that obstacle avoidance is finished (with the final distance reading)
+          postControlEvent(EVENT_OBSTACLE_CLEARED, lastDistance);
 
           // No motor action needed here, car is already stopped and state is reset.
           // The car will remain stopped until a new command is received.
@@ -604,96 +1490,560 @@ void handleObstacleAvoidance() {
         break;
     }
   }
-
-  // --- Exit Critical Section ---
-  stateUpdateInProgress = false; // Release the mutex
 }
 
 
 // =============================================================================
-// Authorization Timeout Check Function
+// Control Task Functions
 // =============================================================================
 /**
- * @brief Checks if the authorized session has expired due to inactivity.
- * @details If `isAuthorized` is true, it compares the current time (`millis()`)
- * with the `lastAuthorizedActivity` timestamp. If the difference exceeds
- * `AUTH_TIMEOUT`, it resets `isAuthorized` to false, clears `authorizedUser`,
- * and broadcasts an "RFID: " message indicating the session expired.
+ * @brief Requests an immediate stop from any task.
+ * @details Sets a flag that the control task honors at the end of its next cycle,
+ * so a stop is never lost even when the command queue is full.
  */
-void checkAuthTimeout() {
-  // Only check timeout if a user is currently authorized
-  if (isAuthorized) {
-    // Check if the time elapsed since the last activity exceeds the timeout period
-    if (millis() - lastAuthorizedActivity > AUTH_TIMEOUT) {
-      isAuthorized = false;    // De-authorize the user
-      authorizedUser = "";     // Clear the authorized user name
+void requestStop() {
+  stopRequested.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Posts an event for the network loop to broadcast. Called from the control task only.
+ */
+void postControlEvent(ControlEventType type, int distance) {
+  ControlEvent event = { type, distance };
+  if (!eventQueue.push(event)) {
+    Serial.println("Control event dropped: event queue full");
+  }
+}
+
+/**
+ * @brief Applies a drive command to the motors. Called from the control task only.
+ * @details Stop is always honored. Movement is ignored while an avoidance maneuver is in
+ * progress. Forward is refused, and the avoidance sequence started, if the path is blocked.
+ */
+void applyCommand(const ControlCommand &controlCommand) {
+  int command = controlCommand.command;
+
+  if (avoidingObstacle && command != CMD_STOP) {
+    return; // The avoidance FSM owns the motors until the maneuver completes
+  }
+
+  lastSentCommand = command; // Store the latest valid command
 
-      // Prepare JSON message indicating session expiration
-      StaticJsonDocument<128> doc;
-      doc["authorized"] = false;
-      doc["message"] = "Session expired";
+  // Apply the speed carried by a binary drive frame before actuating
+  if (controlCommand.speed >= 0) {
+    motorSpeed = controlCommand.speed;
+  }
 
-      String timeoutJson;
-      serializeJson(doc, timeoutJson);
+  switch (command) {
+    case CMD_STOP:
+      Serial.println("Stop");
+      CAR_stop(); // Execute stop motor function
+      break;
+    case CMD_FORWARD:
+      // Only move forward if the path is clear
+      if (lastDistance > STOP_DISTANCE) {
+        Serial.println("Move Forward");
+        CAR_moveForward(); // Execute forward motor function
+      } else {
+        // Path is blocked: notify clients, override the command to STOP and log the blockage
+        postControlEvent(EVENT_FORWARD_BLOCKED, lastDistance);
+        lastSentCommand = CMD_STOP;
+        Serial.println("Forward blocked by obstacle");
+        CAR_stop();
+
+        // Explicitly trigger the obstacle avoidance state machine
+        // This ensures avoidance starts even if the command was initially blocked here
+        avoidingObstacle = true;
+        avoidanceState = BACKING_UP; // Start by backing up
+        avoidanceStateStartTime = millis();
+      }
+      break;
+    case CMD_BACKWARD:
+      Serial.println("Move Backward");
+      CAR_moveBackward(); // Execute backward motor function
+      break;
+    case CMD_LEFT:
+      Serial.println("Turn Left");
+      CAR_turnLeft(); // Execute left turn motor function
+      break;
+    case CMD_RIGHT:
+      Serial.println("Turn Right");
+      CAR_turnRight(); // Execute right turn motor function
+      break;
+  }
+}
 
-      // Prefix the message
-      String timeoutMessage = "RFID:" + timeoutJson;
+/**
+ * @brief Fixed-rate control task: drains the command queue and runs the avoidance FSM.
+ * @param parameter Unused.
+ * @details Runs every `CONTROL_PERIOD_MS` on `CONTROL_TASK_CORE`. Queued commands are applied
+ * in order (recording their actuation latency), then any out-of-band stop request, then one
+ * step of `handleObstacleAvoidance`.
+ */
+void controlTask(void *parameter) {
+  TickType_t lastWakeTime = xTaskGetTickCount();
 
-      // Broadcast the timeout message to all clients
-      webSocket.broadcast(net::WebSocket::DataType::TEXT,
-                         timeoutMessage.c_str(),
-                         timeoutMessage.length());
+  for (;;) {
+    if (latencyResetRequested.exchange(false, std::memory_order_acq_rel)) {
+      latencyHistograms[STAGE_ACTUATE].reset();
+      latencyHistograms[STAGE_TOTAL].reset();
+    }
 
-      Serial.println("Authorization timeout - session expired");
-      CAR_stop(); // Stop the car as a safety measure upon timeout
+    ControlCommand controlCommand;
+    while (commandQueue.pop(controlCommand)) {
+      applyCommand(controlCommand);
+      uint32_t actuatedMicros = micros();
+      latencyHistograms[STAGE_ACTUATE].record(actuatedMicros - controlCommand.queuedMicros);
+      latencyHistograms[STAGE_TOTAL].record(actuatedMicros - controlCommand.receivedMicros);
     }
+
+    if (stopRequested.exchange(false, std::memory_order_acq_rel)) {
+      ControlCommand stopCommand = { CMD_STOP, -1, 0, 0 };
+      applyCommand(stopCommand);
+    }
+
+    handleObstacleAvoidance();
+
+    vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(CONTROL_PERIOD_MS));
+  }
+}
+
+/**
+ * @brief Broadcasts the events posted by the control task. Called from the network loop only.
+ */
+void processControlEvents() {
+  ControlEvent event;
+  while (eventQueue.pop(event)) {
+    int noticeLength = formatObstacleNotice(event.type != EVENT_OBSTACLE_CLEARED, event.distance, NULL);
+    broadcastToClients(net::WebSocket::DataType::TEXT, noticeText, noticeLength);
   }
 }
 
+/**
+ * @brief Formats `OBSTACLE:{"active":..,"distance":..[,"message":".."]}` into `noticeText`.
+ * @details Network loop only. Rejections of spammed movement commands go through here,
+ * so they must not touch the heap.
+ * @return Number of characters written.
+ */
+int formatObstacleNotice(bool active, int distance, const char *message) {
+  int length = snprintf(noticeText, sizeof(noticeText), "OBSTACLE:{\"active\":%s,\"distance\":%d",
+                        active ? "true" : "false", distance);
+  if (message) {
+    length += snprintf(noticeText + length, sizeof(noticeText) - length, ",\"message\":\"%s\"", message);
+  }
+  length += snprintf(noticeText + length, sizeof(noticeText) - length, "}");
+  return min(length, (int)sizeof(noticeText) - 1);
+}
+
 // =============================================================================
-// WiFi Connection Management Function
+// Deadman Watchdog Functions
 // =============================================================================
 /**
- * @brief Periodically checks the WiFi connection status and attempts reconnection if lost.
- * @details Runs approximately every 5 seconds. If `WiFi.status()` is not `WL_CONNECTED`,
- * it attempts to reconnect using `WiFi.begin()`. Prints status messages to Serial.
+ * @brief The car as deadmanStep() sees it: the sketch's globals and pins.
+ * @details The last driver frame's timestamp is stored before the frame is queued, so
+ * the control task never applies a frame while the timer still sees the old one. The
+ * final ramp step's requestStop() makes the control task clear the direction pins and
+ * `lastSentCommand`.
  */
-void checkWiFiConnection() {
-  static unsigned long lastWiFiCheck = 0; // Time of the last connection check
-  unsigned long currentMillis = millis();
+struct DeadmanCar {
+  uint32_t lastFrame() { return lastDriverFrame.load(std::memory_order_acquire); }
+  uint32_t now() { return millis(); }
+  bool driving() { return lastSentCommand != CMD_STOP && !avoidingObstacle; }
+  int speed() { return motorSpeed; }
+  void writeDuty(DeadmanMotor motor, int duty) { analogWrite(motor == DEADMAN_MOTOR_A ? ENA : ENB, duty); }
+  void stop() { requestStop(); }
+};
 
-  // Check connection status periodically (e.g., every 5 seconds)
-  if (currentMillis - lastWiFiCheck < 5000) {
-    return; // Not time to check yet
+/**
+ * @brief Watchdog tick, called by the esp_timer task every `DEADMAN_PERIOD_MS`.
+ * @param parameter Unused.
+ * @details See deadmanStep(). Idle while the car is stopped or the avoidance FSM (a
+ * bounded maneuver) owns the motors.
+ */
+void deadmanTick(void *parameter) {
+  DeadmanCar car;
+  if (deadmanStep(deadmanRamp, car)) {
+    deadmanTrips.fetch_add(1, std::memory_order_relaxed);
   }
+}
 
-  lastWiFiCheck = currentMillis; // Record the time of this check
+/**
+ * @brief Creates and starts the periodic deadman watchdog timer.
+ */
+void startDeadmanWatchdog() {
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = deadmanTick;
+  timerArgs.name = "deadman";
+  if (esp_timer_create(&timerArgs, &deadmanTimer) != ESP_OK ||
+      esp_timer_start_periodic(deadmanTimer, DEADMAN_PERIOD_MS * 1000ULL) != ESP_OK) {
+    Serial.println("ERROR: Deadman watchdog could not be started!");
+    return;
+  }
+  Serial.print("Deadman watchdog started (");
+  Serial.print(DEADMAN_TIMEOUT_MS);
+  Serial.println(" ms).");
+}
 
-  // If WiFi is not connected
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi connection lost. Attempting to reconnect...");
+// =============================================================================
+// Latency Report Functions
+// =============================================================================
+/**
+ * @brief Encodes all latency histograms into `statsText`.
+ * @details Format: `STATS:{"unit":"us","parse":{"n":..,"min":..,"p50":..,"p90":..,
+ * "p99":..,"max":..,"mean":..},"auth":{...},...,"rfid":{...},"wifi":{...},"deadman":{...},
+ * "clients":[...]}` with one object per LatencyStage, the RFID task's probe counters, the
+ * WiFi link counters (drops, attempts, last outage in ms) and the deadman timeout and trip
+ * count since boot, and the connection table
+ * (see encodeClientTable()).
+ * @return Number of characters written.
+ */
+int encodeLatencyStats() {
+  int length = snprintf(statsText, sizeof(statsText), "STATS:{\"unit\":\"us\"");
+  for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+    const LatencyHistogram &histogram = latencyHistograms[stage];
+    uint32_t samples = histogram.samples;
+    length += snprintf(statsText + length, sizeof(statsText) - length,
+                       ",\"%s\":{\"n\":%lu,\"min\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu,\"mean\":%lu}",
+                       LATENCY_STAGE_NAMES[stage], (unsigned long)samples,
+                       (unsigned long)histogram.minValue,
+                       (unsigned long)histogram.valueAtPercentile(50),
+                       (unsigned long)histogram.valueAtPercentile(90),
+                       (unsigned long)histogram.valueAtPercentile(99),
+                       (unsigned long)histogram.maxValue,
+                       (unsigned long)(samples ? histogram.sum / samples : 0));
+    if (length >= (int)sizeof(statsText) - 1) {
+      return sizeof(statsText) - 1; // Truncated; cannot happen with the current stage list
+    }
+  }
+  length += snprintf(statsText + length, sizeof(statsText) - length, ",\"rfid\":{\"probes\":%lu,\"reads\":%lu}",
+                     (unsigned long)rfidProbes.load(std::memory_order_relaxed),
+                     (unsigned long)rfidCardReads.load(std::memory_order_relaxed));
+  length += snprintf(statsText + length, sizeof(statsText) - length,
+                     ",\"wifi\":{\"drops\":%lu,\"attempts\":%lu,\"lastOutage\":%lu}",
+                     (unsigned long)wifiDrops.load(std::memory_order_relaxed), (unsigned long)wifiLink.attempts, wifiLink.lastOutage);
+  length += snprintf(statsText + length, sizeof(statsText) - length, ",\"deadman\":{\"timeout\":%lu,\"trips\":%lu}",
+                     (unsigned long)DEADMAN_TIMEOUT_MS, (unsigned long)deadmanTrips.load(std::memory_order_relaxed));
+  length = encodeClientTable(statsText, length, sizeof(statsText));
+  if (length < (int)sizeof(statsText) - 1) {
+    length += snprintf(statsText + length, sizeof(statsText) - length, "}");
+  }
+  return min(length, (int)sizeof(statsText) - 1);
+}
+
+/**
+ * @brief Clears the histograms. The network loop clears its own; the control task is
+ * asked to clear the ones it writes so every histogram keeps a single writer.
+ */
+void resetLatencyStats() {
+  latencyHistograms[STAGE_PARSE].reset();
+  latencyHistograms[STAGE_AUTH].reset();
+  latencyHistograms[STAGE_QUEUE].reset();
+  latencyResetRequested.store(true, std::memory_order_release);
+}
+
+// =============================================================================
+// Authorization Session Functions
+// =============================================================================
+/**
+ * @brief Recomputes `isAuthorized` (any session bound to a client).
+ */
+void updateAuthorizedFlag() {
+  bool any = false;
+  for (int i = 0; i < MAX_AUTH_SESSIONS; i++) {
+    any = any || (authSessions[i].active && authSessions[i].slot >= 0);
+  }
+  isAuthorized = any;
+}
+
+/**
+ * @brief The active session bound to a client, or NULL.
+ */
+AuthSession *sessionFor(const ClientInfo *info) {
+  if (info == NULL || info->session < 0) {
+    return NULL;
+  }
+  AuthSession &session = authSessions[info->session];
+  return (session.active && session.slot == info - clients) ? &session : NULL;
+}
 
-    // Attempt to reconnect using the stored credentials
-    WiFi.begin(ssid, password);
+/**
+ * @brief Compares two tokens in time independent of where they differ.
+ */
+bool tokensEqual(const uint8_t *a, const uint8_t *b) {
+  uint8_t difference = 0;
+  for (size_t i = 0; i < AUTH_TOKEN_LENGTH; i++) {
+    difference |= a[i] ^ b[i];
+  }
+  return difference == 0;
+}
 
-    int retries = 0;
-    // Wait for connection, with a retry limit (e.g., 10 attempts * 500ms = 5 seconds)
-    while (WiFi.status() != WL_CONNECTED && retries < 10) {
-      delay(500);
-      Serial.print(".");
-      retries++;
+/**
+ * @brief Sends an "RFID:" notice to one client, or to every client if `info` is NULL.
+ * @param session The client's session (authorized, with its token), or NULL for a refusal.
+ * @param message Reason shown for a refusal; ignored when `session` is set.
+ */
+void sendAuthNotice(ClientInfo *info, const AuthSession *session, const char *message, bool resumed) {
+  StaticJsonDocument<192> doc;
+  char tokenHex[2 * AUTH_TOKEN_LENGTH + 1];
+  doc["authorized"] = session != NULL;
+  if (session) {
+    for (size_t i = 0; i < AUTH_TOKEN_LENGTH; i++) {
+      snprintf(tokenHex + 2 * i, 3, "%02x", session->token[i]);
     }
+    doc["user"] = session->user;
+    doc["token"] = tokenHex;
+    doc["grace"] = AUTH_RESUME_GRACE;
+    doc["resumed"] = resumed;
+  } else {
+    doc["message"] = message;
+  }
 
-    // Check the result after attempting reconnection
-    if (WiFi.status() == WL_CONNECTED) {
-      Serial.println("\nWiFi reconnected");
-      Serial.print("IP Address: ");
-      Serial.println(WiFi.localIP()); // Print the new IP address (might change)
-    } else {
-      Serial.println("\nWiFi reconnection failed");
-      // Consider further actions if reconnection fails persistently (e.g., reset ESP32)
+  char notice[224];
+  memcpy(notice, "RFID:", 5);
+  size_t length = 5 + serializeJson(doc, notice + 5, sizeof(notice) - 5);
+  if (info) {
+    sendToClient(*info->socket, net::WebSocket::DataType::TEXT, notice, length);
+  } else {
+    broadcastToClients(net::WebSocket::DataType::TEXT, notice, length);
+  }
+}
+
+/**
+ * @brief Binds a session to a client, replacing any session the client had.
+ */
+void bindSession(int index, ClientInfo &info) {
+  if (info.session >= 0 && info.session != index && authSessions[info.session].slot == &info - clients) {
+    authSessions[info.session].active = false; // One session per client; the newer card wins
+  }
+  AuthSession &session = authSessions[index];
+  session.slot = &info - clients;
+  session.claimable = false;
+  session.lastActivity = millis();
+  esp_fill_random(session.token, AUTH_TOKEN_LENGTH); // Fresh token on every bind
+  info.session = index;
+  info.authRequestedAt = 0;
+  updateAuthorizedFlag();
+}
+
+/**
+ * @brief Opens a session for a scanned card.
+ * @param target Client to bind it to, or NULL to leave it claimable.
+ * @return Index of the session.
+ */
+int openSession(const CardRecord &card, ClientInfo *target) {
+  // Prefer a free slot, then the one idle (or detached) the longest
+  int index = 0;
+  unsigned long now = millis();
+  for (int i = 0; i < MAX_AUTH_SESSIONS; i++) {
+    if (!authSessions[i].active) {
+      index = i;
+      break;
+    }
+    if (now - authSessions[i].lastActivity > now - authSessions[index].lastActivity) {
+      index = i;
     }
   }
+  if (authSessions[index].active && authSessions[index].slot >= 0) {
+    endSession(index, "Session replaced");
+  }
+
+  AuthSession &session = authSessions[index];
+  session.active = true;
+  session.slot = -1;
+  session.claimable = true;
+  session.admin = card.flags & RFID_FLAG_ADMIN;
+  session.uidLength = card.uidLength;
+  memcpy(session.uid, card.uid, card.uidLength);
+  strlcpy(session.user, cardName(cardStore, card), sizeof(session.user));
+  session.lastActivity = now;
+  session.detachedAt = now;
+  if (target) {
+    bindSession(index, *target);
+  }
+  return index;
+}
+
+/**
+ * @brief Ends a session. Its client is told why, and the car is stopped if that client
+ * was (or could be) driving. A lease held with the session is released with it.
+ */
+void endSession(int index, const char *reason) {
+  AuthSession &session = authSessions[index];
+  if (!session.active) {
+    return;
+  }
+  session.active = false;
+  if (session.slot >= 0) {
+    ClientInfo &info = clients[session.slot];
+    info.session = -1;
+    if (leaseHolder == session.slot) {
+      releaseLease(true); // The lease never outlives the session it was granted with
+    } else if (leaseHolder < 0) {
+      requestStop(); // Stop the car as a safety measure
+    }
+    if (info.socket != NULL) {
+      sendAuthNotice(&info, NULL, reason, false);
+    }
+  }
+  updateAuthorizedFlag();
+  Serial.printf("Authorization ended for %s - %s\n", session.user, reason);
+}
+
+/**
+ * @brief Ends every session opened with a card (used when it is revoked).
+ */
+void endSessionsForCard(const uint8_t *uid, uint8_t length, const char *reason) {
+  for (int i = 0; i < MAX_AUTH_SESSIONS; i++) {
+    AuthSession &session = authSessions[i];
+    if (session.active && session.uidLength == length && memcmp(session.uid, uid, length) == 0) {
+      endSession(i, reason);
+    }
+  }
+}
+
+/**
+ * @brief Keeps a disconnecting client's session for AUTH_RESUME_GRACE instead of ending it.
+ */
+void detachSession(ClientInfo &info) {
+  AuthSession *session = sessionFor(&info);
+  info.session = -1;
+  if (session) {
+    session->slot = -1;
+    session->detachedAt = millis();
+    updateAuthorizedFlag();
+  }
+}
+
+/**
+ * @brief Hands an unclaimed session to a client that wants to drive.
+ * @return The session, or NULL if none is waiting.
+ */
+AuthSession *claimSession(ClientInfo &info) {
+  for (int i = 0; i < MAX_AUTH_SESSIONS; i++) {
+    if (authSessions[i].active && authSessions[i].claimable) {
+      bindSession(i, info);
+      sendAuthNotice(&info, &authSessions[i], NULL, false);
+      return &authSessions[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief OP_AUTH_RESUME: moves the session matching `token` to this client.
+ * @details Every session slot is compared, with no early exit, so the time taken does
+ * not depend on which slot (if any) matches. A session still bound to another
+ * connection (whose drop has not been noticed yet) is taken over as well.
+ */
+void resumeSession(ClientInfo &info, const uint8_t *token) {
+  int match = -1;
+  for (int i = 0; i < MAX_AUTH_SESSIONS; i++) {
+    bool equal = tokensEqual(authSessions[i].token, token);
+    bool resumable = authSessions[i].active && !authSessions[i].claimable &&
+                     (authSessions[i].slot >= 0 || millis() - authSessions[i].detachedAt <= AUTH_RESUME_GRACE);
+    match = (equal && resumable) ? i : match;
+  }
+  if (match < 0) {
+    sendAuthNotice(&info, NULL, "Session expired", false);
+    return;
+  }
+  AuthSession &session = authSessions[match];
+  bool moveLease = false;
+  if (session.slot >= 0 && session.slot != &info - clients) {
+    clients[session.slot].session = -1; // The old connection loses it
+    moveLease = leaseHolder == session.slot;
+  }
+  bindSession(match, info);
+  sendAuthNotice(&info, &session, NULL, true);
+  if (moveLease) {
+    grantLease(info); // The lease follows its session to the new connection
+  }
+  Serial.printf("Session of %s resumed by client %d\n", session.user, (int)(&info - clients));
+}
+
+/**
+ * @brief Ends sessions idle for AUTH_TIMEOUT, detached ones not resumed within
+ * AUTH_RESUME_GRACE, and unclaimed ones older than AUTH_CLAIM_WINDOW.
+ */
+void checkAuthTimeout() {
+  unsigned long now = millis();
+  for (int i = 0; i < MAX_AUTH_SESSIONS; i++) {
+    const AuthSession &session = authSessions[i];
+    if (!session.active) {
+      continue;
+    }
+    if (session.slot >= 0) {
+      // Check if the time elapsed since the last activity exceeds the timeout period
+      if (now - session.lastActivity > AUTH_TIMEOUT) {
+        endSession(i, "Session expired");
+      }
+    } else if (now - session.detachedAt > (session.claimable ? AUTH_CLAIM_WINDOW : AUTH_RESUME_GRACE)) {
+      endSession(i, session.claimable ? "Card not claimed" : "Session not resumed");
+    }
+  }
+}
+
+// =============================================================================
+// WiFi Connection Management Functions
+// =============================================================================
+/**
+ * @brief WiFi event handler. Runs in the system event task: records the link state
+ * and, on a disconnect, requests a stop (lock-free, see requestStop()). Nothing else.
+ */
+void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+      wifiConnected.store(true, std::memory_order_release);
+      break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+      if (wifiConnected.exchange(false, std::memory_order_acq_rel)) {
+        wifiDrops.fetch_add(1, std::memory_order_relaxed);
+      }
+      requestStop(); // Fail safe: no commands can reach the car without the link
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief Starts a connection attempt and returns at once; the outcome arrives as an event.
+ */
+void startWiFiAttempt() {
+  WiFi.disconnect(); // Abandon any half-finished association first
+  WiFi.begin(ssid, password);
+  Serial.printf("WiFi: attempt %lu\n", (unsigned long)wifiLink.attempts);
+}
+
+/**
+ * @brief Advances the reconnect state machine (see stepWiFiLink()) and performs its
+ * action. Never blocks.
+ * @details On a lost link: stops the car, frees the driving lease and starts an attempt.
+ */
+void checkWiFiConnection() {
+  // status() is a cached read; it backstops a missed DISCONNECTED event
+  bool connected = wifiConnected.load(std::memory_order_acquire) && WiFi.status() == WL_CONNECTED;
+
+  switch (stepWiFiLink(wifiLink, millis(), connected, esp_random())) {
+    case WIFI_ACTION_LOST:
+      Serial.println("WiFi connection lost. Stopping the car and reconnecting...");
+      requestStop(); // Also covered by the event handler; repeated in case the event was missed
+      releaseLease(false);
+      startWiFiAttempt();
+      break;
+    case WIFI_ACTION_ATTEMPT:
+      startWiFiAttempt();
+      break;
+    case WIFI_ACTION_RECONNECTED:
+      Serial.printf("WiFi reconnected after %lu ms, IP Address: %s\n",
+                    wifiLink.lastOutage, WiFi.localIP().toString().c_str());
+      break;
+    case WIFI_ACTION_FAILED:
+      Serial.printf("WiFi reconnection failed, next attempt in %lu ms\n", wifiLink.backoff);
+      break;
+    case WIFI_ACTION_NONE:
+      break;
+  }
 }
 
 
@@ -709,9 +2059,12 @@ void checkWiFiConnection() {
  * - Connects to the configured WiFi network with retries. Halts if connection fails.
  * - Starts the HTTP server on port 80.
  * - Starts the WebSocket server on port 81 and sets up the connection/message handlers.
- * - Initializes the SPI bus and the MFRC522 RFID reader, including a hardware reset.
+ * - Initializes the SPI bus and the MFRC522 RFID reader, including a hardware reset,
+ *   and loads the authorized cards from NVS.
  * - Checks the RFID reader version to verify initialization.
  * - Performs an initial ultrasonic sensor reading.
+ * - Starts the control task that owns the motors from then on.
+ * - Starts the RFID task that owns the reader from then on.
  * - Prints status messages to the Serial monitor.
  */
 void setup() {
@@ -731,6 +2084,7 @@ void setup() {
   // --- Initialize Ultrasonic Sensor Pins ---
   pinMode(trigPin, OUTPUT);
   pinMode(echoPin, INPUT);
+  attachInterrupt(digitalPinToInterrupt(echoPin), echoISR, CHANGE); // Time echo pulses in the background
   Serial.println("Ultrasonic sensor pins initialized.");
 
   // Ensure motors are stopped at startup
@@ -740,6 +2094,8 @@ void setup() {
   // --- Connect to WiFi ---
   Serial.print("Connecting to WiFi SSID: ");
   Serial.println(ssid);
+  WiFi.onEvent(onWiFiEvent);     // Link state for the reconnect state machine
+  WiFi.setAutoReconnect(false);  // checkWiFiConnection() owns retries
   WiFi.begin(ssid, password); // Start connection attempt
   int wifi_retries = 0;
   // Wait for connection with a timeout (20 * 500ms = 10 seconds)
@@ -757,6 +2113,7 @@ void setup() {
   }
 
   // WiFi connection successful
+  wifiLinkUp(wifiLink, millis());
   Serial.println("\nWiFi connected successfully!");
   Serial.print("IP Address: ");
   Serial.println(WiFi.localIP()); // Print assigned IP address
@@ -770,8 +2127,10 @@ void setup() {
 
   // Register a callback function to handle new client connections
   webSocket.onConnection([](net::WebSocket& ws) {
-    // When a client connects, register the message handler for that specific client
+    // When a client connects, register it and the message/close handlers for that specific client
+    registerClient(ws);
     ws.onMessage(handleWebSocketMessage);
+    ws.onClose(handleWebSocketClose);
     Serial.println("WebSocket client connected");
     // Optionally send a welcome message or initial state here
   });
@@ -799,13 +2158,29 @@ void setup() {
     Serial.println(version, HEX); // Print the firmware version (e.g., 0x91 or 0x92)
     Serial.println("RFID Reader initialized. Waiting for card/tag scan for authorization.");
   }
+  loadCards(cardStore, defaultUsers, sizeof(defaultUsers) / sizeof(defaultUsers[0])); // Authorized cards from NVS into the hashed table
 
   // --- Initial Sensor Readings ---
-  updateUltrasonicSensor(); // Get an initial distance reading
+  updateUltrasonicSensor(); // Trigger an initial distance reading
+  delay(ULTRASONIC_ECHO_TIMEOUT + 5); // Give the echo time to come back (setup only)
+  updateUltrasonicSensor(); // Pick up the reading published by the ISR
   Serial.print("Initial distance reading: ");
   Serial.print(lastDistance);
   Serial.println(" cm");
 
+  // --- Start Control Task ---
+  // From here on only the control task touches the motors
+  xTaskCreatePinnedToCore(controlTask, "control", CONTROL_TASK_STACK, NULL,
+                          CONTROL_TASK_PRIORITY, &controlTaskHandle, CONTROL_TASK_CORE);
+  Serial.println("Control task started.");
+  startDeadmanWatchdog();
+
+  // --- Start RFID Task ---
+  // From here on only the RFID task touches the reader
+  xTaskCreatePinnedToCore(rfidTask, "rfid", RFID_TASK_STACK, NULL,
+                          RFID_TASK_PRIORITY, &rfidTaskHandle, CONTROL_TASK_CORE);
+  Serial.println("RFID task started.");
+
   Serial.println("--- RC Car System Ready ---");
 }
 
@@ -814,67 +2189,37 @@ void setup() {
 // =============================================================================
 /**
  * @brief The main execution loop of the program.
- * @details Continuously performs the following actions:
- * - Checks WiFi connection status and attempts reconnection if needed (`checkWiFiConnection`).
- * - Scans for RFID tags/cards and handles authorization (`checkRFID`).
+ * @details Runs on the network core; motor actuation and obstacle avoidance run in
+ * `controlTask`. Continuously performs the following actions:
+ * - Advances the non-blocking WiFi reconnect state machine (`checkWiFiConnection`).
+ * - Authorizes the cards read by the RFID task (`checkRFID`).
  * - Checks for authorization timeout (`checkAuthTimeout`).
- * - Runs the obstacle avoidance state machine (`handleObstacleAvoidance`).
+ * - Broadcasts events posted by the control task (`processControlEvents`).
  * - Sends telemetry data to clients (`sendTelemetryData`).
- * - Listens for and handles incoming HTTP requests (`httpServer.available`).
+ * - Services HTTP connections without blocking (`serviceHttpServer`).
  * - Listens for and processes incoming WebSocket messages (`webSocket.listen`).
  */
 void loop() {
   // Maintain WiFi connection
   checkWiFiConnection();
 
-  // Check for RFID card scans and handle authorization
+  // Authorize cards scanned by the RFID task
   checkRFID();
 
   // Check if the authorized session has timed out
   checkAuthTimeout();
 
-  // Run the obstacle avoidance logic (includes ultrasonic updates)
-  handleObstacleAvoidance(); // This manages states and motor actions during avoidance
+  // Free the driving lease once the driver has walked away
+  checkLeaseTimeout();
+
+  // Forward obstacle notifications from the control task to clients
+  processControlEvents();
 
   // Send periodic status updates to clients
   sendTelemetryData();
 
   // --- Handle HTTP Client Connections ---
-  WiFiClient httpClient = httpServer.available(); // Check for incoming HTTP clients
-  if (httpClient) { // If a new client has connected
-    Serial.println("[HTTP] New Client Connection");
-    if (httpClient.connected()) { // Double-check connection
-        if (httpClient.available()) { // If there's data waiting to be read
-            // Read the first line of the request (e.g., "GET / HTTP/1.1")
-            String line = httpClient.readStringUntil('\r');
-            httpClient.find("\r\n\r\n"); // Consume the rest of the headers
-
-            Serial.print("<< [HTTP] Request: ");
-            Serial.println(line);
-
-            // Simple routing: Respond to GET requests for the root path "/"
-            if (line.startsWith("GET /")) {
-                // Send standard HTTP response headers
-                httpClient.println("HTTP/1.1 200 OK");
-                httpClient.println("Content-Type: text/html");
-                httpClient.println("Connection: close"); // Close connection after response
-                httpClient.println(); // End of headers
-                // Send the HTML content stored in the "index.h" file
-                httpClient.println(HTML_CONTENT);
-            } else {
-                // Respond with Method Not Allowed for other request types (POST, etc.)
-                httpClient.println("HTTP/1.1 405 Method Not Allowed");
-                httpClient.println("Connection: close");
-                httpClient.println();
-            }
-        }
-    }
-    // Short delay before closing allows data to be sent
-    delay(5);
-    // Close the connection
-    httpClient.stop();
-    Serial.println("[HTTP] Client Disconnected");
-  }
+  serviceHttpServer(httpServer, httpConnections, dashboardPage, millis()); // Accept connections and give each one bounded step of work
 
   // --- Process WebSocket Communications ---
   // This function checks for new messages, handles disconnections, etc.
@@ -882,8 +2227,7 @@ void loop() {
   // happens in the `handleWebSocketMessage` callback.
   webSocket.listen();
 
-  // Optional small delay to prevent WDT issues if loop is too tight,
-  // but yield() in handleWebSocketMessage helps.
+  // Optional small delay to prevent WDT issues if loop is too tight.
   // delay(1);
 }
 
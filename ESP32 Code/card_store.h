@@ -0,0 +1,370 @@
+/**
+ * @file card_store.h
+ * @brief The authorized RFID card table: hashed lookup in RAM, persisted in NVS.
+ * @details Shared by RC_Car_v2.0.0.ino and the host test tests/test_card_store.cpp,
+ * which runs it against an in-memory Preferences stand-in (tests/host). Ending the
+ * sessions of a revoked card is left to the sketch.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <string.h>
+
+// =============================================================================
+// Authorized RFID Users Definition
+// =============================================================================
+// Authorized cards live in NVS (namespace "rfid") and are loaded at boot into a
+// RAM table: a dense array of CardRecords plus an open-addressing hash index
+// (linear probing, FNV-1a over length + UID, power-of-two size at most half full),
+// so a scan is looked up in O(1) whatever the number of cards. UIDs may be 4, 7
+// or 10 bytes. Names are interned in one string pool; records refer to them by
+// offset, so no per-card heap String exists.
+//
+// NVS layout: "count" (u32), "names" (the used part of the pool) and the records
+// in chunks of RFID_CHUNK_CARDS ("c0", "c1", ...), so adding or revoking a card
+// rewrites one or two chunks instead of the whole table. The default 20 KB NVS
+// partition holds several hundred cards; a fleet needs a larger "nvs" partition
+// in the partition table (and a larger RFID_MAX_CARDS).
+//
+// On first boot (empty store) the table is seeded from the sketch's `defaultUsers`.
+// Cards are then added and revoked at runtime with OP_RFID_ADMIN while an admin
+// card's session is active (see "Binary Command Frame Protocol").
+const uint16_t RFID_MAX_CARDS = 1024;      ///< Capacity of the RAM table (14 bytes per card).
+const uint16_t RFID_INDEX_SIZE = 2048;     ///< Hash index slots; power of two, >= 2 * RFID_MAX_CARDS.
+const uint16_t RFID_NAME_POOL_SIZE = 4096; ///< Bytes of interned, NUL-terminated names.
+const uint8_t RFID_NAME_MAX = 24;          ///< Longest name accepted (bytes, without the NUL).
+const uint8_t RFID_UID_MAX = 10;           ///< Longest UID (triple-size ISO 14443A).
+const uint16_t RFID_CHUNK_CARDS = 64;      ///< Records per NVS blob.
+const uint16_t RFID_INDEX_EMPTY = 0xFFFF;  ///< Marks a free hash index slot.
+#define RFID_FLAG_ADMIN 0x01               ///< Card may add and revoke cards.
+
+/**
+ * @struct CardRecord
+ * @brief One authorized card, as stored in RAM and in NVS.
+ */
+struct CardRecord {
+  uint8_t uidLength;         ///< 4, 7 or 10.
+  uint8_t uid[RFID_UID_MAX]; ///< UID bytes; unused bytes are zero.
+  uint8_t flags;             ///< RFID_FLAG_* bits.
+  uint16_t nameOffset;       ///< Offset of the card's name in `CardStore::names`.
+};
+
+/**
+ * @struct DefaultUser
+ * @brief Compile-time card used to seed an empty store.
+ */
+struct DefaultUser {
+  uint8_t uidLength;         ///< 4, 7 or 10.
+  uint8_t uid[RFID_UID_MAX]; ///< UID bytes.
+  uint8_t flags;             ///< RFID_FLAG_* bits.
+  const char *name;          ///< Name associated with the UID.
+};
+
+/**
+ * @enum CardResult
+ * @brief Outcome of a card store operation, reported to the admin client.
+ */
+enum CardResult : uint8_t {
+  CARD_OK = 0,     ///< Added, updated or revoked.
+  CARD_NOT_FOUND,  ///< Revoke of an unknown UID.
+  CARD_FULL,       ///< Table or name pool is full.
+  CARD_INVALID,    ///< Bad UID length or name.
+  CARD_DENIED,     ///< No admin session, or the sender is a spectator.
+  CARD_STORE_FAILED ///< The NVS write failed; RAM and flash may differ until reboot.
+};
+const char *const CARD_RESULT_NAMES[] = {"ok", "not_found", "full", "invalid", "denied", "store_failed"};
+
+/**
+ * @struct CardStore
+ * @brief The RAM table and the NVS handle it is persisted through.
+ */
+struct CardStore {
+  CardRecord cards[RFID_MAX_CARDS];    ///< Dense array of authorized cards.
+  uint16_t count;                      ///< Number of valid entries in `cards`.
+  uint16_t index[RFID_INDEX_SIZE];     ///< Hash index: position in `cards`, or RFID_INDEX_EMPTY.
+  char names[RFID_NAME_POOL_SIZE];     ///< Interned names.
+  uint16_t namesUsed;                  ///< Bytes used in `names`.
+  Preferences nvs;                     ///< NVS handle for namespace "rfid".
+};
+
+// =============================================================================
+// RFID Card Store Functions
+// =============================================================================
+/**
+ * @brief FNV-1a hash of a UID and its length (so a 4-byte UID never matches a longer one).
+ */
+inline uint32_t hashUid(const uint8_t *uid, uint8_t length) {
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ length) * 16777619u;
+    for (uint8_t i = 0; i < length; i++) {
+        hash = (hash ^ uid[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Probes the hash index for a UID.
+ * @return The slot holding the card, or the empty slot where it would be inserted.
+ */
+inline uint16_t findCardSlot(const CardStore &store, const uint8_t *uid, uint8_t length) {
+    uint16_t slot = hashUid(uid, length) & (RFID_INDEX_SIZE - 1);
+    while (store.index[slot] != RFID_INDEX_EMPTY) {
+        const CardRecord &card = store.cards[store.index[slot]];
+        if (card.uidLength == length && memcmp(card.uid, uid, length) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & (RFID_INDEX_SIZE - 1);
+    }
+    return slot;
+}
+
+/**
+ * @brief Looks up an authorized card.
+ * @return The card, or NULL if the UID is not authorized.
+ */
+inline const CardRecord *findCard(const CardStore &store, const uint8_t *uid, uint8_t length) {
+    uint16_t position = store.index[findCardSlot(store, uid, length)];
+    return position == RFID_INDEX_EMPTY ? NULL : &store.cards[position];
+}
+
+/**
+ * @brief The name of a card in the pool.
+ */
+inline const char *cardName(const CardStore &store, const CardRecord &card) {
+    return store.names + card.nameOffset;
+}
+
+/**
+ * @brief Empties a hash index slot, shifting later entries of the probe run back
+ * so lookups never need tombstones.
+ */
+inline void unindexCardSlot(CardStore &store, uint16_t slot) {
+    const uint16_t mask = RFID_INDEX_SIZE - 1;
+    uint16_t hole = slot;
+    for (uint16_t next = (hole + 1) & mask; store.index[next] != RFID_INDEX_EMPTY; next = (next + 1) & mask) {
+        const CardRecord &card = store.cards[store.index[next]];
+        uint16_t home = hashUid(card.uid, card.uidLength) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            store.index[hole] = store.index[next]; // The hole lies on this entry's probe path
+            hole = next;
+        }
+    }
+    store.index[hole] = RFID_INDEX_EMPTY;
+}
+
+/**
+ * @brief Returns the pool offset of a name, adding it if it is not interned yet.
+ * @return The offset, or RFID_INDEX_EMPTY if the pool is full.
+ */
+inline uint16_t internCardName(CardStore &store, const char *name, size_t length) {
+    for (uint16_t offset = 0; offset < store.namesUsed; offset += strlen(store.names + offset) + 1) {
+        if (strncmp(store.names + offset, name, length) == 0 && store.names[offset + length] == '\0') {
+            return offset;
+        }
+    }
+    if (store.namesUsed + length + 1 > RFID_NAME_POOL_SIZE) {
+        return RFID_INDEX_EMPTY;
+    }
+    uint16_t offset = store.namesUsed;
+    memcpy(store.names + offset, name, length);
+    store.names[offset + length] = '\0';
+    store.namesUsed += length + 1;
+    return offset;
+}
+
+/**
+ * @brief Drops names no card refers to any more (left behind by revokes and renames).
+ * @details Moves names down in place and rewrites the offsets of the cards using them.
+ */
+inline void compactCardNames(CardStore &store) {
+    uint16_t write = 0;
+    for (uint16_t read = 0; read < store.namesUsed;) {
+        uint16_t size = strlen(store.names + read) + 1;
+        bool used = false;
+        for (uint16_t i = 0; i < store.count; i++) {
+            if (store.cards[i].nameOffset == read) {
+                store.cards[i].nameOffset = write;
+                used = true;
+            }
+        }
+        if (used) {
+            memmove(store.names + write, store.names + read, size);
+            write += size;
+        }
+        read += size;
+    }
+    store.namesUsed = write;
+}
+
+/**
+ * @brief Writes one chunk of records to NVS, or removes its key if the chunk is now empty.
+ */
+inline bool saveCardChunk(CardStore &store, uint16_t chunk) {
+    char key[8];
+    snprintf(key, sizeof(key), "c%u", chunk);
+    uint16_t first = chunk * RFID_CHUNK_CARDS;
+    if (first >= store.count) {
+        store.nvs.remove(key); // May not exist; nothing to check
+        return true;
+    }
+    size_t size = min((uint16_t)(store.count - first), RFID_CHUNK_CARDS) * sizeof(CardRecord);
+    return store.nvs.putBytes(key, &store.cards[first], size) == size;
+}
+
+/**
+ * @brief Persists part of the table: optionally the name pool, the chunks holding the
+ * positions `first`..`last`, and the card count (written last).
+ */
+inline bool saveCards(CardStore &store, bool names, uint16_t first, uint16_t last) {
+    bool ok = true;
+    if (names) {
+        ok = store.nvs.putBytes("names", store.names, store.namesUsed) == store.namesUsed && ok;
+    }
+    for (uint16_t chunk = first / RFID_CHUNK_CARDS; chunk <= last / RFID_CHUNK_CARDS; chunk++) {
+        ok = saveCardChunk(store, chunk) && ok;
+    }
+    ok = store.nvs.putUInt("count", store.count) == sizeof(uint32_t) && ok;
+    if (!ok) {
+        Serial.println("RFID store: NVS write failed");
+    }
+    return ok;
+}
+
+/**
+ * @brief Adds a card to the RAM table, or updates the flags and name of an existing one.
+ * @param persist True to write the change to NVS.
+ */
+inline CardResult addCard(CardStore &store, const uint8_t *uid, uint8_t length, uint8_t flags, const char *name,
+                          size_t nameLength, bool persist) {
+    if ((length != 4 && length != 7 && length != 10) || nameLength == 0 || nameLength > RFID_NAME_MAX ||
+        memchr(name, '\0', nameLength) != NULL) {
+        return CARD_INVALID;
+    }
+    uint16_t slot = findCardSlot(store, uid, length);
+    uint16_t position = store.index[slot];
+    if (position == RFID_INDEX_EMPTY && store.count >= RFID_MAX_CARDS) {
+        return CARD_FULL;
+    }
+
+    bool compacted = false;
+    uint16_t nameOffset = internCardName(store, name, nameLength);
+    if (nameOffset == RFID_INDEX_EMPTY) {
+        compactCardNames(store);
+        compacted = true;
+        nameOffset = internCardName(store, name, nameLength);
+        if (nameOffset == RFID_INDEX_EMPTY) {
+            return CARD_FULL;
+        }
+    }
+
+    if (position == RFID_INDEX_EMPTY) {
+        position = store.count++;
+        CardRecord &card = store.cards[position];
+        memset(&card, 0, sizeof(card));
+        card.uidLength = length;
+        memcpy(card.uid, uid, length);
+        store.index[slot] = position;
+    }
+    store.cards[position].flags = flags;
+    store.cards[position].nameOffset = nameOffset;
+
+    if (!persist) {
+        return CARD_OK;
+    }
+    // Compaction moved offsets of other cards, so everything is rewritten then
+    bool saved = compacted ? saveCards(store, true, 0, store.count - 1) : saveCards(store, true, position, position);
+    return saved ? CARD_OK : CARD_STORE_FAILED;
+}
+
+/**
+ * @brief Removes a card; the last card moves into its position to keep the array dense.
+ * @details The caller ends the sessions opened with this card.
+ */
+inline CardResult revokeCard(CardStore &store, const uint8_t *uid, uint8_t length) {
+    uint16_t slot = findCardSlot(store, uid, length);
+    uint16_t position = store.index[slot];
+    if (position == RFID_INDEX_EMPTY) {
+        return CARD_NOT_FOUND;
+    }
+    unindexCardSlot(store, slot);
+    uint16_t last = store.count - 1;
+    if (position != last) {
+        store.cards[position] = store.cards[last];
+        store.index[findCardSlot(store, store.cards[position].uid, store.cards[position].uidLength)] = position;
+    }
+    store.count--;
+
+    // Only the chunk that received the last card and the chunk it left changed
+    bool saved = saveCardChunk(store, position / RFID_CHUNK_CARDS);
+    if (last / RFID_CHUNK_CARDS != position / RFID_CHUNK_CARDS) {
+        saved = saveCardChunk(store, last / RFID_CHUNK_CARDS) && saved; // Shrunk, or removed once empty
+    }
+    saved = store.nvs.putUInt("count", store.count) == sizeof(uint32_t) && saved;
+    if (!saved) {
+        Serial.println("RFID store: NVS write failed");
+    }
+    return saved ? CARD_OK : CARD_STORE_FAILED;
+}
+
+/**
+ * @brief Loads the card store from NVS into the RAM table; seeds an empty store
+ * from `defaults`.
+ * @details Records that fail validation (bad length, bad name offset, duplicate)
+ * are skipped. Prints the number of cards and the load time.
+ */
+inline void loadCards(CardStore &store, const DefaultUser *defaults, size_t defaultCount) {
+    unsigned long start = micros();
+    memset(store.index, 0xFF, sizeof(store.index));
+    store.count = 0;
+    store.namesUsed = 0;
+
+    bool opened = store.nvs.begin("rfid", false);
+    uint32_t stored = opened ? store.nvs.getUInt("count", 0xFFFFFFFF) : 0xFFFFFFFF;
+    size_t namesLength = opened ? store.nvs.getBytesLength("names") : 0;
+
+    if (stored == 0xFFFFFFFF || stored > RFID_MAX_CARDS || namesLength > RFID_NAME_POOL_SIZE) {
+        // First boot (or a store this build cannot hold): start from the compiled-in users
+        for (size_t i = 0; i < defaultCount; i++) {
+            const DefaultUser &user = defaults[i];
+            addCard(store, user.uid, user.uidLength, user.flags, user.name, strlen(user.name), false);
+        }
+        if (opened) {
+            saveCards(store, true, 0, store.count ? store.count - 1 : 0);
+        } else {
+            Serial.println("RFID store: NVS unavailable, using the default users until reboot");
+        }
+    } else {
+        store.nvs.getBytes("names", store.names, namesLength);
+        store.namesUsed = namesLength;
+        if (namesLength > 0) {
+            store.names[namesLength - 1] = '\0'; // Keep every offset NUL-terminated
+        }
+        for (uint16_t first = 0; first < stored; first += RFID_CHUNK_CARDS) {
+            char key[8];
+            snprintf(key, sizeof(key), "c%u", first / RFID_CHUNK_CARDS);
+            size_t size = min((uint16_t)(stored - first), RFID_CHUNK_CARDS) * sizeof(CardRecord);
+            if (store.nvs.getBytes(key, &store.cards[store.count], size) != size) {
+                Serial.printf("RFID store: chunk %s missing, %u cards lost\n", key, (unsigned)(stored - first));
+                break;
+            }
+            // Validate and index in place, closing the gaps left by rejected records
+            uint16_t end = store.count + size / sizeof(CardRecord);
+            for (uint16_t read = store.count; read < end; read++) {
+                CardRecord &card = store.cards[read];
+                uint8_t length = card.uidLength;
+                if ((length != 4 && length != 7 && length != 10) || card.nameOffset >= store.namesUsed) {
+                    continue;
+                }
+                uint16_t slot = findCardSlot(store, card.uid, length);
+                if (store.index[slot] != RFID_INDEX_EMPTY) {
+                    continue; // Duplicate
+                }
+                store.cards[store.count] = card;
+                store.index[slot] = store.count++;
+            }
+        }
+    }
+    Serial.printf("RFID store: %u cards, %u name bytes, loaded in %lu us\n",
+                  store.count, store.namesUsed, micros() - start);
+}
@@ -0,0 +1,199 @@
+/**
+ * @file command_frame.h
+ * @brief Command codes, the binary command frame format and its in-place parsers.
+ * @details Shared by RC_Car_v2.0.0.ino and the host tests in tests/. Depends on the C
+ * library only, so the parsers build unchanged on the ESP32 and on Linux.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// =============================================================================
+// Command Definitions
+// =============================================================================
+#define CMD_STOP 0      ///< Command code to stop the car.
+#define CMD_FORWARD 1   ///< Command code to move the car forward.
+#define CMD_BACKWARD 2  ///< Command code to move the car backward.
+#define CMD_LEFT 4      ///< Command code to turn the car left.
+#define CMD_RIGHT 8     ///< Command code to turn the car right.
+
+// =============================================================================
+// Binary Command Frame Protocol
+// =============================================================================
+// Drive commands may be sent as BINARY WebSocket messages so they can be parsed
+// in place without building a String. All multi-byte fields are little-endian.
+//
+//   Byte 0     : opcode (OP_*)
+//   Bytes 1-2  : sequence number (uint16, wraps; 0 restarts the sequence)
+//   Bytes 3..  : opcode specific payload
+//
+//   OP_DRIVE payload : [3] command (CMD_*), [4] optional motor speed (0-255)
+//   OP_PING  payload : none, answered with OP_PONG [3..6] = millis(); or, for the
+//                      four-timestamp clock exchange, [3..10] client transmit time T1
+//                      (float64 us, client clock), answered with OP_PONG
+//                      [3..10] T1 echoed, [11..18] device receive time T2,
+//                      [19..26] device transmit time T3 (int64 us, esp_timer clock).
+//                      The client takes T4 on receipt; RTT = (T4-T1) - (T3-T2) and
+//                      device-minus-client offset = ((T2-T1) + (T3-T4)) / 2.
+//   OP_CLOCK_OFFSET payload : [3..10] int64 us to add to the device clock to get this
+//                      client's clock; telemetry to the client is then stamped in client time.
+//   OP_TELEMETRY_MODE payload : [3] TELEMETRY_JSON or TELEMETRY_BINARY, [4] optional
+//                               TelemetryLevel; also switches this client to delta telemetry
+//   OP_STATS payload : [3] optional, 1 = reset the histograms after reporting.
+//                      Answered with a TEXT "STATS:{...}" latency report.
+//   OP_LEASE payload : [3] 1 = request the driving lease, 0 = release it.
+//                      Answered with a TEXT "LEASE:{...}" notice (see "Connection Table").
+//   OP_RFID_ADMIN payload : [3] RFID_ADMIN_ADD or RFID_ADMIN_REVOKE, [4] UID length
+//                      (4, 7 or 10), [5..] UID; for add followed by [flags] (RFID_FLAG_*)
+//                      and the name (1-24 bytes). Accepted only while an admin card's
+//                      session is active, from the driver (or anyone while no lease is
+//                      held). Answered with TEXT "RFIDADMIN:{"result":..,"count":..,"capacity":..}".
+//   OP_AUTH_RESUME payload : [3..18] session token from an earlier "RFID:" notice. Moves
+//                      that session to this connection (see "Authorization Sessions");
+//                      answered with an "RFID:" notice carrying a new token, or a refusal.
+//
+// The legacy ASCII form ("1\r\n", "PING\r\n", "STATS\r\n") sent as TEXT is still accepted.
+#define OP_DRIVE 0x01   ///< Opcode for a drive command frame.
+#define OP_PING  0x02   ///< Opcode for a keep-alive ping frame.
+#define OP_TELEMETRY_MODE 0x03 ///< Opcode selecting the telemetry encoding for the sending client.
+#define OP_STATS 0x04   ///< Opcode requesting the command latency report.
+#define OP_CLOCK_OFFSET 0x05 ///< Opcode carrying the client's clock offset estimate.
+#define OP_LEASE 0x06   ///< Opcode requesting or releasing the driving lease.
+#define OP_RFID_ADMIN 0x07 ///< Opcode adding or revoking an authorized RFID card.
+#define RFID_ADMIN_ADD 1    ///< OP_RFID_ADMIN action: add a card (or update its flags and name).
+#define RFID_ADMIN_REVOKE 2 ///< OP_RFID_ADMIN action: revoke a card.
+#define OP_AUTH_RESUME 0x08 ///< Opcode resuming an authorization session after a reconnect.
+const size_t AUTH_TOKEN_LENGTH = 16; ///< Session token size (bytes), the OP_AUTH_RESUME payload.
+#define OP_PONG  0x82   ///< Opcode for the reply to OP_PING.
+#define OP_TELEMETRY 0x83 ///< Opcode of a binary telemetry record (see "Telemetry Encoding").
+
+#define FRAME_HEADER_LENGTH 3 ///< Opcode byte plus 16-bit sequence number.
+#define CLOCK_TIMESTAMP_LENGTH 8 ///< Width of a timestamp in the clock exchange.
+#define FRAME_NO_SEQUENCE 0xFFFFFFFF ///< Sequence value used for legacy ASCII commands.
+
+/**
+ * @struct CommandFrame
+ * @brief Decoded view of one incoming command, filled in place from the message buffer.
+ */
+struct CommandFrame {
+  uint8_t opcode;     ///< OP_* value.
+  uint32_t sequence;  ///< Frame sequence number, or FRAME_NO_SEQUENCE for ASCII commands.
+  uint8_t command;    ///< CMD_* value for OP_DRIVE.
+  int16_t speed;      ///< Requested motor speed (0-255), or -1 if not supplied.
+  const uint8_t *payload;  ///< Points into the message buffer after the header (binary frames only).
+  uint16_t payloadLength;  ///< Number of payload bytes.
+};
+
+// =============================================================================
+// Command Frame Parsing Functions
+// =============================================================================
+/**
+ * @brief Parses a legacy ASCII command ("PING", "STATS", or a decimal CMD_* followed by optional CR/LF).
+ * @param message Pointer to the message payload.
+ * @param length Length of the message payload.
+ * @param frame Output frame, filled on success.
+ * @return True if the message is a well-formed ASCII command.
+ */
+inline bool parseAsciiCommand(const char *message, uint16_t length, CommandFrame &frame) {
+    frame.sequence = FRAME_NO_SEQUENCE;
+    frame.speed = -1;
+    frame.payload = NULL;
+    frame.payloadLength = 0;
+
+    if (length >= 4 && memcmp(message, "PING", 4) == 0) {
+        frame.opcode = OP_PING;
+        return true;
+    }
+    if (length >= 5 && memcmp(message, "STATS", 5) == 0) {
+        frame.opcode = OP_STATS;
+        return true;
+    }
+
+    uint16_t value = 0;
+    uint16_t i = 0;
+    while (i < length && message[i] >= '0' && message[i] <= '9' && i < 3) {
+        value = value * 10 + (message[i] - '0');
+        i++;
+    }
+    if (i == 0 || value > 255) {
+        return false; // No digits, or not a byte-sized command code
+    }
+    // Only trailing line terminators or spaces are allowed after the number
+    for (; i < length; i++) {
+        if (message[i] != '\r' && message[i] != '\n' && message[i] != ' ') {
+            return false;
+        }
+    }
+
+    frame.opcode = OP_DRIVE;
+    frame.command = (uint8_t)value;
+    return true;
+}
+
+/**
+ * @brief Parses a binary command frame in place (see "Binary Command Frame Protocol").
+ * @param message Pointer to the message payload.
+ * @param length Length of the message payload.
+ * @param frame Output frame, filled on success.
+ * @return True if the frame has a known opcode and a payload of the right size.
+ */
+inline bool parseBinaryCommand(const char *message, uint16_t length, CommandFrame &frame) {
+    if (length < FRAME_HEADER_LENGTH) {
+        return false;
+    }
+    const uint8_t *bytes = (const uint8_t *)message;
+
+    frame.opcode = bytes[0];
+    frame.sequence = (uint16_t)(bytes[1] | (bytes[2] << 8));
+    frame.speed = -1;
+    frame.payload = bytes + FRAME_HEADER_LENGTH;
+    frame.payloadLength = length - FRAME_HEADER_LENGTH;
+
+    switch (frame.opcode) {
+        case OP_DRIVE:
+            if (length < FRAME_HEADER_LENGTH + 1) {
+                return false;
+            }
+            frame.command = bytes[3];
+            if (length >= FRAME_HEADER_LENGTH + 2) {
+                frame.speed = bytes[4];
+            }
+            return true;
+        case OP_PING:
+        case OP_STATS:
+            return true;
+        case OP_CLOCK_OFFSET:
+            return frame.payloadLength >= CLOCK_TIMESTAMP_LENGTH;
+        case OP_TELEMETRY_MODE:
+        case OP_LEASE:
+            return frame.payloadLength >= 1;
+        case OP_RFID_ADMIN:
+            return frame.payloadLength >= 2 && frame.payloadLength >= 2 + frame.payload[1];
+        case OP_AUTH_RESUME:
+            return frame.payloadLength >= AUTH_TOKEN_LENGTH;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Reads a little-endian 64-bit value from a frame payload.
+ */
+inline uint64_t readUint64(const uint8_t *bytes) {
+    uint64_t value = 0;
+    for (int b = CLOCK_TIMESTAMP_LENGTH - 1; b >= 0; b--) {
+        value = (value << 8) | bytes[b];
+    }
+    return value;
+}
+
+/**
+ * @brief Writes a 64-bit value little-endian into a frame buffer.
+ */
+inline void writeUint64(uint8_t *bytes, uint64_t value) {
+    for (int b = 0; b < CLOCK_TIMESTAMP_LENGTH; b++) {
+        bytes[b] = (uint8_t)(value >> (8 * b));
+    }
+}
@@ -0,0 +1,81 @@
+/**
+ * @file control_queue.h
+ * @brief Lock-free handoff between the network loop and the control task.
+ * @details The network loop pushes validated ControlCommands to the control task, and the
+ * control task pushes ControlEvents back, each through its own SpscRing. Only <atomic> is
+ * used, so the same code runs in tests/test_control_queue.cpp under ThreadSanitizer.
+ */
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @class SpscRing
+ * @brief Lock-free single-producer/single-consumer ring buffer.
+ * @details `push()` must only be called from one task and `pop()` from one other task.
+ * Indices grow monotonically; `N` must be a power of two so wrap-around is a mask.
+ */
+template <typename T, size_t N>
+class SpscRing {
+  static_assert((N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+  /// @return False if the ring is full (the item is not stored).
+  bool push(const T &item) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == N) {
+      return false;
+    }
+    items_[head & (N - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// @return False if the ring is empty.
+  bool pop(T &item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  T items_[N];
+  std::atomic<size_t> head_{0}; ///< Next slot to write (producer owned).
+  std::atomic<size_t> tail_{0}; ///< Next slot to read (consumer owned).
+};
+
+/**
+ * @struct ControlCommand
+ * @brief A validated, authorized drive command handed from the network loop to the control task.
+ */
+struct ControlCommand {
+  uint8_t command;  ///< CMD_* value.
+  int16_t speed;    ///< Motor speed to apply (0-255), or -1 to keep the current speed.
+  uint32_t receivedMicros; ///< micros() when the WebSocket frame reached the handler.
+  uint32_t queuedMicros;   ///< micros() when the command was pushed to the queue.
+};
+
+/**
+ * @enum ControlEventType
+ * @brief Notifications posted by the control task for the network loop to broadcast.
+ */
+enum ControlEventType {
+  EVENT_OBSTACLE_ACTIVE,   ///< Avoidance started (obstacle ahead while moving forward).
+  EVENT_FORWARD_BLOCKED,   ///< A forward command was refused because the path is blocked.
+  EVENT_OBSTACLE_CLEARED   ///< Avoidance maneuver finished.
+};
+
+/**
+ * @struct ControlEvent
+ * @brief Event record carried from the control task back to the network loop.
+ */
+struct ControlEvent {
+  ControlEventType type; ///< What happened.
+  int distance;          ///< Distance (cm) at the time of the event.
+};
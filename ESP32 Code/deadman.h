@@ -0,0 +1,99 @@
+/**
+ * @file deadman.h
+ * @brief The deadman watchdog's tick: when to ramp the motors down, and how.
+ * @details Shared by RC_Car_v2.0.0.ino (deadmanTick(), run by an esp_timer) and the host
+ * test tests/test_deadman.cpp. Plain C++ only: the tick reads and writes the car through
+ * a small hook object (see deadmanStep()), so the same decision runs against the sketch's
+ * globals on the ESP32 and against a simulated car, control task and link on Linux.
+ */
+#pragma once
+
+#include <stdint.h>
+
+// While a movement command is held, the driver's dashboard re-sends it every third of
+// DEADMAN_TIMEOUT_MS (the timeout is part of its LEASE notice). A periodic timer checks
+// how long ago the last driver frame was accepted; past DEADMAN_TIMEOUT_MS it ramps the
+// ENA/ENB duty to zero over DEADMAN_RAMP_STEPS periods, then requests a stop.
+const uint32_t DEADMAN_TIMEOUT_MS = 500;   ///< Moving with no driver frame for this long: ramp down (ms).
+const uint32_t DEADMAN_PERIOD_MS = 20;     ///< Watchdog timer period (ms).
+const int DEADMAN_RAMP_STEPS = 10;         ///< Timer periods from full duty to zero.
+
+/**
+ * @enum DeadmanMotor
+ * @brief The enable pin a duty write is for.
+ */
+enum DeadmanMotor : uint8_t {
+  DEADMAN_MOTOR_A = 0, ///< ENA
+  DEADMAN_MOTOR_B      ///< ENB
+};
+
+/**
+ * @struct DeadmanRamp
+ * @brief State of a ramp-down. Only the tick touches it.
+ */
+struct DeadmanRamp {
+  int step = 0; ///< 0 while armed, else ramp steps taken.
+  int duty = 0; ///< Duty the ramp started from.
+};
+
+/**
+ * @brief One watchdog tick.
+ * @details Idle while the car is not driving (stopped, or the avoidance FSM owns the
+ * motors). Once the driver has been silent for DEADMAN_TIMEOUT_MS, every tick lowers both
+ * duties by one ramp step; the last step requests a stop. A new driver frame re-arms the
+ * watchdog, and the command it carries restores full duty.
+ *
+ * The control task may apply a new frame in the middle of a tick (it runs on the other
+ * core), so the timeout is re-checked right before every write and before the stop
+ * request, and a frame that slips in between gets its duty written back.
+ *
+ * `Car` provides:
+ * - `uint32_t lastFrame()`: millis() the last driver frame was accepted (stored before it is queued);
+ * - `uint32_t now()`: millis(), read after lastFrame() so the frame is never "in the future";
+ * - `bool driving()`: moving under driver control (not stopped, not avoiding an obstacle);
+ * - `int speed()`: the duty the control task applies for a movement command;
+ * - `void writeDuty(DeadmanMotor motor, int duty)` and `void stop()` (request a stop).
+ * @return True if this tick started a ramp-down (a trip).
+ */
+template <typename Car>
+inline bool deadmanStep(DeadmanRamp &ramp, Car &car) {
+  if (!car.driving()) {
+    ramp.step = 0;
+    return false;
+  }
+  uint32_t lastFrame = car.lastFrame();
+  if (car.now() - lastFrame < DEADMAN_TIMEOUT_MS) {
+    ramp.step = 0;
+    return false;
+  }
+
+  bool tripped = ramp.step == 0;
+  if (tripped) {
+    ramp.duty = car.speed();
+  }
+  if (ramp.step < DEADMAN_RAMP_STEPS) {
+    ramp.step++;
+    int duty = ramp.duty * (DEADMAN_RAMP_STEPS - ramp.step) / DEADMAN_RAMP_STEPS;
+    // The timeout still holds: no newer frame, and still driving
+    auto stillExpired = [&]() { return car.lastFrame() == lastFrame && car.driving(); };
+    if (stillExpired()) {
+      car.writeDuty(DEADMAN_MOTOR_A, duty);
+    }
+    if (stillExpired()) {
+      car.writeDuty(DEADMAN_MOTOR_B, duty);
+    }
+    if (!stillExpired()) {
+      // A driver frame (or a stop, or the avoidance FSM) got in first: leave the motors to it
+      ramp.step = 0;
+      if (car.driving()) {
+        car.writeDuty(DEADMAN_MOTOR_A, car.speed()); // What the control task wrote, if it already ran
+        car.writeDuty(DEADMAN_MOTOR_B, car.speed());
+      }
+      return tripped;
+    }
+    if (ramp.step == DEADMAN_RAMP_STEPS) {
+      car.stop();
+    }
+  }
+  return tripped;
+}
@@ -0,0 +1,364 @@
+/**
+ * @file http_server.h
+ * @brief Non-blocking, multi-connection HTTP server for the dashboard page.
+ * @details Shared by RC_Car_v2.0.0.ino and the host load test in tests/test_http_server.cpp,
+ * which runs it against a socket-backed WiFiServer/WiFiClient stand-in (tests/host).
+ * Responses are written with send(MSG_DONTWAIT) on the client's socket instead of
+ * WiFiClient::write(), which on the ESP32 retries for up to ~10 s while the peer's
+ * window is closed.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <lwip/sockets.h>
+
+// =============================================================================
+// HTTP Connection Table
+// =============================================================================
+// The HTTP server is event driven: each loop() iteration accepts new connections and
+// gives every open connection one bounded step of work (read what has arrived, or
+// write what the TCP stack will take without waiting, at most one chunk). Nothing
+// waits on a client, so a slow or malicious client can never stall WebSocket or
+// control processing. Error replies (431, 503) go through the same slots.
+const int HTTP_MAX_CONNECTIONS = 4;                ///< Connections served concurrently.
+const int HTTP_REFUSAL_SLOTS = 2;                  ///< Extra slots that only send "503" to clients beyond HTTP_MAX_CONNECTIONS.
+const int HTTP_CONNECTION_SLOTS = HTTP_MAX_CONNECTIONS + HTTP_REFUSAL_SLOTS; ///< Size of the connection table.
+const size_t HTTP_REQUEST_BUFFER = 768;            ///< Max request line + headers (bytes).
+const size_t HTTP_HEADER_BUFFER = 256;             ///< Max response header block (bytes).
+const size_t HTTP_CHUNK_SIZE = 1460;               ///< Max bytes written per connection per step (one TCP segment).
+const unsigned long HTTP_REQUEST_TIMEOUT = 2000;   ///< A request must fully arrive within this (ms) (anti-slowloris).
+const unsigned long HTTP_WRITE_TIMEOUT = 5000;     ///< Abort a response that makes no progress for this long (ms).
+const unsigned long HTTP_KEEPALIVE_TIMEOUT = 5000; ///< Close idle keep-alive connections after this (ms).
+const uint8_t HTTP_KEEPALIVE_MAX_REQUESTS = 16;    ///< Requests served per connection before closing it.
+
+/**
+ * @enum HttpConnectionState
+ * @brief Per-connection state machine of the HTTP server.
+ */
+enum HttpConnectionState {
+  HTTP_FREE,            ///< Slot unused.
+  HTTP_READING_REQUEST, ///< Accumulating the request line and headers.
+  HTTP_WRITING_HEADERS, ///< Writing the response header block.
+  HTTP_WRITING_BODY,    ///< Streaming the response body from flash.
+  HTTP_KEEPALIVE        ///< Response done; waiting for the next request on the same connection.
+};
+
+/**
+ * @struct HttpConnection
+ * @brief One HTTP connection slot.
+ */
+struct HttpConnection {
+  WiFiClient client;                      ///< The TCP connection.
+  HttpConnectionState state;              ///< Where the connection is in its request/response cycle.
+  unsigned long stateSince;               ///< Timestamp (millis) the current state (or last progress) began.
+  char request[HTTP_REQUEST_BUFFER + 1];  ///< Request bytes received so far (NUL terminated).
+  size_t requestLength;                   ///< Number of bytes in `request`.
+  char headers[HTTP_HEADER_BUFFER];       ///< Response header block.
+  size_t headersLength;                   ///< Length of `headers`.
+  const uint8_t *body;                    ///< Response body (in flash), or NULL.
+  size_t bodyLength;                      ///< Length of `body`.
+  size_t offset;                          ///< Bytes of headers/body already written in the current state.
+  bool keepAlive;                         ///< Keep the connection open after this response.
+  uint8_t requestsServed;                 ///< Requests answered on this connection.
+};
+
+/**
+ * @struct HttpPage
+ * @brief The page served for GET, in both encodings.
+ */
+struct HttpPage {
+  const uint8_t *gzip;  ///< Pre-gzipped page (index_gz.h).
+  size_t gzipLength;    ///< Length of `gzip`.
+  const char *etag;     ///< Quoted ETag of the gzipped page.
+  const char *plain;    ///< Uncompressed page, for clients that do not accept gzip (NUL terminated).
+};
+
+// =============================================================================
+// HTTP Serving Functions
+// =============================================================================
+/**
+ * @brief Case-insensitively finds a header in a NUL-terminated request and returns its value.
+ * @param request Request text (request line + headers).
+ * @param name Header name including the colon, lowercase (e.g. "if-none-match:").
+ * @return Pointer to the start of the value (after spaces), or NULL if absent. The value ends at '\r'.
+ */
+inline const char *findHttpHeader(const char *request, const char *name) {
+  size_t nameLength = strlen(name);
+  const char *line = strstr(request, "\r\n");
+  while (line != NULL) {
+    line += 2;
+    if (strncasecmp(line, name, nameLength) == 0) {
+      const char *value = line + nameLength;
+      while (*value == ' ') {
+        value++;
+      }
+      return value;
+    }
+    line = strstr(line, "\r\n");
+  }
+  return NULL;
+}
+
+/**
+ * @brief Returns true if the header value (terminated by '\r') contains `token`.
+ */
+inline bool httpHeaderContains(const char *value, const char *token) {
+  if (value == NULL) {
+    return false;
+  }
+  const char *end = strchr(value, '\r');
+  const char *found = strstr(value, token);
+  return found != NULL && (end == NULL || found < end);
+}
+
+/**
+ * @brief Closes a connection and frees its slot.
+ */
+inline void closeHttpConnection(HttpConnection &connection) {
+  connection.client.stop();
+  connection.client = WiFiClient(); // Release the connection object
+  connection.state = HTTP_FREE;
+  Serial.println("[HTTP] Client Disconnected");
+}
+
+/**
+ * @brief Queues a bodiless reply that closes the connection once written (431, 503).
+ * @param headers Complete header block, ending in an empty line.
+ */
+inline void queueHttpReply(HttpConnection &connection, const char *headers, unsigned long currentMillis) {
+  connection.headersLength = strlen(headers);
+  if (connection.headersLength > HTTP_HEADER_BUFFER - 1) {
+    connection.headersLength = HTTP_HEADER_BUFFER - 1;
+  }
+  memcpy(connection.headers, headers, connection.headersLength);
+  connection.body = NULL;
+  connection.bodyLength = 0;
+  connection.keepAlive = false;
+  connection.offset = 0;
+  connection.state = HTTP_WRITING_HEADERS;
+  connection.stateSince = currentMillis;
+}
+
+/**
+ * @brief Prepares the response for a complete request held in `connection.request`.
+ * @details `GET` is answered with the gzipped page (`Content-Encoding: gzip`, `ETag`),
+ * or `304 Not Modified` when `If-None-Match` matches the ETag. Clients that do not accept
+ * gzip get the plain page. Other methods get `405 Method Not Allowed`. HTTP/1.1 clients
+ * get keep-alive unless they ask for `Connection: close`.
+ */
+inline void prepareHttpResponse(HttpConnection &connection, const HttpPage &page, unsigned long currentMillis) {
+  const char *request = connection.request;
+  const char *lineEnd = strstr(request, "\r\n");
+  Serial.print("<< [HTTP] Request: ");
+  Serial.write((const uint8_t *)request, lineEnd ? lineEnd - request : strlen(request));
+  Serial.println();
+
+  const char *connectionHeader = findHttpHeader(request, "connection:");
+  bool http11 = lineEnd != NULL && lineEnd - request >= 8 && strncmp(lineEnd - 8, "HTTP/1.1", 8) == 0;
+  connection.keepAlive = http11 && !httpHeaderContains(connectionHeader, "close") &&
+                         connection.requestsServed + 1 < HTTP_KEEPALIVE_MAX_REQUESTS;
+  const char *connectionValue = connection.keepAlive ? "keep-alive" : "close";
+
+  connection.body = NULL;
+  connection.bodyLength = 0;
+
+  // Simple routing: Respond to GET requests for the root path "/"
+  if (strncmp(request, "GET /", 5) != 0) {
+    // Respond with Method Not Allowed for other request types (POST, etc.)
+    connection.headersLength = snprintf(connection.headers, HTTP_HEADER_BUFFER,
+        "HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n", connectionValue);
+  } else {
+    bool acceptsGzip = httpHeaderContains(findHttpHeader(request, "accept-encoding:"), "gzip");
+    bool etagMatches = httpHeaderContains(findHttpHeader(request, "if-none-match:"), page.etag);
+
+    if (acceptsGzip && etagMatches) {
+      // The browser's cached copy is current
+      connection.headersLength = snprintf(connection.headers, HTTP_HEADER_BUFFER,
+          "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nCache-Control: no-cache\r\nConnection: %s\r\n\r\n",
+          page.etag, connectionValue);
+    } else if (acceptsGzip) {
+      connection.body = page.gzip;
+      connection.bodyLength = page.gzipLength;
+      // Cache, but revalidate (cheap 304) on each load
+      connection.headersLength = snprintf(connection.headers, HTTP_HEADER_BUFFER,
+          "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Encoding: gzip\r\nETag: %s\r\n"
+          "Cache-Control: no-cache\r\nContent-Length: %u\r\nConnection: %s\r\n\r\n",
+          page.etag, (unsigned)connection.bodyLength, connectionValue);
+    } else {
+      connection.body = (const uint8_t *)page.plain;
+      connection.bodyLength = strlen(page.plain);
+      connection.headersLength = snprintf(connection.headers, HTTP_HEADER_BUFFER,
+          "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: %u\r\nConnection: %s\r\n\r\n",
+          (unsigned)connection.bodyLength, connectionValue);
+    }
+  }
+
+  connection.headersLength = min(connection.headersLength, HTTP_HEADER_BUFFER - 1);
+  connection.offset = 0;
+  connection.state = HTTP_WRITING_HEADERS;
+  connection.stateSince = currentMillis;
+}
+
+/**
+ * @brief Writes as much of `data` from `connection.offset` as the TCP stack takes right now,
+ * at most `HTTP_CHUNK_SIZE` bytes.
+ * @details Uses send(MSG_DONTWAIT) on the socket: a full send buffer (a slow or stalled
+ * reader) writes nothing this step instead of blocking loop().
+ * @return 1 once all `length` bytes have been written, 0 if more remain, -1 if the connection failed.
+ */
+inline int writeHttpChunk(HttpConnection &connection, const uint8_t *data, size_t length, unsigned long currentMillis) {
+  size_t remaining = length - connection.offset;
+  if (remaining == 0) {
+    return 1;
+  }
+  int written = send(connection.client.fd(), data + connection.offset, min(remaining, HTTP_CHUNK_SIZE), MSG_DONTWAIT);
+  if (written < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+  }
+  if (written > 0) {
+    connection.offset += written;
+    connection.stateSince = currentMillis; // Progress resets the write timeout
+  }
+  return connection.offset >= length ? 1 : 0;
+}
+
+/**
+ * @brief Gives one connection a single bounded step of work.
+ * @details Reads whatever request bytes are available (never waits), or writes what the
+ * TCP stack accepts of the response, and enforces the per-state timeouts.
+ */
+inline void serviceHttpConnection(HttpConnection &connection, const HttpPage &page, unsigned long currentMillis) {
+  if (!connection.client.connected() && connection.client.available() == 0) {
+    closeHttpConnection(connection);
+    return;
+  }
+
+  unsigned long elapsed = currentMillis - connection.stateSince;
+  int written;
+
+  switch (connection.state) {
+    case HTTP_KEEPALIVE:
+      if (connection.client.available() == 0) {
+        if (elapsed > HTTP_KEEPALIVE_TIMEOUT) {
+          closeHttpConnection(connection);
+        }
+        return;
+      }
+      // The next request has started arriving
+      connection.state = HTTP_READING_REQUEST;
+      connection.stateSince = currentMillis;
+      connection.requestLength = 0;
+      // fall through
+
+    case HTTP_READING_REQUEST: {
+      int available = connection.client.available();
+      if (available > 0) {
+        size_t room = HTTP_REQUEST_BUFFER - connection.requestLength;
+        int received = connection.client.read((uint8_t *)connection.request + connection.requestLength,
+                                              min((size_t)available, room));
+        if (received > 0) {
+          connection.requestLength += received;
+        }
+        connection.request[connection.requestLength] = '\0';
+      }
+
+      if (strstr(connection.request, "\r\n\r\n") != NULL) {
+        prepareHttpResponse(connection, page, currentMillis);
+      } else if (connection.requestLength >= HTTP_REQUEST_BUFFER) {
+        Serial.println("[HTTP] Request too large");
+        queueHttpReply(connection, "HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\n\r\n",
+                       currentMillis);
+      } else if (currentMillis - connection.stateSince > HTTP_REQUEST_TIMEOUT) {
+        Serial.println("[HTTP] Request timed out");
+        closeHttpConnection(connection);
+      }
+      break;
+    }
+
+    case HTTP_WRITING_HEADERS:
+      written = writeHttpChunk(connection, (const uint8_t *)connection.headers, connection.headersLength, currentMillis);
+      if (written > 0) {
+        connection.state = HTTP_WRITING_BODY;
+        connection.offset = 0;
+      } else if (written < 0 || elapsed > HTTP_WRITE_TIMEOUT) {
+        Serial.println("[HTTP] Write failed or timed out");
+        closeHttpConnection(connection);
+      }
+      break;
+
+    case HTTP_WRITING_BODY:
+      written = connection.body == NULL ? 1 : writeHttpChunk(connection, connection.body, connection.bodyLength, currentMillis);
+      if (written > 0) {
+        connection.requestsServed++;
+        if (connection.keepAlive) {
+          connection.state = HTTP_KEEPALIVE;
+          connection.stateSince = currentMillis;
+        } else {
+          closeHttpConnection(connection);
+        }
+      } else if (written < 0 || elapsed > HTTP_WRITE_TIMEOUT) {
+        Serial.println("[HTTP] Write failed or timed out");
+        closeHttpConnection(connection);
+      }
+      break;
+
+    case HTTP_FREE:
+      break;
+  }
+}
+
+/**
+ * @brief Returns a free slot in `connections[first, last)`, or NULL.
+ */
+inline HttpConnection *findFreeHttpSlot(HttpConnection *connections, int first, int last) {
+  for (int i = first; i < last; i++) {
+    if (connections[i].state == HTTP_FREE) {
+      return &connections[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Accepts new HTTP connections and advances every open one by one step.
+ * @details Called once per loop() iteration with the HTTP_CONNECTION_SLOTS entry table.
+ * A new connection is placed in a free serving slot. If all HTTP_MAX_CONNECTIONS are
+ * busy it takes a refusal slot and gets a queued 503; if those are busy too it is
+ * closed at once. Then each slot gets `serviceHttpConnection`.
+ */
+inline void serviceHttpServer(WiFiServer &server, HttpConnection *connections, const HttpPage &page,
+                              unsigned long currentMillis) {
+  WiFiClient newClient = server.available(); // Check for incoming HTTP clients
+  if (newClient) {
+    HttpConnection *slot = findFreeHttpSlot(connections, 0, HTTP_MAX_CONNECTIONS);
+    if (slot != NULL) {
+      Serial.println("[HTTP] New Client Connection");
+      newClient.setNoDelay(true);
+      slot->client = newClient;
+      slot->state = HTTP_READING_REQUEST;
+      slot->stateSince = currentMillis;
+      slot->requestLength = 0;
+      slot->request[0] = '\0';
+      slot->requestsServed = 0;
+    } else if ((slot = findFreeHttpSlot(connections, HTTP_MAX_CONNECTIONS, HTTP_CONNECTION_SLOTS)) != NULL) {
+      Serial.println("[HTTP] Connection table full, refusing client");
+      slot->client = newClient;
+      slot->requestsServed = 0;
+      queueHttpReply(*slot, "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nConnection: close\r\n\r\n",
+                     currentMillis);
+    } else {
+      Serial.println("[HTTP] Connection table full, dropping client");
+      newClient.stop();
+    }
+  }
+
+  for (int i = 0; i < HTTP_CONNECTION_SLOTS; i++) {
+    if (connections[i].state != HTTP_FREE) {
+      serviceHttpConnection(connections[i], page, currentMillis);
+    }
+  }
+}
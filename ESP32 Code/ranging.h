@@ -0,0 +1,154 @@
+/**
+ * @file ranging.h
+ * @brief HC-SR04 timing, echo pulse conversion and the range / time-to-collision filter.
+ * @details Shared by RC_Car_v2.0.0.ino (echoISR and the control task) and the host tests
+ * tests/test_echo_timing.cpp and tests/test_range_filter.cpp. Plain C++ only, so it builds
+ * on the ESP32 and on Linux.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+// The HC-SR04 holds ECHO high for ~38 ms when nothing returns, so a 40 ms cycle (25 Hz)
+// is the fastest rate that cannot pick up the previous pulse's echo.
+const unsigned long ULTRASONIC_INTERVAL = 40; ///< Minimum interval (ms) between ultrasonic measurements to avoid echo interference.
+const unsigned long ULTRASONIC_ECHO_TIMEOUT = 30; ///< Time (ms) after a trigger before a missing echo is treated as a timeout (> 400 cm).
+const int ULTRASONIC_MAX_DISTANCE = 400; ///< Readings at or beyond this (cm) are not plausible for the HC-SR04.
+
+/**
+ * @brief Converts an echo pulse width into a distance.
+ * @details Distance (cm) = duration (us) * 0.0343 (cm/us) / 2, in integer math so it is
+ * safe in an ISR.
+ * @return Distance in cm, or -1 if it is outside the plausible range (0-400 cm).
+ */
+inline int echoDistanceCm(uint32_t durationMicros) {
+  int distance = (int)(durationMicros * 343UL / 20000UL);
+  return (distance > 0 && distance < ULTRASONIC_MAX_DISTANCE) ? distance : -1;
+}
+
+// =============================================================================
+// Ultrasonic Filtering & Time-To-Collision
+// =============================================================================
+// Raw readings pass through a streaming median (rejects single bad echoes), then an
+// alpha-beta filter (a steady-state Kalman filter for constant velocity) that tracks
+// distance and its rate of change. Time-to-collision = distance / closing speed.
+const int RANGE_MEDIAN_WINDOW = 5;          ///< Samples in the streaming median (odd).
+const float RANGE_FILTER_ALPHA = 0.5f;      ///< Alpha-beta filter position gain.
+const float RANGE_FILTER_BETA = 0.1f;       ///< Alpha-beta filter velocity gain.
+const int RANGE_OUTLIER_GATE = 80;          ///< Median outputs further than this (cm) from the prediction are rejected...
+const int RANGE_OUTLIER_CONFIRM = 3;        ///< ...unless this many in a row agree, in which case the filter re-seeds.
+const int MIN_CLOSING_SPEED = 5;            ///< Closing speeds (cm/s) below this are treated as "not closing" (no TTC).
+const int STOP_DISTANCE = 25; ///< Hard floor (cm): avoidance triggers and forward motion is blocked at or below this distance regardless of TTC.
+const unsigned long TTC_THRESHOLD = 1000; ///< Avoidance triggers when the predicted time-to-collision (ms) drops below this.
+
+/**
+ * @struct RangeFilter
+ * @brief State of the ultrasonic median + alpha-beta filter. Owned by the control task.
+ */
+struct RangeFilter {
+  int window[RANGE_MEDIAN_WINDOW]; ///< Ring of the most recent raw readings (cm).
+  uint8_t count;                   ///< Number of valid samples in `window`.
+  uint8_t next;                    ///< Next slot to overwrite in `window`.
+  float distance;                  ///< Filtered distance estimate (cm).
+  float velocity;                  ///< Filtered rate of change of distance (cm/s, negative = approaching).
+  unsigned long lastUpdate;        ///< Timestamp (millis) of the last sample folded in.
+  bool initialized;                ///< False until the first sample seeds the estimate.
+  uint8_t outlierRun;              ///< Consecutive samples rejected by the outlier gate.
+};
+
+/**
+ * @struct RangeEstimate
+ * @brief What the filter publishes after each accepted sample.
+ */
+struct RangeEstimate {
+  int distance;          ///< Filtered distance (cm).
+  int closingSpeed;      ///< Speed (cm/s) at which the obstacle approaches (negative = receding).
+  long timeToCollision;  ///< Predicted time-to-collision (ms), or -1 if not closing.
+};
+
+/**
+ * @brief Returns the median of the samples currently held in the filter window.
+ */
+inline int rangeWindowMedian(const RangeFilter &filter) {
+  int sorted[RANGE_MEDIAN_WINDOW];
+  uint8_t n = filter.count;
+  for (uint8_t i = 0; i < n; i++) {
+    // Insertion sort; the window is tiny
+    int value = filter.window[i];
+    int j = i;
+    while (j > 0 && sorted[j - 1] > value) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = value;
+  }
+  return sorted[n / 2];
+}
+
+/**
+ * @brief Folds one raw reading into the range filter.
+ * @param filter Filter state, updated in place.
+ * @param rawDistance Raw distance (cm) from `echoISR`.
+ * @param timestamp millis() at which the reading was taken.
+ * @param estimate Receives distance, closing speed and TTC when the sample is accepted.
+ * @return False if the outlier gate rejected the sample (`estimate` is left untouched).
+ */
+inline bool rangeFilterUpdate(RangeFilter &filter, int rawDistance, unsigned long timestamp,
+                              RangeEstimate &estimate) {
+  filter.window[filter.next] = rawDistance;
+  filter.next = (filter.next + 1) % RANGE_MEDIAN_WINDOW;
+  if (filter.count < RANGE_MEDIAN_WINDOW) {
+    filter.count++;
+  }
+  float measured = rangeWindowMedian(filter);
+
+  if (!filter.initialized) {
+    filter.distance = measured;
+    filter.velocity = 0;
+    filter.lastUpdate = timestamp;
+    filter.initialized = true;
+  } else {
+    float dt = (timestamp - filter.lastUpdate) / 1000.0f;
+    if (dt <= 0) {
+      dt = ULTRASONIC_INTERVAL / 1000.0f;
+    }
+
+    // Predict, then correct with the residual
+    float predicted = filter.distance + filter.velocity * dt;
+    float residual = measured - predicted;
+
+    if (fabsf(residual) > RANGE_OUTLIER_GATE && ++filter.outlierRun < RANGE_OUTLIER_CONFIRM) {
+      return false; // Implausible jump; wait to see if it persists
+    }
+
+    if (filter.outlierRun >= RANGE_OUTLIER_CONFIRM) {
+      // The scene really changed (e.g. something stepped in front): re-seed
+      filter.distance = measured;
+      filter.velocity = 0;
+    } else {
+      filter.distance = predicted + RANGE_FILTER_ALPHA * residual;
+      filter.velocity += (RANGE_FILTER_BETA / dt) * residual;
+    }
+    filter.outlierRun = 0;
+    filter.lastUpdate = timestamp;
+  }
+
+  estimate.distance = (int)(filter.distance + 0.5f);
+  estimate.closingSpeed = (int)(-filter.velocity);
+  if (estimate.closingSpeed >= MIN_CLOSING_SPEED && filter.distance > 0) {
+    estimate.timeToCollision = (long)(filter.distance * 1000.0f / estimate.closingSpeed);
+  } else {
+    estimate.timeToCollision = -1;
+  }
+  return true;
+}
+
+/**
+ * @brief True when the car must not keep driving forward: the predicted time-to-collision
+ * is below TTC_THRESHOLD, or the obstacle is already within the STOP_DISTANCE hard floor.
+ */
+inline bool rangeCollisionImminent(const RangeEstimate &estimate) {
+  return (estimate.timeToCollision >= 0 && estimate.timeToCollision < (long)TTC_THRESHOLD) ||
+         estimate.distance <= STOP_DISTANCE;
+}
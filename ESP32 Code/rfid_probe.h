@@ -0,0 +1,82 @@
+/**
+ * @file rfid_probe.h
+ * @brief The RFID task's card presence probe and its adaptive cadence.
+ * @details Shared by RC_Car_v2.0.0.ino (rfidTask) and the host test tests/test_rfid_probe.cpp,
+ * which runs it against an MFRC522 stand-in (tests/host) that counts SPI register accesses.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <MFRC522.h>
+#include "card_store.h"
+
+// The MFRC522 is owned by a low-priority task on the control core; the Arduino loop
+// never touches SPI. PICC_IsNewCardPresent() with no card in the field busy-polls
+// ComIrqReg over SPI until the reader's 25 ms timeout, so calling it every loop pass
+// kept the bus busy and stalled WebSocket servicing by ~25 ms per iteration.
+//
+// Instead the task sends a bare REQA and sleeps RFID_PROBE_WAIT_MS, then reads
+// ComIrqReg once: a card in the field has answered (RxIRq) by then. Only then is the
+// UID read (anticollision + select), the card halted, and its UID posted to the loop,
+// which does the lookup and broadcasts the result (see checkRFID()). The probe cadence
+// adapts: RFID_POLL_FAST_MS for RFID_FAST_WINDOW after a card or a wakeRfidTask()
+// (e.g. a command rejected for missing authorization), RFID_POLL_IDLE_MS otherwise.
+//
+// The reader's IRQ pin cannot replace the probes: the MFRC522 only raises it for
+// frames it receives, and a card never transmits without a REQA, so it is not used.
+const uint32_t RFID_POLL_FAST_MS = 50;        ///< Probe period right after activity.
+const uint32_t RFID_POLL_IDLE_MS = 300;       ///< Probe period when idle (worst-case detection delay).
+const unsigned long RFID_FAST_WINDOW = 10000; ///< How long activity keeps the fast cadence (ms).
+const uint32_t RFID_PROBE_WAIT_MS = 2;        ///< REQA to ATQA takes ~0.3 ms; read the IRQ flags after this.
+const uint8_t RFID_RX_IRQ = 0x20;             ///< ComIrqReg RxIRq: the REQA was answered.
+
+/**
+ * @struct RfidEvent
+ * @brief UID of a card read by the RFID task, for the network loop to authorize.
+ */
+struct RfidEvent {
+  uint8_t uidLength;         ///< 4, 7 or 10.
+  uint8_t uid[RFID_UID_MAX]; ///< UID bytes.
+};
+
+/**
+ * @brief Starts a card presence probe: sends a REQA and returns without waiting.
+ * @details A card in the field answers with its ATQA, which sets RxIRq in ComIrqReg.
+ * Six register writes. Called from the RFID task only.
+ */
+inline void startCardProbe(MFRC522 &reader) {
+    reader.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Idle);
+    reader.PCD_WriteRegister(MFRC522::ComIrqReg, 0x7F);    // Clear all interrupt flags
+    reader.PCD_WriteRegister(MFRC522::FIFOLevelReg, 0x80); // Flush the FIFO
+    reader.PCD_WriteRegister(MFRC522::FIFODataReg, MFRC522::PICC_CMD_REQA);
+    reader.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Transceive);
+    reader.PCD_WriteRegister(MFRC522::BitFramingReg, 0x87); // StartSend, short frame (7 bits)
+}
+
+/**
+ * @brief Finishes a probe started RFID_PROBE_WAIT_MS ago: one ComIrqReg read, and the
+ * UID only if a card answered.
+ * @details A card answering the probe is left in the READY state, so the UID is read
+ * with PICC_ReadCardSerial() directly. The card is then halted and does not answer
+ * again until it has left the field, as with PICC_IsNewCardPresent().
+ * @return True if a card was read into `event`.
+ */
+inline bool finishCardProbe(MFRC522 &reader, RfidEvent &event) {
+    if (!(reader.PCD_ReadRegister(MFRC522::ComIrqReg) & RFID_RX_IRQ) || !reader.PICC_ReadCardSerial()) {
+        return false;
+    }
+    event.uidLength = min((uint8_t)reader.uid.size, RFID_UID_MAX);
+    memcpy(event.uid, reader.uid.uidByte, event.uidLength);
+    reader.PICC_HaltA();      // Halt communication with the current PICC (RFID tag/card)
+    reader.PCD_StopCrypto1(); // Stop encryption (relevant for Mifare Classic)
+    return true;
+}
+
+/**
+ * @brief The wait before the next probe (ms).
+ * @param now millis() now.
+ * @param lastActivity millis() of the last card read or wakeRfidTask().
+ */
+inline uint32_t rfidProbePeriod(unsigned long now, unsigned long lastActivity) {
+    return (now - lastActivity < RFID_FAST_WINDOW) ? RFID_POLL_FAST_MS : RFID_POLL_IDLE_MS;
+}
@@ -0,0 +1,210 @@
+/**
+ * @file telemetry_encoder.h
+ * @brief Telemetry field table and the JSON / binary encoders that write into caller-owned buffers.
+ * @details Shared by RC_Car_v2.0.0.ino (sendTelemetryData) and the host benchmark in
+ * tests/test_telemetry_encoder.cpp. Depends on the C library and command_frame.h only.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "command_frame.h"
+
+/**
+ * @enum TelemetryLevel
+ * @brief Subscription levels a client can negotiate with OP_TELEMETRY_MODE.
+ */
+enum TelemetryLevel : uint8_t {
+  TELEMETRY_LEVEL_SAFETY = 0, ///< Authorization, distance, TTC and avoidance state only.
+  TELEMETRY_LEVEL_FULL = 1,   ///< Everything the dashboard displays (default).
+  TELEMETRY_LEVEL_DEBUG = 2   ///< All fields, including sensor diagnostics.
+};
+
+// =============================================================================
+// Telemetry Encoding
+// =============================================================================
+// Telemetry is a fixed list of fields. Each tick, clients that negotiated deltas get
+// only the fields that changed since the previous tick (within their subscription
+// level), plus a full keyframe every TELEMETRY_KEYFRAME_INTERVAL ticks.
+//
+// Binary form (OP_TELEMETRY, little-endian):
+//   [0] opcode  [1-2] sequence  [3-4] field mask (bit n = field n, bit 15 = keyframe,
+//   bit 14 = timestamped)  then, if timestamped, the capture time as int64 us in the
+//   client's clock, then each field present in the mask, in field order,
+//   TELEMETRY_FIELD_BYTES[n] wide. Values of -1 ("none") appear as all ones in unsigned fields.
+// The JSON form carries the same timestamp as "t". Only clients that sent OP_CLOCK_OFFSET
+// get timestamps, since the device clock means nothing to the others.
+
+/**
+ * @enum TelemetryField
+ * @brief Telemetry fields, in wire order. Bit n of a field mask refers to field n.
+ */
+enum TelemetryField {
+  TF_RSSI,               ///< WiFi signal strength (dBm), int8.
+  TF_AUTHORIZED,         ///< Current authorization status, bool.
+  TF_DISTANCE,           ///< Filtered ultrasonic distance (cm), uint16.
+  TF_DISTANCE_AGE,       ///< Age (ms) of the newest reading, uint16, -1 if none yet.
+  TF_CLOSING_SPEED,      ///< Obstacle approach speed (cm/s), int16.
+  TF_TTC,                ///< Predicted time-to-collision (ms), uint16, -1 if not closing.
+  TF_OBSTACLE_AVOIDANCE, ///< Is obstacle avoidance currently active? bool.
+  TF_CURRENT_COMMAND,    ///< Last command applied by the control task, uint8.
+  TF_AVOIDANCE_STATE,    ///< Current state of the avoidance FSM, uint8.
+  TELEMETRY_FIELD_COUNT
+};
+
+/// JSON key of each field (matches the original telemetry JSON).
+const char *const TELEMETRY_FIELD_NAMES[TELEMETRY_FIELD_COUNT] = {
+  "rssi", "authorized", "distance", "distanceAge", "closingSpeed", "ttc",
+  "obstacleAvoidance", "currentCommand", "avoidanceState"
+};
+/// Width in bytes of each field in the binary form.
+const uint8_t TELEMETRY_FIELD_BYTES[TELEMETRY_FIELD_COUNT] = { 1, 1, 2, 2, 2, 2, 1, 1, 1 };
+
+#define TF_BIT(field) (1u << (field))
+const uint16_t TELEMETRY_BOOL_FIELDS = TF_BIT(TF_AUTHORIZED) | TF_BIT(TF_OBSTACLE_AVOIDANCE);
+const uint16_t TELEMETRY_KEYFRAME_BIT = 0x8000; ///< Set in the binary field mask for keyframes.
+const uint16_t TELEMETRY_TIMESTAMP_BIT = 0x4000; ///< Set in the binary field mask when a timestamp follows it.
+const int TELEMETRY_TIMESTAMP_OFFSET = 5;       ///< Byte offset of the timestamp in a binary record.
+
+/// Field mask for each TelemetryLevel.
+const uint16_t TELEMETRY_LEVEL_MASKS[] = {
+  // SAFETY
+  TF_BIT(TF_AUTHORIZED) | TF_BIT(TF_DISTANCE) | TF_BIT(TF_TTC) |
+  TF_BIT(TF_OBSTACLE_AVOIDANCE) | TF_BIT(TF_AVOIDANCE_STATE),
+  // FULL
+  TF_BIT(TF_RSSI) | TF_BIT(TF_AUTHORIZED) | TF_BIT(TF_DISTANCE) | TF_BIT(TF_CLOSING_SPEED) |
+  TF_BIT(TF_TTC) | TF_BIT(TF_OBSTACLE_AVOIDANCE) | TF_BIT(TF_CURRENT_COMMAND) | TF_BIT(TF_AVOIDANCE_STATE),
+  // DEBUG
+  TF_BIT(TELEMETRY_FIELD_COUNT) - 1
+};
+
+const uint8_t TELEMETRY_KEYFRAME_INTERVAL = 10; ///< Ticks between full keyframes (1 s at 10 Hz).
+
+/**
+ * @struct TelemetrySnapshot
+ * @brief Values sampled once per telemetry tick and shared by every encoder, indexed by TelemetryField.
+ */
+struct TelemetrySnapshot {
+  long values[TELEMETRY_FIELD_COUNT];
+  int64_t captureTime; ///< esp_timer_get_time() when the values were sampled.
+};
+
+const size_t TELEMETRY_TEXT_SIZE = 256; ///< Capacity of the reused JSON telemetry buffer.
+const size_t TELEMETRY_BINARY_SIZE = 5 + CLOCK_TIMESTAMP_LENGTH + 2 * TELEMETRY_FIELD_COUNT; ///< Upper bound of a binary record.
+
+/**
+ * @brief Returns the mask of fields whose value differs between two snapshots.
+ */
+inline uint16_t changedTelemetryFields(const TelemetrySnapshot &current, const TelemetrySnapshot &previous) {
+    uint16_t mask = 0;
+    for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+        if (current.values[field] != previous.values[field]) {
+            mask |= TF_BIT(field);
+        }
+    }
+    return mask;
+}
+
+/**
+ * @brief Appends a string to `text` at `length`, truncating at TELEMETRY_TEXT_SIZE - 1.
+ * @return The new length. `text` is kept NUL-terminated.
+ */
+inline int appendTelemetryText(char *text, int length, const char *value) {
+    while (*value && length < (int)TELEMETRY_TEXT_SIZE - 1) {
+        text[length++] = *value++;
+    }
+    text[length] = '\0';
+    return length;
+}
+
+/**
+ * @brief Appends a decimal integer to `text` at `length` (same truncation as appendTelemetryText).
+ * @details Hand-rolled instead of snprintf("%ld"), which dominated the encoding time.
+ */
+inline int appendTelemetryInteger(char *text, int length, long long value) {
+    char digits[21];
+    int n = sizeof(digits) - 1;
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    digits[n] = '\0';
+    do {
+        digits[--n] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) {
+        digits[--n] = '-';
+    }
+    return appendTelemetryText(text, length, digits + n);
+}
+
+/**
+ * @brief Formats the fields in `mask` as "TELEMETRY:{..." into `text` (TELEMETRY_TEXT_SIZE bytes).
+ * @details Adds "seq" and, for keyframes, "key":true so delta clients can reset their state.
+ * The object is left open; `finishTelemetryJson` closes it per client.
+ * @return Length of the message, without the terminating NUL.
+ */
+inline int encodeTelemetryJson(char *text, uint16_t sequence, const TelemetrySnapshot &snapshot,
+                               uint16_t mask, bool keyframe) {
+    int length = appendTelemetryText(text, 0, "TELEMETRY:{\"seq\":");
+    length = appendTelemetryInteger(text, length, sequence);
+    if (keyframe) {
+        length = appendTelemetryText(text, length, ",\"key\":true");
+    }
+    for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+        if (!(mask & TF_BIT(field))) {
+            continue;
+        }
+        length = appendTelemetryText(text, length, ",\"");
+        length = appendTelemetryText(text, length, TELEMETRY_FIELD_NAMES[field]);
+        length = appendTelemetryText(text, length, "\":");
+        if (TELEMETRY_BOOL_FIELDS & TF_BIT(field)) {
+            length = appendTelemetryText(text, length, snapshot.values[field] ? "true" : "false");
+        } else {
+            length = appendTelemetryInteger(text, length, snapshot.values[field]);
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief Appends the client's timestamp (if it has one) and the closing brace to the
+ * open object left in `text` by `encodeTelemetryJson`.
+ * @param length Length returned by `encodeTelemetryJson`.
+ * @param timestamped True if the client's clock is synced.
+ * @param clientTime Capture time in the client's clock (us), used if `timestamped`.
+ * @return Length of the complete message.
+ */
+inline int finishTelemetryJson(char *text, int length, bool timestamped, int64_t clientTime) {
+    if (timestamped) {
+        length = appendTelemetryText(text, length, ",\"t\":");
+        length = appendTelemetryInteger(text, length, clientTime);
+    }
+    return appendTelemetryText(text, length, "}");
+}
+
+/**
+ * @brief Writes the fields in `mask` as an OP_TELEMETRY record into `record` (TELEMETRY_BINARY_SIZE bytes).
+ * @param timestamped Reserve room for the capture timestamp, which the caller fills in per client.
+ * @return Length of the record in bytes.
+ */
+inline int encodeTelemetryBinary(uint8_t *record, uint16_t sequence, const TelemetrySnapshot &snapshot,
+                                 uint16_t mask, bool keyframe, bool timestamped) {
+    uint16_t wireMask = mask | (keyframe ? TELEMETRY_KEYFRAME_BIT : 0) | (timestamped ? TELEMETRY_TIMESTAMP_BIT : 0);
+    int length = 0;
+    record[length++] = OP_TELEMETRY;
+    record[length++] = sequence & 0xFF;
+    record[length++] = sequence >> 8;
+    record[length++] = wireMask & 0xFF;
+    record[length++] = wireMask >> 8;
+    if (timestamped) {
+        length += CLOCK_TIMESTAMP_LENGTH; // Filled in per client by the caller
+    }
+    for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+        if (!(mask & TF_BIT(field))) {
+            continue;
+        }
+        uint32_t value = (uint32_t)snapshot.values[field];
+        for (uint8_t b = 0; b < TELEMETRY_FIELD_BYTES[field]; b++) {
+            record[length++] = (uint8_t)(value >> (8 * b));
+        }
+    }
+    return length;
+}
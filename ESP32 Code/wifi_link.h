@@ -0,0 +1,124 @@
+/**
+ * @file wifi_link.h
+ * @brief The WiFi reconnect state machine: connect timeout, exponential backoff and jitter.
+ * @details Shared by RC_Car_v2.0.0.ino (checkWiFiConnection()) and the link-flap harness
+ * tests/test_wifi_link.cpp. Plain C++ only: the sketch passes in the time, the link state
+ * and a random number, and performs the action stepWiFiLink() returns (stopping the car,
+ * WiFi.begin(), logging), so the decisions run unchanged on Linux.
+ */
+#pragma once
+
+#include <stdint.h>
+
+// The machine never waits: an attempt is started (WiFi.begin()) and its outcome is
+// looked at on later passes. Failed attempts are retried with exponential backoff and
+// jitter, so several cars losing the same access point do not retry in lockstep.
+const unsigned long WIFI_CONNECT_TIMEOUT = 10000; ///< An attempt without an IP after this long has failed (ms).
+const unsigned long WIFI_BACKOFF_MIN = 500;       ///< Delay before the first retry (ms, +/-25%).
+const unsigned long WIFI_BACKOFF_MAX = 30000;     ///< Upper bound of the retry delay (ms).
+
+/**
+ * @enum WiFiLinkState
+ * @brief States of the reconnect state machine.
+ */
+enum WiFiLinkState : uint8_t {
+  WIFI_LINK_UP = 0,     ///< Associated and holding an IP address.
+  WIFI_LINK_LOST,       ///< Link just dropped; the loop has not reacted yet.
+  WIFI_LINK_CONNECTING, ///< An attempt is in progress.
+  WIFI_LINK_BACKOFF     ///< Waiting before the next attempt.
+};
+
+/**
+ * @enum WiFiLinkAction
+ * @brief What the caller must do after a stepWiFiLink().
+ */
+enum WiFiLinkAction : uint8_t {
+  WIFI_ACTION_NONE = 0,     ///< Nothing.
+  WIFI_ACTION_LOST,         ///< The link dropped: stop the car, free the lease, then start an attempt.
+  WIFI_ACTION_ATTEMPT,      ///< Start an attempt (the backoff has run out).
+  WIFI_ACTION_RECONNECTED,  ///< An attempt succeeded; lastOutage is set.
+  WIFI_ACTION_FAILED        ///< An attempt timed out; the next one starts after `backoff` (jittered).
+};
+
+/**
+ * @struct WiFiLink
+ * @brief State of the reconnect state machine. Owned by the network loop.
+ */
+struct WiFiLink {
+  WiFiLinkState state = WIFI_LINK_LOST;
+  unsigned long stateSince = 0;             ///< millis() the current state was entered.
+  unsigned long backoff = WIFI_BACKOFF_MIN; ///< Delay before the next retry (ms), jittered once an attempt fails.
+  uint32_t attempts = 0;                    ///< Connection attempts since boot.
+  unsigned long lastOutage = 0;             ///< Duration of the last completed outage (ms).
+  unsigned long outageStart = 0;            ///< millis() the current or last outage began.
+};
+
+/**
+ * @brief Marks the link as up (the boot-time connect in setup() succeeded).
+ */
+inline void wifiLinkUp(WiFiLink &link, unsigned long now) {
+  link.state = WIFI_LINK_UP;
+  link.stateSince = now;
+}
+
+/**
+ * @brief Advances the reconnect state machine by one pass. Never blocks.
+ * @details A lost link starts an attempt at once. An attempt without an IP address after
+ * WIFI_CONNECT_TIMEOUT fails, and the next one starts after the current backoff with
+ * +/-25% jitter; the backoff then doubles up to WIFI_BACKOFF_MAX. Success resets it.
+ * The first retry is jittered too: cars that lost the same access point time out
+ * together, and would otherwise all retry WIFI_BACKOFF_MIN later.
+ * WIFI_ACTION_LOST and WIFI_ACTION_ATTEMPT have already counted the attempt and entered
+ * WIFI_LINK_CONNECTING.
+ * @param now millis() now.
+ * @param connected Whether the link is associated and holds an IP address.
+ * @param random A random number for the jitter (esp_random() on the car).
+ */
+inline WiFiLinkAction stepWiFiLink(WiFiLink &link, unsigned long now, bool connected, uint32_t random) {
+  switch (link.state) {
+    case WIFI_LINK_UP:
+      if (!connected) {
+        link.state = WIFI_LINK_LOST;
+        link.stateSince = now;
+      }
+      return WIFI_ACTION_NONE;
+
+    case WIFI_LINK_LOST:
+      link.outageStart = now;
+      link.backoff = WIFI_BACKOFF_MIN;
+      link.attempts++;
+      link.state = WIFI_LINK_CONNECTING;
+      link.stateSince = now;
+      return WIFI_ACTION_LOST;
+
+    case WIFI_LINK_CONNECTING:
+      if (connected) {
+        link.lastOutage = now - link.outageStart;
+        link.backoff = WIFI_BACKOFF_MIN;
+        link.state = WIFI_LINK_UP;
+        link.stateSince = now;
+        return WIFI_ACTION_RECONNECTED;
+      }
+      if (now - link.stateSince >= WIFI_CONNECT_TIMEOUT) {
+        unsigned long wait = link.backoff - link.backoff / 4 + random % (link.backoff / 2 + 1);
+        link.backoff = wait > WIFI_BACKOFF_MAX ? WIFI_BACKOFF_MAX : wait;
+        link.state = WIFI_LINK_BACKOFF;
+        link.stateSince = now;
+        return WIFI_ACTION_FAILED;
+      }
+      return WIFI_ACTION_NONE;
+
+    case WIFI_LINK_BACKOFF:
+      if (connected) {
+        link.state = WIFI_LINK_CONNECTING; // Associated late; accounted for on the next pass
+      } else if (now - link.stateSince >= link.backoff) {
+        link.backoff = link.backoff * 2 > WIFI_BACKOFF_MAX ? WIFI_BACKOFF_MAX : link.backoff * 2;
+        link.attempts++;
+        link.state = WIFI_LINK_CONNECTING;
+        link.stateSince = now;
+        return WIFI_ACTION_ATTEMPT;
+      }
+      return WIFI_ACTION_NONE;
+  }
+  return WIFI_ACTION_NONE;
+}
@@ -0,0 +1,323 @@
+#!/usr/bin/env python3
+"""
+WebSocket load test for the car (port 81) and camera (port 82) sketches.
+
+Opens one driver connection and N spectator connections. The driver sends
+a STOP drive frame and a timed ping ten times a second, like the dashboard
+does while a key is held. Every spectator floods pings at --rate. The
+report shows the driver's ping round-trip time next to what the spectators
+got through, so you can check that a chatty spectator does not starve the
+driver (spectator messages over the firmware's budget are dropped).
+
+With --drive-spam the spectators also send drive frames, which the car must
+reject without parsing them because the driver holds the driving lease.
+Only a client with an RFID session can hold the lease. Pass --token with the
+hex session token from the dashboard's "RFID:" notice (sessionStorage key
+rcSessionToken). The driver then resumes that session with OP_AUTH_RESUME,
+which takes it away from the dashboard, and requests the lease with OP_LEASE.
+Without a token nobody holds the lease: the driver's STOPs still reach the
+car, but spectator drive frames are not rejected.
+Against the car, --benchmark resets the firmware's latency histograms at
+the start and prints them at the end (driver command parse/auth/queue/
+actuate/total in microseconds), so runs with 0 and 10 spectators can be
+compared.
+
+Usage:
+    python3 ws_load_test.py 192.168.1.50 [--spectators 3] [--rate 50] [--duration 20]
+    python3 ws_load_test.py 192.168.1.50 --spectators 10 --drive-spam --benchmark --token 0123...ef
+    python3 ws_load_test.py 192.168.1.51 --camera [--spectators 3]
+
+Only the standard library is needed. The driver only ever sends STOP, so
+the car stays put. The car's client table
+has 12 slots, but the mWebSockets library accepts 4 clients unless
+MAX_CONNECTIONS in its config.h is raised (to 11 or more for 10 spectators).
+"""
+
+import argparse
+import base64
+import json
+import os
+import socket
+import struct
+import threading
+import time
+
+OP_DRIVE = 0x01
+OP_PING = 0x02
+OP_STATS = 0x04
+OP_LEASE = 0x06
+OP_AUTH_RESUME = 0x08
+OP_PONG = 0x82
+CMD_STOP = 0
+
+
+class WebSocketClient:
+    """Minimal blocking RFC 6455 client: masked sends, unfragmented receives."""
+
+    def __init__(self, host, port):
+        self.sock = socket.create_connection((host, port), timeout=5)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        key = base64.b64encode(os.urandom(16)).decode()
+        request = ("GET / HTTP/1.1\r\nHost: %s:%d\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                   "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n" % (host, port, key))
+        self.sock.sendall(request.encode())
+        response = b""
+        while b"\r\n\r\n" not in response:
+            chunk = self.sock.recv(1024)
+            if not chunk:
+                raise ConnectionError("handshake failed")
+            response += chunk
+        if b" 101 " not in response.split(b"\r\n", 1)[0]:
+            raise ConnectionError("handshake rejected: %r" % response.split(b"\r\n", 1)[0])
+        self.buffer = response.split(b"\r\n\r\n", 1)[1]
+        self.lock = threading.Lock()
+
+    def send(self, payload, binary):
+        if isinstance(payload, str):
+            payload = payload.encode()
+        header = bytes([0x82 if binary else 0x81])
+        if len(payload) < 126:
+            header += bytes([0x80 | len(payload)])
+        else:
+            header += bytes([0x80 | 126]) + struct.pack(">H", len(payload))
+        mask = os.urandom(4)
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        with self.lock:
+            self.sock.sendall(header + mask + masked)
+
+    def _read(self, count):
+        while len(self.buffer) < count:
+            chunk = self.sock.recv(65536)
+            if not chunk:
+                raise ConnectionError("closed")
+            self.buffer += chunk
+        data, self.buffer = self.buffer[:count], self.buffer[count:]
+        return data
+
+    def receive(self):
+        """Returns (opcode, payload)."""
+        first, second = self._read(2)
+        length = second & 0x7F
+        if length == 126:
+            length = struct.unpack(">H", self._read(2))[0]
+        elif length == 127:
+            length = struct.unpack(">Q", self._read(8))[0]
+        return first & 0x0F, self._read(length)
+
+    def close(self):
+        try:
+            self.sock.close()
+        except OSError:
+            pass
+
+
+def now_us():
+    return time.perf_counter() * 1e6
+
+
+class Client:
+    def __init__(self, name, host, port, camera):
+        self.name = name
+        self.camera = camera
+        self.ws = WebSocketClient(host, port)
+        self.ws.sock.settimeout(1)
+        self.sent = 0
+        self.pongs = 0
+        self.rtts = []
+        self.frames = 0
+        self.frame_bytes = 0
+        self.errors = 0
+        self.rejected = 0
+        self.stats = None
+        self.stats_event = threading.Event()
+        self.authorized_event = threading.Event()
+        self.driver_event = threading.Event()
+        self.sequence = 0
+        self.running = True
+        self.reader = threading.Thread(target=self.read_loop, daemon=True)
+        self.reader.start()
+
+    def ping(self):
+        t1 = now_us()
+        if self.camera:
+            self.ws.send(json.dumps({"ping": int(t1)}), binary=False)
+        else:
+            self.sequence = (self.sequence + 1) & 0xFFFF
+            self.ws.send(struct.pack("<BHd", OP_PING, self.sequence, t1), binary=True)
+        self.sent += 1
+
+    def drive_stop(self):
+        if self.camera:
+            self.ws.send(json.dumps({"drive": CMD_STOP}), binary=False)
+        else:
+            self.sequence = (self.sequence + 1) & 0xFFFF
+            self.ws.send(struct.pack("<BHB", OP_DRIVE, self.sequence, CMD_STOP), binary=True)
+        self.sent += 1
+
+    def take_lease(self, token):
+        """Resumes the RFID session with `token` (hex) and requests the driving lease."""
+        self.ws.send(struct.pack("<BH", OP_AUTH_RESUME, 0) + bytes.fromhex(token), binary=True)
+        if not self.authorized_event.wait(3):
+            return False
+        self.ws.send(struct.pack("<BHB", OP_LEASE, 0, 1), binary=True)
+        return self.driver_event.wait(3)
+
+    def request_stats(self, reset):
+        """Asks the car for its STATS report; reset=True clears the histograms afterwards."""
+        self.stats_event.clear()
+        self.ws.send(struct.pack("<BHB", OP_STATS, 0, 1 if reset else 0), binary=True)
+        if self.stats_event.wait(3):
+            return self.stats
+        return None
+
+    def read_loop(self):
+        while self.running:
+            try:
+                opcode, payload = self.ws.receive()
+            except socket.timeout:
+                continue
+            except (ConnectionError, OSError):
+                break
+            t4 = now_us()
+            if opcode == 0x2 and not self.camera and payload[:1] == bytes([OP_PONG]) and len(payload) >= 27:
+                t1 = struct.unpack_from("<d", payload, 3)[0]
+                t2, t3 = struct.unpack_from("<qq", payload, 11)
+                self.record_pong(t1, t2, t3, t4)
+            elif opcode == 0x2 and self.camera:
+                self.frames += 1
+                self.frame_bytes += len(payload)
+            elif opcode == 0x1:
+                text = payload.decode(errors="replace")
+                if self.camera and text.startswith("{"):
+                    message = json.loads(text)
+                    if message.get("type") == "pong":
+                        self.record_pong(message["t1"], message["t2"], message["t3"], t4)
+                elif text.startswith("STATS:"):
+                    self.stats = json.loads(text[len("STATS:"):])
+                    self.stats_event.set()
+                elif text.startswith("RFID:"):
+                    if json.loads(text[len("RFID:"):]).get("authorized"):
+                        self.authorized_event.set()
+                elif text.startswith("LEASE:"):
+                    if json.loads(text[len("LEASE:"):]).get("driver"):
+                        self.driver_event.set()
+                    else:
+                        self.rejected += 1
+                elif text.startswith("ERROR"):
+                    self.errors += 1
+            elif opcode == 0x8:
+                break
+
+    def record_pong(self, t1, t2, t3, t4):
+        self.pongs += 1
+        self.rtts.append(((t4 - t1) - (t3 - t2)) / 1000.0)
+
+    def stop(self):
+        self.running = False
+        self.ws.close()
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p / 100.0 * len(values)))]
+
+
+def run(args):
+    port = args.port or (82 if args.camera else 81)
+    driver = Client("driver", args.host, port, args.camera)
+    spectators = [Client("spectator %d" % (i + 1), args.host, port, args.camera) for i in range(args.spectators)]
+    print("Connected 1 driver and %d spectators to %s:%d" % (len(spectators), args.host, port))
+
+    def flood(client):
+        interval = 1.0 / args.rate
+        next_send = time.perf_counter()
+        while client.running and time.perf_counter() < deadline:
+            try:
+                client.ping()
+                if args.drive_spam:
+                    client.drive_stop()
+            except OSError:
+                break
+            next_send += interval
+            time.sleep(max(0.0, next_send - time.perf_counter()))
+
+    if args.token and not args.camera:
+        # Take the driving lease before the spectators start
+        if driver.take_lease(args.token):
+            print("Driver holds the driving lease")
+        else:
+            print("Driver could not take the driving lease (token expired or lease busy)")
+    elif args.drive_spam and not args.camera:
+        print("No --token: nobody holds the driving lease, so spectator drive frames are not rejected")
+    if args.benchmark and not args.camera:
+        driver.request_stats(reset=True)
+
+    deadline = time.perf_counter() + args.duration
+    threads = [threading.Thread(target=flood, args=(s,), daemon=True) for s in spectators]
+    for thread in threads:
+        thread.start()
+
+    while time.perf_counter() < deadline:
+        driver.drive_stop()
+        driver.ping()
+        time.sleep(0.1)
+
+    for thread in threads:
+        thread.join()
+    time.sleep(1)  # Let the last replies arrive
+    stats = driver.request_stats(reset=False) if args.benchmark and not args.camera else None
+    for client in [driver] + spectators:
+        client.stop()
+
+    print("%-12s %6s %6s %8s %8s %8s %7s %8s %8s" % ("client", "sent", "pongs", "rtt p50", "rtt p95", "rtt max",
+                                                      "frames", "kB/s", "notices"))
+    for client in [driver] + spectators:
+        print("%-12s %6d %6d %8.1f %8.1f %8.1f %7d %8.1f %8d" % (
+            client.name, client.sent, client.pongs, percentile(client.rtts, 50), percentile(client.rtts, 95),
+            percentile(client.rtts, 100), client.frames, client.frame_bytes / 1000.0 / args.duration,
+            client.rejected))
+
+    if args.benchmark and not args.camera:
+        print_stats(stats, len(spectators))
+
+
+def print_stats(stats, spectators):
+    """Prints the car's command latency histograms and connection table."""
+    if stats is None:
+        print("\nNo STATS reply from the car")
+        return
+    print("\nCommand latency with %d spectators (us):" % spectators)
+    print("  %-8s %6s %7s %7s %7s %7s %7s" % ("stage", "n", "p50", "p90", "p99", "max", "mean"))
+    for stage in ("parse", "auth", "queue", "actuate", "total"):
+        h = stats.get(stage)
+        if h:
+            print("  %-8s %6d %7d %7d %7d %7d %7d" % (stage, h["n"], h["p50"], h["p90"], h["p99"], h["max"], h["mean"]))
+    if "rfid" in stats:
+        print("  RFID probes %d, cards read %d (since boot)" % (stats["rfid"]["probes"], stats["rfid"]["reads"]))
+    if "deadman" in stats:
+        print("  Deadman timeout %d ms, ramp-downs %d (since boot)" % (stats["deadman"]["timeout"],
+                                                                     stats["deadman"]["trips"]))
+    for slot in stats.get("clients", []):
+        print("  slot %-2d %-9s in %7d B  out %8d B  dropped %5d  rejected %5d" % (
+            slot["slot"], slot["role"], slot["in"], slot["out"], slot["dropped"], slot.get("rejected", 0)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="WebSocket load test for the RC car and camera sketches")
+    parser.add_argument("host", help="IP address of the car or camera")
+    parser.add_argument("--camera", action="store_true", help="target the camera sketch (JSON control, port 82)")
+    parser.add_argument("--port", type=int, help="override the port")
+    parser.add_argument("--spectators", type=int, default=3, help="number of spectator connections")
+    parser.add_argument("--rate", type=float, default=50, help="pings per second per spectator")
+    parser.add_argument("--duration", type=float, default=20, help="seconds to run")
+    parser.add_argument("--drive-spam", action="store_true", help="spectators also send drive frames (STOP)")
+    parser.add_argument("--token", help="hex RFID session token; the driver resumes it and takes the driving lease")
+    parser.add_argument("--benchmark", action="store_true",
+                        help="reset the car's latency histograms first and print them at the end")
+    run(parser.parse_args())
+
+
+if __name__ == "__main__":
+    main()
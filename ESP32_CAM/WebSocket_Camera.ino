@@ -13,9 +13,15 @@
  */
 
 #include "esp_camera.h"
+#include "img_converters.h"
 #include <WiFi.h>
 #include "WebSocketServer.h" // Using quotes for local header
 #include <ArduinoJson.h>
+#include <atomic>
+#include "frame_fanout.h"
+#include "abr.h"
+#include "control_message.h"
+#include "motion_detector.h"
 
 /**
  * @brief GPIO pin definitions for AI-THINKER ESP32-CAM module
@@ -66,6 +72,190 @@ net::WebSocketServer webSocket(82);
 #define FRAME_SIZE FRAMESIZE_VGA
 #define JPEG_QUALITY 10  // 0-63, lower is higher quality
 
+/**
+ * @brief Per-viewer frame delivery
+ * 
+ * Every viewer has its own sender task, so a slow viewer only delays itself.
+ * A captured frame is shared by reference: each viewer that is handed the
+ * frame holds one reference, and the camera buffer is returned to the driver
+ * when the last reference is released.
+ * 
+ * Each viewer holds at most one pending frame ("latest frame wins"): if a
+ * newer frame is published while the viewer is still sending, the pending
+ * one is replaced (and released) so the viewer skips straight to the newest.
+ * 
+ * The viewer table doubles as the connection table: each slot records the
+ * client's role, activity and traffic. The viewer that sent the latest
+ * "drive" hint is the driver; its sender task runs one priority level
+ * higher, and spectators' control messages beyond SPECTATOR_MESSAGE_BUDGET
+ * per window are dropped before parsing.
+ */
+#define MAX_VIEWERS 4               // Matches the WebSocket library's connection limit
+#define VIEWER_TASK_STACK 4096
+#define VIEWER_TASK_PRIORITY 1
+#define VIEWER_TASK_CORE 0          // Arduino loop (capture) runs on core 1
+#define STREAM_REPORT_INTERVAL 5000 // ms between stream statistics on Serial
+#define SPECTATOR_MESSAGE_BUDGET 20 // Control messages a spectator may send per window
+#define CLIENT_BUDGET_WINDOW 1000   // ms
+
+/**
+ * @brief Capture / transmit pipeline
+ * 
+ * The capture task grabs frames at FRAME_INTERVAL_MS and hands them to the
+ * transmit task through frameQueue; the transmit task publishes them to the
+ * viewers. With fb_count = 2 the sensor fills one buffer while the other is
+ * being sent, instead of capture and WiFi taking turns in loop().
+ */
+#define FRAME_INTERVAL_MS 50        // ~20 frames per second
+#define CAPTURE_TASK_STACK 4096
+#define CAPTURE_TASK_PRIORITY 2     // Above the Arduino loop (1), so WebSocket polling cannot delay capture
+#define CAPTURE_TASK_CORE 1
+#define TRANSMIT_TASK_STACK 4096
+#define TRANSMIT_TASK_PRIORITY 2
+#define TRANSMIT_TASK_CORE 0
+
+/**
+ * @brief Binary frame header
+ * 
+ * Every binary message starts with this header, followed by the JPEG data.
+ * All fields are little-endian:
+ * 
+ *   [0]      header version (FRAME_HEADER_VERSION)
+ *   [1]      header length in bytes (FRAME_HEADER_LENGTH); skip this many to reach the JPEG
+ *   [2-5]    frame sequence number (uint32, +1 per captured frame, so gaps are drops)
+ *   [6-13]   capture timestamp (int64 us, esp_timer clock; see the "ping" command)
+ *   [14-15]  width (uint16)
+ *   [16-17]  height (uint16)
+ *   [18]     JPEG quality (0-63)
+ *   [19]     reserved (0)
+ *   [20-23]  encode-to-send delay (uint32 us): capture to hand-off to the viewer senders
+ * 
+ * A JPEG always starts with 0xFF, so a first byte of FRAME_HEADER_VERSION
+ * can't be mistaken for a bare frame.
+ */
+#define FRAME_HEADER_VERSION 1
+#define FRAME_HEADER_LENGTH 24
+#define FRAME_BUFFER_GROWTH 4096 // Wire buffers grow in steps of this many bytes
+
+/**
+ * @brief Delivery state of one connected viewer
+ */
+struct Viewer {
+  net::WebSocket *socket;      // NULL while the slot is free
+  FrameMailbox mailbox;        // Newest frame posted by the transmit task
+  std::atomic<bool> infoPending; // camera_info for the sender task to send (see broadcastCameraInfo)
+  std::atomic<bool> pongPending; // pongT1/pongT2 hold a pong for the sender task to send
+  int64_t pongT1;              // Client send time of the ping being answered (us, client clock)
+  int64_t pongT2;              // When that ping arrived (us, esp_timer)
+  TaskHandle_t task;           // Sender task, notified when a frame is pending
+  SemaphoreHandle_t sendLock;  // Held while writing to socket, so close waits for it
+  uint32_t framesSent;         // Frames delivered since the last report
+  uint32_t framesSkipped;      // Pending frames replaced by a newer one since the last report
+  uint32_t bytesSent;          // Wire bytes delivered since the last report
+  uint32_t latencyMax;         // Longest capture-to-sent time since the last report (us)
+  uint64_t latencyTotal;       // Sum of capture-to-sent times since the last report (us)
+  uint32_t latencyEwma;        // Smoothed capture-to-sent time (us), for the bitrate controller
+  uint32_t sendTimeEwma;       // Smoothed duration of socket->send() (us)
+  uint32_t abrSent;            // Frames sent since the last bitrate controller tick
+  uint32_t abrSkipped;         // Frames skipped since the last bitrate controller tick
+  uint32_t clientLatency;      // Latest glass-to-glass latency reported by the client (ms), 0 if none
+  unsigned long clientLatencyAt; // millis() of that report
+  bool driver;                 // Sent the latest drive hint (otherwise a spectator)
+  unsigned long connectedAt;   // millis() when the client connected
+  unsigned long lastActivity;  // millis() of the last message received
+  uint32_t bytesIn;            // Control bytes received
+  uint32_t bytesOut;           // Bytes sent (frames and replies)
+  uint32_t messagesDropped;    // Control messages over the spectator budget
+  uint16_t budgetUsed;         // Messages received in the current budget window
+  unsigned long budgetWindowStart;
+};
+
+FramePool framePool;
+Viewer viewers[MAX_VIEWERS];
+QueueHandle_t frameQueue = NULL;       // Captured frames (SharedFrame *) awaiting the transmit task
+
+// Capture task statistics, reset by reportStreamStats()
+uint32_t framesCaptured = 0;
+uint32_t capturesSkipped = 0;  // Ticks skipped because every frame buffer was still held
+uint32_t captureStallMax = 0;  // Longest capture + hand-off to the transmit task (us)
+uint64_t captureStallTotal = 0;
+uint32_t framesSuperseded = 0; // Frames dropped by the transmit task because a newer one was queued
+uint32_t frameSequence = 0;    // Sequence number of the next published (or superseded) frame
+uint32_t framesSuppressed = 0; // Near-duplicate frames not sent in motion-aware mode
+TaskHandle_t captureTaskHandle = NULL;
+
+// Motion-aware capture: the decision is in motion_detector.h
+bool motionEnabled = false;
+volatile unsigned long lastActivityAt = 0; // millis() of the last change or wake-up
+MotionState motionState;                   // Last frame sent in motion mode (transmit task)
+uint8_t *motionThumbnail = NULL;           // 1/8 scale RGB565 decode buffer
+size_t motionThumbnailSize = 0;
+
+MotionRegion motionRoi = { 0, 0, 100, 100 };
+
+bool abrEnabled = true;
+uint32_t abrTargetLatency = ABR_DEFAULT_TARGET_LATENCY;
+AbrState abrState = { 0, 0, 0 };
+framesize_t currentFramesize = FRAME_SIZE;
+int baseQuality = JPEG_QUALITY;    // Quality chosen by the bitrate controller or "set_quality"
+int currentQuality = JPEG_QUALITY; // Quality applied to the sensor (base + pacing offset)
+
+/**
+ * @brief Drive-state pacing
+ * 
+ * Clients send {"drive": command, "speed": 0-255} whenever the car's drive
+ * command changes, and again every couple of seconds while it holds (the
+ * dashboard holding the car's driving lease relays what it sends to the car;
+ * the car node could connect and send the same hint). A moving hint makes
+ * its sender the driver; a stop hint from anyone but the driver is ignored. While the car is stopped the scheduler asks for
+ * fewer, sharper frames; the faster it drives, the shorter the frame
+ * interval and the coarser the JPEG quality, so airtime stays roughly flat.
+ * The quality offset is added to the bitrate controller's ladder quality
+ * (not to a manual "set_quality", which is used as given).
+ * Without a hint newer than DRIVE_HINT_TTL the stream runs at
+ * FRAME_INTERVAL_MS and the unmodified quality.
+ */
+#define DRIVE_HINT_TTL 5000
+#define PACING_STOPPED_INTERVAL_MS 100    // 10 FPS while stopped
+#define PACING_FAST_INTERVAL_MS 33        // 30 FPS at full speed
+#define PACING_STOPPED_QUALITY_OFFSET -4  // Sharper while stopped
+#define PACING_FAST_QUALITY_OFFSET 8      // Coarser at full speed
+#define MIN_JPEG_QUALITY 4                // Best quality the pacing offset may reach
+
+/**
+ * @brief Frame interval and quality offset chosen for a drive state
+ */
+struct Pacing {
+  uint32_t intervalMs;
+  int qualityOffset;
+};
+
+uint8_t driveCommand = 0;          // Last hinted drive command (0 = stop)
+uint8_t driveSpeed = 0;            // Last hinted speed (0-255)
+unsigned long driveHintAt = 0;     // millis() of the last hint
+bool driveHintValid = false;
+Pacing currentPacing = { FRAME_INTERVAL_MS, 0 };
+std::atomic<uint32_t> pacingIntervalMs(FRAME_INTERVAL_MS); // Read by the capture task
+std::atomic<uint32_t> fpsCapIntervalMs(0);                 // Shortest interval allowed by "fps", 0 = no cap
+framesize_t maxFramesize = FRAME_SIZE;                     // Frame buffers are sized for this (set in initCamera)
+
+/**
+ * @brief Control messages
+ * 
+ * A text message is parsed in one pass into a CameraControl, then applied.
+ * parseControl() (control_message.h) tokenizes it into a fixed array on
+ * the stack, so a control message allocates nothing on the heap the frame
+ * buffers and sender tasks depend on. CTRL_* bits mark which fields the
+ * message carried. Parse time and rejected messages are shown in the
+ * stream statistics.
+ */
+#define CONTROL_REPLY_SIZE 192 // pong and camera_info text
+
+uint32_t controlParseCount = 0; // Messages parsed since the last report
+uint32_t controlParseMax = 0;   // Slowest parse since the last report (us)
+uint64_t controlParseTotal = 0;
+uint32_t controlRejected = 0;   // Invalid messages since the last report
+
 /**
  * @brief Initialize the ESP32 camera with appropriate settings
  * 
@@ -102,14 +292,18 @@ bool initCamera() {
     config.frame_size = FRAME_SIZE;
     config.jpeg_quality = JPEG_QUALITY;
     config.fb_count = 2;
+    config.fb_location = CAMERA_FB_IN_PSRAM;
+    config.grab_mode = CAMERA_GRAB_LATEST; // Always hand out the newest of the two buffers
   } else {
     Serial.println("PSRAM not found. Camera may not initialize properly.");
     config.frame_size = FRAMESIZE_SVGA;
     config.jpeg_quality = 12;
     config.fb_count = 1;
   }
+  framePool.fbCount = config.fb_count;
   
   // Initialize camera
+  maxFramesize = config.frame_size;
   esp_err_t err = esp_camera_init(&config);
   if (err != ESP_OK) {
     Serial.printf("Camera init failed with error 0x%x", err);
@@ -132,36 +326,204 @@ bool initCamera() {
  */
 int numClients = 0;
 
+/**
+ * @brief Record a control message from a viewer and apply the spectator budget
+ * 
+ * @param viewer Sender's slot
+ * @param length Message length in bytes
+ * @return false if a spectator has used up its budget for this window
+ */
+bool chargeViewerMessage(Viewer &viewer, uint16_t length) {
+  unsigned long now = millis();
+  viewer.lastActivity = now;
+  viewer.bytesIn += length;
+  if (now - viewer.budgetWindowStart >= CLIENT_BUDGET_WINDOW) {
+    viewer.budgetWindowStart = now;
+    viewer.budgetUsed = 0;
+  }
+  bool allowed = viewer.budgetUsed < SPECTATOR_MESSAGE_BUDGET; // Checked before counting: 20 means 20
+  if (allowed) viewer.budgetUsed++;
+  return viewer.driver || allowed;
+}
+
+/**
+ * @brief Make a viewer the driver: its frames are sent ahead of the spectators'
+ */
+void promoteDriver(Viewer &viewer) {
+  if (viewer.driver) return;
+  for (int i = 0; i < MAX_VIEWERS; i++) {
+    if (viewers[i].driver) {
+      viewers[i].driver = false;
+      vTaskPrioritySet(viewers[i].task, VIEWER_TASK_PRIORITY);
+    }
+  }
+  viewer.driver = true;
+  vTaskPrioritySet(viewer.task, VIEWER_TASK_PRIORITY + 1);
+  Serial.printf("Viewer %d is now the driver\n", (int)(&viewer - viewers));
+}
+
+/**
+ * @brief Apply a parsed control message
+ * 
+ * @param client Client that sent it (for the ping reply and its latency report)
+ * @param control Parsed message
+ * @param receivedAt esp_timer time the message arrived (us)
+ */
+void applyControl(net::WebSocket& client, const CameraControl &control, int64_t receivedAt) {
+  sensor_t * s = esp_camera_sensor_get();
+
+  if (control.fields & CTRL_QUALITY) {
+    baseQuality = control.quality;
+    abrEnabled = false; // Manual quality overrides the controller until "abr" is re-enabled
+    applyStreamQuality();
+    Serial.printf("Quality set to %d\n", control.quality);
+  }
+
+  if (control.fields & CTRL_FRAMESIZE) {
+    if (control.framesize != currentFramesize) {
+      s->set_framesize(s, control.framesize);
+      currentFramesize = control.framesize;
+    }
+    abrEnabled = false; // Like set_quality: the controller would move it again
+    applyStreamQuality();
+    Serial.printf("Framesize set to %d\n", (int)control.framesize);
+  }
+
+  if (control.fields & CTRL_ABR) {
+    abrEnabled = control.abr;
+    abrState.goodTicks = 0;
+    applyStreamQuality();
+    Serial.printf("Adaptive bitrate %s\n", abrEnabled ? "enabled" : "disabled");
+  }
+
+  if (control.fields & CTRL_TARGET_LATENCY) {
+    abrTargetLatency = control.targetLatency;
+    Serial.printf("Target latency set to %u ms\n", abrTargetLatency);
+  }
+
+  if (control.fields & CTRL_FPS) {
+    fpsCapIntervalMs.store(control.fps ? 1000 / control.fps : 0, std::memory_order_relaxed);
+    wakeCapture(); // Re-evaluate the interval now
+    Serial.printf("Frame rate cap %u FPS\n", control.fps);
+  }
+
+  if (control.fields & CTRL_BRIGHTNESS) {
+    s->set_brightness(s, control.brightness);
+    Serial.printf("Brightness set to %d\n", control.brightness);
+  }
+
+  if (control.fields & CTRL_MIRROR) {
+    s->set_hmirror(s, control.mirror ? 1 : 0);
+    motionState.referenceValid = false;
+    Serial.printf("Mirror %s\n", control.mirror ? "on" : "off");
+  }
+
+  if (control.fields & CTRL_PING) {
+    // Never wait for sendLock here: this runs on loop(), and the viewer's sender may be
+    // in the middle of a frame on a slow socket. The sender task writes the pong between
+    // frames instead (see sendPong()), like camera_info.
+    Viewer *viewer = findViewer(client);
+    if (viewer == NULL) {
+      char pong[CONTROL_REPLY_SIZE];
+      int length = pongJson(pong, sizeof(pong), control.ping, receivedAt);
+      client.send(net::WebSocket::DataType::TEXT, pong, length);
+    } else if (!viewer->pongPending.load(std::memory_order_acquire)) {
+      viewer->pongT1 = control.ping;
+      viewer->pongT2 = receivedAt;
+      viewer->pongPending.store(true, std::memory_order_release);
+      xTaskNotifyGive(viewer->task);
+    } // else the previous pong is still queued; it answers an older ping just as well
+  }
+
+  if (control.fields & CTRL_MOTION_MODE) {
+    motionEnabled = control.motionMode;
+    motionState.referenceValid = false;
+    wakeCapture();
+    Serial.printf("Motion-aware capture %s\n", motionEnabled ? "enabled" : "disabled");
+  }
+
+  if (control.fields & CTRL_ROI) {
+    motionRoi = control.roi;
+    motionState.referenceValid = false;
+    Serial.printf("Motion region %u,%u %ux%u %%\n", motionRoi.x, motionRoi.y, motionRoi.w, motionRoi.h);
+  }
+
+  if (control.fields & CTRL_WAKE) {
+    wakeCapture();
+  }
+
+  if (control.fields & CTRL_DRIVE) {
+    Viewer *viewer = findViewer(client);
+    bool driverKnown = false;
+    for (int i = 0; i < MAX_VIEWERS; i++) driverKnown |= viewers[i].driver;
+    // A spectator's stop says nothing about the car the driver is moving
+    bool ignored = control.driveCommand == 0 && driverKnown && (viewer == NULL || !viewer->driver);
+    if (!ignored) {
+      if (viewer != NULL && control.driveCommand != 0) promoteDriver(*viewer);
+      driveCommand = control.driveCommand;
+      driveSpeed = control.driveSpeed;
+      driveHintAt = millis();
+      driveHintValid = true;
+      if (driveCommand != 0) wakeCapture(); // The scene is about to change
+    }
+  }
+
+  if (control.fields & CTRL_FRAME_LATENCY) {
+    Viewer *viewer = findViewer(client);
+    if (viewer != NULL) {
+      viewer->clientLatency = control.frameLatency;
+      viewer->clientLatencyAt = millis();
+    }
+  }
+}
+
 /**
  * @brief Process text commands received from WebSocket clients
  * 
- * Parses JSON messages from clients and handles any supported commands.
- * Currently implements quality adjustment via the "set_quality" parameter.
+ * Parses JSON messages from clients and handles any supported commands:
+ * "set_quality" (manual quality, turns the bitrate controller off), "abr"
+ * (true/false), "target_latency" (ms) and "frame_latency" (the client's
+ * measured glass-to-glass latency in ms, fed to the bitrate controller).
+ * "ping" carries the client's send time T1 (us) and is answered with
+ * {"type":"pong","t1":T1,"t2":receive,"t3":transmit} in the camera's
+ * esp_timer clock, so the client can convert frame capture timestamps
+ * to its own clock (offset = ((t2 - t1) + (t3 - t4)) / 2). The viewer's
+ * sender task writes the pong between frames and stamps t3 as it does.
+ * "motion_mode" (true/false) turns motion-aware capture on or off, and
+ * "wake" restores the full frame rate immediately. "drive" (command) with
+ * an optional "speed" (0-255) is the drive-state hint used for pacing.
+ * "framesize" ("VGA", "QVGA", ... or the enum value, up to the size the
+ * camera was initialised with; turns the bitrate controller off), "fps"
+ * (frame rate cap, 0 = none), "brightness" (-2..2), "mirror" (true/false)
+ * and "roi" ([x, y, w, h] in percent of the frame, or false) set the
+ * sensor and the region the motion detector watches.
  * 
  * @param client Reference to the WebSocket client that sent the command
  * @param message Pointer to the text message content
  * @param length Length of the message in bytes
  */
 void handleTextCommand(net::WebSocket& client, const char* message, uint16_t length) {
-  String msg = String(message);
-  DynamicJsonDocument doc(200);
-  DeserializationError error = deserializeJson(doc, msg);
-  
-  if (error) {
-    Serial.println("Failed to parse JSON command");
+  int64_t receivedAt = esp_timer_get_time();
+  Viewer *viewer = findViewer(client);
+  if (viewer != NULL && !chargeViewerMessage(*viewer, length)) {
+    viewer->messagesDropped++;
     return;
   }
-  
-  // Check if it's a quality change command
-  if (doc.containsKey("set_quality")) {
-    int quality = doc["set_quality"];
-    quality = constrain(quality, 0, 63);
-    
-    sensor_t * s = esp_camera_sensor_get();
-    s->set_quality(s, quality);
-    
-    Serial.printf("Quality set to %d\n", quality);
+
+  CameraControl control;
+  bool valid = parseControl(message, length, maxFramesize, control);
+
+  uint32_t parseTime = (uint32_t)(esp_timer_get_time() - receivedAt);
+  controlParseCount++;
+  controlParseTotal += parseTime;
+  if (parseTime > controlParseMax) controlParseMax = parseTime;
+
+  if (!valid) {
+    controlRejected++;
+    Serial.println("Failed to parse JSON command");
+    return;
   }
+  applyControl(client, control, receivedAt);
 }
 
 /**
@@ -182,12 +544,115 @@ void handleWebSocketMessage(net::WebSocket& client, net::WebSocket::DataType dat
   }
 }
 
+/**
+ * @brief Sender task of one viewer
+ * 
+ * Sleeps until a frame is published to its viewer, then sends the newest
+ * pending frame and releases it. A camera_info flagged by
+ * broadcastCameraInfo() and a pong queued by applyControl() go out before
+ * the next frame. Only this viewer waits on its socket.
+ * 
+ * @param parameter Pointer to the Viewer served by this task
+ */
+void viewerTask(void *parameter) {
+  Viewer &viewer = *(Viewer *)parameter;
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    for (;;) {
+      if (viewer.infoPending.exchange(false, std::memory_order_acq_rel)) {
+        sendCameraInfo(viewer);
+      }
+      if (viewer.pongPending.load(std::memory_order_acquire)) {
+        sendPong(viewer);
+      }
+
+      SharedFrame *frame = takeFrame(viewer.mailbox);
+      if (frame == NULL) {
+        break;
+      }
+
+      xSemaphoreTake(viewer.sendLock, portMAX_DELAY);
+      if (viewer.socket != NULL) {
+        int64_t sendStart = esp_timer_get_time();
+        viewer.socket->send(net::WebSocket::DataType::BINARY, (const char*)frame->wire, frame->wireLength);
+        int64_t sendEnd = esp_timer_get_time();
+        viewer.framesSent++;
+        viewer.bytesSent += frame->wireLength;
+        viewer.bytesOut += frame->wireLength;
+        viewer.abrSent++;
+
+        int64_t capturedAt = (int64_t)frame->fb->timestamp.tv_sec * 1000000 + frame->fb->timestamp.tv_usec;
+        uint32_t latency = (uint32_t)(sendEnd - capturedAt);
+        viewer.latencyTotal += latency;
+        if (latency > viewer.latencyMax) {
+          viewer.latencyMax = latency;
+        }
+        viewer.latencyEwma += ((int32_t)latency - (int32_t)viewer.latencyEwma) / 8;
+        viewer.sendTimeEwma += ((int32_t)(sendEnd - sendStart) - (int32_t)viewer.sendTimeEwma) / 8;
+      }
+      xSemaphoreGive(viewer.sendLock);
+
+      releaseFrame(framePool, frame);
+    }
+  }
+}
+
+/**
+ * @brief Create the viewer slots and their (idle) sender tasks
+ */
+void initViewers() {
+  for (int i = 0; i < MAX_VIEWERS; i++) {
+    viewers[i].socket = NULL;
+    viewers[i].sendLock = xSemaphoreCreateMutex();
+    xTaskCreatePinnedToCore(viewerTask, "viewer", VIEWER_TASK_STACK, &viewers[i],
+                            VIEWER_TASK_PRIORITY, &viewers[i].task, VIEWER_TASK_CORE);
+  }
+}
+
+/**
+ * @brief Handle WebSocket client disconnections
+ * 
+ * Waits for any frame being sent to this client to finish, frees its viewer
+ * slot and releases the frame it still had pending.
+ * 
+ * @param client Reference to the disconnecting WebSocket client
+ * @param code Close code
+ * @param reason Close reason (unused)
+ * @param length Length of the close reason
+ */
+void handleClientClose(net::WebSocket& client, net::WebSocket::CloseCode code, const char* reason, uint16_t length) {
+  for (int i = 0; i < MAX_VIEWERS; i++) {
+    Viewer &viewer = viewers[i];
+    if (viewer.socket != &client) {
+      continue;
+    }
+
+    xSemaphoreTake(viewer.sendLock, portMAX_DELAY);
+    viewer.socket = NULL;
+    xSemaphoreGive(viewer.sendLock);
+    if (viewer.driver) {
+      viewer.driver = false;
+      vTaskPrioritySet(viewer.task, VIEWER_TASK_PRIORITY);
+    }
+    Serial.printf("Viewer %d left: %lu bytes in / %lu out, %lu messages dropped\n", i,
+                  (unsigned long)viewer.bytesIn, (unsigned long)viewer.bytesOut, (unsigned long)viewer.messagesDropped);
+
+    clearMailbox(framePool, viewer.mailbox);
+  }
+
+  numClients--;
+  Serial.println("Client disconnected");
+  Serial.printf("Number of clients: %d\n", numClients);
+}
+
 /**
  * @brief Handle new WebSocket client connections
  * 
  * Called when a new client connects to the WebSocket server.
- * Increments client counter, sets up message handlers, and sends
- * initial camera configuration information to the client.
+ * Increments client counter, assigns a viewer slot, sets up message handlers,
+ * and sends initial camera configuration information to the client.
  * 
  * @param client Reference to the newly connected WebSocket client
  */
@@ -195,41 +660,562 @@ void handleClientConnection(net::WebSocket& client) {
   numClients++;
   Serial.println("Client connected");
   Serial.printf("Number of clients: %d\n", numClients);
-  
-  // Set up message handler for this client
+
+  // Set up message and close handlers for this client
   client.onMessage(handleWebSocketMessage);
+  client.onClose(handleClientClose);
   
-  // Send camera information to client
-  DynamicJsonDocument doc(200);
-  doc["type"] = "camera_info";
-  doc["framesize"] = FRAME_SIZE;
-  doc["quality"] = JPEG_QUALITY;
-  
-  String json;
-  serializeJson(doc, json);
-  client.send(net::WebSocket::DataType::TEXT, json.c_str(), json.length());
+  // Send camera information to client (before its sender task can start writing frames)
+  char json[CONTROL_REPLY_SIZE];
+  size_t length = cameraInfoJson(json, sizeof(json));
+  client.send(net::WebSocket::DataType::TEXT, json, length);
+
+  bool assigned = false;
+  for (int i = 0; i < MAX_VIEWERS && !assigned; i++) {
+    if (viewers[i].socket == NULL) {
+      viewers[i].framesSent = 0;
+      viewers[i].framesSkipped = 0;
+      viewers[i].bytesSent = 0;
+      viewers[i].latencyMax = 0;
+      viewers[i].latencyTotal = 0;
+      viewers[i].latencyEwma = 0;
+      viewers[i].sendTimeEwma = 0;
+      viewers[i].abrSent = 0;
+      viewers[i].abrSkipped = 0;
+      viewers[i].clientLatency = 0;
+      viewers[i].driver = false;
+      viewers[i].connectedAt = millis();
+      viewers[i].lastActivity = viewers[i].connectedAt;
+      viewers[i].bytesIn = 0;
+      viewers[i].bytesOut = length; // camera_info
+      viewers[i].messagesDropped = 0;
+      viewers[i].budgetUsed = 0;
+      viewers[i].budgetWindowStart = viewers[i].connectedAt;
+      viewers[i].infoPending.store(false, std::memory_order_relaxed);
+      viewers[i].pongPending.store(false, std::memory_order_relaxed);
+      viewers[i].socket = &client;
+      assigned = true;
+    }
+  }
+  if (!assigned) {
+    Serial.println("No free viewer slot, client will not receive frames");
+  }
+}
+
+/**
+ * @brief Make frame buffers available when every one is held
+ * 
+ * A viewer that is still sending an older frame gives up its pending frame;
+ * it will pick up the next one published after it finishes.
+ */
+void reclaimPendingFrames() {
+  for (int i = 0; i < MAX_VIEWERS; i++) {
+    if (reclaimFrame(framePool, viewers[i].mailbox)) {
+      viewers[i].framesSkipped++;
+      viewers[i].abrSkipped++;
+    }
+  }
+}
+
+/**
+ * @brief Hand a captured frame to every viewer
+ * 
+ * Each viewer gets a reference; a frame it had not started sending yet is
+ * replaced and released (latest frame wins).
+ * 
+ * @param frame Captured frame, holding the caller's single reference
+ */
+void publishFrame(SharedFrame *frame) {
+  for (int i = 0; i < MAX_VIEWERS; i++) {
+    Viewer &viewer = viewers[i];
+    if (viewer.socket == NULL) {
+      continue;
+    }
+
+    if (postFrame(framePool, viewer.mailbox, frame)) {
+      viewer.framesSkipped++;
+      viewer.abrSkipped++;
+    }
+    xTaskNotifyGive(viewer.task);
+  }
+
+  releaseFrame(framePool, frame); // Drop the transmit task's own reference
 }
 
 /**
- * @brief Capture and broadcast camera frames to all clients
+ * @brief Capture a camera frame into a free SharedFrame
+ * 
+ * Skips the tick if viewers still hold every frame buffer rather than
+ * block in esp_camera_fb_get().
  * 
- * Captures a frame from the camera and sends it to all connected
- * WebSocket clients as binary data. Skips processing if no clients
- * are connected to save resources.
+ * @return The frame holding the caller's single reference, or NULL if no frame was captured
  */
-void sendCameraFrames() {
-  if (numClients == 0) return; // Don't capture if nobody is connected
+SharedFrame *captureFrame() {
+  if (framePoolExhausted(framePool)) {
+    reclaimPendingFrames();
+    if (framePoolExhausted(framePool)) {
+      capturesSkipped++;
+      return NULL;
+    }
+  }
+
+  SharedFrame *frame = freeFrameSlot(framePool);
+  if (frame == NULL) {
+    capturesSkipped++;
+    return NULL;
+  }
   
   camera_fb_t *fb = esp_camera_fb_get();
   if (!fb) {
     Serial.println("Camera capture failed");
-    return;
+    return NULL;
+  }
+
+  frame->quality = currentQuality;
+  holdFrame(framePool, frame, fb);
+  framesCaptured++;
+  return frame;
+}
+
+/**
+ * @brief Current capture interval: the drive-state pacing, or the idle rate in motion-aware mode
+ */
+uint32_t captureIntervalMs() {
+  uint32_t interval = max(pacingIntervalMs.load(std::memory_order_relaxed),
+                         fpsCapIntervalMs.load(std::memory_order_relaxed));
+  return motionEnabled ? motionCaptureInterval(interval, millis() - lastActivityAt) : interval;
+}
+
+/**
+ * @brief Return to the full frame rate now (motion seen, or a drive command is coming)
+ */
+void wakeCapture() {
+  lastActivityAt = millis();
+  if (captureTaskHandle != NULL) {
+    xTaskNotifyGive(captureTaskHandle); // Cut short an idle-rate wait
+  }
+}
+
+/**
+ * @brief Capture task: grabs a frame every captureIntervalMs() while anyone is watching
+ * 
+ * Frames go to the transmit task through frameQueue, so the sensor keeps
+ * exposing into the second buffer while the first one is being sent.
+ * The wait between frames ends early when wakeCapture() is called.
+ * 
+ * @param parameter Unused
+ */
+void captureTask(void *parameter) {
+  TickType_t lastCapture = xTaskGetTickCount();
+
+  for (;;) {
+    TickType_t interval = pdMS_TO_TICKS(captureIntervalMs());
+    TickType_t elapsed = xTaskGetTickCount() - lastCapture;
+    if (elapsed < interval) {
+      ulTaskNotifyTake(pdTRUE, interval - elapsed); // Re-evaluates the interval when woken
+      continue;
+    }
+    lastCapture = (elapsed < 2 * interval) ? lastCapture + interval : xTaskGetTickCount(); // No burst after a stall
+
+    if (numClients == 0) continue; // Don't capture if nobody is connected
+
+    uint32_t start = micros();
+    SharedFrame *frame = captureFrame();
+    if (frame == NULL) continue;
+
+    if (xQueueSend(frameQueue, &frame, 0) != pdTRUE) {
+      releaseFrame(framePool, frame); // Cannot happen: the queue holds as many entries as there are buffers
+      continue;
+    }
+
+    uint32_t stall = micros() - start;
+    captureStallTotal += stall;
+    if (stall > captureStallMax) {
+      captureStallMax = stall;
+    }
+  }
+}
+
+/**
+ * @brief Reduce a JPEG frame to a MOTION_GRID_W x MOTION_GRID_H grid of mean luma
+ * 
+ * @param fb Frame to analyse
+ * @param grid Output grid
+ * @return false if the frame could not be decoded
+ */
+bool computeMotionGrid(camera_fb_t *fb, uint8_t *grid) {
+  size_t width = (fb->width + 7) / 8, height = (fb->height + 7) / 8;
+  size_t needed = width * height * 2;
+  if (needed > motionThumbnailSize) {
+    free(motionThumbnail);
+    motionThumbnail = (uint8_t *)malloc(needed);
+    motionThumbnailSize = motionThumbnail ? needed : 0;
+    if (!motionThumbnail) return false;
+  }
+  if (!jpg2rgb565(fb->buf, fb->len, motionThumbnail, JPG_SCALE_8X)) return false;
+  motionGridFromRgb565(motionThumbnail, width, height, grid);
+  return true;
+}
+
+/**
+ * @brief Decide whether a frame is a near-duplicate of the last frame sent
+ * 
+ * Called from the transmit task for every frame in motion-aware mode.
+ * A changed frame becomes the new reference and keeps the capture rate up.
+ * 
+ * @param fb Frame to check
+ * @return true if the frame should not be sent
+ */
+bool isDuplicateFrame(camera_fb_t *fb) {
+  uint8_t grid[MOTION_GRID_CELLS];
+  if (!computeMotionGrid(fb, grid)) return false; // Can't tell: send it
+
+  MotionVerdict verdict = motionCheckFrame(motionState, grid, fb->width, motionRoi, millis());
+  if (verdict == MOTION_CHANGED) {
+    wakeCapture();
+  }
+  return verdict == MOTION_DUPLICATE;
+}
+
+/**
+ * @brief Write a little-endian value of `bytes` bytes
+ */
+void putLittleEndian(uint8_t *out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    out[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+/**
+ * @brief Build the message viewers receive: frame header followed by the JPEG
+ * 
+ * The wire buffer of each SharedFrame slot is kept between frames and only
+ * grows, so steady-state streaming does not allocate.
+ * 
+ * @param frame Captured frame
+ * @return false if the buffer could not be allocated
+ */
+bool prepareWireFrame(SharedFrame *frame) {
+  camera_fb_t *fb = frame->fb;
+  size_t needed = FRAME_HEADER_LENGTH + fb->len;
+  if (needed > frame->wireCapacity) {
+    size_t capacity = (needed + FRAME_BUFFER_GROWTH - 1) / FRAME_BUFFER_GROWTH * FRAME_BUFFER_GROWTH;
+    free(frame->wire);
+    frame->wire = (uint8_t *)(psramFound() ? ps_malloc(capacity) : malloc(capacity));
+    frame->wireCapacity = frame->wire ? capacity : 0;
+    if (!frame->wire) {
+      Serial.println("Frame buffer allocation failed");
+      return false;
+    }
+  }
+
+  int64_t capturedAt = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+  uint8_t *header = frame->wire;
+  header[0] = FRAME_HEADER_VERSION;
+  header[1] = FRAME_HEADER_LENGTH;
+  putLittleEndian(header + 2, frame->sequence, 4);
+  putLittleEndian(header + 6, (uint64_t)capturedAt, 8);
+  putLittleEndian(header + 14, fb->width, 2);
+  putLittleEndian(header + 16, fb->height, 2);
+  header[18] = frame->quality;
+  header[19] = 0;
+  memcpy(header + FRAME_HEADER_LENGTH, fb->buf, fb->len);
+  putLittleEndian(header + 20, (uint32_t)(esp_timer_get_time() - capturedAt), 4);
+  frame->wireLength = needed;
+  return true;
+}
+
+/**
+ * @brief Transmit task: publishes captured frames to the viewers
+ * 
+ * If more than one frame is waiting, only the newest is published. In
+ * motion-aware mode, near-duplicates of the last frame sent are dropped.
+ * 
+ * @param parameter Unused
+ */
+void transmitTask(void *parameter) {
+  for (;;) {
+    SharedFrame *frame;
+    if (xQueueReceive(frameQueue, &frame, portMAX_DELAY) != pdTRUE) continue;
+
+    SharedFrame *newer;
+    while (xQueueReceive(frameQueue, &newer, 0) == pdTRUE) {
+      releaseFrame(framePool, frame);
+      framesSuperseded++;
+      frameSequence++; // A dropped frame: leave a gap in the sequence
+      frame = newer;
+    }
+
+    if (motionEnabled && isDuplicateFrame(frame->fb)) {
+      releaseFrame(framePool, frame); // Suppressed on purpose: no sequence gap
+      framesSuppressed++;
+      continue;
+    }
+
+    frame->sequence = frameSequence++;
+    if (!prepareWireFrame(frame)) {
+      releaseFrame(framePool, frame);
+      continue;
+    }
+    publishFrame(frame);
+  }
+}
+
+/**
+ * @brief Create the frame queue and start the capture and transmit tasks
+ */
+void startCameraPipeline() {
+  frameQueue = xQueueCreate(MAX_SHARED_FRAMES, sizeof(SharedFrame *));
+  xTaskCreatePinnedToCore(transmitTask, "transmit", TRANSMIT_TASK_STACK, NULL,
+                          TRANSMIT_TASK_PRIORITY, NULL, TRANSMIT_TASK_CORE);
+  xTaskCreatePinnedToCore(captureTask, "capture", CAPTURE_TASK_STACK, NULL,
+                          CAPTURE_TASK_PRIORITY, &captureTaskHandle, CAPTURE_TASK_CORE);
+}
+
+/**
+ * @brief Return the viewer slot of a client, or NULL if it has none
+ */
+Viewer *findViewer(net::WebSocket &client) {
+  for (int i = 0; i < MAX_VIEWERS; i++) {
+    if (viewers[i].socket == &client) {
+      return &viewers[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Build the camera_info message describing the current stream settings
+ */
+size_t cameraInfoJson(char *buffer, size_t size) {
+  StaticJsonDocument<256> doc;
+  doc["type"] = "camera_info";
+  doc["framesize"] = (int)currentFramesize;
+  doc["quality"] = currentQuality;
+  doc["interval"] = currentPacing.intervalMs;
+  doc["abr"] = abrEnabled;
+  doc["target_latency"] = abrTargetLatency;
+  doc["motion_mode"] = motionEnabled;
+  uint32_t fpsCap = fpsCapIntervalMs.load(std::memory_order_relaxed);
+  doc["fps"] = fpsCap ? 1000 / fpsCap : 0;
+
+  return serializeJson(doc, buffer, size);
+}
+
+/**
+ * @brief Periodically run the bitrate controller and apply its decision
+ * 
+ * Framesize is only reconfigured when it actually changes, since that
+ * briefly disturbs the sensor. Viewers are told about the new settings
+ * with a camera_info message.
+ */
+void updateBitrate() {
+  static unsigned long lastTick = 0;
+  unsigned long currentMillis = millis();
+  if (currentMillis - lastTick < ABR_INTERVAL_MS) return;
+  lastTick = currentMillis;
+
+  AbrInputs inputs = { 0, 0, 0, currentPacing.intervalMs };
+  bool measured = false;
+  for (int i = 0; i < MAX_VIEWERS; i++) {
+    Viewer &viewer = viewers[i];
+    uint32_t sent = viewer.abrSent, skipped = viewer.abrSkipped;
+    viewer.abrSent = 0;
+    viewer.abrSkipped = 0;
+    if (viewer.socket == NULL || sent + skipped == 0) continue;
+
+    uint32_t latency = viewer.latencyEwma / 1000;
+    if (viewer.clientLatency > latency && currentMillis - viewer.clientLatencyAt < ABR_CLIENT_REPORT_TTL) {
+      latency = viewer.clientLatency;
+    }
+    inputs.latencyMs = max(inputs.latencyMs, latency);
+    inputs.sendTimeMs = max(inputs.sendTimeMs, viewer.sendTimeEwma / 1000);
+    inputs.skipPercent = max(inputs.skipPercent, (uint8_t)(skipped * 100 / (sent + skipped)));
+    measured = true;
+  }
+  if (!abrEnabled || !measured) return;
+
+  int previous = abrState.step;
+  int step = abrNextStep(abrState, inputs, abrTargetLatency);
+  if (step == previous) return;
+
+  const StreamStep &next = STREAM_LADDER[step];
+  sensor_t * s = esp_camera_sensor_get();
+  if (next.framesize != currentFramesize) {
+    s->set_framesize(s, next.framesize);
+    currentFramesize = next.framesize;
+  }
+  baseQuality = next.quality;
+  applyStreamQuality();
+  Serial.printf("ABR: step %d -> %d (latency %u ms, send %u ms, skipped %u%%)\n",
+                previous, step, inputs.latencyMs, inputs.sendTimeMs, inputs.skipPercent);
+
+  broadcastCameraInfo();
+}
+
+/**
+ * @brief Have every viewer's sender task send camera_info
+ * 
+ * Only flags the viewers and wakes their senders: loop() must not wait
+ * for sendLock while a sender is writing a frame to a slow socket.
+ */
+void broadcastCameraInfo() {
+  for (int i = 0; i < MAX_VIEWERS; i++) {
+    if (viewers[i].socket != NULL) {
+      viewers[i].infoPending.store(true, std::memory_order_release);
+      xTaskNotifyGive(viewers[i].task);
+    }
+  }
+}
+
+/**
+ * @brief Send the current camera_info to one viewer (called from its sender task)
+ */
+void sendCameraInfo(Viewer &viewer) {
+  char json[CONTROL_REPLY_SIZE];
+  size_t length = cameraInfoJson(json, sizeof(json));
+  xSemaphoreTake(viewer.sendLock, portMAX_DELAY);
+  if (viewer.socket != NULL) {
+    viewer.bytesOut += length;
+    viewer.socket->send(net::WebSocket::DataType::TEXT, json, length);
+  }
+  xSemaphoreGive(viewer.sendLock);
+}
+
+/**
+ * @brief Format a pong; t3 (transmit) is taken now, so call it right before sending
+ */
+int pongJson(char *buffer, size_t size, int64_t t1, int64_t t2) {
+  return snprintf(buffer, size, "{\"type\":\"pong\",\"t1\":%lld,\"t2\":%lld,\"t3\":%lld}",
+                  (long long)t1, (long long)t2, (long long)esp_timer_get_time());
+}
+
+/**
+ * @brief Send the pong queued by applyControl() to one viewer (called from its sender task)
+ * 
+ * t1 and t2 are read before pongPending is cleared: applyControl() only writes
+ * them while it is clear.
+ */
+void sendPong(Viewer &viewer) {
+  int64_t t1 = viewer.pongT1, t2 = viewer.pongT2;
+  viewer.pongPending.store(false, std::memory_order_release);
+  char pong[CONTROL_REPLY_SIZE];
+  xSemaphoreTake(viewer.sendLock, portMAX_DELAY);
+  if (viewer.socket != NULL) {
+    int length = pongJson(pong, sizeof(pong), t1, t2);
+    viewer.bytesOut += length;
+    viewer.socket->send(net::WebSocket::DataType::TEXT, pong, length);
+  }
+  xSemaphoreGive(viewer.sendLock);
+}
+
+/**
+ * @brief Apply baseQuality plus the pacing offset to the sensor, if it changed
+ */
+void applyStreamQuality() {
+  int offset = abrEnabled ? currentPacing.qualityOffset : 0;
+  int quality = constrain(baseQuality + offset, abrEnabled ? MIN_JPEG_QUALITY : 0, 63);
+  if (quality == currentQuality) return;
+  sensor_t * s = esp_camera_sensor_get();
+  s->set_quality(s, quality);
+  currentQuality = quality;
+}
+
+/**
+ * @brief Pacing scheduler decision for a drive state
+ * 
+ * Pure function, so it can be checked against recorded drive sessions.
+ * Stopped maps to PACING_STOPPED_*; a moving command interpolates towards
+ * PACING_FAST_* with speed.
+ * 
+ * @param command Drive command (0 = stop)
+ * @param speed Motor speed (0-255)
+ * @return Frame interval and quality offset
+ */
+Pacing pacingFor(uint8_t command, uint8_t speed) {
+  if (command == 0) {
+    return { PACING_STOPPED_INTERVAL_MS, PACING_STOPPED_QUALITY_OFFSET };
+  }
+  Pacing pacing;
+  pacing.intervalMs = PACING_STOPPED_INTERVAL_MS -
+                      (PACING_STOPPED_INTERVAL_MS - PACING_FAST_INTERVAL_MS) * speed / 255;
+  pacing.qualityOffset = PACING_STOPPED_QUALITY_OFFSET +
+                         (PACING_FAST_QUALITY_OFFSET - PACING_STOPPED_QUALITY_OFFSET) * speed / 255;
+  return pacing;
+}
+
+/**
+ * @brief Re-run the pacing scheduler on the latest drive hint and apply its decision
+ */
+void updatePacing() {
+  if (driveHintValid && millis() - driveHintAt > DRIVE_HINT_TTL) {
+    driveHintValid = false; // The hinting client went quiet
+  }
+
+  Pacing pacing = driveHintValid ? pacingFor(driveCommand, driveSpeed) : Pacing{ FRAME_INTERVAL_MS, 0 };
+  if (pacing.intervalMs == currentPacing.intervalMs && pacing.qualityOffset == currentPacing.qualityOffset) return;
+
+  currentPacing = pacing;
+  pacingIntervalMs.store(pacing.intervalMs, std::memory_order_relaxed);
+  applyStreamQuality();
+  if (captureTaskHandle != NULL) xTaskNotifyGive(captureTaskHandle); // Pick up a shorter interval now
+  Serial.printf("Pacing: %u ms, quality %d (drive %u, speed %u)\n",
+                pacing.intervalMs, currentQuality, driveCommand, driveSpeed);
+  broadcastCameraInfo();
+}
+
+/**
+ * @brief Periodically print per-viewer FPS and capture loop stall time
+ */
+void reportStreamStats() {
+  static unsigned long lastReport = 0;
+  unsigned long currentMillis = millis();
+  unsigned long elapsed = currentMillis - lastReport;
+  if (elapsed < STREAM_REPORT_INTERVAL) return;
+  lastReport = currentMillis;
+
+  if (numClients > 0) {
+    Serial.printf("Capture: %.1f FPS, %u skipped, %u superseded, %u suppressed, stall avg %lu us / max %lu us\n",
+                  framesCaptured * 1000.0f / elapsed, capturesSkipped, framesSuperseded, framesSuppressed,
+                  (unsigned long)(framesCaptured ? captureStallTotal / framesCaptured : 0),
+                  (unsigned long)captureStallMax);
+    for (int i = 0; i < MAX_VIEWERS; i++) {
+      Viewer &viewer = viewers[i];
+      if (viewer.socket != NULL) {
+        Serial.printf("  Viewer %d (%s): %.1f FPS, %.1f kB/s, %u frames skipped, capture-to-sent avg %lu us / max %lu us\n",
+                      i, viewer.driver ? "driver" : "spectator",
+                      viewer.framesSent * 1000.0f / elapsed, viewer.bytesSent / (float)elapsed, viewer.framesSkipped,
+                      (unsigned long)(viewer.framesSent ? viewer.latencyTotal / viewer.framesSent : 0),
+                      (unsigned long)viewer.latencyMax);
+        Serial.printf("    idle %lu ms, %lu bytes in / %lu out, %lu messages dropped\n",
+                      currentMillis - viewer.lastActivity, (unsigned long)viewer.bytesIn,
+                      (unsigned long)viewer.bytesOut, (unsigned long)viewer.messagesDropped);
+      }
+    }
+    if (controlParseCount > 0) {
+      Serial.printf("  Control: %u messages, %u rejected, parse avg %lu us / max %lu us\n",
+                    controlParseCount, controlRejected,
+                    (unsigned long)(controlParseTotal / controlParseCount), (unsigned long)controlParseMax);
+    }
+  }
+
+  controlParseCount = 0;
+  controlParseTotal = 0;
+  controlParseMax = 0;
+  controlRejected = 0;
+  framesCaptured = 0;
+  capturesSkipped = 0;
+  framesSuperseded = 0;
+  framesSuppressed = 0;
+  captureStallMax = 0;
+  captureStallTotal = 0;
+  for (int i = 0; i < MAX_VIEWERS; i++) {
+    viewers[i].framesSent = 0;
+    viewers[i].framesSkipped = 0;
+    viewers[i].bytesSent = 0;
+    viewers[i].latencyMax = 0;
+    viewers[i].latencyTotal = 0;
   }
-  
-  // Send the frame data to all connected clients - CHANGED TO MATCH net::WebSocket API
-  webSocket.broadcast(net::WebSocket::DataType::BINARY, (const char*)fb->buf, fb->len);
-  
-  esp_camera_fb_return(fb);
 }
 
 /**
@@ -248,6 +1234,7 @@ void setup() {
     Serial.println("Camera initialization failed!");
     while(1) delay(100);
   }
+  initViewers();
   // Add before WiFi.begin():
   /*IPAddress staticIP(192, 168, 242, 149); // Same as RC car
   IPAddress gateway(192, 168, 242, 1);    // Router IP
@@ -282,33 +1269,24 @@ void setup() {
   s->set_quality(s, JPEG_QUALITY);
   s->set_hmirror(s, 1); // Optional: mirror horizontally
   s->set_brightness(s, 1); // Increase brightness slightly
-}
 
-/**
- * @brief Frame rate control variables
- * 
- * lastFrameTime: Timestamp of the last frame capture
- * frameInterval: Target time between frames in milliseconds (50ms = 20 FPS)
- */
-unsigned long lastFrameTime = 0;
-const int frameInterval = 50; // ~20 frames per second
+  startCameraPipeline();
+}
 
 /**
  * @brief Arduino main loop function - runs repeatedly
  * 
- * Handles incoming WebSocket connections and messages,
- * and captures/sends camera frames at the specified interval
- * to maintain consistent frame rate.
+ * Handles incoming WebSocket connections and messages and runs the
+ * bitrate controller. Frames are captured and sent by the capture,
+ * transmit and viewer tasks.
  */
 void loop() {
   // CHANGED webSocket.loop() TO MATCH net::WebSocket API
   webSocket.listen();
-  
-  unsigned long currentMillis = millis();
-  if (currentMillis - lastFrameTime > frameInterval) {
-    lastFrameTime = currentMillis;
-    sendCameraFrames();
-  }
+
+  updatePacing();
+  updateBitrate();
+  reportStreamStats();
 }
 
   
@@ -0,0 +1,112 @@
+/**
+ * @file abr.h
+ * @brief The camera stream's bitrate ladder and the adaptive bitrate (ABR) decision.
+ * @details Shared by WebSocket_Camera.ino (updateBitrate) and the trace-driven simulator in
+ * tests/test_abr.cpp, which tunes the controller offline. Depends on framesize_t only.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "esp_camera.h"
+
+/**
+ * @brief Adaptive bitrate (ABR) controller
+ *
+ * Every ABR_INTERVAL_MS the controller looks at the worst viewer's smoothed
+ * capture-to-sent latency (or the glass-to-glass latency the client reports,
+ * if higher), how long socket sends take, and how many frames had to be
+ * skipped, then moves along a ladder of framesize/quality steps to hold
+ * abrTargetLatency. It steps down at once (two steps when far over target)
+ * and steps up only after ABR_UPGRADE_TICKS consecutive ticks with headroom,
+ * holding ABR_HOLD_TICKS after every change to let the link settle.
+ */
+#define ABR_INTERVAL_MS 500
+#define ABR_DEFAULT_TARGET_LATENCY 150 // ms
+#define ABR_UPGRADE_HEADROOM 60        // Step up only below this % of the target latency
+#define ABR_UPGRADE_TICKS 6            // Consecutive good ticks needed to step up (3 s)
+#define ABR_HOLD_TICKS 2               // Ticks to wait after a change before stepping up again
+#define ABR_SKIP_CONGESTED 50          // % of frames skipped that counts as congestion
+#define ABR_CLIENT_REPORT_TTL 2000     // ms a client latency report stays valid
+
+/**
+ * @brief One rung of the bitrate ladder
+ */
+struct StreamStep {
+  framesize_t framesize;
+  int quality;
+};
+
+// Best first; step 0 matches FRAME_SIZE / JPEG_QUALITY
+const StreamStep STREAM_LADDER[] = {
+  { FRAMESIZE_VGA, 10 }, { FRAMESIZE_VGA, 15 }, { FRAMESIZE_VGA, 22 },
+  { FRAMESIZE_CIF, 15 }, { FRAMESIZE_QVGA, 12 }, { FRAMESIZE_QVGA, 20 },
+  { FRAMESIZE_QQVGA, 15 }
+};
+const int STREAM_LADDER_STEPS = sizeof(STREAM_LADDER) / sizeof(STREAM_LADDER[0]);
+
+/**
+ * @brief Measurements fed to the controller on each tick
+ */
+struct AbrInputs {
+  uint32_t latencyMs;   // Worst viewer latency
+  uint32_t sendTimeMs;  // Worst viewer send duration
+  uint8_t skipPercent;  // Worst viewer share of frames skipped
+  uint32_t intervalMs;  // Frame interval the pacing scheduler is asking for
+};
+
+/**
+ * @brief Controller state carried between ticks
+ */
+struct AbrState {
+  int step;           // Current index into STREAM_LADDER
+  uint8_t goodTicks;  // Consecutive ticks with headroom
+  uint8_t holdTicks;  // Ticks left before stepping up is allowed
+};
+
+/**
+ * @brief One bitrate controller decision
+ *
+ * Pure function of the inputs and the previous state, so it can be
+ * exercised with recorded traces.
+ *
+ * @param state Controller state, updated in place
+ * @param inputs Measurements of the last tick
+ * @param targetLatency Latency to hold (ms)
+ * @return The new ladder step
+ */
+inline int abrNextStep(AbrState &state, const AbrInputs &inputs, uint32_t targetLatency) {
+  bool congested = inputs.latencyMs > targetLatency ||
+                   inputs.sendTimeMs > inputs.intervalMs ||
+                   inputs.skipPercent >= ABR_SKIP_CONGESTED;
+  bool headroom = inputs.latencyMs * 100 < targetLatency * ABR_UPGRADE_HEADROOM &&
+                  inputs.sendTimeMs * 2 < inputs.intervalMs &&
+                  inputs.skipPercent == 0;
+
+  if (state.holdTicks > 0) {
+    state.holdTicks--;
+  }
+
+  int step = state.step;
+  if (congested) {
+    step += (inputs.latencyMs > 2 * targetLatency) ? 2 : 1; // Back off fast
+    state.goodTicks = 0;
+  } else if (headroom) {
+    if (++state.goodTicks >= ABR_UPGRADE_TICKS && state.holdTicks == 0) {
+      step--; // Probe up slowly
+      state.goodTicks = 0;
+    }
+  } else {
+    state.goodTicks = 0;
+  }
+
+  if (step < 0) {
+    step = 0;
+  } else if (step > STREAM_LADDER_STEPS - 1) {
+    step = STREAM_LADDER_STEPS - 1;
+  }
+  if (step != state.step) {
+    state.step = step;
+    state.holdTicks = ABR_HOLD_TICKS;
+  }
+  return step;
+}
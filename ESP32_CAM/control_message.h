@@ -0,0 +1,449 @@
+/**
+ * @file control_message.h
+ * @brief Parses the camera's JSON control messages into a CameraControl without heap allocation.
+ * @details parseControl() tokenizes a message into a fixed array of JsonTokens on the
+ * caller's stack (the arena), then reads the known keys out of it. Strings stay in the
+ * message and are compared in place, so nothing is copied. Shared by WebSocket_Camera.ino
+ * (handleTextCommand) and the fuzz / benchmark harness in tests/test_control_message.cpp.
+ * Depends on the C library, framesize_t and MotionRegion (motion_detector.h) only.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include "esp_camera.h"
+#include "motion_detector.h"
+
+#define CONTROL_MAX_LENGTH 256  // Longer messages are rejected before parsing
+#define CONTROL_MAX_TOKENS 48   // Arena: keys, values and array elements of one message
+#define CONTROL_MAX_DEPTH 4     // Deepest nesting accepted (unknown keys may hold objects)
+#define DRIVE_DEFAULT_SPEED 200 // Speed assumed when a drive hint carries none (the car's default)
+
+enum ControlField : uint32_t {
+  CTRL_QUALITY = 1 << 0,
+  CTRL_ABR = 1 << 1,
+  CTRL_TARGET_LATENCY = 1 << 2,
+  CTRL_PING = 1 << 3,
+  CTRL_MOTION_MODE = 1 << 4,
+  CTRL_WAKE = 1 << 5,
+  CTRL_DRIVE = 1 << 6,
+  CTRL_FRAME_LATENCY = 1 << 7,
+  CTRL_FRAMESIZE = 1 << 8,
+  CTRL_FPS = 1 << 9,
+  CTRL_BRIGHTNESS = 1 << 10,
+  CTRL_MIRROR = 1 << 11,
+  CTRL_ROI = 1 << 12
+};
+
+/**
+ * @brief One parsed control message; only fields flagged in `fields` are set
+ */
+struct CameraControl {
+  uint32_t fields;
+  int quality;            // set_quality
+  bool abr;
+  uint32_t targetLatency; // ms
+  int64_t ping;           // Client send time T1 (us)
+  bool motionMode;
+  uint8_t driveCommand;
+  uint8_t driveSpeed;
+  uint32_t frameLatency;  // ms
+  framesize_t framesize;
+  uint8_t fps;            // 0 = no cap
+  int8_t brightness;      // -2..2
+  bool mirror;
+  MotionRegion roi;
+};
+
+const struct {
+  const char *name;
+  framesize_t framesize;
+} FRAMESIZE_NAMES[] = {
+  { "QQVGA", FRAMESIZE_QQVGA }, { "QVGA", FRAMESIZE_QVGA }, { "CIF", FRAMESIZE_CIF },
+  { "HVGA", FRAMESIZE_HVGA }, { "VGA", FRAMESIZE_VGA }, { "SVGA", FRAMESIZE_SVGA },
+  { "XGA", FRAMESIZE_XGA }, { "SXGA", FRAMESIZE_SXGA }, { "UXGA", FRAMESIZE_UXGA }
+};
+
+enum JsonType : uint8_t { JSON_OBJECT, JSON_ARRAY, JSON_STRING, JSON_INTEGER, JSON_NUMBER, JSON_TRUE, JSON_FALSE, JSON_NULL };
+
+/**
+ * @brief One JSON value (or object key) in the token arena
+ */
+struct JsonToken {
+  JsonType type;
+  uint16_t start;    // Offset in the message (strings: just after the opening quote)
+  uint16_t length;   // Bytes (strings: without the quotes, escapes left as they are)
+  uint16_t children; // Objects: key/value pairs; arrays: elements
+  uint16_t end;      // Index of the first token after this value and everything inside it
+  int64_t integer;   // Value of a JSON_INTEGER
+};
+
+/**
+ * @brief Tokenizer state: the message and the arena being filled
+ */
+struct JsonParser {
+  const char *text;
+  size_t length;
+  size_t pos;
+  JsonToken *tokens;
+  int count;
+};
+
+inline void skipJsonSpace(JsonParser &p) {
+  while (p.pos < p.length && (p.text[p.pos] == ' ' || p.text[p.pos] == '\t' ||
+                              p.text[p.pos] == '\n' || p.text[p.pos] == '\r')) {
+    p.pos++;
+  }
+}
+
+inline bool isJsonDigit(char c) { return c >= '0' && c <= '9'; }
+
+/**
+ * @brief Take the next token from the arena
+ * @return Its index, or -1 if the arena is full
+ */
+inline int newJsonToken(JsonParser &p, JsonType type) {
+  if (p.count >= CONTROL_MAX_TOKENS) return -1;
+  JsonToken &token = p.tokens[p.count];
+  token.type = type;
+  token.start = (uint16_t)p.pos;
+  token.length = 0;
+  token.children = 0;
+  token.integer = 0;
+  return p.count++;
+}
+
+/**
+ * @brief Parse a string starting at the opening quote
+ * @return Token index, or -1 if the string is malformed
+ */
+inline int parseJsonString(JsonParser &p) {
+  int index = newJsonToken(p, JSON_STRING);
+  if (index < 0) return -1;
+  size_t start = ++p.pos;
+  while (p.pos < p.length && p.text[p.pos] != '"') {
+    char c = p.text[p.pos];
+    if ((uint8_t)c < 0x20) return -1;
+    if (c == '\\') {
+      if (++p.pos >= p.length) return -1;
+      c = p.text[p.pos];
+      if (c == 'u') {
+        for (int i = 0; i < 4; i++) {
+          if (++p.pos >= p.length) return -1;
+          char h = p.text[p.pos];
+          if (!isJsonDigit(h) && !((h | 0x20) >= 'a' && (h | 0x20) <= 'f')) return -1;
+        }
+      } else if (!strchr("\"\\/bfnrt", c) || c == '\0') {
+        return -1;
+      }
+    }
+    p.pos++;
+  }
+  if (p.pos >= p.length) return -1; // Unterminated
+  p.tokens[index].start = (uint16_t)start;
+  p.tokens[index].length = (uint16_t)(p.pos - start);
+  p.pos++;
+  p.tokens[index].end = (uint16_t)p.count;
+  return index;
+}
+
+/**
+ * @brief Parse a number; integers that fit in int64 become JSON_INTEGER
+ * @return Token index, or -1 if the number is malformed
+ */
+inline int parseJsonNumber(JsonParser &p) {
+  int index = newJsonToken(p, JSON_INTEGER);
+  if (index < 0) return -1;
+  JsonToken &token = p.tokens[index];
+  bool negative = p.pos < p.length && p.text[p.pos] == '-';
+  if (negative) p.pos++;
+  if (p.pos >= p.length || !isJsonDigit(p.text[p.pos])) return -1;
+
+  uint64_t magnitude = 0;
+  bool overflow = false;
+  if (p.text[p.pos] == '0') {
+    p.pos++;
+  } else {
+    while (p.pos < p.length && isJsonDigit(p.text[p.pos])) {
+      uint64_t digit = (uint64_t)(p.text[p.pos++] - '0');
+      if (magnitude > (UINT64_MAX - digit) / 10) overflow = true;
+      magnitude = magnitude * 10 + digit;
+    }
+  }
+  if (p.pos < p.length && p.text[p.pos] == '.') {
+    token.type = JSON_NUMBER;
+    p.pos++;
+    if (p.pos >= p.length || !isJsonDigit(p.text[p.pos])) return -1;
+    while (p.pos < p.length && isJsonDigit(p.text[p.pos])) p.pos++;
+  }
+  if (p.pos < p.length && (p.text[p.pos] == 'e' || p.text[p.pos] == 'E')) {
+    token.type = JSON_NUMBER;
+    p.pos++;
+    if (p.pos < p.length && (p.text[p.pos] == '+' || p.text[p.pos] == '-')) p.pos++;
+    if (p.pos >= p.length || !isJsonDigit(p.text[p.pos])) return -1;
+    while (p.pos < p.length && isJsonDigit(p.text[p.pos])) p.pos++;
+  }
+  if (token.type == JSON_INTEGER) {
+    if (overflow || magnitude > (uint64_t)INT64_MAX + (negative ? 1 : 0)) {
+      token.type = JSON_NUMBER; // Out of int64 range: not an integer for our purposes
+    } else {
+      token.integer = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    }
+  }
+  token.length = (uint16_t)(p.pos - token.start);
+  token.end = (uint16_t)p.count;
+  return index;
+}
+
+inline int parseJsonValue(JsonParser &p, int depth);
+
+/**
+ * @brief Parse an object or array starting at its opening bracket
+ * @return Token index, or -1 if it is malformed, too deep or too large for the arena
+ */
+inline int parseJsonContainer(JsonParser &p, int depth) {
+  bool object = p.text[p.pos] == '{';
+  int index = newJsonToken(p, object ? JSON_OBJECT : JSON_ARRAY);
+  if (index < 0 || depth >= CONTROL_MAX_DEPTH) return -1;
+  char close = object ? '}' : ']';
+  p.pos++;
+  skipJsonSpace(p);
+  if (p.pos < p.length && p.text[p.pos] == close) {
+    p.pos++;
+    p.tokens[index].end = (uint16_t)p.count;
+    return index;
+  }
+  for (;;) {
+    if (object) {
+      if (p.pos >= p.length || p.text[p.pos] != '"' || parseJsonString(p) < 0) return -1;
+      skipJsonSpace(p);
+      if (p.pos >= p.length || p.text[p.pos] != ':') return -1;
+      p.pos++;
+    }
+    if (parseJsonValue(p, depth + 1) < 0) return -1;
+    p.tokens[index].children++;
+    skipJsonSpace(p);
+    if (p.pos >= p.length) return -1;
+    if (p.text[p.pos] == close) break;
+    if (p.text[p.pos] != ',') return -1;
+    p.pos++;
+    skipJsonSpace(p);
+  }
+  p.pos++;
+  p.tokens[index].length = (uint16_t)(p.pos - p.tokens[index].start);
+  p.tokens[index].end = (uint16_t)p.count;
+  return index;
+}
+
+/**
+ * @brief Parse any JSON value at the current position (after skipping whitespace)
+ * @return Token index, or -1 if the value is malformed
+ */
+inline int parseJsonValue(JsonParser &p, int depth) {
+  skipJsonSpace(p);
+  if (p.pos >= p.length) return -1;
+  char c = p.text[p.pos];
+  if (c == '{' || c == '[') return parseJsonContainer(p, depth);
+  if (c == '"') return parseJsonString(p);
+  if (c == '-' || isJsonDigit(c)) return parseJsonNumber(p);
+
+  static const struct {
+    const char *word;
+    JsonType type;
+  } LITERALS[] = { { "true", JSON_TRUE }, { "false", JSON_FALSE }, { "null", JSON_NULL } };
+  for (size_t i = 0; i < sizeof(LITERALS) / sizeof(LITERALS[0]); i++) {
+    size_t length = strlen(LITERALS[i].word);
+    if (p.length - p.pos >= length && memcmp(p.text + p.pos, LITERALS[i].word, length) == 0) {
+      int index = newJsonToken(p, LITERALS[i].type);
+      if (index < 0) return -1;
+      p.pos += length;
+      p.tokens[index].length = (uint16_t)length;
+      p.tokens[index].end = (uint16_t)p.count;
+      return index;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Read access to a tokenized message, in the style of a JSON document
+ *
+ * Values are token indices; -1 stands for "missing". A missing key and a
+ * JSON null are both "null", as in the ArduinoJson code this replaces.
+ */
+struct ControlDocument {
+  const char *text;
+  const JsonToken *tokens;
+
+  /// Value of `key` in the object at `object` (the first one if repeated), or -1
+  int get(int object, const char *key) const {
+    size_t keyLength = strlen(key);
+    int token = object + 1;
+    for (uint16_t pair = 0; pair < tokens[object].children; pair++) {
+      const JsonToken &name = tokens[token];
+      if (name.length == keyLength && memcmp(text + name.start, key, keyLength) == 0) {
+        return token + 1;
+      }
+      token = tokens[token + 1].end;
+    }
+    return -1;
+  }
+
+  /// Element `n` of the array at `array`, or -1
+  int at(int array, int n) const {
+    if (n < 0 || n >= tokens[array].children) return -1;
+    int token = array + 1;
+    while (n-- > 0) token = tokens[token].end;
+    return token;
+  }
+
+  bool isNull(int value) const { return value < 0 || tokens[value].type == JSON_NULL; }
+  bool isBool(int value) const { return value >= 0 && (tokens[value].type == JSON_TRUE || tokens[value].type == JSON_FALSE); }
+  bool asBool(int value) const { return value >= 0 && tokens[value].type == JSON_TRUE; }
+  bool isInt64(int value) const { return value >= 0 && tokens[value].type == JSON_INTEGER; }
+  bool isInt(int value) const {
+    return isInt64(value) && tokens[value].integer >= INT32_MIN && tokens[value].integer <= INT32_MAX;
+  }
+  int asInt(int value) const { return isInt(value) ? (int)tokens[value].integer : 0; }
+  bool isString(int value) const { return value >= 0 && tokens[value].type == JSON_STRING; }
+};
+
+inline int clampControl(int value, int low, int high) {
+  return value < low ? low : (value > high ? high : value);
+}
+
+/**
+ * @brief Look up a framesize by name ("VGA", "QVGA", ...) or enum value
+ *
+ * @param doc Tokenized message
+ * @param value Token of a JSON string or integer
+ * @param maxFramesize Largest framesize the frame buffers were allocated for
+ * @param framesize Output
+ * @return false if the value names no supported framesize
+ */
+inline bool parseFramesize(const ControlDocument &doc, int value, framesize_t maxFramesize, framesize_t &framesize) {
+  if (doc.isInt(value)) {
+    int size = doc.asInt(value);
+    if (size < 0 || size > (int)maxFramesize) return false;
+    framesize = (framesize_t)size;
+    return true;
+  }
+  if (!doc.isString(value)) return false;
+  const JsonToken &name = doc.tokens[value];
+  for (size_t i = 0; i < sizeof(FRAMESIZE_NAMES) / sizeof(FRAMESIZE_NAMES[0]); i++) {
+    if (strlen(FRAMESIZE_NAMES[i].name) == name.length &&
+        strncasecmp(doc.text + name.start, FRAMESIZE_NAMES[i].name, name.length) == 0) {
+      framesize = FRAMESIZE_NAMES[i].framesize;
+      return framesize <= maxFramesize;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Parse one text message into a CameraControl
+ *
+ * The tokens live in a fixed array on the stack, so nothing is allocated
+ * per message. Values are range-checked here, so applyControl() can trust
+ * them. Unknown keys are ignored; a key with a value of the wrong type
+ * makes the whole message invalid.
+ *
+ * @param message Message text (not necessarily NUL-terminated)
+ * @param length Length of the message in bytes
+ * @param maxFramesize Largest framesize the frame buffers were allocated for
+ * @param control Output, fields present are flagged in control.fields
+ * @return false if the message is not a valid control object
+ */
+inline bool parseControl(const char *message, size_t length, framesize_t maxFramesize, CameraControl &control) {
+  control.fields = 0;
+  if (length == 0 || length > CONTROL_MAX_LENGTH) return false;
+
+  JsonToken tokens[CONTROL_MAX_TOKENS];
+  JsonParser parser = { message, length, 0, tokens, 0 };
+  int root = parseJsonValue(parser, 0);
+  skipJsonSpace(parser);
+  if (root < 0 || parser.pos != length || tokens[root].type != JSON_OBJECT) return false;
+  ControlDocument doc = { message, tokens };
+  int value;
+
+  if (!doc.isNull(value = doc.get(root, "set_quality"))) {
+    if (!doc.isInt(value)) return false;
+    control.quality = clampControl(doc.asInt(value), 0, 63);
+    control.fields |= CTRL_QUALITY;
+  }
+  if (!doc.isNull(value = doc.get(root, "abr"))) {
+    if (!doc.isBool(value)) return false;
+    control.abr = doc.asBool(value);
+    control.fields |= CTRL_ABR;
+  }
+  if (!doc.isNull(value = doc.get(root, "target_latency"))) {
+    if (!doc.isInt(value)) return false;
+    control.targetLatency = clampControl(doc.asInt(value), 30, 5000);
+    control.fields |= CTRL_TARGET_LATENCY;
+  }
+  if (!doc.isNull(value = doc.get(root, "ping"))) {
+    if (!doc.isInt64(value)) return false;
+    control.ping = tokens[value].integer;
+    control.fields |= CTRL_PING;
+  }
+  if (!doc.isNull(value = doc.get(root, "motion_mode"))) {
+    if (!doc.isBool(value)) return false;
+    control.motionMode = doc.asBool(value);
+    control.fields |= CTRL_MOTION_MODE;
+  }
+  if (!doc.isNull(doc.get(root, "wake"))) {
+    control.fields |= CTRL_WAKE;
+  }
+  if (!doc.isNull(value = doc.get(root, "drive"))) {
+    if (!doc.isInt(value)) return false;
+    control.driveCommand = (uint8_t)doc.asInt(value);
+    int speed = doc.get(root, "speed");
+    if (!doc.isNull(speed) && !doc.isInt(speed)) return false;
+    control.driveSpeed = doc.isNull(speed) ? DRIVE_DEFAULT_SPEED : clampControl(doc.asInt(speed), 0, 255);
+    control.fields |= CTRL_DRIVE;
+  }
+  if (!doc.isNull(value = doc.get(root, "frame_latency"))) {
+    if (!doc.isInt(value)) return false;
+    control.frameLatency = clampControl(doc.asInt(value), 0, 60000);
+    control.fields |= CTRL_FRAME_LATENCY;
+  }
+  if (!doc.isNull(value = doc.get(root, "framesize"))) {
+    if (!parseFramesize(doc, value, maxFramesize, control.framesize)) return false;
+    control.fields |= CTRL_FRAMESIZE;
+  }
+  if (!doc.isNull(value = doc.get(root, "fps"))) {
+    if (!doc.isInt(value)) return false;
+    control.fps = clampControl(doc.asInt(value), 0, 60);
+    control.fields |= CTRL_FPS;
+  }
+  if (!doc.isNull(value = doc.get(root, "brightness"))) {
+    if (!doc.isInt(value)) return false;
+    control.brightness = clampControl(doc.asInt(value), -2, 2);
+    control.fields |= CTRL_BRIGHTNESS;
+  }
+  if (!doc.isNull(value = doc.get(root, "mirror"))) {
+    if (!doc.isBool(value)) return false;
+    control.mirror = doc.asBool(value);
+    control.fields |= CTRL_MIRROR;
+  }
+  if (!doc.isNull(value = doc.get(root, "roi"))) {
+    if (doc.isBool(value) && !doc.asBool(value)) {
+      control.roi = MotionRegion{ 0, 0, 100, 100 }; // false clears the region
+    } else {
+      if (tokens[value].type != JSON_ARRAY || tokens[value].children != 4) return false;
+      int region[4];
+      for (int i = 0; i < 4; i++) {
+        int element = doc.at(value, i);
+        region[i] = doc.isInt(element) ? doc.asInt(element) : -1;
+      }
+      int x = region[0], y = region[1], w = region[2], h = region[3];
+      if (x < 0 || y < 0 || w <= 0 || h <= 0 || x > 100 || y > 100 || w > 100 || h > 100 ||
+          x + w > 100 || y + h > 100) return false;
+      control.roi = MotionRegion{ (uint8_t)x, (uint8_t)y, (uint8_t)w, (uint8_t)h };
+    }
+    control.fields |= CTRL_ROI;
+  }
+  return true;
+}
@@ -0,0 +1,151 @@
+/**
+ * @file frame_fanout.h
+ * @brief Reference-counted camera frames and the latest-frame-wins handoff to the viewer senders.
+ * @details The transmit task posts every frame to each viewer's FrameMailbox; each viewer's
+ * sender task takes the newest frame from its own mailbox, so a slow viewer skips frames
+ * instead of holding up capture. A camera buffer goes back to the driver when the last
+ * reference to its frame is released. Only <atomic> and the camera_fb_t type are used, so
+ * tests/test_frame_fanout.cpp runs the same code on Linux (with tests/host/esp_camera.h).
+ */
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_camera.h"
+
+#define MAX_SHARED_FRAMES 2 // fb_count configured in initCamera()
+
+/**
+ * @brief A captured camera frame shared between viewers
+ */
+struct SharedFrame {
+  camera_fb_t *fb;          // Driver frame buffer, returned when refs drops to 0
+  std::atomic<int> refs;    // Outstanding references
+  std::atomic<bool> inUse;  // Slot holds a frame that has not been returned yet
+  uint32_t sequence;        // Capture sequence number
+  uint8_t quality;          // JPEG quality the frame was captured at
+  uint8_t *wire;            // Header + JPEG as sent to viewers (reused between frames)
+  size_t wireLength;        // Bytes of wire in use
+  size_t wireCapacity;      // Allocated size of wire
+};
+
+/**
+ * @brief The SharedFrame slots and the driver buffers they hold
+ */
+struct FramePool {
+  SharedFrame frames[MAX_SHARED_FRAMES];
+  std::atomic<int> outstanding{0}; // Frame buffers currently checked out of the driver
+  int fbCount = 1;                 // Frame buffers the driver was configured with
+};
+
+/**
+ * @brief One viewer's slot for the newest frame it has not started sending
+ *
+ * Written by the transmit task (postFrame, reclaimFrame) and by the viewer's
+ * sender (takeFrame); each exchange moves one frame reference, so no lock is needed.
+ */
+struct FrameMailbox {
+  std::atomic<SharedFrame *> pending{nullptr}; // Newest frame not yet being sent
+  std::atomic<bool> sending{false};            // Sender is writing a frame
+};
+
+/**
+ * @brief Drop one reference to a shared frame
+ *
+ * The camera buffer goes back to the driver when the last reference is released.
+ * Safe to call from the capture side and from any sender.
+ */
+inline void releaseFrame(FramePool &pool, SharedFrame *frame) {
+  if (frame->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    esp_camera_fb_return(frame->fb);
+    frame->fb = NULL;
+    frame->inUse.store(false, std::memory_order_release);
+    pool.outstanding.fetch_sub(1, std::memory_order_acq_rel);
+  }
+}
+
+/**
+ * @brief True when every driver buffer is checked out (esp_camera_fb_get() would block)
+ */
+inline bool framePoolExhausted(const FramePool &pool) {
+  return pool.outstanding.load(std::memory_order_acquire) >= pool.fbCount;
+}
+
+/**
+ * @brief Find a SharedFrame slot that is not in use, or NULL
+ */
+inline SharedFrame *freeFrameSlot(FramePool &pool) {
+  for (int i = 0; i < MAX_SHARED_FRAMES; i++) {
+    if (!pool.frames[i].inUse.load(std::memory_order_acquire)) {
+      return &pool.frames[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Put a driver buffer into a free slot; the caller holds the single reference
+ */
+inline void holdFrame(FramePool &pool, SharedFrame *frame, camera_fb_t *fb) {
+  frame->fb = fb;
+  frame->refs.store(1, std::memory_order_relaxed);
+  frame->inUse.store(true, std::memory_order_release);
+  pool.outstanding.fetch_add(1, std::memory_order_acq_rel);
+}
+
+/**
+ * @brief Give a viewer a reference to a frame (latest frame wins)
+ *
+ * @return true if this replaced a frame the viewer had not started sending (a skip)
+ */
+inline bool postFrame(FramePool &pool, FrameMailbox &mailbox, SharedFrame *frame) {
+  frame->refs.fetch_add(1, std::memory_order_relaxed); // The caller still holds its own
+  SharedFrame *replaced = mailbox.pending.exchange(frame, std::memory_order_acq_rel);
+  if (replaced != NULL) {
+    releaseFrame(pool, replaced);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Sender side: take the newest pending frame
+ *
+ * @return The frame, whose reference now belongs to the caller, or NULL if none is pending
+ */
+inline SharedFrame *takeFrame(FrameMailbox &mailbox) {
+  SharedFrame *frame = mailbox.pending.exchange(NULL, std::memory_order_acq_rel);
+  mailbox.sending.store(frame != NULL, std::memory_order_release);
+  return frame;
+}
+
+/**
+ * @brief Take back the pending frame of a viewer that is still sending an older one
+ *
+ * Used when every driver buffer is held; the viewer picks up the next frame
+ * posted after it finishes.
+ *
+ * @return true if a frame was released (a skip)
+ */
+inline bool reclaimFrame(FramePool &pool, FrameMailbox &mailbox) {
+  if (!mailbox.sending.load(std::memory_order_acquire)) {
+    return false;
+  }
+  SharedFrame *frame = mailbox.pending.exchange(NULL, std::memory_order_acq_rel);
+  if (frame == NULL) {
+    return false;
+  }
+  releaseFrame(pool, frame);
+  return true;
+}
+
+/**
+ * @brief Release the pending frame of a viewer that is going away
+ */
+inline void clearMailbox(FramePool &pool, FrameMailbox &mailbox) {
+  SharedFrame *frame = mailbox.pending.exchange(NULL, std::memory_order_acq_rel);
+  if (frame != NULL) {
+    releaseFrame(pool, frame);
+  }
+}
@@ -0,0 +1,142 @@
+/**
+ * @file motion_detector.h
+ * @brief The motion-aware capture decision: the luma grid, the near-duplicate test and
+ * the idle frame rate.
+ * @details Shared by WebSocket_Camera.ino (computeMotionGrid, isDuplicateFrame and
+ * captureIntervalMs) and tests/test_motion_detector.cpp, which checks it and replays
+ * recordings prepared by motion_evaluator.py. The JPEG decode (jpg2rgb565() at 1/8 scale)
+ * stays in the sketch; everything after it is here. Plain C++ only.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Motion-aware capture
+ *
+ * When enabled ("motion_mode"), each frame is decoded at 1/8 scale
+ * (DCT scaling, so only the DC coefficients are really decoded) and
+ * averaged into a MOTION_GRID_W x MOTION_GRID_H luma grid. A frame in
+ * which fewer than MOTION_MIN_CELLS cells of the region of interest differ
+ * from the last frame sent by MOTION_THRESHOLD luma levels (0-255) or more
+ * is a near-duplicate and is not sent, except for one refresh frame every
+ * MOTION_REFRESH_MS. After MOTION_IDLE_TIMEOUT ms without change the
+ * capture rate drops to MOTION_IDLE_INTERVAL_MS; it returns to the full
+ * rate at once when a frame changes or a client sends {"wake": true}
+ * (e.g. on a drive command).
+ */
+#define MOTION_GRID_W 16
+#define MOTION_GRID_H 12
+#define MOTION_GRID_CELLS (MOTION_GRID_W * MOTION_GRID_H)
+#define MOTION_THRESHOLD 12 // Per-cell luma change that counts as motion
+#define MOTION_MIN_CELLS 2  // Cells that must change (one alone is usually sensor noise)
+#define MOTION_REFRESH_MS 1000
+#define MOTION_IDLE_TIMEOUT 2000
+#define MOTION_IDLE_INTERVAL_MS 250 // 4 FPS while nothing moves
+
+/**
+ * @brief Part of the frame the motion detector compares, in percent of width/height
+ */
+struct MotionRegion {
+  uint8_t x, y, w, h;
+};
+
+/**
+ * @brief The last frame sent in motion-aware mode
+ */
+struct MotionState {
+  uint8_t reference[MOTION_GRID_CELLS]; // Grid of the last frame sent
+  bool referenceValid = false;
+  uint16_t referenceWidth = 0;          // Frame width the reference grid was taken at
+  unsigned long lastSentAt = 0;         // millis() of the last frame sent
+};
+
+/**
+ * @brief What motionCheckFrame() made of a frame
+ */
+enum MotionVerdict : uint8_t {
+  MOTION_CHANGED = 0, // Send it; it is the new reference and keeps the capture rate up
+  MOTION_REFRESH,     // Unchanged, but due for a refresh: send it
+  MOTION_DUPLICATE    // Near-duplicate: do not send it
+};
+
+/**
+ * @brief Reduce a 1/8 scale RGB565 thumbnail (high byte first, as jpg2rgb565() writes
+ * it) to the grid of mean luma
+ */
+inline void motionGridFromRgb565(const uint8_t *pixels, size_t width, size_t height, uint8_t *grid) {
+  uint32_t sums[MOTION_GRID_CELLS] = { 0 };
+  uint16_t counts[MOTION_GRID_CELLS] = { 0 };
+  for (size_t y = 0; y < height; y++) {
+    for (size_t x = 0; x < width; x++) {
+      const uint8_t *pixel = pixels + 2 * (y * width + x);
+      uint8_t r = pixel[0] & 0xF8;
+      uint8_t g = ((pixel[0] & 0x07) << 5) | ((pixel[1] & 0xE0) >> 3);
+      uint8_t b = (pixel[1] & 0x1F) << 3;
+      int cell = (y * MOTION_GRID_H / height) * MOTION_GRID_W + (x * MOTION_GRID_W / width);
+      sums[cell] += (77 * r + 150 * g + 29 * b) >> 8;
+      counts[cell]++;
+    }
+  }
+  for (int cell = 0; cell < MOTION_GRID_CELLS; cell++) {
+    grid[cell] = counts[cell] ? sums[cell] / counts[cell] : 0;
+  }
+}
+
+/**
+ * @brief Cells of the region of interest that differ by MOTION_THRESHOLD or more
+ * @details The region always covers at least one cell.
+ */
+inline int motionChangedCells(const uint8_t *grid, const uint8_t *reference, const MotionRegion &roi) {
+  int x0 = roi.x * MOTION_GRID_W / 100, x1 = (roi.x + roi.w) * MOTION_GRID_W / 100;
+  int y0 = roi.y * MOTION_GRID_H / 100, y1 = (roi.y + roi.h) * MOTION_GRID_H / 100;
+  if (x1 <= x0) x1 = x0 + 1;
+  if (y1 <= y0) y1 = y0 + 1;
+  int changedCells = 0;
+  for (int y = y0; y < y1; y++) {
+    for (int x = x0; x < x1; x++) {
+      int cell = y * MOTION_GRID_W + x;
+      if (abs((int)grid[cell] - (int)reference[cell]) >= MOTION_THRESHOLD) changedCells++;
+    }
+  }
+  return changedCells;
+}
+
+/**
+ * @brief Decide whether a frame is a near-duplicate of the last frame sent
+ * @details A frame that is sent (MOTION_CHANGED or MOTION_REFRESH) becomes the reference.
+ * The first frame, and the first after a framesize change, always counts as changed.
+ *
+ * @param grid The frame's grid (motionGridFromRgb565())
+ * @param width The frame's width
+ * @param now millis()
+ */
+inline MotionVerdict motionCheckFrame(MotionState &state, const uint8_t *grid, uint16_t width,
+                                      const MotionRegion &roi, unsigned long now) {
+  bool changed = !state.referenceValid || width != state.referenceWidth ||
+                 motionChangedCells(grid, state.reference, roi) >= MOTION_MIN_CELLS;
+  if (!changed && now - state.lastSentAt < MOTION_REFRESH_MS) {
+    return MOTION_DUPLICATE;
+  }
+  memcpy(state.reference, grid, sizeof(state.reference));
+  state.referenceValid = true;
+  state.referenceWidth = width;
+  state.lastSentAt = now;
+  return changed ? MOTION_CHANGED : MOTION_REFRESH;
+}
+
+/**
+ * @brief Capture interval in motion-aware mode: `interval` (the pacing and fps cap), or
+ * the idle rate once nothing has changed for MOTION_IDLE_TIMEOUT
+ *
+ * @param sinceActivity ms since the last changed frame or wake-up
+ */
+inline uint32_t motionCaptureInterval(uint32_t interval, unsigned long sinceActivity) {
+  if (sinceActivity > MOTION_IDLE_TIMEOUT && interval < MOTION_IDLE_INTERVAL_MS) {
+    return MOTION_IDLE_INTERVAL_MS;
+  }
+  return interval;
+}
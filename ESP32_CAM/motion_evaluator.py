@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""
+Offline evaluator for the camera's motion-aware capture mode.
+
+Decodes a recorded JPEG sequence to the 1/8 scale RGB565 thumbnails the
+firmware gets from jpg2rgb565(..., JPG_SCALE_8X), writes them to a trace
+and replays it with tests/build/test_motion_detector, which runs the
+decision in motion_detector.h: the luma grid, the region of interest, the
+refresh frame and the capture loop's drop to MOTION_IDLE_INTERVAL_MS
+(4 FPS) once nothing has moved for MOTION_IDLE_TIMEOUT. It reports the
+frames captured, sent and suppressed, the bytes sent against streaming
+every frame, and the longest time the picture shown was out of date.
+The only difference left from the camera is the JPEG decoder (Pillow's
+instead of tjpgd), which can shift a cell's mean luma by a level or two.
+
+Usage:
+    python3 motion_evaluator.py recording.mjpeg [--fps 20] [--roi 0,0,100,100]
+    python3 motion_evaluator.py frames_dir/      (JPEG files, sorted by name)
+
+--roi is the dashboard's region of interest in percent (x,y,w,h). Requires
+Pillow (pip install pillow) and a host g++ for the test build. A recording
+can be made with e.g.
+    ffmpeg -i drive.mp4 -vf scale=640:480 -q:v 10 -f mjpeg recording.mjpeg
+"""
+
+import argparse
+import io
+import os
+import subprocess
+import sys
+import tempfile
+
+from PIL import Image
+
+TESTS_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tests")
+REPLAY = os.path.join("build", "test_motion_detector")
+
+
+def split_jpegs(data):
+    """Splits an MJPEG recording at SOI markers that follow an EOI marker."""
+    frames = []
+    start = data.find(b"\xff\xd8\xff")
+    while start >= 0:
+        end = data.find(b"\xff\xd9\xff\xd8\xff", start)
+        if end < 0:
+            frames.append(data[start:])
+            break
+        frames.append(data[start:end + 2])
+        start = end + 2
+    return frames
+
+
+def load_frames(path):
+    if os.path.isdir(path):
+        names = sorted(n for n in os.listdir(path) if n.lower().endswith((".jpg", ".jpeg")))
+        frames = []
+        for name in names:
+            with open(os.path.join(path, name), "rb") as f:
+                frames.append(f.read())
+        return frames
+    with open(path, "rb") as f:
+        return split_jpegs(f.read())
+
+
+def trace_line(jpeg):
+    """One trace line: JPEG size, frame width and the 1/8 scale thumbnail in RGB565."""
+    image = Image.open(io.BytesIO(jpeg))
+    width, height = image.size
+    image.draft("RGB", ((width + 7) // 8, (height + 7) // 8))
+    image = image.convert("RGB")
+    rgb = image.tobytes()
+    pixels = bytearray()
+    for i in range(0, len(rgb), 3):
+        r, g, b = rgb[i], rgb[i + 1], rgb[i + 2]
+        value = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3)
+        pixels += bytes((value >> 8, value & 0xFF))
+    return "%d %d %d %d %s\n" % (len(jpeg), width, image.size[0], image.size[1], pixels.hex())
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("recording", help="MJPEG file or directory of JPEG frames")
+    parser.add_argument("--fps", type=float, default=20, help="frame rate of the recording")
+    parser.add_argument("--roi", default="0,0,100,100",
+                        help="region of interest in percent of the frame: x,y,w,h")
+    args = parser.parse_args()
+
+    frames = load_frames(args.recording)
+    if not frames:
+        sys.exit("error: no JPEG frames found in %s" % args.recording)
+
+    if subprocess.call(["make", "-s", "-C", TESTS_DIR, REPLAY]) != 0:
+        sys.exit("error: could not build %s" % REPLAY)
+    with tempfile.NamedTemporaryFile("w", suffix=".txt") as trace:
+        trace.writelines(trace_line(jpeg) for jpeg in frames)
+        trace.flush()
+        sys.exit(subprocess.call([os.path.join(TESTS_DIR, REPLAY), trace.name, str(args.fps), args.roi]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""
+Summarises recorded drive sessions to check the camera's drive-state pacing.
+
+A session is the CSV the dashboard downloads after startCameraSession() /
+saveCameraSession() in the browser console: one row per received frame with
+its size, capture-to-receive latency, resolution, JPEG quality and the drive
+command the car was executing. For each drive state the report shows frame
+rate, bandwidth, latency and perceived latency, i.e. the latency plus half
+the mean gap between frames (how old the picture on screen is on average).
+
+Usage:
+    python3 pacing_report.py session.csv [more_sessions.csv ...]
+
+Record one session with pacing (the dashboard sends drive hints) and one
+without (e.g. older dashboard or firmware) over the same route to compare.
+"""
+
+import csv
+import sys
+
+COMMAND_NAMES = {0: "stop", 1: "forward", 2: "backward", 4: "left", 8: "right"}
+MAX_GAP_MS = 1000  # Longer gaps (paused stream, reconnect) don't count as frame intervals
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p / 100.0 * len(values)))]
+
+
+def load_session(path):
+    with open(path, newline="") as f:
+        return list(csv.DictReader(f))
+
+
+def summarise(rows):
+    """Groups frames by drive state; each frame's gap is charged to its own state."""
+    groups = {}
+    previous = None
+    for row in rows:
+        time_ms = float(row["time_ms"])
+        seq = int(row["seq"])
+        state = COMMAND_NAMES.get(int(row["command"]), "command " + row["command"])
+        group = groups.setdefault(state, {"frames": 0, "bytes": 0, "duration": 0.0, "dropped": 0,
+                                          "gaps": [], "latencies": [], "qualities": []})
+        group["frames"] += 1
+        group["bytes"] += int(row["bytes"])
+        group["qualities"].append(int(row["quality"]))
+        if row["latency_ms"]:
+            group["latencies"].append(float(row["latency_ms"]))
+        if previous is not None:
+            gap = time_ms - previous[0]
+            if 0 < gap <= MAX_GAP_MS:
+                group["duration"] += gap
+                group["gaps"].append(gap)
+            if seq > previous[1] + 1:
+                group["dropped"] += seq - previous[1] - 1
+        previous = (time_ms, seq)
+    return groups
+
+
+def print_report(path, groups):
+    print(path)
+    print("  %-9s %7s %6s %9s %8s %8s %10s %8s %6s" % (
+        "state", "frames", "FPS", "kbit/s", "lat p50", "lat p95", "perceived", "quality", "drops"))
+    for state, g in sorted(groups.items(), key=lambda item: -item[1]["frames"]):
+        seconds = g["duration"] / 1000.0
+        fps = len(g["gaps"]) / seconds if seconds else 0.0
+        kbps = g["bytes"] * 8 / 1000.0 / seconds if seconds else 0.0
+        mean_gap = sum(g["gaps"]) / len(g["gaps"]) if g["gaps"] else 0.0
+        latency_p50 = percentile(g["latencies"], 50)
+        print("  %-9s %7d %6.1f %9.0f %8.0f %8.0f %10.0f %8.1f %6d" % (
+            state, g["frames"], fps, kbps, latency_p50, percentile(g["latencies"], 95),
+            latency_p50 + mean_gap / 2, sum(g["qualities"]) / len(g["qualities"]), g["dropped"]))
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__.strip().split("\n\n")[2])
+    for path in sys.argv[1:]:
+        rows = load_session(path)
+        if not rows:
+            print("%s: no frames" % path)
+            continue
+        print_report(path, summarise(rows))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""
+Generates index_gz.h: a pre-gzipped copy of the dashboard in index_v2.0.0.h.
+
+The firmware serves this byte array with `Content-Encoding: gzip` and uses the
+ETag to answer `If-None-Match` revalidations with 304 Not Modified.
+
+Usage (run again whenever index_v2.0.0.h changes):
+    python3 build_index_gz.py [input.h] [output.h]
+
+Copy the generated index_gz.h next to the sketch, like index.h.
+"""
+
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_INPUT = os.path.join(HERE, "index_v2.0.0.h")
+DEFAULT_OUTPUT = os.path.join(HERE, "index_gz.h")
+BYTES_PER_LINE = 16
+
+
+def extract_html(header_text):
+    """Returns the contents of the R"=====(...)=====" raw string literal."""
+    match = re.search(r'R"=====\((.*)\)====="', header_text, re.S)
+    if not match:
+        sys.exit("error: no R\"=====( ... )=====\" literal found in input")
+    # The .h file may be checked out with CRLF line endings; serve LF only.
+    return match.group(1).replace("\r\n", "\n")
+
+
+def main():
+    input_path = sys.argv[1] if len(sys.argv) > 1 else DEFAULT_INPUT
+    output_path = sys.argv[2] if len(sys.argv) > 2 else DEFAULT_OUTPUT
+
+    with open(input_path, encoding="utf-8") as f:
+        html = extract_html(f.read()).encode("utf-8")
+
+    # mtime=0 keeps the output (and therefore the ETag) reproducible.
+    compressed = gzip.compress(html, compresslevel=9, mtime=0)
+    etag = '"' + hashlib.sha1(compressed).hexdigest()[:16] + '"'
+
+    lines = []
+    for i in range(0, len(compressed), BYTES_PER_LINE):
+        chunk = compressed[i:i + BYTES_PER_LINE]
+        lines.append("  " + ", ".join("0x%02x" % b for b in chunk) + ",")
+
+    with open(output_path, "w", encoding="utf-8", newline="\n") as f:
+        f.write("// Generated by build_index_gz.py from %s -- do not edit.\n"
+                % os.path.basename(input_path))
+        f.write("// Uncompressed: %d bytes, gzip: %d bytes.\n" % (len(html), len(compressed)))
+        f.write("const char HTML_CONTENT_GZ_ETAG[] = %s;\n" % ('"\\"' + etag[1:-1] + '\\""'))
+        f.write("const size_t HTML_CONTENT_GZ_LENGTH = %d;\n" % len(compressed))
+        f.write("const uint8_t HTML_CONTENT_GZ[] PROGMEM = {\n")
+        f.write("\n".join(lines) + "\n")
+        f.write("};\n")
+
+    print("%s: %d -> %d bytes, ETag %s" % (output_path, len(html), len(compressed), etag))
+
+
+if __name__ == "__main__":
+    main()
@@ -416,16 +416,19 @@ const char *HTML_CONTENT = R"=====(
       margin-bottom: 15px;
     }
 
-    #camera-stream {
+    #camera-stream, #camera-canvas {
       width: 100%;
       height: 100%;
       object-fit: cover;
       display: block;
     }
+    #camera-canvas.hidden, #camera-stream.hidden { display: none; }
 
     .stream-overlay { position: absolute; top: 0; left: 0; width: 100%; height: 100%; background-color: rgba(0, 0, 0, 0.7); display: flex; flex-direction: column; align-items: center; justify-content: center; color: white; gap: 10px; transition: opacity 0.3s ease; text-align: center; z-index: 5; border-radius: 8px; }
     .stream-overlay i { font-size: 1.8rem; }
     .stream-overlay.hidden { opacity: 0; pointer-events: none; }
+    .stream-stats { position: absolute; top: 8px; left: 8px; padding: 3px 8px; border-radius: 4px; background-color: rgba(0, 0, 0, 0.55); color: white; font-size: 0.75rem; font-family: monospace; z-index: 4; pointer-events: none; }
+    .stream-stats.hidden { display: none; }
 
     .video-controls { display: flex; align-items: center; justify-content: space-between; margin-top: auto; padding-top: 10px; flex-wrap: wrap; gap: 10px; flex-shrink: 0; }
     .camera-btn { background-color: var(--accent-primary); color: white; border: none; border-radius: 50px; padding: 8px 18px; font-size: 0.9rem; font-weight: 600; cursor: pointer; display: flex; align-items: center; justify-content: center; gap: 8px; transition: var(--transition); box-shadow: var(--shadow-sm); flex-grow: 1; }
@@ -973,6 +976,11 @@ const char *HTML_CONTENT = R"=====(
               <span class="telemetry-label">Latency</span>
               <span class="telemetry-value" id="telemetry-latency">--- ms</span>
             </div>
+            <div class="telemetry-item" title="Command receipt to motor actuation on the car (p50 / p99)">
+              <i class="fas fa-cogs telemetry-icon"></i>
+              <span class="telemetry-label">Actuation</span>
+              <span class="telemetry-value" id="telemetry-actuation">--- ms</span>
+            </div>
             <div class="telemetry-item">
               <i class="fas fa-ruler telemetry-icon"></i>
               <span class="telemetry-label">Distance</span>
@@ -1000,6 +1008,8 @@ const char *HTML_CONTENT = R"=====(
         <div class="video-feed-section">
           <div class="video-feed">
             <img id="camera-stream" src="" alt="RC Car Camera Feed">
+            <canvas id="camera-canvas" class="hidden"></canvas>
+            <div class="stream-stats hidden" id="stream-stats"></div>
             <div class="stream-overlay" id="stream-overlay">
               <i class="fas fa-power-off"></i>
               <span>Camera feed inactive</span>
@@ -1042,6 +1052,81 @@ const char *HTML_CONTENT = R"=====(
 
   <!-- Floating Control Button and Panel will be added by JS -->
 
+  <!-- Camera viewer worker: decodes JPEG frames off the main thread and draws only the newest.
+       Not executed here; started from its text by initCameraViewer(). camera_viewer_benchmark.html
+       loads the same source. -->
+  <script type="text/js-worker" id="camera-viewer-worker">
+    // Messages in:  { type: 'init', canvas?: OffscreenCanvas }
+    //               { type: 'frame', buffer, offset, length }  (buffer transferred)
+    // Messages out: { type: 'bitmap', bitmap }  (only without a canvas; bitmap transferred)
+    //               { type: 'stats', received, decoded, drawn, dropped, errors, decodeTimes }  once per second
+    let canvas = null, ctx = null;
+    let pending = null;   // Newest frame not yet decoded
+    let latest = null;    // Newest decoded bitmap not yet drawn
+    let decoding = false, drawScheduled = false;
+    let stats = { received: 0, decoded: 0, drawn: 0, dropped: 0, errors: 0, decodeTimes: [] };
+    const nextFrame = self.requestAnimationFrame ? cb => self.requestAnimationFrame(cb) : cb => setTimeout(cb, 16);
+
+    self.onmessage = (event) => {
+      const message = event.data;
+      if (message.type === 'init') {
+        canvas = message.canvas || null;
+        ctx = canvas ? canvas.getContext('2d') : null;
+      } else if (message.type === 'frame') {
+        stats.received++;
+        if (pending) stats.dropped++; // Stale before it was even decoded
+        pending = message;
+        if (!decoding) decodeFrames();
+      }
+    };
+
+    async function decodeFrames() {
+      decoding = true;
+      while (pending) {
+        const frame = pending;
+        pending = null;
+        const start = performance.now();
+        let bitmap;
+        try {
+          const jpeg = new Uint8Array(frame.buffer, frame.offset, frame.length);
+          bitmap = await createImageBitmap(new Blob([jpeg], { type: 'image/jpeg' }));
+        } catch (error) {
+          stats.errors++;
+          continue;
+        }
+        stats.decodeTimes.push(performance.now() - start);
+        stats.decoded++;
+        if (latest) { latest.close(); stats.dropped++; } // Decoded but superseded before display
+        latest = bitmap;
+        if (!drawScheduled) { drawScheduled = true; nextFrame(draw); }
+      }
+      decoding = false;
+    }
+
+    function draw() {
+      drawScheduled = false;
+      if (!latest) return;
+      const bitmap = latest;
+      latest = null;
+      stats.drawn++;
+      if (!ctx) {
+        self.postMessage({ type: 'bitmap', bitmap }, [bitmap]);
+        return;
+      }
+      if (canvas.width !== bitmap.width || canvas.height !== bitmap.height) {
+        canvas.width = bitmap.width;
+        canvas.height = bitmap.height;
+      }
+      ctx.drawImage(bitmap, 0, 0);
+      bitmap.close();
+    }
+
+    setInterval(() => {
+      self.postMessage(Object.assign({ type: 'stats' }, stats));
+      stats = { received: 0, decoded: 0, drawn: 0, dropped: 0, errors: 0, decodeTimes: [] };
+    }, 1000);
+  </script>
+
   <script>
     // Constants
     const CMD_STOP     = 0;
@@ -1049,19 +1134,63 @@ const char *HTML_CONTENT = R"=====(
     const CMD_BACKWARD = 2;
     const CMD_LEFT     = 4;
     const CMD_RIGHT    = 8;
+    // Binary command frame opcodes (see "Binary Command Frame Protocol" in the firmware)
+    const OP_DRIVE     = 0x01;
+    const OP_PING      = 0x02;
+    const OP_TELEMETRY_MODE = 0x03;
+    const OP_STATS     = 0x04;
+    const OP_CLOCK_OFFSET = 0x05;
+    const OP_LEASE     = 0x06;
+    const OP_RFID_ADMIN = 0x07;
+    const OP_AUTH_RESUME = 0x08;
+    const OP_PONG      = 0x82;
+    const OP_TELEMETRY = 0x83;
+    const TELEMETRY_BINARY = 1;
+    const TELEMETRY_LEVEL_FULL = 1; // 0 = safety only, 1 = full, 2 = debug
+    const TELEMETRY_KEYFRAME_BIT = 0x8000;
+    const TELEMETRY_TIMESTAMP_BIT = 0x4000; // Record carries its capture time (int64 us, our clock)
+    const CLOCK_WINDOW = 16; // PING/PONG samples kept for the rolling RTT/jitter/offset estimate
+    const CAMERA_FRAME_HEADER_VERSION = 1; // See "Binary frame header" in WebSocket_Camera.ino
+    const CAMERA_SESSION_LIMIT = 100000; // Frames kept by a session recording (~1.5 h at 20 FPS)
+    // Telemetry fields in wire order: [name, bytes, kind] (kind: 's' signed, 'b' bool, 'n' unsigned with 0xFFFF = none)
+    const TELEMETRY_FIELDS = [
+      ['rssi', 1, 's'], ['authorized', 1, 'b'], ['distance', 2, 'u'], ['distanceAge', 2, 'n'],
+      ['closingSpeed', 2, 's'], ['ttc', 2, 'n'], ['obstacleAvoidance', 1, 'b'],
+      ['currentCommand', 1, 'u'], ['avoidanceState', 1, 'u']
+    ];
     const VALUE_UPDATE_ANIMATION_DURATION = 400; // ms, match CSS
 
     // --- State Variables ---
     let ws = null;
     let lastSentCommand = CMD_STOP;
+    let commandSequence = 0; // 16-bit sequence for binary command frames, restarts at 0 per connection
+    let drivingLease = { driver: false, held: false }; // Last LEASE notice: do we drive, does anyone
+    let driveRepeatMs = 150; // Re-send interval of a held command: a third of the car's deadman timeout
+    let driveRepeatTimer = null;
+    let telemetryState = {}; // Last known value of every telemetry field; deltas are merged into it
     let keyboardEnabled = true;
     let keyPressActive = {};
     let latestPing = 0;
     let currentLatency = 0;
     let pingInterval = null;
+    let pingSequence = 0; // 16-bit sequence of clock-exchange pings
+    let pingsLost = 0;
+    let clockSamples = []; // Rolling window of { seq, rtt, offset } (us)
+    let clockOffset = null; // Device clock minus our clock (us), from the lowest-RTT sample
+    let telemetryDelay = null; // Capture-to-display delay of the last timestamped telemetry (us)
+    let cameraSocket = null; // Camera WebSocket (port 82), attached by the camera snippet
+    let cameraPingTimer = null;
+    let cameraClockSamples = []; // Rolling window of { rtt, offset } (us) against the camera's clock
+    let cameraClockOffset = null; // Camera clock minus our clock (us)
+    let cameraStats = null; // Per-second frame counters, see recordCameraFrame()
+    let cameraSession = null; // Per-frame log of a recorded drive session, see startCameraSession()
+    let cameraViewer = null; // Worker decoding camera frames, see initCameraViewer()
+    let cameraViewerStats = null; // Last per-second stats reported by the worker
+    let statsInterval = null;
     let reconnectAttempts = 0;
     const maxReconnectAttempts = 3;
     let rfidAuthorized = false;
+    let sessionToken = sessionStorage.getItem('rcSessionToken'); // Hex token of our RFID session, for resuming after a reconnect
     let lastAccessTime = null;
     let authorizedUser = null;
     let videoStreamActive = false;
@@ -1088,12 +1217,15 @@ const char *HTML_CONTENT = R"=====(
     const connectBtn = document.getElementById('wc_conn');
     const telemetrySignalEl = document.getElementById('telemetry-signal');
     const telemetryLatencyEl = document.getElementById('telemetry-latency');
+    const telemetryActuationEl = document.getElementById('telemetry-actuation');
     const particleToggle = document.getElementById('particle_toggle'); // In menu
     const keyboardToggle = document.getElementById('keyboard_toggle'); // In menu
     const soundToggle = document.getElementById('sound_toggle');     // In menu
     const darkModeToggle = document.getElementById('dark_mode_toggle'); // In nav
     const cameraStream = document.getElementById('camera-stream');
     const streamOverlay = document.getElementById('stream-overlay');
+    const streamStatsEl = document.getElementById('stream-stats');
+    const cameraCanvas = document.getElementById('camera-canvas');
     const cameraToggleBtn = document.getElementById('camera-toggle');
     const qualitySelector = document.getElementById('video-quality');
     const fullPageBtn = document.querySelector('.full-page-button');
@@ -1719,6 +1851,7 @@ const char *HTML_CONTENT = R"=====(
           const host = window.location.hostname || '192.168.4.1'; // Default IP if hostname fails
           const wsUrl = `ws://${host}:81`; // Standard port for ESP AsyncWebSocket
           ws = new WebSocket(wsUrl);
+          ws.binaryType = 'arraybuffer'; // Binary replies (e.g. OP_PONG) arrive as ArrayBuffer
           console.log(`Attempting connect: ${wsUrl}`);
           updateConnectionStatus('CONNECTING'); // Update main status
           updateNavbarStatus('CONNECTING');   // Update navbar status
@@ -1778,10 +1911,23 @@ const char *HTML_CONTENT = R"=====(
         showToast('Connected successfully', 'success');
         playSound('connect'); // Added sound
         reconnectAttempts = 0; // Reset on successful connection
+        commandSequence = 0; // First frame on a new connection restarts the firmware's sequence window
+        telemetryState = {};
+        pingSequence = 0; pingsLost = 0; clockSamples = []; clockOffset = null; telemetryDelay = null;
+        // Opt into compact binary delta telemetry at the "full" subscription level
+        ws.send(new Uint8Array([OP_TELEMETRY_MODE, 0, 0, TELEMETRY_BINARY, TELEMETRY_LEVEL_FULL]).buffer);
         clearInterval(pingInterval); // Clear existing interval just in case
-        pingInterval = setInterval(sendPing, 3000); // Start pinging
+        pingInterval = setInterval(sendPing, 1000); // Start pinging (feeds the rolling clock estimate)
         sendPing(); // Send initial ping immediately
+        clearInterval(statsInterval);
+        statsInterval = setInterval(requestLatencyStats, 5000); // Poll the car's latency histograms
         resetAuthorizationStatus(); // Reset RFID state
+        if (sessionToken) {
+          // Take our RFID session back without a re-scan: [OP_AUTH_RESUME][seq lo][seq hi][16-byte token]
+          const token = sessionToken.match(/../g).map(hex => parseInt(hex, 16));
+          ws.send(new Uint8Array([OP_AUTH_RESUME, 0, 0, ...token]).buffer);
+          if (authDetailsEl) authDetailsEl.textContent = 'Resuming session...';
+        }
         resetTelemetryDisplay(); // Clear old telemetry
         if (streamOverlay) {
             streamOverlay.innerHTML = '<i class="fas fa-play"></i><span>Press Start Feed</span>';
@@ -1803,6 +1949,9 @@ const char *HTML_CONTENT = R"=====(
         if (connectionDetailsEl) connectionDetailsEl.textContent = 'Not connected to device';
         if (cameraToggleBtn) cameraToggleBtn.disabled = true; // Disable camera
         clearInterval(pingInterval); pingInterval = null;
+        clearInterval(statsInterval); statsInterval = null;
+        clearInterval(driveRepeatTimer); driveRepeatTimer = null;
+        drivingLease = { driver: false, held: false };
         resetTelemetryDisplay();
         resetAuthorizationStatus();
         pauseVideoStream(); // Ensure video stops and overlay shows disconnected state
@@ -1823,12 +1972,25 @@ const char *HTML_CONTENT = R"=====(
       function handleWebSocketMessage(event) {
         const message = event.data;
         // console.log("WS Recv:", message); // Can be noisy, uncomment if debugging
+        if (message instanceof ArrayBuffer) {
+          handleBinaryMessage(message);
+          return;
+        }
         if (message.startsWith('PONG:')) {
           const now = Date.now();
           currentLatency = now - latestPing;
           updateTelemetryValue(telemetryLatencyEl, `${currentLatency} ms`, false); // Update frequently, no animation
         } else if (message.startsWith('TELEMETRY:')) {
           processTelemetry(message);
+        } else if (message.startsWith('STATS:')) {
+          processLatencyStats(message);
+        } else if (message.startsWith('LEASE:')) {
+          processLeaseNotice(message);
+        } else if (message.startsWith('RFIDADMIN:')) {
+          const reply = JSON.parse(message.substring('RFIDADMIN:'.length));
+          console.log('RFID admin:', reply);
+          showToast(`Card store: ${reply.result} (${reply.count}/${reply.capacity} cards)`,
+                    reply.result === 'ok' ? 'success' : 'error');
         } else if (message.startsWith('RFID:')) {
           handleRfidAuthorization(message);
         } 
@@ -1871,6 +2033,26 @@ const char *HTML_CONTENT = R"=====(
               }
       }
 
+      function handleBinaryMessage(buffer) {
+        const bytes = new Uint8Array(buffer);
+        if (bytes.length === 0) return;
+        switch (bytes[0]) {
+          case OP_PONG:
+            if (bytes.length >= 27) {
+              handleClockPong(new DataView(buffer));
+              break;
+            }
+            currentLatency = Date.now() - latestPing;
+            updateTelemetryValue(telemetryLatencyEl, `${currentLatency} ms`, false);
+            break;
+          case OP_TELEMETRY:
+            if (bytes.length >= 5) mergeTelemetry(decodeTelemetryRecord(new DataView(buffer)));
+            break;
+          default:
+            console.log("Unknown binary WS msg, opcode:", bytes[0]);
+        }
+      }
+
       function handleWebSocketError(error) {
         console.error('WS Error:', error);
         showToast('WebSocket connection error', 'error');
@@ -1890,10 +2072,21 @@ const char *HTML_CONTENT = R"=====(
           // Don't explicitly call ws.close() here, let the browser handle error/close sequence
       }
 
+      // Our clock in microseconds, with sub-millisecond resolution
+      function clientMicros() {
+        return (performance.timeOrigin + performance.now()) * 1000;
+      }
+
       function sendPing() {
         if (ws && ws.readyState === WebSocket.OPEN) {
           latestPing = Date.now();
-          ws.send('PING\r\n'); // Using CRLF as common ESP terminator
+          // Four-timestamp exchange: [OP_PING, seq lo, seq hi, T1 (float64 us)]
+          const frame = new DataView(new ArrayBuffer(11));
+          frame.setUint8(0, OP_PING);
+          frame.setUint16(1, pingSequence, true);
+          frame.setFloat64(3, clientMicros(), true);
+          pingSequence = (pingSequence + 1) & 0xFFFF;
+          ws.send(frame.buffer);
         } else {
           // Stop pinging if WS is not open
           clearInterval(pingInterval); pingInterval = null; currentLatency = 0;
@@ -1901,6 +2094,69 @@ const char *HTML_CONTENT = R"=====(
         }
       }
 
+      // NTP-style estimate: RTT excludes the car's processing time (T3 - T2), and the
+      // offset is taken from the lowest-RTT sample in the window, where queuing delay
+      // (and therefore path asymmetry) is smallest.
+      function handleClockPong(view) {
+        const t4 = clientMicros();
+        const seq = view.getUint16(1, true);
+        const t1 = view.getFloat64(3, true);
+        const t2 = Number(view.getBigInt64(11, true));
+        const t3 = Number(view.getBigInt64(19, true));
+        const last = clockSamples[clockSamples.length - 1];
+        if (last) {
+          const gap = (seq - last.seq) & 0xFFFF;
+          if (gap === 0 || gap > 0x8000) return; // Duplicate or reordered pong
+          pingsLost += gap - 1;
+        }
+        clockSamples.push({ seq, rtt: (t4 - t1) - (t3 - t2), offset: ((t2 - t1) + (t3 - t4)) / 2 });
+        if (clockSamples.length > CLOCK_WINDOW) clockSamples.shift();
+
+        const best = clockSamples.reduce((a, b) => (b.rtt < a.rtt ? b : a));
+        clockOffset = best.offset;
+        let jitter = 0;
+        for (let i = 1; i < clockSamples.length; i++) jitter += Math.abs(clockSamples[i].rtt - clockSamples[i - 1].rtt);
+        if (clockSamples.length > 1) jitter /= clockSamples.length - 1;
+
+        // Let the car stamp our telemetry in our clock (client = device - offset)
+        const offsetFrame = new DataView(new ArrayBuffer(11));
+        offsetFrame.setUint8(0, OP_CLOCK_OFFSET);
+        offsetFrame.setBigInt64(3, BigInt(Math.round(-clockOffset)), true);
+        ws.send(offsetFrame.buffer);
+
+        const rtt = clockSamples[clockSamples.length - 1].rtt;
+        currentLatency = Math.round(rtt / 1000);
+        updateTelemetryValue(telemetryLatencyEl, `${(rtt / 1000).toFixed(1)} ms`, false);
+        const details = [`RTT ${(rtt / 1000).toFixed(1)} ms (min ${(best.rtt / 1000).toFixed(1)} ms)`,
+          `Jitter ${(jitter / 1000).toFixed(1)} ms`, `Clock offset ${(clockOffset / 1000).toFixed(1)} ms`,
+          `Lost pings ${pingsLost}`];
+        if (telemetryDelay !== null) details.push(`Telemetry delay ${(telemetryDelay / 1000).toFixed(1)} ms`);
+        if (telemetryLatencyEl) telemetryLatencyEl.closest('.telemetry-item').title = details.join('\n');
+      }
+
+      function requestLatencyStats() {
+        if (ws && ws.readyState === WebSocket.OPEN) {
+          ws.send(new Uint8Array([OP_STATS, 0, 0]).buffer);
+        }
+      }
+
+      // Shows command-to-actuation latency (p50 / p99 of the "total" stage) and logs every stage
+      function processLatencyStats(data) {
+        try {
+          const stats = JSON.parse(data.substring('STATS:'.length));
+          const total = stats.total;
+          if (!total || total.n === 0) return;
+          const ms = us => (us / 1000).toFixed(1);
+          updateTelemetryValue(telemetryActuationEl, `${ms(total.p50)} / ${ms(total.p99)} ms`, false);
+          const stages = ['parse', 'auth', 'queue', 'actuate', 'total']
+            .filter(name => stats[name])
+            .map(name => `${name}: p50 ${stats[name].p50} us, p99 ${stats[name].p99} us, max ${stats[name].max} us`);
+          if (telemetryActuationEl) telemetryActuationEl.closest('.telemetry-item').title = stages.join('\n');
+        } catch (error) {
+          console.error('Latency stats parse error:', error);
+        }
+      }
+
       // Add this function to your JavaScript code
       function disableForwardControls(disabled) {
         // This is a helper function to disable forward movement controls
@@ -1936,9 +2192,19 @@ const char *HTML_CONTENT = R"=====(
           // Only send if WebSocket is open and command is different from last sent,
           // OR always send STOP command immediately when requested.
           if (ws && ws.readyState === WebSocket.OPEN) {
+            if (drivingLease.held && !drivingLease.driver) {
+              // Someone else is driving: ask for a handover instead (granted once they stop and idle)
+              if (command !== CMD_STOP) {
+                sendLeaseRequest(true);
+                showToast('Another client is driving - requested control', 'warning', 1500);
+              }
+              return;
+            }
             if (command !== lastSentCommand || command === CMD_STOP) {
-              ws.send(command + "\r\n"); // Send command + CRLF
+              sendDriveFrame(command);
               lastSentCommand = command;
+              updateDriveRepeat();
+              sendCameraDriveHint(); // Camera re-paces before the car moves
               console.log(`Sent command: ${command}`); // Debug log
             }
           } else if ((!ws || ws.readyState !== WebSocket.OPEN) && command !== CMD_STOP) {
@@ -1947,6 +2213,76 @@ const char *HTML_CONTENT = R"=====(
           }
       }
 
+      // Encodes a command as a binary OP_DRIVE frame: [opcode][seq lo][seq hi][command]
+      function sendDriveFrame(command) {
+          const frame = new Uint8Array(4);
+          frame[0] = OP_DRIVE;
+          frame[1] = commandSequence & 0xFF;
+          frame[2] = (commandSequence >> 8) & 0xFF;
+          frame[3] = command & 0xFF;
+          commandSequence = (commandSequence + 1) & 0xFFFF;
+          ws.send(frame.buffer);
+      }
+
+      // Keeps feeding the car's deadman watchdog while a movement command is held: without a
+      // driver frame for its timeout (frozen tab, lost link) the car ramps its motors down
+      function updateDriveRepeat() {
+          clearInterval(driveRepeatTimer);
+          driveRepeatTimer = lastSentCommand !== CMD_STOP ? setInterval(repeatDriveCommand, driveRepeatMs) : null;
+      }
+
+      function repeatDriveCommand() {
+          if (ws && ws.readyState === WebSocket.OPEN && lastSentCommand !== CMD_STOP) {
+            sendDriveFrame(lastSentCommand);
+          } else {
+            clearInterval(driveRepeatTimer);
+            driveRepeatTimer = null;
+          }
+      }
+
+      // Requests (true) or releases (false) the driving lease: [OP_LEASE][seq lo][seq hi][1|0]
+      function sendLeaseRequest(request) {
+          ws.send(new Uint8Array([OP_LEASE, 0, 0, request ? 1 : 0]).buffer);
+      }
+
+      // Card store administration, from the browser console while an admin card's session is active:
+      //   addRfidCard('04:A3:1B:2C:5D:80:00', 'Alice')   addRfidCard('4B17E200', 'Bob', true)   revokeRfidCard('4B17E200')
+      // Frame: [OP_RFID_ADMIN][seq lo][seq hi][action][uid length][uid...] + for add [flags][name UTF-8]
+      function sendRfidAdmin(action, uid, extra = []) {
+          const uidBytes = (uid.match(/[0-9a-f]{2}/gi) || []).map(hex => parseInt(hex, 16));
+          if (![4, 7, 10].includes(uidBytes.length)) throw new Error('UID must be 4, 7 or 10 bytes');
+          if (!ws || ws.readyState !== WebSocket.OPEN) throw new Error('Not connected');
+          ws.send(new Uint8Array([OP_RFID_ADMIN, 0, 0, action, uidBytes.length, ...uidBytes, ...extra]).buffer);
+      }
+      function addRfidCard(uid, name, admin = false) {
+          sendRfidAdmin(1, uid, [admin ? 1 : 0, ...new TextEncoder().encode(name)]);
+      }
+      function revokeRfidCard(uid) {
+          sendRfidAdmin(2, uid);
+      }
+
+      // "LEASE:{"driver":bool,"held":bool,"deadman":ms}" is sent on every lease change and after a rejected command
+      function processLeaseNotice(data) {
+        try {
+          const lease = JSON.parse(data.substring('LEASE:'.length));
+          if (lease.deadman > 0) {
+            driveRepeatMs = Math.max(50, Math.floor(lease.deadman / 3));
+          }
+          const wasDriver = drivingLease.driver;
+          drivingLease = { driver: !!lease.driver, held: !!lease.held };
+          if (drivingLease.driver && !wasDriver) {
+            sendCameraDriveHint(); // The command that won the lease was not hinted yet
+            showToast('You have control of the car', 'success', 1500);
+          } else if (!drivingLease.driver && wasDriver) {
+            lastSentCommand = CMD_STOP; // Our held command no longer applies
+            sendCameraDriveHint(true);
+            showToast('Control passed to another client - spectating', 'info', 2000);
+          }
+        } catch (e) {
+          console.error('Invalid LEASE notice:', e, data);
+        }
+      }
+
       // --- Telemetry & Status Updates ---
       function updateConnectionStatus(status) {
         if (wsStateEl) wsStateEl.textContent = status;
@@ -2006,11 +2342,47 @@ const char *HTML_CONTENT = R"=====(
         }
       }
 
+      // Decodes an OP_TELEMETRY record: [op][seq u16][field mask u16][present fields, little-endian]
+      function decodeTelemetryRecord(view) {
+        const mask = view.getUint16(3, true);
+        const data = { seq: view.getUint16(1, true), key: (mask & TELEMETRY_KEYFRAME_BIT) !== 0 };
+        let offset = 5;
+        if ((mask & TELEMETRY_TIMESTAMP_BIT) && view.byteLength >= 13) {
+          data.t = Number(view.getBigInt64(5, true));
+          offset = 13;
+        }
+        TELEMETRY_FIELDS.forEach(([name, size, kind], bit) => {
+          if (!(mask & (1 << bit)) || offset + size > view.byteLength) return;
+          let value = size === 1 ? view.getUint8(offset) : view.getUint16(offset, true);
+          if (kind === 's') value = size === 1 ? view.getInt8(offset) : view.getInt16(offset, true);
+          else if (kind === 'b') value = value !== 0;
+          else if (kind === 'n' && value === 0xFFFF) value = -1;
+          data[name] = value;
+          offset += size;
+        });
+        return data;
+      }
+
+      // Keyframes replace the known state, deltas only update the fields they carry
+      function mergeTelemetry(data) {
+        if (data.t !== undefined) telemetryDelay = clientMicros() - data.t; // Stamped in our clock by the car
+        if (data.key) telemetryState = {};
+        Object.assign(telemetryState, data);
+        applyTelemetry(telemetryState);
+      }
+
       function processTelemetry(data) {
         try {
               const jsonData = data.substring('TELEMETRY:'.length);
-              const telemetryData = JSON.parse(jsonData);
+              mergeTelemetry(JSON.parse(jsonData));
+        } catch (error) {
+            console.error('Telemetry Parse Error:', error, "Data:", data);
+            showToast('Error processing telemetry', 'error', 2000);
+        }
+      }
 
+      function applyTelemetry(telemetryData) {
+        try {
               // Signal (RSSI)
               const rssiValue = telemetryData.rssi;
               let signalText = 'N/A';
@@ -2061,7 +2433,7 @@ const char *HTML_CONTENT = R"=====(
                 }
               }
         } catch (error) {
-            console.error('Telemetry Parse Error:', error, "Data:", data);
+            console.error('Telemetry Display Error:', error, "Data:", telemetryData);
             showToast('Error processing telemetry', 'error', 2000);
             // Optionally reset only specific fields on error
             // resetTelemetryDisplay(false);
@@ -2071,6 +2443,7 @@ const char *HTML_CONTENT = R"=====(
       function resetTelemetryDisplay(animate = false) {
         updateTelemetryValue(telemetrySignalEl, 'N/A', animate);
         updateTelemetryValue(telemetryLatencyEl, '--- ms', animate);
+        updateTelemetryValue(telemetryActuationEl, '--- ms', animate);
         currentLatency = 0;
 
         const signalItem = telemetrySignalEl?.closest('.telemetry-item');
@@ -2084,6 +2457,10 @@ const char *HTML_CONTENT = R"=====(
         try {
             const authData = JSON.parse(data.substring('RFID:'.length));
             rfidAuthorized = authData.authorized;
+            // The firmware binds the session to this connection and rotates the token on every grant
+            sessionToken = rfidAuthorized && authData.token ? authData.token : null;
+            if (sessionToken) sessionStorage.setItem('rcSessionToken', sessionToken);
+            else sessionStorage.removeItem('rcSessionToken');
             authorizationPanel.classList.remove('authorized', 'unauthorized', 'waiting');
             authStateEl.classList.remove('authorized', 'unauthorized'); // Also clear status classes from text element
 
@@ -2095,7 +2472,7 @@ const char *HTML_CONTENT = R"=====(
                 authStateEl.classList.add('authorized'); // Add class to text
                 authDetailsEl.textContent = `User: ${authorizedUser}`;
                 authTimeEl.textContent = `Access: ${lastAccessTime.toLocaleTimeString()}`;
-                showToast(`RFID Authorized: ${authorizedUser}`, 'success');
+                showToast(authData.resumed ? `Session resumed: ${authorizedUser}` : `RFID Authorized: ${authorizedUser}`, 'success');
                 playSound('connect'); // Use 'connect' sound for success
             } else {
                 authorizedUser = null; lastAccessTime = null;
@@ -2191,6 +2568,178 @@ const char *HTML_CONTENT = R"=====(
           };
       }
 
+      // --- Camera WebSocket frames (header + JPEG) ---
+      // Starts clock sync and latency reporting on a camera socket opened by the camera snippet
+      function attachCameraSocket(socket) {
+          cameraSocket = socket;
+          socket.binaryType = 'arraybuffer';
+          cameraClockSamples = []; cameraClockOffset = null;
+          cameraStats = { windowStart: performance.now(), frames: 0, dropped: 0, bytes: 0, latencySum: 0, latencyCount: 0, lastSeq: null };
+          const ping = () => {
+              if (socket.readyState === WebSocket.OPEN) socket.send(JSON.stringify({ ping: Math.round(clientMicros()) }));
+              sendCameraDriveHint(); // Refresh, so the camera's hint doesn't expire while a command is held
+          };
+          clearInterval(cameraPingTimer);
+          cameraPingTimer = setInterval(ping, 2000);
+          ping();
+          socket.addEventListener('close', () => {
+              clearInterval(cameraPingTimer); cameraPingTimer = null;
+              if (cameraSocket === socket) cameraSocket = null;
+              streamStatsEl?.classList.add('hidden');
+          });
+      }
+
+      // Tells the camera what the car is doing, so it can trade frame rate against sharpness.
+      // Only the lease holder knows that; a spectator's hint would fight the driver's.
+      // `leaseLost` sends the final stop of a driver that just lost the lease.
+      function sendCameraDriveHint(leaseLost = false) {
+          if (!cameraSocket || cameraSocket.readyState !== WebSocket.OPEN) return;
+          if (!drivingLease.driver && !leaseLost) return;
+          const command = (ws && ws.readyState === WebSocket.OPEN && !leaseLost) ? lastSentCommand : CMD_STOP;
+          cameraSocket.send(JSON.stringify({ drive: command }));
+      }
+
+      // Text messages from the camera: pong (clock sync) and camera_info
+      function handleCameraMessage(text) {
+          let message;
+          try { message = JSON.parse(text); } catch (error) { return; }
+          if (message.type === 'pong') {
+              const t4 = clientMicros();
+              const rtt = (t4 - message.t1) - (message.t3 - message.t2);
+              cameraClockSamples.push({ rtt, offset: ((message.t2 - message.t1) + (message.t3 - t4)) / 2 });
+              if (cameraClockSamples.length > CLOCK_WINDOW) cameraClockSamples.shift();
+              cameraClockOffset = cameraClockSamples.reduce((a, b) => (b.rtt < a.rtt ? b : a)).offset;
+          } else if (message.type === 'camera_info') {
+              console.log('Camera settings:', message);
+          }
+      }
+
+      // Splits a binary camera message into its header and JPEG; bare JPEGs (older firmware) have no header
+      function parseCameraFrame(buffer) {
+          const bytes = new Uint8Array(buffer);
+          if (bytes.length === 0) return null;
+          if (bytes[0] === 0xFF) return { header: null, jpeg: bytes };
+          if (bytes[0] !== CAMERA_FRAME_HEADER_VERSION || bytes.length < bytes[1]) return null;
+          const view = new DataView(buffer);
+          const header = {
+              seq: view.getUint32(2, true),
+              captureTime: Number(view.getBigInt64(6, true)),
+              width: view.getUint16(14, true),
+              height: view.getUint16(16, true),
+              quality: view.getUint8(18),
+              sendDelay: view.getUint32(20, true)
+          };
+          recordCameraFrame(header, clientMicros(), bytes.length);
+          return { header, jpeg: new Uint8Array(buffer, bytes[1]) };
+      }
+
+      // Counts frames, bytes, sequence gaps and capture-to-receive latency; publishes them once per second
+      function recordCameraFrame(header, receivedAt, length) {
+          if (!cameraStats) return;
+          if (cameraStats.lastSeq !== null) {
+              const gap = header.seq - cameraStats.lastSeq;
+              if (gap <= 0) return; // Duplicate or reordered frame
+              cameraStats.dropped += gap - 1;
+          }
+          cameraStats.lastSeq = header.seq;
+          cameraStats.frames++;
+          cameraStats.bytes += length;
+          const frameLatency = cameraClockOffset === null ? null : receivedAt - (header.captureTime - cameraClockOffset);
+          if (frameLatency !== null) {
+              cameraStats.latencySum += frameLatency;
+              cameraStats.latencyCount++;
+          }
+          if (cameraSession && cameraSession.length < CAMERA_SESSION_LIMIT) {
+              const command = (ws && ws.readyState === WebSocket.OPEN) ? lastSentCommand : CMD_STOP;
+              cameraSession.push([Math.round(receivedAt / 1000), header.seq, length, frameLatency === null ? '' : (frameLatency / 1000).toFixed(1),
+                                  header.width, header.height, header.quality, command]);
+          }
+
+          const elapsed = performance.now() - cameraStats.windowStart;
+          if (elapsed < 1000) return;
+          const fps = cameraStats.frames * 1000 / elapsed;
+          const dropRate = 100 * cameraStats.dropped / (cameraStats.frames + cameraStats.dropped);
+          const latency = cameraStats.latencyCount ? cameraStats.latencySum / cameraStats.latencyCount / 1000 : null;
+          const kbps = cameraStats.bytes * 8 / elapsed;
+          updateStreamStats({ fps, kbps, dropRate, latency, width: header.width, height: header.height, quality: header.quality });
+          if (latency !== null && cameraSocket && cameraSocket.readyState === WebSocket.OPEN) {
+              cameraSocket.send(JSON.stringify({ frame_latency: Math.round(latency) })); // Feeds the camera's bitrate controller
+          }
+          Object.assign(cameraStats, { windowStart: performance.now(), frames: 0, dropped: 0, bytes: 0, latencySum: 0, latencyCount: 0 });
+      }
+
+      function updateStreamStats(stats) {
+          if (!streamStatsEl) return;
+          const latencyText = stats.latency === null ? '--' : stats.latency.toFixed(0);
+          let text = `${stats.fps.toFixed(1)} FPS | ${stats.kbps.toFixed(0)} kbit/s | drop ${stats.dropRate.toFixed(0)}% | ${latencyText} ms | ${stats.width}x${stats.height} q${stats.quality}`;
+          if (cameraViewerStats && cameraViewerStats.decodeTimes.length) {
+              const decodeMs = cameraViewerStats.decodeTimes.reduce((a, b) => a + b, 0) / cameraViewerStats.decodeTimes.length;
+              text += ` | decode ${decodeMs.toFixed(1)} ms, ${cameraViewerStats.dropped} stale`;
+          }
+          streamStatsEl.textContent = text;
+          streamStatsEl.classList.remove('hidden');
+      }
+
+      // Drive session recording, for tuning the camera's pacing offline (ESP32_CAM/pacing_report.py).
+      // Run startCameraSession() in the browser console, drive, then saveCameraSession() downloads a CSV.
+      function startCameraSession() {
+          cameraSession = [];
+          console.log('Recording camera session');
+      }
+
+      function saveCameraSession() {
+          if (!cameraSession) return;
+          const rows = [['time_ms', 'seq', 'bytes', 'latency_ms', 'width', 'height', 'quality', 'command'], ...cameraSession];
+          const link = document.createElement('a');
+          link.href = URL.createObjectURL(new Blob([rows.map(row => row.join(',')).join('\n')], { type: 'text/csv' }));
+          link.download = `camera_session_${new Date().toISOString().replace(/[:.]/g, '-')}.csv`;
+          link.click();
+          setTimeout(() => URL.revokeObjectURL(link.href), 1000);
+          console.log(`Saved ${cameraSession.length} frames`);
+          cameraSession = null;
+      }
+
+      // Starts the decode worker once. With OffscreenCanvas the worker draws straight into
+      // #camera-canvas; otherwise it hands decoded bitmaps back and they are drawn here.
+      function initCameraViewer() {
+          if (cameraViewer || !cameraCanvas) return cameraViewer;
+          const source = document.getElementById('camera-viewer-worker').textContent;
+          cameraViewer = new Worker(URL.createObjectURL(new Blob([source], { type: 'text/javascript' })));
+          if (cameraCanvas.transferControlToOffscreen) {
+              const offscreen = cameraCanvas.transferControlToOffscreen();
+              cameraViewer.postMessage({ type: 'init', canvas: offscreen }, [offscreen]);
+          } else {
+              const ctx = cameraCanvas.getContext('2d');
+              cameraViewer.postMessage({ type: 'init' });
+              cameraViewer.addEventListener('message', (event) => {
+                  if (event.data.type !== 'bitmap') return;
+                  const bitmap = event.data.bitmap;
+                  if (cameraCanvas.width !== bitmap.width || cameraCanvas.height !== bitmap.height) {
+                      cameraCanvas.width = bitmap.width;
+                      cameraCanvas.height = bitmap.height;
+                  }
+                  ctx.drawImage(bitmap, 0, 0);
+                  bitmap.close();
+              });
+          }
+          cameraViewer.addEventListener('message', (event) => {
+              if (event.data.type === 'stats') cameraViewerStats = event.data;
+          });
+          return cameraViewer;
+      }
+
+      // Hands a parsed frame to the decode worker without copying: the message's buffer is transferred
+      function renderCameraFrame(frame) {
+          if (!initCameraViewer()) return false;
+          const jpeg = frame.jpeg;
+          cameraViewer.postMessage({ type: 'frame', buffer: jpeg.buffer, offset: jpeg.byteOffset, length: jpeg.byteLength }, [jpeg.buffer]);
+          if (cameraCanvas.classList.contains('hidden')) {
+              cameraCanvas.classList.remove('hidden');
+              cameraStream?.classList.add('hidden');
+          }
+          return true;
+      }
+
       function refreshVideoStream() {
           if (!videoStreamActive || !streamUrl || !cameraStream) return;
           console.log("Refreshing video stream source");
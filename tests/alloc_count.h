@@ -0,0 +1,25 @@
+/**
+ * @file alloc_count.h
+ * @brief Replaces the global operator new/delete to count heap allocations.
+ * @details Include from exactly one translation unit of a test binary. The benchmarks
+ * read the counters before and after a loop to report heap churn.
+ */
+#pragma once
+
+#include <new>
+#include <stdlib.h>
+
+static size_t allocations = 0;     ///< operator new calls since start.
+static size_t allocatedBytes = 0;  ///< Bytes requested from operator new since start.
+
+void *operator new(size_t size) {
+  allocations++;
+  allocatedBytes += size;
+  void *block = malloc(size ? size : 1);
+  if (!block) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+void operator delete(void *block) noexcept { free(block); }
+void operator delete(void *block, size_t) noexcept { free(block); }
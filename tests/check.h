@@ -0,0 +1,31 @@
+/**
+ * @file check.h
+ * @brief Minimal assertion and timing helpers shared by the host tests.
+ */
+#pragma once
+
+#include <chrono>
+#include <stdio.h>
+
+static int checkFailures = 0; ///< Failed CHECKs so far; main() returns non-zero if any.
+
+/// Records a failure (and keeps going) when `condition` is false.
+#define CHECK(condition)                                                              \
+  do {                                                                                \
+    if (!(condition)) {                                                               \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition);   \
+      checkFailures++;                                                                \
+    }                                                                                 \
+  } while (0)
+
+/// Ends a test's main(): prints the verdict and returns the exit status.
+inline int checkResult(const char *name) {
+  printf("%s: %s\n", name, checkFailures ? "FAILED" : "ok");
+  return checkFailures ? 1 : 0;
+}
+
+/// Wall-clock nanoseconds from a steady clock, for the benchmarks.
+inline long long nowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,46 @@
+/**
+ * @file Arduino.h
+ * @brief Host stand-in for the parts of the ESP32 Arduino core the shared headers use.
+ * @details millis()/micros() run on the steady clock. Serial output is dropped unless
+ * the HOST_SERIAL environment variable is set, so the load tests stay quiet.
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGMEM
+
+using std::max;
+using std::min;
+
+inline unsigned long micros() {
+  static const auto start = std::chrono::steady_clock::now();
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start).count();
+}
+
+inline unsigned long millis() { return micros() / 1000; }
+
+/// Serial replacement: writes to stderr when HOST_SERIAL is set.
+struct HostSerial {
+  bool enabled = getenv("HOST_SERIAL") != NULL;
+  size_t write(const uint8_t *data, size_t length) { return enabled ? fwrite(data, 1, length, stderr) : length; }
+  size_t print(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+  size_t println(const char *text = "") { return print(text) + print("\n"); }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    return length > 0 ? write((const uint8_t *)line, std::min((size_t)length, sizeof(line) - 1)) : 0;
+  }
+};
+static HostSerial Serial;
@@ -0,0 +1,145 @@
+/**
+ * @file MFRC522.h
+ * @brief Host stand-in for the MFRC522 library: a reader and one card on a virtual clock.
+ * @details Every register access costs SPI_ACCESS_US of virtual time (about what a
+ * two-byte transfer plus chip select takes at 4 MHz) and is counted. The card is in the
+ * field while `field(now)` says so. The stand-in models only what the probes depend on:
+ * - Writing BitFramingReg with StartSend while CommandReg is PCD_Transceive sends the
+ *   FIFO. A REQA is answered (RxIRq) ATQA_US later, unless the card is absent or halted.
+ *   Otherwise the reader's timer fires (TimerIRq) TIMER_US later, the 25 ms PCD_Init()
+ *   sets.
+ * - PICC_IsNewCardPresent() follows the library's code path: three baud-rate writes,
+ *   clearing CollReg, the six-write transceive setup and setting StartSend, then it reads
+ *   ComIrqReg until RxIRq or TimerIRq.
+ * - PICC_ReadCardSerial() (anticollision and select, each with its CRC) is charged a
+ *   fixed READ_SERIAL_ACCESSES.
+ * - PICC_HaltA() halts the card until it leaves the field.
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef uint8_t byte;
+
+class MFRC522 {
+public:
+  enum PCD_Register {
+    CommandReg = 0x01 << 1, ComIrqReg = 0x04 << 1, FIFODataReg = 0x09 << 1, FIFOLevelReg = 0x0A << 1,
+    BitFramingReg = 0x0D << 1, CollReg = 0x0E << 1, TxModeReg = 0x12 << 1, RxModeReg = 0x13 << 1,
+    ModWidthReg = 0x24 << 1
+  };
+  enum PCD_Command { PCD_Idle = 0x00, PCD_Transceive = 0x0C };
+  enum PICC_Command { PICC_CMD_REQA = 0x26 };
+
+  struct Uid {
+    byte size;
+    byte uidByte[10];
+    byte sak;
+  };
+
+  static const unsigned long SPI_ACCESS_US = 10;
+  static const unsigned long ATQA_US = 300;
+  static const unsigned long TIMER_US = 25000;
+  static const unsigned long READ_SERIAL_ACCESSES = 80;
+  static const unsigned long NEVER = ~0UL;
+
+  MFRC522(int, int) {}
+
+  void PCD_WriteRegister(PCD_Register reg, byte value) {
+    access();
+    if (reg == CommandReg) {
+      command_ = value;
+    } else if (reg == ComIrqReg && (value & 0x7F) == 0x7F) {
+      rxAt_ = timerAt_ = NEVER; // Clear all interrupt flags
+    } else if (reg == FIFODataReg) {
+      fifo_ = value;
+    } else if (reg == BitFramingReg && (value & 0x80) && command_ == PCD_Transceive) {
+      bool answers = fifo_ == PICC_CMD_REQA && field && field(now) && !halted_;
+      rxAt_ = answers ? now + ATQA_US : NEVER;
+      timerAt_ = now + TIMER_US;
+    }
+  }
+
+  byte PCD_ReadRegister(PCD_Register reg) {
+    access();
+    if (reg != ComIrqReg) {
+      return reg == BitFramingReg ? 0x07 : 0;
+    }
+    if (rxAt_ != NEVER && now >= rxAt_) {
+      return 0x20 | 0x10; // RxIRq | IdleIRq
+    }
+    return (timerAt_ != NEVER && now >= timerAt_) ? 0x01 : 0; // TimerIRq
+  }
+
+  bool PICC_IsNewCardPresent() {
+    PCD_WriteRegister(TxModeReg, 0x00);
+    PCD_WriteRegister(RxModeReg, 0x00);
+    PCD_WriteRegister(ModWidthReg, 0x26);
+    PCD_WriteRegister(CollReg, PCD_ReadRegister(CollReg) & ~0x80);
+    PCD_WriteRegister(CommandReg, PCD_Idle);
+    PCD_WriteRegister(ComIrqReg, 0x7F);
+    PCD_WriteRegister(FIFOLevelReg, 0x80);
+    PCD_WriteRegister(FIFODataReg, PICC_CMD_REQA);
+    PCD_WriteRegister(BitFramingReg, 0x07);
+    PCD_WriteRegister(CommandReg, PCD_Transceive);
+    PCD_WriteRegister(BitFramingReg, PCD_ReadRegister(BitFramingReg) | 0x80);
+    for (;;) {
+      byte irq = PCD_ReadRegister(ComIrqReg);
+      if (irq & 0x20) {
+        return true;
+      }
+      if (irq & 0x01) {
+        return false;
+      }
+    }
+  }
+
+  bool PICC_ReadCardSerial() {
+    for (unsigned long i = 0; i < READ_SERIAL_ACCESSES; i++) {
+      access();
+    }
+    if (!field || !field(now) || halted_) {
+      return false;
+    }
+    uid = cardUid;
+    return true;
+  }
+
+  void PICC_HaltA() {
+    access();
+    halted_ = true;
+  }
+
+  void PCD_StopCrypto1() { access(); }
+
+  /// Advances the virtual clock without touching the bus (a task sleeping).
+  void sleep(unsigned long us) {
+    now += us;
+    checkField();
+  }
+
+  Uid uid = {};
+  Uid cardUid = { 4, { 0x4B, 0x17, 0xE2, 0x00 }, 0x08 }; ///< The card's UID.
+  bool (*field)(unsigned long us) = nullptr;              ///< Is the card in the field at `us`?
+  unsigned long now = 0;       ///< Virtual time (us).
+  unsigned long accesses = 0;  ///< SPI register accesses so far.
+
+private:
+  void access() {
+    now += SPI_ACCESS_US;
+    accesses++;
+    checkField();
+  }
+
+  void checkField() {
+    if (halted_ && !(field && field(now))) {
+      halted_ = false; // Out of the field: the card powers down and answers REQA again
+    }
+  }
+
+  byte command_ = PCD_Idle;
+  byte fifo_ = 0;
+  bool halted_ = false;
+  unsigned long rxAt_ = NEVER;
+  unsigned long timerAt_ = NEVER;
+};
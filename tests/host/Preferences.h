@@ -0,0 +1,95 @@
+/**
+ * @file Preferences.h
+ * @brief Host stand-in for the ESP32 Preferences (NVS) library, kept in memory.
+ * @details Namespaces outlive a Preferences object, as they outlive a reboot on the car,
+ * so a second begin() on the same namespace sees what was written before. The return
+ * values follow the ESP32 library: putBytes() of zero bytes stores nothing and returns 0,
+ * and getBytes() returns 0 if the value does not fit the buffer. Writes are counted, and
+ * `failWrites` makes every put fail, for testing the store's error paths.
+ */
+#pragma once
+
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+class Preferences {
+public:
+  typedef std::map<std::string, std::vector<uint8_t> > Namespace;
+
+  bool begin(const char *name, bool readOnly = false) {
+    values_ = &namespaces()[name];
+    readOnly_ = readOnly;
+    return true;
+  }
+
+  void end() { values_ = NULL; }
+
+  size_t putBytes(const char *key, const void *value, size_t length) {
+    if (!writable() || key == NULL || value == NULL || length == 0) {
+      return 0;
+    }
+    (*values_)[key].assign((const uint8_t *)value, (const uint8_t *)value + length);
+    writes++;
+    bytesWritten += length;
+    return length;
+  }
+
+  size_t putUInt(const char *key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+
+  size_t getBytesLength(const char *key) const {
+    const std::vector<uint8_t> *value = find(key);
+    return value ? value->size() : 0;
+  }
+
+  size_t getBytes(const char *key, void *buffer, size_t maxLength) const {
+    const std::vector<uint8_t> *value = find(key);
+    if (value == NULL || value->size() > maxLength) {
+      return 0;
+    }
+    memcpy(buffer, value->data(), value->size());
+    return value->size();
+  }
+
+  uint32_t getUInt(const char *key, uint32_t defaultValue = 0) const {
+    uint32_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+  }
+
+  bool remove(const char *key) { return writable() && values_->erase(key) > 0; }
+
+  bool clear() {
+    if (!writable()) {
+      return false;
+    }
+    values_->clear();
+    return true;
+  }
+
+  /// Every namespace, shared by all Preferences objects (the flash).
+  static std::map<std::string, Namespace> &namespaces() {
+    static std::map<std::string, Namespace> flash;
+    return flash;
+  }
+
+  size_t writes = 0;        ///< Successful put calls.
+  size_t bytesWritten = 0;  ///< Bytes stored by them.
+  bool failWrites = false;  ///< Make every put fail.
+
+private:
+  bool writable() const { return values_ != NULL && !readOnly_ && !failWrites; }
+
+  const std::vector<uint8_t> *find(const char *key) const {
+    if (values_ == NULL) {
+      return NULL;
+    }
+    Namespace::const_iterator it = values_->find(key);
+    return it == values_->end() ? NULL : &it->second;
+  }
+
+  Namespace *values_ = NULL;
+  bool readOnly_ = false;
+};
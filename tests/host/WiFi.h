@@ -0,0 +1,131 @@
+/**
+ * @file WiFi.h
+ * @brief Socket-backed host stand-in for the ESP32 WiFiServer and WiFiClient.
+ * @details Behaves like the ESP32 classes where the HTTP server depends on it:
+ * - copies of a WiFiClient share one socket, and stop() closes it for all of them;
+ * - available(), read() and connected() never block;
+ * - write()/print() block until everything is sent, like the ESP32's retrying write();
+ * - accepted sockets get a 5744 byte send buffer, lwIP's default TCP_SND_BUF on the
+ *   ESP32, so a reader that stops reading fills it as quickly as it would on the car.
+ * WiFiServer(0) listens on an ephemeral port, which port() reports.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <lwip/sockets.h>
+
+const int HOST_TCP_SND_BUF = 5744; ///< lwIP TCP_SND_BUF default on the ESP32 (4 x MSS).
+
+class WiFiClient {
+ public:
+  WiFiClient() {}
+  explicit WiFiClient(int fd) : socket_(std::make_shared<Socket>(fd)) {}
+
+  int fd() const { return socket_ ? socket_->fd : -1; }
+
+  uint8_t connected() {
+    if (fd() < 0) {
+      return 0;
+    }
+    char byte;
+    ssize_t peeked = recv(fd(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return peeked > 0 || (peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+  }
+  explicit operator bool() { return connected(); }
+
+  int available() {
+    int count = 0;
+    return (fd() >= 0 && ioctl(fd(), FIONREAD, &count) == 0) ? count : 0;
+  }
+
+  int read(uint8_t *buffer, size_t size) {
+    ssize_t received = fd() < 0 ? -1 : recv(fd(), buffer, size, MSG_DONTWAIT);
+    return received < 0 ? -1 : (int)received;
+  }
+
+  size_t write(const uint8_t *data, size_t length) {
+    size_t total = 0;
+    while (fd() >= 0 && total < length) {
+      ssize_t sent = send(fd(), data + total, length - total, MSG_NOSIGNAL);
+      if (sent <= 0) {
+        break;
+      }
+      total += sent;
+    }
+    return total;
+  }
+  size_t print(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+
+  void setNoDelay(bool noDelay) {
+    int flag = noDelay;
+    setsockopt(fd(), IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  }
+
+  void stop() {
+    if (socket_) {
+      socket_->close();
+    }
+  }
+
+ private:
+  struct Socket {
+    int fd;
+    explicit Socket(int descriptor) : fd(descriptor) {}
+    ~Socket() { close(); }
+    void close() {
+      if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+  };
+  std::shared_ptr<Socket> socket_;
+};
+
+class WiFiServer {
+ public:
+  explicit WiFiServer(uint16_t port) : port_(port) {}
+  ~WiFiServer() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  void begin() {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port_);
+    if (bind(fd_, (sockaddr *)&address, sizeof(address)) != 0 || listen(fd_, 16) != 0) {
+      perror("WiFiServer::begin");
+      exit(2);
+    }
+    socklen_t length = sizeof(address);
+    getsockname(fd_, (sockaddr *)&address, &length);
+    port_ = ntohs(address.sin_port);
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+  }
+
+  uint16_t port() const { return port_; }
+
+  /// Returns the next pending connection, or an empty client if there is none.
+  WiFiClient available() {
+    int fd = accept(fd_, NULL, NULL);
+    if (fd < 0) {
+      return WiFiClient();
+    }
+    int sendBuffer = HOST_TCP_SND_BUF / 2; // Linux doubles the requested size
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+    return WiFiClient(fd);
+  }
+
+ private:
+  uint16_t port_;
+  int fd_ = -1;
+};
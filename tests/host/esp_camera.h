@@ -0,0 +1,41 @@
+/**
+ * @file esp_camera.h
+ * @brief Host stand-in for the parts of the esp32-camera driver that frame_fanout.h, abr.h and
+ * control_message.h use.
+ * @details The frame buffer type, the frame sizes (same values as sensor.h) and
+ * esp_camera_fb_return(). Each test that returns frames defines esp_camera_fb_return()
+ * itself, around its synthetic frame source.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+typedef enum {
+  FRAMESIZE_96X96,   // 96x96
+  FRAMESIZE_QQVGA,   // 160x120
+  FRAMESIZE_QCIF,    // 176x144
+  FRAMESIZE_HQVGA,   // 240x176
+  FRAMESIZE_240X240, // 240x240
+  FRAMESIZE_QVGA,    // 320x240
+  FRAMESIZE_CIF,     // 400x296
+  FRAMESIZE_HVGA,    // 480x320
+  FRAMESIZE_VGA,     // 640x480
+  FRAMESIZE_SVGA,    // 800x600
+  FRAMESIZE_XGA,     // 1024x768
+  FRAMESIZE_HD,      // 1280x720
+  FRAMESIZE_SXGA,    // 1280x1024
+  FRAMESIZE_UXGA,    // 1600x1200
+} framesize_t;
+
+typedef struct {
+  uint8_t *buf;             ///< JPEG data.
+  size_t len;               ///< Bytes of buf in use.
+  size_t width;
+  size_t height;
+  int format;
+  struct timeval timestamp; ///< When the frame was read out of the sensor.
+} camera_fb_t;
+
+void esp_camera_fb_return(camera_fb_t *fb);
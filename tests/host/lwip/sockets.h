@@ -0,0 +1,11 @@
+/**
+ * @file sockets.h
+ * @brief Host stand-in for lwIP's BSD socket header: the Linux one has the same calls.
+ */
+#pragma once
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
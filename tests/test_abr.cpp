@@ -0,0 +1,264 @@
+/**
+ * @file test_abr.cpp
+ * @brief Trace-driven simulator for the camera's bitrate controller in abr.h.
+ * @details One viewer is simulated in discrete time. A frame is captured every
+ * FRAME_INTERVAL_MS. Its size follows the current ladder step (STEP_FRAME_BYTES). The
+ * viewer's sender writes one frame at a time, at the link bandwidth the trace gives for
+ * that moment. A frame captured while the sender is busy waits as the pending frame, and a
+ * newer one replaces it (latest frame wins, as in frame_fanout.h). The sender keeps the
+ * same smoothed latency and send time as viewerTask(). Every ABR_INTERVAL_MS these values
+ * and the skip ratio go to abrNextStep(), the same call updateBitrate() makes.
+ *
+ * Each trace runs twice, with the controller and with the ladder held at step 0 (the fixed
+ * VGA q10 stream from before the controller). The report gives frame rate, capture-to-sent
+ * latency and the step range for each segment of the trace.
+ *
+ * The built-in traces:
+ * - drive: a good link, then the car goes behind a wall (150 KB/s, then 60 KB/s), then back.
+ *   Once each weak segment has settled, the fixed stream runs over the target latency. The
+ *   controller must keep p95 within 1.5x the target, and it must climb back to step 0
+ *   before the trace ends.
+ * - steady: a constant 400 KB/s for a minute. Once settled, the controller must not
+ *   oscillate.
+ *
+ * With a CSV of "time_ms,kbytes_per_second" on the command line, only that trace is
+ * replayed, and every step change is printed.
+ *
+ * Usage: build/test_abr [link.csv]
+ */
+#include "abr.h"
+#include "check.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <vector>
+
+static const uint32_t FRAME_INTERVAL_MS = 50;
+static const uint32_t TARGET_LATENCY_MS = ABR_DEFAULT_TARGET_LATENCY;
+static const uint32_t SETTLE_MS = 3000; ///< Left out of a segment's latency figures.
+
+/// Typical OV2640 JPEG size (bytes) of an indoor scene at each STREAM_LADDER step.
+static const uint32_t STEP_FRAME_BYTES[] = { 24000, 18000, 13500, 7000, 5400, 3800, 1100 };
+static_assert(sizeof(STEP_FRAME_BYTES) / sizeof(STEP_FRAME_BYTES[0]) == STREAM_LADDER_STEPS,
+              "one frame size per ladder step");
+
+struct Segment {
+  uint32_t startMs;
+  uint32_t kbytesPerSecond;
+};
+
+struct Trace {
+  const char *name;
+  std::vector<Segment> segments;
+  uint32_t endMs;
+
+  uint32_t bandwidthAt(uint64_t us) const {
+    uint32_t bandwidth = segments.front().kbytesPerSecond;
+    for (const Segment &segment : segments) {
+      if (us >= (uint64_t)segment.startMs * 1000) {
+        bandwidth = segment.kbytesPerSecond;
+      }
+    }
+    return std::max(bandwidth, 1u);
+  }
+};
+
+struct SegmentResult {
+  uint32_t framesSent = 0;
+  uint32_t framesSkipped = 0;
+  uint64_t bytesSent = 0;
+  int minStep = STREAM_LADDER_STEPS;
+  int maxStep = -1;
+  std::vector<uint32_t> latencies; ///< Capture-to-sent (ms) of frames sent after SETTLE_MS.
+};
+
+struct RunResult {
+  std::vector<SegmentResult> segments;
+  int stepChanges = 0;
+  int finalStep = 0;
+};
+
+static uint32_t percentile(std::vector<uint32_t> values, int p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, values.size() * p / 100)];
+}
+
+static size_t segmentAt(const Trace &trace, uint64_t us) {
+  size_t index = 0;
+  for (size_t i = 0; i < trace.segments.size(); i++) {
+    if (us >= (uint64_t)trace.segments[i].startMs * 1000) {
+      index = i;
+    }
+  }
+  return index;
+}
+
+static RunResult simulate(const Trace &trace, bool controller, bool verbose) {
+  RunResult result;
+  result.segments.resize(trace.segments.size());
+  AbrState state = { 0, 0, 0 };
+
+  struct Frame {
+    uint64_t capturedAt;
+    uint32_t bytes;
+  };
+  bool busy = false, hasPending = false;
+  Frame sending = {}, pending = {};
+  uint64_t busyUntil = 0, sendStart = 0;
+  uint32_t latencyEwma = 0, sendTimeEwma = 0; // us, as in Viewer
+  uint32_t tickSent = 0, tickSkipped = 0;
+
+  auto start = [&](const Frame &frame, uint64_t at) {
+    sending = frame;
+    sendStart = at;
+    busyUntil = at + (uint64_t)frame.bytes * 1000 / trace.bandwidthAt(at); // KB/s = bytes per ms
+    busy = true;
+  };
+
+  for (uint64_t now = 0; now < (uint64_t)trace.endMs * 1000; now += FRAME_INTERVAL_MS * 1000) {
+    // Sends that finished before this capture
+    while (busy && busyUntil <= now) {
+      uint32_t latency = (uint32_t)(busyUntil - sending.capturedAt);
+      latencyEwma += ((int32_t)latency - (int32_t)latencyEwma) / 8;
+      sendTimeEwma += ((int32_t)(busyUntil - sendStart) - (int32_t)sendTimeEwma) / 8;
+      size_t index = segmentAt(trace, busyUntil);
+      SegmentResult &segment = result.segments[index];
+      segment.framesSent++;
+      segment.bytesSent += sending.bytes;
+      if (busyUntil >= ((uint64_t)trace.segments[index].startMs + SETTLE_MS) * 1000) {
+        segment.latencies.push_back(latency / 1000);
+      }
+      tickSent++;
+      busy = false;
+      if (hasPending) {
+        hasPending = false;
+        start(pending, busyUntil);
+      }
+    }
+
+    Frame frame = { now, STEP_FRAME_BYTES[state.step] };
+    if (!busy) {
+      start(frame, now);
+    } else {
+      if (hasPending) {
+        result.segments[segmentAt(trace, now)].framesSkipped++;
+        tickSkipped++;
+      }
+      pending = frame;
+      hasPending = true;
+    }
+
+    SegmentResult &segment = result.segments[segmentAt(trace, now)];
+    segment.minStep = std::min(segment.minStep, state.step);
+    segment.maxStep = std::max(segment.maxStep, state.step);
+
+    if (controller && now % (ABR_INTERVAL_MS * 1000) == 0 && tickSent + tickSkipped > 0) {
+      AbrInputs inputs = { latencyEwma / 1000, sendTimeEwma / 1000,
+                           (uint8_t)(tickSkipped * 100 / (tickSent + tickSkipped)), FRAME_INTERVAL_MS };
+      int previous = state.step;
+      int step = abrNextStep(state, inputs, TARGET_LATENCY_MS);
+      if (step != previous) {
+        result.stepChanges++;
+        if (verbose) {
+          printf("  %7.1f s  step %d -> %d  (latency %u ms, send %u ms, skipped %u%%, link %u KB/s)\n",
+                 now / 1e6, previous, step, inputs.latencyMs, inputs.sendTimeMs, inputs.skipPercent,
+                 trace.bandwidthAt(now));
+        }
+      }
+      tickSent = 0;
+      tickSkipped = 0;
+    }
+  }
+  result.finalStep = state.step;
+  return result;
+}
+
+static void report(const Trace &trace, const char *mode, const RunResult &result) {
+  printf("  %-6s %-5s %d step changes, final step %d\n", trace.name, mode, result.stepChanges, result.finalStep);
+  for (size_t i = 0; i < trace.segments.size(); i++) {
+    const SegmentResult &segment = result.segments[i];
+    uint32_t endMs = i + 1 < trace.segments.size() ? trace.segments[i + 1].startMs : trace.endMs;
+    double seconds = (endMs - trace.segments[i].startMs) / 1000.0;
+    printf("    %5.1f-%5.1f s %5u KB/s  steps %d-%d  %5.1f FPS (%3u skipped)  %5.1f KB/frame  latency p50 %5u ms  p95 %5u ms\n",
+           trace.segments[i].startMs / 1000.0, endMs / 1000.0, trace.segments[i].kbytesPerSecond, segment.minStep,
+           segment.maxStep, segment.framesSent / seconds, segment.framesSkipped,
+           segment.framesSent ? segment.bytesSent / 1000.0 / segment.framesSent : 0.0,
+           percentile(segment.latencies, 50), percentile(segment.latencies, 95));
+  }
+}
+
+static Trace loadTrace(const char *path) {
+  Trace trace = { "trace", {}, 0 };
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    exit(2);
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), file)) {
+    unsigned long timeMs, kbytesPerSecond;
+    if (sscanf(line, "%lu,%lu", &timeMs, &kbytesPerSecond) == 2) {
+      trace.segments.push_back({ (uint32_t)timeMs, (uint32_t)kbytesPerSecond });
+      trace.endMs = (uint32_t)timeMs + ABR_INTERVAL_MS;
+    }
+  }
+  fclose(file);
+  if (trace.segments.empty()) {
+    fprintf(stderr, "%s: no samples\n", path);
+    exit(2);
+  }
+  return trace;
+}
+
+static void checkDecisions() {
+  AbrState state = { 0, 0, 0 };
+  AbrInputs congested = { TARGET_LATENCY_MS + 1, 20, 0, FRAME_INTERVAL_MS };
+  CHECK(abrNextStep(state, congested, TARGET_LATENCY_MS) == 1 && state.holdTicks == ABR_HOLD_TICKS);
+  AbrInputs farOver = { 2 * TARGET_LATENCY_MS + 1, 20, 0, FRAME_INTERVAL_MS };
+  CHECK(abrNextStep(state, farOver, TARGET_LATENCY_MS) == 3);
+
+  AbrInputs good = { 30, 10, 0, FRAME_INTERVAL_MS };
+  for (int tick = 1; tick < ABR_UPGRADE_TICKS; tick++) {
+    CHECK(abrNextStep(state, good, TARGET_LATENCY_MS) == 3);
+  }
+  CHECK(abrNextStep(state, good, TARGET_LATENCY_MS) == 2);
+
+  state = { STREAM_LADDER_STEPS - 1, 0, 0 };
+  CHECK(abrNextStep(state, farOver, TARGET_LATENCY_MS) == STREAM_LADDER_STEPS - 1);
+  state = { 0, 0, 0 };
+  for (int tick = 0; tick < 3 * ABR_UPGRADE_TICKS; tick++) {
+    CHECK(abrNextStep(state, good, TARGET_LATENCY_MS) == 0);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    Trace trace = loadTrace(argv[1]);
+    RunResult result = simulate(trace, true, true);
+    report(trace, "abr", result);
+    return 0;
+  }
+
+  checkDecisions();
+
+  Trace drive = { "drive", { { 0, 1500 }, { 10000, 150 }, { 25000, 60 }, { 35000, 1500 } }, 60000 };
+  RunResult fixed = simulate(drive, false, false);
+  RunResult adaptive = simulate(drive, true, false);
+  report(drive, "fixed", fixed);
+  report(drive, "abr", adaptive);
+  for (size_t i = 1; i <= 2; i++) {
+    CHECK(percentile(adaptive.segments[i].latencies, 95) <= TARGET_LATENCY_MS * 3 / 2);
+    CHECK(percentile(fixed.segments[i].latencies, 95) > TARGET_LATENCY_MS);
+  }
+  CHECK(adaptive.finalStep == 0);
+
+  Trace steady = { "steady", { { 0, 400 }, { 10000, 400 } }, 60000 }; // Split to check the last 50 s
+  RunResult steadyResult = simulate(steady, true, false);
+  report(steady, "abr", steadyResult);
+  CHECK(steadyResult.segments[1].minStep == steadyResult.segments[1].maxStep);
+  CHECK(percentile(steadyResult.segments[1].latencies, 95) <= TARGET_LATENCY_MS);
+  return checkResult("test_abr");
+}
@@ -0,0 +1,336 @@
+/**
+ * @file test_camera_pipeline.cpp
+ * @brief Compares the serial capture -> send loop with the capture / transmit pipeline on a
+ * synthetic JPEG source: achieved FPS and glass-to-browser latency.
+ * @details SyntheticCamera stands in for the OV2640 behind esp32-camera. A sensor thread reads
+ * out a 24 KB frame every SENSOR_PERIOD_MS into one of FB_COUNT buffers. Each frame is
+ * stamped with its glass time, when its exposure started. Buffers are handed out the way
+ * the driver does in either grab mode:
+ * - CAMERA_GRAB_WHEN_EMPTY (the driver default): filled buffers queue up and
+ *   esp_camera_fb_get() returns the oldest. A frame that finishes while no buffer is free
+ *   is lost.
+ * - CAMERA_GRAB_LATEST: a finished frame overwrites an older unclaimed one, and
+ *   esp_camera_fb_get() returns the newest.
+ *
+ * The viewer's socket takes frame bytes / link bandwidth to write. A frame's
+ * glass-to-browser latency runs from its glass time until the last byte is written;
+ * decoding in the browser is not modelled. Two designs are run for each link:
+ * - serial: the original loop(). Every FRAME_INTERVAL_MS it calls fb_get (WHEN_EMPTY),
+ *   writes the frame and returns the buffer, all on one thread.
+ * - pipeline: captureTask(), transmitTask() and viewerTask() from the sketch, re-created as
+ *   threads around frame_fanout.h. They use GRAB_LATEST, a frame queue of FB_COUNT entries
+ *   of which only the newest is published, and a latest-frame-wins viewer mailbox.
+ *
+ * The timing model is simple and the figures are host figures, but the thread structure is
+ * the sketch's: a slow socket only ever delays the viewer's own sender.
+ */
+#include "frame_fanout.h"
+#include "check.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static const int FB_COUNT = 2;              ///< fb_count with PSRAM (initCamera()).
+static const unsigned long SENSOR_PERIOD_MS = 40; ///< 25 FPS VGA readout.
+static const unsigned long FRAME_INTERVAL_MS = 50;
+static const size_t FRAME_BYTES = 24000;    ///< A VGA JPEG at quality 10.
+static const unsigned long RUN_MS = 2000;
+
+static unsigned long micros() {
+  static const auto start = std::chrono::steady_clock::now();
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start).count();
+}
+
+static void sleepMicros(unsigned long us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+static unsigned long glassTime(const camera_fb_t *fb) {
+  return (unsigned long)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+}
+
+// --- Synthetic camera ----------------------------------------------------------------
+enum GrabMode { GRAB_WHEN_EMPTY, GRAB_LATEST };
+
+class SyntheticCamera {
+public:
+  explicit SyntheticCamera(GrabMode mode) : mode_(mode) {
+    for (int i = 0; i < FB_COUNT; i++) {
+      fbs_[i].buf = data_[i];
+      state_[i] = FREE;
+    }
+    sensor_ = std::thread([this] { runSensor(); });
+  }
+
+  ~SyntheticCamera() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    ready_.notify_all();
+    sensor_.join();
+  }
+
+  /// esp_camera_fb_get(): waits for a filled buffer.
+  camera_fb_t *get() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    int chosen = -1;
+    ready_.wait(lock, [&] { return stopping_ || (chosen = pickFilled(mode_ == GRAB_LATEST)) >= 0; });
+    if (chosen < 0) {
+      return NULL;
+    }
+    state_[chosen] = HELD;
+    return &fbs_[chosen];
+  }
+
+  /// esp_camera_fb_return()
+  void put(camera_fb_t *fb) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int i = (int)(fb - fbs_);
+    CHECK(state_[i] == HELD);
+    state_[i] = FREE;
+  }
+
+private:
+  enum State { FREE, FILLED, HELD };
+
+  /// The oldest (or newest) filled buffer, or -1.
+  int pickFilled(bool newest) const {
+    int chosen = -1;
+    for (int i = 0; i < FB_COUNT; i++) {
+      if (state_[i] == FILLED &&
+          (chosen < 0 || (newest ? order_[i] > order_[chosen] : order_[i] < order_[chosen]))) {
+        chosen = i;
+      }
+    }
+    return chosen;
+  }
+
+  void runSensor() {
+    unsigned long start = micros();
+    for (uint32_t frame = 1;; frame++) {
+      unsigned long readout = start + frame * SENSOR_PERIOD_MS * 1000;
+      unsigned long now = micros();
+      if (readout > now) {
+        sleepMicros(readout - now);
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_) {
+        return;
+      }
+      int target = -1;
+      for (int i = 0; i < FB_COUNT && target < 0; i++) {
+        if (state_[i] == FREE) {
+          target = i;
+        }
+      }
+      if (target < 0 && mode_ == GRAB_LATEST) {
+        target = pickFilled(false); // Overwrite the oldest unclaimed frame
+      }
+      if (target < 0) {
+        continue; // Lost: nowhere to read it out to
+      }
+      unsigned long glass = readout - SENSOR_PERIOD_MS * 1000;
+      fbs_[target].len = FRAME_BYTES;
+      fbs_[target].timestamp.tv_sec = glass / 1000000;
+      fbs_[target].timestamp.tv_usec = glass % 1000000;
+      memcpy(data_[target], &frame, sizeof(frame));
+      order_[target] = frame;
+      state_[target] = FILLED;
+      ready_.notify_all();
+    }
+  }
+
+  GrabMode mode_;
+  camera_fb_t fbs_[FB_COUNT] = {};
+  uint8_t data_[FB_COUNT][FRAME_BYTES];
+  State state_[FB_COUNT];
+  uint32_t order_[FB_COUNT] = {};
+  bool stopping_ = false;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::thread sensor_;
+};
+
+static SyntheticCamera *camera = NULL;
+
+void esp_camera_fb_return(camera_fb_t *fb) { camera->put(fb); }
+
+// --- Viewer --------------------------------------------------------------------------
+struct Link {
+  const char *name;
+  unsigned long bytesPerSecond;
+};
+
+struct RunResult {
+  uint32_t framesSent = 0;
+  std::vector<unsigned long> latencies; ///< Glass-to-browser (us), one per frame sent.
+};
+
+static void sendFrame(const Link &link, const camera_fb_t *fb, RunResult &result) {
+  sleepMicros((unsigned long)(fb->len * 1000000ULL / link.bytesPerSecond));
+  result.latencies.push_back(micros() - glassTime(fb));
+  result.framesSent++;
+}
+
+/// Calls `tick` every FRAME_INTERVAL_MS for RUN_MS; after a stall the schedule restarts instead of bursting.
+template <typename Tick>
+static void paced(Tick tick) {
+  unsigned long end = micros() + RUN_MS * 1000;
+  unsigned long next = micros();
+  while (micros() < end) {
+    unsigned long now = micros();
+    if (now < next) {
+      sleepMicros(next - now);
+      continue;
+    }
+    next = now - next < FRAME_INTERVAL_MS * 1000 ? next + FRAME_INTERVAL_MS * 1000 : now;
+    tick();
+  }
+}
+
+/// The original loop(): capture, send and return, one after the other.
+static RunResult runSerial(const Link &link) {
+  RunResult result;
+  SyntheticCamera source(GRAB_WHEN_EMPTY);
+  camera = &source;
+  paced([&] {
+    camera_fb_t *fb = source.get();
+    sendFrame(link, fb, result);
+    esp_camera_fb_return(fb);
+  });
+  camera = NULL;
+  return result;
+}
+
+static FramePool pool;
+
+/// captureTask() -> frameQueue -> transmitTask() -> viewer mailbox -> viewerTask().
+static RunResult runPipeline(const Link &link) {
+  RunResult result;
+  SyntheticCamera source(GRAB_LATEST);
+  camera = &source;
+  pool.fbCount = FB_COUNT;
+
+  std::mutex queueMutex;
+  std::condition_variable queued;
+  std::deque<SharedFrame *> frameQueue;
+  FrameMailbox mailbox;
+  std::mutex wakeMutex;
+  std::condition_variable wake;
+  bool notified = false;
+  std::atomic<bool> running(true);
+
+  std::thread viewer([&] {
+    while (running.load()) {
+      {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wake.wait_for(lock, std::chrono::milliseconds(10), [&] { return notified; });
+        notified = false;
+      }
+      while (SharedFrame *frame = takeFrame(mailbox)) {
+        sendFrame(link, frame->fb, result);
+        releaseFrame(pool, frame);
+      }
+    }
+  });
+
+  std::thread transmit([&] {
+    for (;;) {
+      SharedFrame *frame;
+      {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        queued.wait_for(lock, std::chrono::milliseconds(10), [&] { return !frameQueue.empty(); });
+        if (frameQueue.empty()) {
+          if (!running.load()) {
+            return;
+          }
+          continue;
+        }
+        frame = frameQueue.front();
+        frameQueue.pop_front();
+        while (!frameQueue.empty()) { // Only the newest is published
+          releaseFrame(pool, frame);
+          frame = frameQueue.front();
+          frameQueue.pop_front();
+        }
+      }
+      postFrame(pool, mailbox, frame);
+      {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        notified = true;
+      }
+      wake.notify_one();
+      releaseFrame(pool, frame);
+    }
+  });
+
+  paced([&] {
+    if (framePoolExhausted(pool)) {
+      reclaimFrame(pool, mailbox);
+      if (framePoolExhausted(pool)) {
+        return;
+      }
+    }
+    SharedFrame *frame = freeFrameSlot(pool);
+    if (frame == NULL) {
+      return;
+    }
+    holdFrame(pool, frame, source.get());
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      frameQueue.push_back(frame);
+    }
+    queued.notify_one();
+  });
+
+  running = false;
+  transmit.join();
+  viewer.join();
+  clearMailbox(pool, mailbox);
+  CHECK(pool.outstanding == 0);
+  camera = NULL;
+  return result;
+}
+
+static unsigned long percentile(std::vector<unsigned long> values, int p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, values.size() * p / 100)];
+}
+
+static double fps(const RunResult &result) { return result.framesSent * 1000.0 / RUN_MS; }
+
+static void report(const char *design, const Link &link, const RunResult &result) {
+  printf("  %-9s %-6s link (%4lu KB/s, %3lu ms/frame)  %5.1f FPS  glass-to-browser p50 %5.1f ms  p95 %5.1f ms  max %5.1f ms\n",
+         design, link.name, link.bytesPerSecond / 1000, FRAME_BYTES * 1000 / link.bytesPerSecond, fps(result),
+         percentile(result.latencies, 50) / 1000.0, percentile(result.latencies, 95) / 1000.0,
+         percentile(result.latencies, 100) / 1000.0);
+}
+
+int main() {
+  printf("  sensor every %lu ms, capture every %lu ms, %u byte frames, %d driver buffers, %lu ms per run\n",
+         SENSOR_PERIOD_MS, FRAME_INTERVAL_MS, (unsigned)FRAME_BYTES, FB_COUNT, RUN_MS);
+  const Link links[] = { { "fast", 1200000 }, { "slow", 400000 } };
+  for (const Link &link : links) {
+    RunResult serial = runSerial(link);
+    RunResult pipeline = runPipeline(link);
+    report("serial", link, serial);
+    report("pipeline", link, pipeline);
+
+    // The pipeline never delivers an older frame than the serial loop would, and it
+    // keeps within 20% of its frame rate. On a link slower than the capture interval it
+    // delivers a little less: a reclaimed buffer has to wait for the next sensor readout.
+    CHECK(percentile(pipeline.latencies, 50) < percentile(serial.latencies, 50));
+    CHECK(fps(pipeline) >= 0.8 * fps(serial));
+  }
+  return checkResult("test_camera_pipeline");
+}
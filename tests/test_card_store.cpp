@@ -0,0 +1,246 @@
+/**
+ * @file test_card_store.cpp
+ * @brief Checks and benchmarks the RFID card table in card_store.h against the in-memory
+ * Preferences stand-in (tests/host/Preferences.h).
+ * @details
+ * - basics: seeding from the default users, UID lengths, name limits, updates, revokes.
+ * - model: a seeded run of adds and revokes (mixed UID lengths, shared and unique names, so
+ *   the name pool compacts) compared with a std::map after every step, then reloaded
+ *   from the stand-in's flash and compared again. Every add or revoke may write at
+ *   most two record chunks.
+ * - load: corrupt and duplicate records are skipped; a failed NVS write is reported.
+ * - benchmark: lookups in a full table (RFID_MAX_CARDS, the car's capacity) hitting
+ *   and missing, next to a linear scan of the same records, and the time loadCards()
+ *   takes. The stand-in's reads are memcpy, so the load figure covers validating and
+ *   indexing the records, not reading NVS flash on the car.
+ */
+#include "card_store.h"
+#include "check.h"
+
+#include <map>
+#include <vector>
+
+static const DefaultUser DEFAULT_USERS[] = {
+  {4, {0x4B, 0x17, 0xE2, 0x00}, RFID_FLAG_ADMIN, "User 1"},
+  {4, {0x63, 0xED, 0x38, 0x2D}, 0, "User 2"}
+};
+static const int LOOKUPS = 1 << 20;
+static const int LOADS = 200;
+
+typedef std::vector<uint8_t> Uid;
+
+struct Expected {
+  uint8_t flags;
+  std::string name;
+};
+
+static CardStore store; // Large: kept out of the stack
+static CardStore reloaded;
+
+static uint32_t seed = 1;
+
+static uint32_t random32() {
+  seed = seed * 1103515245u + 12345u;
+  return seed >> 8;
+}
+
+static Uid randomUid() {
+  static const uint8_t LENGTHS[] = { 4, 7, 10 };
+  Uid uid(LENGTHS[random32() % 3]);
+  for (uint8_t &byte : uid) {
+    byte = (uint8_t)random32();
+  }
+  return uid;
+}
+
+static void resetFlash() {
+  Preferences::namespaces().clear();
+  store.nvs.failWrites = false;
+  loadCards(store, DEFAULT_USERS, sizeof(DEFAULT_USERS) / sizeof(DEFAULT_USERS[0]));
+}
+
+static CardResult add(const Uid &uid, uint8_t flags, const std::string &name) {
+  return addCard(store, uid.data(), (uint8_t)uid.size(), flags, name.data(), name.size(), true);
+}
+
+static bool matches(const CardStore &table, const std::map<Uid, Expected> &model) {
+  if (table.count != model.size()) {
+    return false;
+  }
+  for (const auto &entry : model) {
+    const CardRecord *card = findCard(table, entry.first.data(), (uint8_t)entry.first.size());
+    if (card == NULL || card->flags != entry.second.flags || entry.second.name != cardName(table, *card)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void checkBasics() {
+  resetFlash();
+  CHECK(store.count == 2);
+  const CardRecord *admin = findCard(store, DEFAULT_USERS[0].uid, 4);
+  CHECK(admin != NULL && admin->flags == RFID_FLAG_ADMIN && strcmp(cardName(store, *admin), "User 1") == 0);
+  CHECK(Preferences::namespaces()["rfid"].count("count") == 1); // The seed is persisted
+
+  Uid seven = { 1, 2, 3, 4, 5, 6, 7 }, ten = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+  CHECK(add(seven, 0, "Seven") == CARD_OK && add(ten, 0, "Ten") == CARD_OK && store.count == 4);
+  CHECK(findCard(store, seven.data(), 4) == NULL); // A prefix of a longer UID is another card
+  CHECK(add(Uid(5, 1), 0, "Five") == CARD_INVALID);
+  CHECK(add(seven, 0, std::string(RFID_NAME_MAX + 1, 'x')) == CARD_INVALID);
+  CHECK(add(seven, 0, std::string("a\0b", 3)) == CARD_INVALID && add(seven, 0, "") == CARD_INVALID);
+  CHECK(add(seven, RFID_FLAG_ADMIN, std::string(RFID_NAME_MAX, 'y')) == CARD_OK && store.count == 4);
+  CHECK(findCard(store, seven.data(), 7)->flags == RFID_FLAG_ADMIN);
+  CHECK(revokeCard(store, ten.data(), 10) == CARD_OK && findCard(store, ten.data(), 10) == NULL);
+  CHECK(revokeCard(store, ten.data(), 10) == CARD_NOT_FOUND && store.count == 3);
+}
+
+static void checkAgainstModel() {
+  resetFlash();
+  std::map<Uid, Expected> model;
+  for (const DefaultUser &user : DEFAULT_USERS) {
+    model[Uid(user.uid, user.uid + user.uidLength)] = { user.flags, user.name };
+  }
+  std::vector<Uid> known;
+  for (const auto &entry : model) {
+    known.push_back(entry.first);
+  }
+
+  int compactions = 0, chunkOverruns = 0, mismatches = 0, fullSeen = 0;
+  for (int step = 0; step < 20000; step++) {
+    size_t writesBefore = store.nvs.writes;
+    uint16_t namesBefore = store.namesUsed;
+    bool revoke = !known.empty() && random32() % 3 == 0;
+    if (revoke) {
+      size_t pick = random32() % known.size();
+      Uid uid = known[pick];
+      known[pick] = known.back();
+      known.pop_back();
+      CHECK(revokeCard(store, uid.data(), (uint8_t)uid.size()) == CARD_OK);
+      model.erase(uid);
+      chunkOverruns += store.nvs.writes - writesBefore > 3; // Two chunks + "count"
+    } else {
+      Uid uid = (!known.empty() && random32() % 8 == 0) ? known[random32() % known.size()] : randomUid();
+      char name[RFID_NAME_MAX + 1];
+      if (random32() % 4 == 0) {
+        snprintf(name, sizeof(name), "Guest %u", random32() % 100000); // Mostly unique
+      } else {
+        snprintf(name, sizeof(name), "Team %u", random32() % 40);      // Shared, interned once
+      }
+      uint8_t flags = random32() % 10 == 0 ? RFID_FLAG_ADMIN : 0;
+      CardResult result = add(uid, flags, name);
+      if (result == CARD_FULL) {
+        fullSeen++;
+        CHECK(store.count == RFID_MAX_CARDS && model.count(uid) == 0);
+      } else {
+        CHECK(result == CARD_OK);
+        if (model.count(uid) == 0) {
+          known.push_back(uid);
+        }
+        model[uid] = { flags, name };
+        compactions += store.namesUsed < namesBefore;
+        bool compacted = store.namesUsed < namesBefore;
+        chunkOverruns += !compacted && store.nvs.writes - writesBefore > 3; // "names", one chunk, "count"
+      }
+    }
+    if (step % 500 == 0 || step == 19999) {
+      mismatches += !matches(store, model);
+    }
+  }
+  printf("  model      20000 steps: %u cards at the end, %d compactions, %d adds refused as full\n",
+         store.count, compactions, fullSeen);
+  CHECK(mismatches == 0);
+  CHECK(chunkOverruns == 0);
+  CHECK(compactions > 0 && fullSeen > 0);
+
+  loadCards(reloaded, DEFAULT_USERS, 2);
+  CHECK(matches(reloaded, model));
+}
+
+static void checkLoadAndFailures() {
+  resetFlash();
+  Uid extra = { 9, 9, 9, 9 };
+  CHECK(add(extra, 0, "Extra") == CARD_OK && store.count == 3);
+
+  // Corrupt record 0 (bad length) and make record 2 a duplicate of record 1
+  std::vector<uint8_t> &chunk = Preferences::namespaces()["rfid"]["c0"];
+  CardRecord *records = (CardRecord *)chunk.data();
+  records[0].uidLength = 5;
+  records[2] = records[1];
+  loadCards(reloaded, DEFAULT_USERS, 2);
+  CHECK(reloaded.count == 1 && findCard(reloaded, DEFAULT_USERS[1].uid, 4) != NULL);
+
+  // A chunk missing from flash drops the cards it held, not the whole store
+  Preferences::namespaces()["rfid"].erase("c0");
+  loadCards(reloaded, DEFAULT_USERS, 2);
+  CHECK(reloaded.count == 0);
+
+  resetFlash();
+  store.nvs.failWrites = true;
+  CHECK(add(extra, 0, "Extra") == CARD_STORE_FAILED && findCard(store, extra.data(), 4) != NULL);
+  CHECK(revokeCard(store, extra.data(), 4) == CARD_STORE_FAILED && findCard(store, extra.data(), 4) == NULL);
+  store.nvs.failWrites = false;
+}
+
+static void benchmark() {
+  resetFlash();
+  std::vector<Uid> present;
+  while (store.count < RFID_MAX_CARDS) {
+    Uid uid = randomUid();
+    char name[RFID_NAME_MAX + 1];
+    snprintf(name, sizeof(name), "Team %u", random32() % 100);
+    if (add(uid, 0, name) == CARD_OK && present.size() < store.count) {
+      present.push_back(uid);
+    }
+  }
+  std::vector<Uid> absent;
+  while (absent.size() < 4096) {
+    Uid uid = randomUid();
+    if (findCard(store, uid.data(), (uint8_t)uid.size()) == NULL) {
+      absent.push_back(uid);
+    }
+  }
+
+  static volatile uintptr_t sink;
+  auto time = [&](const std::vector<Uid> &uids, bool linear) {
+    long long start = nowNanos();
+    for (int i = 0; i < LOOKUPS; i++) {
+      const Uid &uid = uids[i % uids.size()];
+      const CardRecord *found = NULL;
+      if (linear) {
+        for (uint16_t n = 0; n < store.count && found == NULL; n++) {
+          if (store.cards[n].uidLength == uid.size() && memcmp(store.cards[n].uid, uid.data(), uid.size()) == 0) {
+            found = &store.cards[n];
+          }
+        }
+      } else {
+        found = findCard(store, uid.data(), (uint8_t)uid.size());
+      }
+      sink = sink + (uintptr_t)found;
+    }
+    return (double)(nowNanos() - start) / LOOKUPS;
+  };
+  double hit = time(present, false), miss = time(absent, false);
+  double linearHit = time(present, true), linearMiss = time(absent, true);
+
+  long long start = nowNanos();
+  for (int i = 0; i < LOADS; i++) {
+    loadCards(reloaded, DEFAULT_USERS, 2);
+  }
+  double loadMicros = (nowNanos() - start) / 1e3 / LOADS;
+
+  printf("  benchmark  %u cards (4/7/10-byte UIDs), %u name bytes\n", store.count, store.namesUsed);
+  printf("    hash lookup   hit %6.1f ns   miss %6.1f ns\n", hit, miss);
+  printf("    linear scan   hit %6.1f ns   miss %6.1f ns\n", linearHit, linearMiss);
+  printf("    loadCards()   %6.1f us (stand-in reads: validation and indexing only)\n", loadMicros);
+  CHECK(reloaded.count == RFID_MAX_CARDS);
+  CHECK(hit < linearHit && miss < linearMiss);
+}
+
+int main() {
+  checkBasics();
+  checkAgainstModel();
+  checkLoadAndFailures();
+  benchmark();
+  return checkResult("test_card_store");
+}
@@ -0,0 +1,181 @@
+/**
+ * @file test_command_frame.cpp
+ * @brief Checks the command frame parsers and benchmarks them on a command stream.
+ * @details The stream is either a recording given on the command line or, by default,
+ * one minute of synthetic dashboard traffic: held-key drive frames every 150 ms with
+ * key changes, a clock-exchange ping about every second, a STATS poll about every 5 s, plus legacy
+ * ASCII commands from an old client. A recording has one message per line, "b <hex>"
+ * for a binary frame or "t <text>" for a text message (\r and \n escapes allowed).
+ *
+ * Usage: build/test_command_frame [recording.txt]
+ */
+#include "command_frame.h"
+#include "alloc_count.h"
+#include "check.h"
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+struct Message {
+  bool binary;
+  std::string bytes;
+};
+
+// --- Command streams ------------------------------------------------------------------
+static void addDrive(std::vector<Message> &stream, uint16_t &sequence, uint8_t command, int speed) {
+  std::string frame = { (char)OP_DRIVE, (char)(sequence & 0xFF), (char)(sequence >> 8), (char)command };
+  if (speed >= 0) {
+    frame.push_back((char)speed);
+  }
+  sequence++;
+  stream.push_back({ true, frame });
+}
+
+static std::vector<Message> syntheticSession() {
+  std::vector<Message> stream;
+  uint16_t sequence = 0;
+  const uint8_t pattern[] = { CMD_FORWARD, CMD_FORWARD, CMD_LEFT, CMD_FORWARD, CMD_RIGHT, CMD_BACKWARD, CMD_STOP };
+  stream.push_back({ true, std::string("\x03\x00\x00\x01\x01", 5) }); // OP_TELEMETRY_MODE binary, full
+  for (int ms = 0; ms < 60000; ms += 150) {
+    uint8_t command = pattern[(ms / 1200) % sizeof(pattern)];
+    addDrive(stream, sequence, command, (ms / 3000) % 2 ? 180 : -1);
+    if (ms % 1050 == 0) {
+      std::string ping = { (char)OP_PING, (char)(ms & 0xFF), (char)(ms >> 8) };
+      ping.append(8, '\x41'); // float64 T1
+      stream.push_back({ true, ping });
+    }
+    if (ms % 4950 == 0) {
+      stream.push_back({ true, std::string("\x04\x00\x00", 3) });
+    }
+    if (ms % 600 == 0) {
+      stream.push_back({ false, "1\r\n" }); // Legacy client
+      stream.push_back({ false, "PING\r\n" });
+    }
+  }
+  return stream;
+}
+
+static std::vector<Message> loadRecording(const char *path) {
+  std::vector<Message> stream;
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    exit(2);
+  }
+  char line[4096];
+  while (fgets(line, sizeof(line), file)) {
+    std::string text(line);
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+      text.pop_back();
+    }
+    if (text.size() < 2 || text[1] != ' ') {
+      continue;
+    }
+    Message message = { text[0] == 'b', "" };
+    for (size_t i = 2; i < text.size(); i++) {
+      if (message.binary) {
+        if (i + 1 < text.size() && isxdigit((unsigned char)text[i])) {
+          message.bytes.push_back((char)strtol(text.substr(i, 2).c_str(), NULL, 16));
+          i++;
+        }
+      } else if (text[i] == '\\' && i + 1 < text.size() && (text[i + 1] == 'r' || text[i + 1] == 'n')) {
+        message.bytes.push_back(text[++i] == 'r' ? '\r' : '\n');
+      } else {
+        message.bytes.push_back(text[i]);
+      }
+    }
+    stream.push_back(message);
+  }
+  fclose(file);
+  return stream;
+}
+
+// --- Parser checks --------------------------------------------------------------------
+static bool parseBinary(const std::string &bytes, CommandFrame &frame) {
+  return parseBinaryCommand(bytes.data(), bytes.size(), frame);
+}
+
+static bool parseText(const char *text, CommandFrame &frame) {
+  return parseAsciiCommand(text, strlen(text), frame);
+}
+
+static void checkParsers() {
+  CommandFrame frame;
+
+  CHECK(parseBinary(std::string("\x01\x34\x12\x01", 4), frame));
+  CHECK(frame.opcode == OP_DRIVE && frame.sequence == 0x1234 && frame.command == CMD_FORWARD && frame.speed == -1);
+  CHECK(parseBinary(std::string("\x01\x00\x00\x02\xC8", 5), frame));
+  CHECK(frame.command == CMD_BACKWARD && frame.speed == 200);
+  CHECK(!parseBinary(std::string("\x01\x00\x00", 3), frame));  // Drive without a command
+  CHECK(!parseBinary(std::string("\x01\x00", 2), frame));      // Short header
+  CHECK(!parseBinary(std::string("\x7F\x00\x00\x00", 4), frame)); // Unknown opcode
+
+  std::string ping("\x02\x05\x00", 3);
+  CHECK(parseBinary(ping, frame) && frame.opcode == OP_PING && frame.payloadLength == 0);
+  ping.append(8, '\0');
+  CHECK(parseBinary(ping, frame) && frame.payloadLength == CLOCK_TIMESTAMP_LENGTH);
+
+  CHECK(!parseBinary(std::string("\x05\x00\x00\x01\x02", 5), frame)); // Clock offset needs 8 bytes
+  CHECK(!parseBinary(std::string("\x06\x00\x00", 3), frame));         // Lease needs its flag
+  CHECK(parseBinary(std::string("\x06\x00\x00\x01", 4), frame) && frame.payload[0] == 1);
+  CHECK(!parseBinary(std::string("\x07\x00\x00\x01\x04\xAA\xBB", 7), frame));  // UID shorter than its length
+  CHECK(parseBinary(std::string("\x07\x00\x00\x02\x04\xAA\xBB\xCC\xDD", 9), frame));
+  CHECK(!parseBinary(std::string("\x08\x00\x00", 3) + std::string(AUTH_TOKEN_LENGTH - 1, 'x'), frame));
+  CHECK(parseBinary(std::string("\x08\x00\x00", 3) + std::string(AUTH_TOKEN_LENGTH, 'x'), frame));
+
+  CHECK(parseText("1\r\n", frame) && frame.opcode == OP_DRIVE && frame.command == CMD_FORWARD);
+  CHECK(frame.sequence == FRAME_NO_SEQUENCE && frame.speed == -1);
+  CHECK(parseText("8", frame) && frame.command == CMD_RIGHT);
+  CHECK(parseText("PING\r\n", frame) && frame.opcode == OP_PING);
+  CHECK(parseText("STATS", frame) && frame.opcode == OP_STATS);
+  CHECK(!parseText("", frame));
+  CHECK(!parseText("256", frame));   // Not a byte
+  CHECK(!parseText("1x", frame));    // Trailing garbage
+  CHECK(!parseText("1234", frame));  // Too many digits
+
+  uint8_t bytes[CLOCK_TIMESTAMP_LENGTH];
+  writeUint64(bytes, 0x0102030405060708ULL);
+  CHECK(bytes[0] == 0x08 && bytes[7] == 0x01);
+  CHECK(readUint64(bytes) == 0x0102030405060708ULL);
+}
+
+// --- Benchmark --------------------------------------------------------------------------
+static void benchmark(const std::vector<Message> &stream, bool synthetic) {
+  const int passes = 2000;
+  unsigned long checksum = 0;
+  size_t parsedCount = 0;
+
+  size_t allocationsBefore = allocations;
+  size_t bytesBefore = allocatedBytes;
+  long long start = nowNanos();
+  for (int pass = 0; pass < passes; pass++) {
+    for (const Message &message : stream) {
+      CommandFrame frame = {};
+      bool parsed = message.binary
+          ? parseBinaryCommand(message.bytes.data(), message.bytes.size(), frame)
+          : parseAsciiCommand(message.bytes.data(), message.bytes.size(), frame);
+      if (parsed) {
+        parsedCount++;
+        checksum += frame.opcode + frame.command;
+      }
+    }
+  }
+  long long elapsed = nowNanos() - start;
+  size_t parseAllocations = allocations - allocationsBefore;
+  size_t parseBytes = allocatedBytes - bytesBefore;
+
+  size_t commands = stream.size() * passes;
+  printf("  %zu messages x %d passes, %zu parsed (checksum %lu)\n", stream.size(), passes, parsedCount, checksum);
+  printf("  %.1f ns/command, %zu allocations (%zu bytes) while parsing\n",
+         (double)elapsed / commands, parseAllocations, parseBytes);
+  CHECK(parseAllocations == 0);
+  CHECK(!synthetic || parsedCount == commands); // Every synthetic message is well formed
+}
+
+int main(int argc, char **argv) {
+  checkParsers();
+  std::vector<Message> stream = argc > 1 ? loadRecording(argv[1]) : syntheticSession();
+  benchmark(stream, argc <= 1);
+  return checkResult("test_command_frame");
+}
@@ -0,0 +1,192 @@
+/**
+ * @file test_control_message.cpp
+ * @brief Checks, fuzzes and benchmarks the camera control message parser in control_message.h.
+ * @details Three parts:
+ * - commands: every key parseControl() knows, with valid, clamped, mistyped and malformed
+ *   values, plus the length, depth and arena limits.
+ * - fuzz: seeded mutations (byte flips, inserts, deletes, structural characters, truncation)
+ *   of a corpus of real dashboard messages. Every input is copied into a heap block of
+ *   exactly its length with no terminating NUL, so the AddressSanitizer build (the Makefile
+ *   also builds this test with -fsanitize=address,undefined) catches any read past the end.
+ *   Every accepted message must yield values inside the ranges applyControl() relies on.
+ * - benchmark: the time to parse each corpus message, and the heap allocations it makes,
+ *   which must be none. There is no baseline figure: the String + DynamicJsonDocument
+ *   version this replaced needs ArduinoJson, which is not vendored in this tree.
+ */
+#include "control_message.h"
+#include "alloc_count.h"
+#include "check.h"
+
+#include <stdlib.h>
+#include <string>
+
+static const framesize_t MAX_FRAMESIZE = FRAMESIZE_VGA; ///< What initCamera() picks with PSRAM.
+static const int FUZZ_CASES = 200000;
+static const int BENCHMARK_PASSES = 100000;
+
+static const char *const CORPUS[] = {
+  "{\"set_quality\":12}",
+  "{\"abr\":true,\"target_latency\":200}",
+  "{\"ping\":1712345678901234}",
+  "{\"motion_mode\":false,\"wake\":true}",
+  "{\"drive\":1,\"speed\":180}",
+  "{\"frame_latency\":95}",
+  "{\"framesize\":\"QVGA\",\"fps\":15}",
+  "{\"brightness\":-1,\"mirror\":true}",
+  "{\"roi\":[10,20,50,60]}",
+  "{\"roi\":false,\"client\":{\"name\":\"dash\\u00e9\",\"v\":[1,2.5e3,{\"x\":null}]}}",
+};
+static const int CORPUS_SIZE = sizeof(CORPUS) / sizeof(CORPUS[0]);
+
+static bool parse(const std::string &text, CameraControl &control) {
+  return parseControl(text.data(), text.size(), MAX_FRAMESIZE, control);
+}
+
+static bool parse(const char *text, CameraControl &control) { return parse(std::string(text), control); }
+
+static void checkCommands() {
+  CameraControl c;
+  CHECK(parse("{\"set_quality\":12}", c) && c.fields == CTRL_QUALITY && c.quality == 12);
+  CHECK(parse("{\"set_quality\":99}", c) && c.quality == 63);
+  CHECK(!parse("{\"set_quality\":\"12\"}", c) && !parse("{\"set_quality\":12.5}", c));
+  CHECK(!parse("{\"set_quality\":99999999999}", c)); // Not an int
+  CHECK(parse("{\"set_quality\":null}", c) && c.fields == 0); // null = absent
+  CHECK(parse("{\"abr\":false,\"target_latency\":10}", c) && c.fields == (CTRL_ABR | CTRL_TARGET_LATENCY) &&
+        !c.abr && c.targetLatency == 30);
+  CHECK(!parse("{\"abr\":1}", c));
+  CHECK(parse("{\"ping\":-9223372036854775808}", c) && c.ping == INT64_MIN);
+  CHECK(parse("{\"ping\":9223372036854775807}", c) && c.ping == INT64_MAX);
+  CHECK(!parse("{\"ping\":9223372036854775808}", c));
+  CHECK(parse("{\"wake\":0}", c) && c.fields == CTRL_WAKE);
+  CHECK(parse("{\"drive\":2}", c) && c.driveCommand == 2 && c.driveSpeed == DRIVE_DEFAULT_SPEED);
+  CHECK(parse("{\"drive\":1,\"speed\":300}", c) && c.driveSpeed == 255);
+  CHECK(!parse("{\"drive\":1,\"speed\":\"fast\"}", c));
+  CHECK(parse("{\"framesize\":\"qvga\"}", c) && c.framesize == FRAMESIZE_QVGA);
+  CHECK(parse("{\"framesize\":5}", c) && c.framesize == (framesize_t)5);
+  CHECK(!parse("{\"framesize\":\"UXGA\"}", c) && !parse("{\"framesize\":\"QVGAX\"}", c));
+  CHECK(!parse("{\"framesize\":-1}", c) && !parse("{\"framesize\":true}", c));
+  CHECK(parse("{\"fps\":200,\"brightness\":-7,\"mirror\":true}", c) && c.fps == 60 && c.brightness == -2 && c.mirror);
+  CHECK(parse("{\"roi\":[0,0,100,100]}", c) && c.roi.w == 100 && c.roi.h == 100);
+  CHECK(parse("{\"roi\":false}", c) && c.fields == CTRL_ROI && c.roi.w == 100);
+  CHECK(!parse("{\"roi\":[10,10,95,10]}", c) && !parse("{\"roi\":[1,2,3]}", c));
+  CHECK(!parse("{\"roi\":[1,2,3,\"4\"]}", c) && !parse("{\"roi\":true}", c));
+  CHECK(!parse("{\"roi\":[1,2,2147483647,4]}", c));
+  CHECK(parse("{\"set_quality\":5,\"set_quality\":60}", c) && c.quality == 5); // First one wins
+
+  // Structure and limits
+  CHECK(parse(" \r\n{ \"unknown\" : [ { } , [ ] ] ,\"fps\":1 }\t", c) && c.fields == CTRL_FPS);
+  CHECK(!parse("", c) && !parse("[]", c) && !parse("\"x\"", c) && !parse("{}x", c));
+  CHECK(!parse("{\"fps\":1,}", c) && !parse("{\"fps\" 1}", c) && !parse("{'fps':1}", c));
+  CHECK(!parse("{\"fps\":01}", c) && !parse("{\"fps\":-}", c) && !parse("{\"fps\":1.}", c));
+  CHECK(!parse("{\"a\":\"\\x\"}", c) && !parse("{\"a\":\"\\u12g4\"}", c) && !parse("{\"a\":\"tab\there\"}", c));
+  CHECK(!parse("{\"a\":\"unterminated}", c) && !parse("{\"a\":tru}", c));
+  CHECK(parse("{\"a\":[[[1]]]}", c) && !parse("{\"a\":[[[[1]]]]}", c)); // CONTROL_MAX_DEPTH
+  std::string many = "{\"a\":[";
+  for (int i = 0; i < CONTROL_MAX_TOKENS; i++) {
+    many += i ? ",1" : "1";
+  }
+  CHECK(!parse(many + "]}", c)); // More values than the arena holds
+  std::string padded = "{\"fps\":1,\"pad\":\"";
+  padded += std::string(CONTROL_MAX_LENGTH - padded.size() - 2, 'x') + "\"}";
+  CHECK(padded.size() == CONTROL_MAX_LENGTH && parse(padded, c));
+  CHECK(!parse(padded + " ", c));
+}
+
+static bool withinRanges(const CameraControl &c) {
+  bool ok = true;
+  if (c.fields & CTRL_QUALITY) ok &= c.quality >= 0 && c.quality <= 63;
+  if (c.fields & CTRL_TARGET_LATENCY) ok &= c.targetLatency >= 30 && c.targetLatency <= 5000;
+  if (c.fields & CTRL_FRAME_LATENCY) ok &= c.frameLatency <= 60000;
+  if (c.fields & CTRL_FRAMESIZE) ok &= c.framesize >= 0 && c.framesize <= MAX_FRAMESIZE;
+  if (c.fields & CTRL_FPS) ok &= c.fps <= 60;
+  if (c.fields & CTRL_BRIGHTNESS) ok &= c.brightness >= -2 && c.brightness <= 2;
+  if (c.fields & CTRL_ROI) ok &= c.roi.w > 0 && c.roi.h > 0 && c.roi.x + c.roi.w <= 100 && c.roi.y + c.roi.h <= 100;
+  return ok && c.fields < (CTRL_ROI << 1);
+}
+
+static uint32_t seed = 1;
+
+static uint32_t random32() {
+  seed = seed * 1103515245u + 12345u;
+  return seed >> 8;
+}
+
+static std::string mutate(std::string text) {
+  static const char STRUCTURAL[] = "{}[]\",:-.0123456789eEtfnul\\ ";
+  int mutations = 1 + random32() % 4;
+  for (int m = 0; m < mutations; m++) {
+    size_t at = text.empty() ? 0 : random32() % text.size();
+    switch (random32() % 6) {
+      case 0:
+        if (!text.empty()) text[at] = (char)random32();
+        break;
+      case 1:
+        text.insert(text.begin() + at, (char)random32());
+        break;
+      case 2:
+        if (!text.empty()) text.erase(at, 1);
+        break;
+      case 3:
+        if (!text.empty()) text[at] = STRUCTURAL[random32() % (sizeof(STRUCTURAL) - 1)];
+        break;
+      case 4:
+        text.insert(at, text.substr(random32() % (text.size() + 1), random32() % 16));
+        break;
+      case 5:
+        text.resize(at);
+        break;
+    }
+  }
+  return text;
+}
+
+static void fuzz() {
+  int accepted = 0, outOfRange = 0;
+  long long start = nowNanos();
+  for (int i = 0; i < FUZZ_CASES; i++) {
+    std::string text = mutate(CORPUS[random32() % CORPUS_SIZE]);
+    char *exact = (char *)malloc(text.size() ? text.size() : 1); // No NUL: over-reads hit the redzone
+    memcpy(exact, text.data(), text.size());
+    CameraControl control;
+    if (parseControl(exact, text.size(), MAX_FRAMESIZE, control)) {
+      accepted++;
+      if (!withinRanges(control)) {
+        outOfRange++;
+        fprintf(stderr, "  out of range: %s\n", text.c_str());
+      }
+    }
+    free(exact);
+  }
+  double seconds = (nowNanos() - start) / 1e9;
+  printf("  fuzz       %d mutated messages in %.2f s: %d accepted, %d rejected, %d out of range\n", FUZZ_CASES,
+         seconds, accepted, FUZZ_CASES - accepted, outOfRange);
+  CHECK(outOfRange == 0);
+  CHECK(accepted > FUZZ_CASES / 20 && accepted < FUZZ_CASES); // The mutations reach both outcomes
+}
+
+static void benchmark() {
+  static volatile uint32_t sink;
+  for (int i = 0; i < CORPUS_SIZE; i++) {
+    std::string text = CORPUS[i];
+    CameraControl control;
+    size_t allocationsBefore = allocations;
+    long long start = nowNanos();
+    for (int pass = 0; pass < BENCHMARK_PASSES; pass++) {
+      parseControl(text.data(), text.size(), MAX_FRAMESIZE, control);
+      sink = sink + control.fields;
+    }
+    double nanos = (double)(nowNanos() - start) / BENCHMARK_PASSES;
+    size_t perMessage = (allocations - allocationsBefore) / BENCHMARK_PASSES;
+    printf("  benchmark  %7.1f ns/message  %zu allocations  %3zu bytes  %.60s\n", nanos, perMessage, text.size(),
+           text.c_str());
+    CHECK(control.fields != 0);
+    CHECK(allocations == allocationsBefore);
+  }
+}
+
+int main() {
+  checkCommands();
+  fuzz();
+  benchmark();
+  return checkResult("test_control_message");
+}
@@ -0,0 +1,105 @@
+/**
+ * @file test_control_queue.cpp
+ * @brief Two-thread stress test of the control task handoff, meant to run under ThreadSanitizer.
+ * @details One thread plays the network loop: it pushes numbered ControlCommands (retrying
+ * when the ring is full, as a stop does) and drains ControlEvents. The other plays the control
+ * task: it drains commands and posts an event for every 64th one. Every field of a command is
+ * derived from its number, so a torn or reordered read shows up as a mismatch, and every
+ * number must arrive exactly once and in order. Built with -fsanitize=thread by the Makefile.
+ */
+#include "control_queue.h"
+#include "check.h"
+
+#include <thread>
+
+static const uint32_t COMMANDS = 200000;
+
+static ControlCommand commandFor(uint32_t number) {
+  ControlCommand command = { (uint8_t)(number % 9), (int16_t)(number % 256), number, ~number };
+  return command;
+}
+
+static void checkSingleThreaded() {
+  SpscRing<ControlCommand, 4> ring;
+  ControlCommand command;
+  CHECK(!ring.pop(command));
+  for (uint32_t i = 0; i < 4; i++) {
+    CHECK(ring.push(commandFor(i)));
+  }
+  CHECK(!ring.push(commandFor(4))); // Full: the item is not stored
+  for (uint32_t i = 0; i < 4; i++) {
+    CHECK(ring.pop(command) && command.receivedMicros == i);
+  }
+  CHECK(!ring.pop(command));
+}
+
+static void stress() {
+  SpscRing<ControlCommand, 16> commandQueue;
+  SpscRing<ControlEvent, 8> eventQueue;
+  std::atomic<bool> done(false);
+  uint32_t fullRetries = 0;
+  uint32_t eventsReceived = 0;
+  int eventMismatches = 0;
+
+  std::thread controlTask([&] {
+    uint32_t expected = 0;
+    int mismatches = 0;
+    uint32_t eventsPosted = 0;
+    ControlCommand command;
+    while (expected < COMMANDS) {
+      if (!commandQueue.pop(command)) {
+        std::this_thread::yield();
+        continue;
+      }
+      ControlCommand reference = commandFor(expected);
+      if (command.command != reference.command || command.speed != reference.speed ||
+          command.receivedMicros != reference.receivedMicros || command.queuedMicros != reference.queuedMicros) {
+        mismatches++;
+      }
+      if (expected % 64 == 0) {
+        ControlEvent event = { EVENT_OBSTACLE_ACTIVE, (int)(expected / 64) };
+        while (!eventQueue.push(event)) {
+          std::this_thread::yield();
+        }
+        eventsPosted++;
+      }
+      expected++;
+    }
+    CHECK(mismatches == 0);
+    printf("  control task: %u commands in order, %u events posted\n", expected, eventsPosted);
+    done.store(true);
+  });
+
+  ControlEvent event;
+  for (uint32_t number = 0; number < COMMANDS; number++) {
+    while (!commandQueue.push(commandFor(number))) {
+      fullRetries++;
+      std::this_thread::yield();
+      while (eventQueue.pop(event)) {
+        eventMismatches += event.distance != (int)eventsReceived++;
+      }
+    }
+  }
+  for (;;) {
+    bool finished = done.load(); // Read first: once set, every event is already in the ring
+    if (eventQueue.pop(event)) {
+      eventMismatches += event.distance != (int)eventsReceived++;
+    } else if (finished) {
+      break;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  controlTask.join();
+
+  printf("  network loop: %u commands pushed (%u retries on a full ring), %u events received\n",
+         COMMANDS, fullRetries, eventsReceived);
+  CHECK(eventMismatches == 0);
+  CHECK(eventsReceived == (COMMANDS + 63) / 64);
+}
+
+int main() {
+  checkSingleThreaded();
+  stress();
+  return checkResult("test_control_queue");
+}
@@ -0,0 +1,273 @@
+/**
+ * @file test_deadman.cpp
+ * @brief Sweeps link-loss timing through the deadman watchdog tick in deadman.h, and
+ * checks the tick's re-checks against frames that arrive in the middle of it.
+ * @details A simulated car on a 1 ms virtual clock: the dashboard re-sends its held
+ * command every REPEAT_MS (DEADMAN_TIMEOUT_MS / 3, as the dashboard does), each frame
+ * arrives LATENCY_MS later, is stamped (lastDriverFrame) and queued, and the control task
+ * applies queued frames and then a requested stop every CONTROL_PERIOD_MS, as
+ * controlTask() does. deadmanStep() runs every DEADMAN_PERIOD_MS. Out-of-order frames
+ * are dropped, as acceptDriveSequence() drops them.
+ * - sweep: the link goes silent at every phase of the repeat, timer and control periods;
+ *   reported is the time from the loss to duty 0 and to the applied stop, and how long
+ *   the car kept going at full-speed equivalent (the integral of duty / speed). Repeated
+ *   with the control task stuck after the loss, so only the timer acts.
+ * - jitter: 60 s of driving with an extra random delay per frame, counting false trips.
+ * - races: a frame applied, a frame stamped but not applied, and a stop applied while a
+ *   tick is between its writes.
+ * The figures follow from this model's timings; they are not measurements on the car.
+ */
+#include "deadman.h"
+#include "check.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+static const uint32_t REPEAT_MS = DEADMAN_TIMEOUT_MS / 3; ///< The dashboard's driveRepeatMs.
+static const uint32_t LATENCY_MS = 5;                     ///< One-way frame latency.
+static const uint32_t CONTROL_PERIOD_MS = 10;             ///< CONTROL_PERIOD_MS in RC_Car_v2.0.0.ino.
+static const int SPEED = 200;                             ///< motorSpeed's default.
+static const uint32_t DRIVE_MS = 60000;                   ///< Length of each jitter run.
+
+/// The car's state the tick and the control task share, with deadmanStep()'s hooks.
+struct SimCar {
+  uint32_t clock = 0;
+  uint32_t lastDriverFrame = 0;
+  bool moving = true;       ///< lastSentCommand != CMD_STOP
+  int duty[2] = { SPEED, SPEED };
+  int queuedFrames = 0;     ///< Stamped, not yet applied by the control task.
+  bool stopRequested = false;
+  std::function<void(SimCar &, DeadmanMotor)> onWrite; ///< Runs "on the other core" after a write.
+
+  uint32_t lastFrame() { return lastDriverFrame; }
+  uint32_t now() { return clock; }
+  bool driving() { return moving; }
+  int speed() { return SPEED; }
+  void writeDuty(DeadmanMotor motor, int value) {
+    duty[motor] = value;
+    if (onWrite) {
+      onWrite(*this, motor);
+    }
+  }
+  void stop() { stopRequested = true; }
+
+  /// The network loop accepts a driver frame: stamped, then queued.
+  void frame() {
+    lastDriverFrame = clock;
+    queuedFrames++;
+  }
+
+  /// One controlTask() pass: queued commands, then the out-of-band stop.
+  void control() {
+    if (queuedFrames > 0) {
+      queuedFrames = 0;
+      moving = true;
+      duty[0] = duty[1] = SPEED;
+    }
+    if (stopRequested) {
+      stopRequested = false;
+      moving = false;
+      duty[0] = duty[1] = 0;
+    }
+  }
+};
+
+static uint32_t seed = 1;
+
+static uint32_t random32() {
+  seed = seed * 1103515245u + 12345u;
+  return seed >> 8;
+}
+
+struct Outcome {
+  int trips = 0;
+  long dutyZero = -1, stopped = -1; ///< ms after the loss, -1 if never.
+  double fullSpeedMs = 0;
+};
+
+/**
+ * @brief Drives until `loss` (frames sent before it still arrive), then runs until `horizon`.
+ * @param jitter Extra random delay per frame, 0-jitter ms.
+ */
+static Outcome drive(uint32_t loss, uint32_t horizon, uint32_t timerPhase, uint32_t controlPhase, bool stuckControl,
+                     uint32_t jitter) {
+  std::vector<std::pair<uint32_t, uint32_t>> arrivals; // (arrival, sequence)
+  for (uint32_t sent = 0, sequence = 1; sent < loss; sent += REPEAT_MS, sequence++) {
+    arrivals.push_back({ sent + LATENCY_MS + (jitter ? random32() % (jitter + 1) : 0), sequence });
+  }
+  std::sort(arrivals.begin(), arrivals.end());
+
+  SimCar car;
+  DeadmanRamp ramp;
+  Outcome outcome;
+  size_t next = 0;
+  uint32_t lastSequence = 0;
+  for (car.clock = 1; car.clock < horizon; car.clock++) {
+    for (; next < arrivals.size() && arrivals[next].first <= car.clock; next++) {
+      if (arrivals[next].second > lastSequence) {
+        lastSequence = arrivals[next].second;
+        car.frame();
+      }
+    }
+    if (car.clock % DEADMAN_PERIOD_MS == timerPhase) {
+      outcome.trips += deadmanStep(ramp, car);
+    }
+    if (car.clock % CONTROL_PERIOD_MS == controlPhase && !(stuckControl && car.clock >= loss)) {
+      car.control();
+    }
+    if (car.clock >= loss) {
+      long since = car.clock - loss;
+      outcome.fullSpeedMs += (car.duty[0] + car.duty[1]) / (2.0 * SPEED);
+      if (outcome.dutyZero < 0 && car.duty[0] == 0 && car.duty[1] == 0) {
+        outcome.dutyZero = since;
+      }
+      if (outcome.stopped < 0 && !car.moving) {
+        outcome.stopped = since;
+      }
+    }
+  }
+  return outcome;
+}
+
+struct Range {
+  double min = 1e9, total = 0, max = 0;
+  int count = 0;
+  void add(double value) {
+    min = std::min(min, value);
+    max = std::max(max, value);
+    total += value;
+    count++;
+  }
+};
+
+static void printRange(const char *name, const Range &range) {
+  if (range.count == 0) {
+    printf("    %-22s %8s %8s %8s\n", name, "-", "-", "-");
+  } else {
+    printf("    %-22s %8.0f %8.1f %8.0f\n", name, range.min, range.total / range.count, range.max);
+  }
+}
+
+/// Link loss at every phase of the repeat, timer and control periods.
+static void sweep(bool stuckControl) {
+  const uint32_t base = 4 * REPEAT_MS;
+  const uint32_t span = DEADMAN_TIMEOUT_MS + (DEADMAN_RAMP_STEPS + 2) * DEADMAN_PERIOD_MS + 3 * CONTROL_PERIOD_MS;
+  Range dutyZero, stopped, fullSpeed;
+  int runs = 0, neverZero = 0;
+  for (uint32_t offset = 0; offset < REPEAT_MS; offset++) {
+    for (uint32_t timerPhase = 0; timerPhase < DEADMAN_PERIOD_MS; timerPhase++) {
+      for (uint32_t controlPhase = 0; controlPhase < CONTROL_PERIOD_MS; controlPhase++) {
+        uint32_t loss = base + offset;
+        Outcome outcome = drive(loss, loss + span, timerPhase, controlPhase, stuckControl, 0);
+        runs++;
+        if (outcome.dutyZero < 0) {
+          neverZero++;
+          continue;
+        }
+        dutyZero.add(outcome.dutyZero);
+        fullSpeed.add(outcome.fullSpeedMs);
+        if (outcome.stopped >= 0) {
+          stopped.add(outcome.stopped);
+        }
+      }
+    }
+  }
+  printf("  sweep      %d link losses%s\n", runs, stuckControl ? ", control task stuck after the loss" : "");
+  printf("    %-22s %8s %8s %8s\n", "after the loss (ms)", "min", "mean", "max");
+  printRange("duty 0", dutyZero);
+  printRange("stopped", stopped);
+  printRange("full-speed equivalent", fullSpeed);
+
+  // The last frame arrives between REPEAT_MS before the loss and LATENCY_MS after it; the
+  // first ramp step comes within a timer period of the timeout, the last one
+  // DEADMAN_RAMP_STEPS - 1 periods later, and the control task applies the stop within
+  // one control period
+  const uint32_t worstZero = LATENCY_MS + DEADMAN_TIMEOUT_MS + DEADMAN_RAMP_STEPS * DEADMAN_PERIOD_MS;
+  CHECK(neverZero == 0);
+  CHECK(dutyZero.max <= worstZero);
+  CHECK(dutyZero.min >= DEADMAN_TIMEOUT_MS - REPEAT_MS);
+  if (stuckControl) {
+    CHECK(stopped.count == 0); // Only the timer acted, and it only lowers the duty
+  } else {
+    CHECK(stopped.count == runs && stopped.max <= worstZero + CONTROL_PERIOD_MS);
+  }
+}
+
+static void jitter() {
+  printf("  jitter     false trips over %u s of driving without a loss\n", DRIVE_MS / 1000);
+  static const uint32_t JITTERS[] = { 0, 50, 150, 300, 600 };
+  for (uint32_t extra : JITTERS) {
+    seed = 1;
+    Outcome outcome = drive(DRIVE_MS, DRIVE_MS, 0, 0, false, extra);
+    printf("    jitter 0-%-4u ms  %5d trips\n", extra, outcome.trips);
+    if (REPEAT_MS + LATENCY_MS + extra < DEADMAN_TIMEOUT_MS) {
+      CHECK(outcome.trips == 0); // A frame always lands within the timeout
+    }
+  }
+}
+
+/// Runs one tick on an expired car at ramp step `rampStep`; `race` runs "on the other
+/// core" right after the tick's first write to `motor`.
+static void racyTick(SimCar &car, DeadmanRamp &ramp, int rampStep, DeadmanMotor motor,
+                     const std::function<void(SimCar &)> &race) {
+  ramp.step = rampStep;
+  ramp.duty = SPEED;
+  car.clock = DEADMAN_TIMEOUT_MS + 100;
+  bool fired = false;
+  car.onWrite = [&](SimCar &c, DeadmanMotor written) {
+    if (!fired && written == motor) {
+      fired = true;
+      race(c);
+    }
+  };
+  deadmanStep(ramp, car);
+  car.onWrite = nullptr;
+}
+
+static void races() {
+  // A frame stamped and applied by the control task right after the ENA write
+  {
+    SimCar car;
+    DeadmanRamp ramp;
+    racyTick(car, ramp, 3, DEADMAN_MOTOR_A, [](SimCar &c) {
+      c.frame();
+      c.control();
+    });
+    CHECK(ramp.step == 0 && car.duty[0] == SPEED && car.duty[1] == SPEED && !car.stopRequested);
+  }
+  // A frame stamped but not yet applied, on the last step: no stop, full duty written back
+  {
+    SimCar car;
+    DeadmanRamp ramp;
+    racyTick(car, ramp, DEADMAN_RAMP_STEPS - 1, DEADMAN_MOTOR_B, [](SimCar &c) { c.frame(); });
+    CHECK(ramp.step == 0 && !car.stopRequested && car.duty[0] == SPEED && car.duty[1] == SPEED);
+  }
+  // A stop applied after the ENA write: the tick leaves the motors to it
+  {
+    SimCar car;
+    DeadmanRamp ramp;
+    racyTick(car, ramp, DEADMAN_RAMP_STEPS - 1, DEADMAN_MOTOR_A, [](SimCar &c) {
+      c.stop();
+      c.control();
+    });
+    CHECK(ramp.step == 0 && !car.stopRequested && car.duty[0] == 0 && car.duty[1] == 0);
+  }
+  // Undisturbed, the last step writes zero and requests the stop
+  {
+    SimCar car;
+    DeadmanRamp ramp;
+    racyTick(car, ramp, DEADMAN_RAMP_STEPS - 1, DEADMAN_MOTOR_A, [](SimCar &) {});
+    CHECK(ramp.step == DEADMAN_RAMP_STEPS && car.stopRequested && car.duty[0] == 0 && car.duty[1] == 0);
+  }
+}
+
+int main() {
+  printf("  deadman timeout %u ms, timer period %u ms, ramp %d steps, repeat %u ms, latency %u ms\n",
+         DEADMAN_TIMEOUT_MS, DEADMAN_PERIOD_MS, DEADMAN_RAMP_STEPS, REPEAT_MS, LATENCY_MS);
+  sweep(false);
+  sweep(true);
+  jitter();
+  races();
+  return checkResult("test_deadman");
+}
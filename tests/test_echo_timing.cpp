@@ -0,0 +1,186 @@
+/**
+ * @file test_echo_timing.cpp
+ * @brief Simulates HC-SR04 echo timing to compare the control cycle stall of pulseIn()
+ * ranging with the edge-interrupt ranging in RC_Car_v2.0.0.ino.
+ * @details A virtual microsecond clock replays a distance trace (a CSV of
+ * "time_ms,distance_cm", -1 for nothing in range, or a built-in one minute drive).
+ * The sensor model follows the HC-SR04 datasheet: ECHO rises about 450 us after the
+ * trigger and stays high 58 us per cm, or about 38 ms when nothing returns.
+ *
+ * - pulseIn: every 200 ms (the old interval) the cycle sends the trigger and then
+ *   waits in pulseIn(echoPin, HIGH, 30000) until the echo falls or 30 ms pass.
+ * - interrupt: every ULTRASONIC_INTERVAL the cycle only sends the 12 us trigger; each
+ *   echo edge costs one short ISR that preempts whatever cycle it lands in.
+ *
+ * For every 10 ms control cycle the stall added by ranging is recorded. The echo
+ * pulses are also decoded with echoDistanceCm() and must match the trace within 1 cm.
+ * The costs of the trigger and the ISR are model inputs, not measurements.
+ *
+ * Usage: build/test_echo_timing [trace.csv]
+ */
+#include "ranging.h"
+#include "check.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <vector>
+
+static const uint32_t CONTROL_PERIOD_US = 10000;  ///< Control task period (CONTROL_PERIOD_MS).
+static const uint32_t OLD_INTERVAL_MS = 200;      ///< Ranging interval of the pulseIn() version.
+static const uint32_t PULSEIN_TIMEOUT_US = 30000; ///< pulseIn() timeout of the old version.
+static const uint32_t TRIGGER_US = 12;            ///< 2 us low + 10 us high trigger pulse.
+static const uint32_t ECHO_RISE_US = 450;         ///< Trigger end to ECHO rising (8 cycles of 40 kHz + setup).
+static const uint32_t NO_ECHO_HIGH_US = 38000;    ///< ECHO high time when nothing returns.
+static const uint32_t ISR_US = 2;                 ///< Cost of one echo edge interrupt (entry, micros(), exit).
+
+struct Sample {
+  uint32_t timeMs;
+  int distance; ///< cm, or -1 for nothing in range.
+};
+
+/// Distance in the trace at a given time (the last sample at or before it).
+static int distanceAt(const std::vector<Sample> &trace, uint32_t timeMs) {
+  auto it = std::upper_bound(trace.begin(), trace.end(), timeMs,
+                             [](uint32_t t, const Sample &sample) { return t < sample.timeMs; });
+  return it == trace.begin() ? trace.front().distance : (it - 1)->distance;
+}
+
+static uint32_t echoHighMicros(int distance) {
+  return distance < 0 ? NO_ECHO_HIGH_US : (uint32_t)(distance * 20000UL / 343UL + 1);
+}
+
+/// One minute: open space, a wall approached at 1 m/s, a stop, backing off, gaps with no echo.
+static std::vector<Sample> builtInTrace() {
+  std::vector<Sample> trace;
+  uint32_t seed = 12345;
+  for (uint32_t t = 0; t < 60000; t += 10) {
+    int distance;
+    uint32_t phase = t % 20000;
+    if (phase < 4000) {
+      distance = -1;                                   // Nothing in range
+    } else if (phase < 7300) {
+      distance = 350 - (int)((phase - 4000) / 10);     // Approaching at 100 cm/s
+    } else if (phase < 12000) {
+      distance = 20;                                   // Stopped at the wall
+    } else {
+      distance = 20 + (int)((phase - 12000) / 40);     // Backing away at 25 cm/s
+    }
+    seed = seed * 1103515245u + 12345u;
+    if (distance > 0 && (seed >> 16) % 50 == 0) {
+      distance = -1;                                   // Lost echo (soft or angled surface)
+    }
+    trace.push_back({ t, distance });
+  }
+  return trace;
+}
+
+static std::vector<Sample> loadTrace(const char *path) {
+  std::vector<Sample> trace;
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    exit(2);
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), file)) {
+    unsigned long timeMs;
+    int distance;
+    if (sscanf(line, "%lu,%d", &timeMs, &distance) == 2) {
+      trace.push_back({ (uint32_t)timeMs, distance });
+    }
+  }
+  fclose(file);
+  return trace;
+}
+
+struct StallReport {
+  std::vector<uint32_t> stalls; ///< Ranging stall per control cycle (us).
+  int readings = 0;
+  int decodeErrors = 0;
+};
+
+/// Sums per-cycle stall for one ranging design; `blocking` selects pulseIn() or interrupts.
+static StallReport simulate(const std::vector<Sample> &trace, bool blocking, uint32_t intervalMs) {
+  StallReport report;
+  uint32_t durationUs = trace.back().timeMs * 1000;
+  report.stalls.assign(durationUs / CONTROL_PERIOD_US + 1, 0);
+  uint32_t nextTriggerUs = 0;
+
+  for (uint32_t cycleStart = 0; cycleStart < durationUs; cycleStart += CONTROL_PERIOD_US) {
+    if (cycleStart < nextTriggerUs) {
+      continue;
+    }
+    nextTriggerUs = cycleStart + intervalMs * 1000;
+    uint32_t cycle = cycleStart / CONTROL_PERIOD_US;
+    int distance = distanceAt(trace, cycleStart / 1000);
+    uint32_t high = echoHighMicros(distance);
+    uint32_t rise = cycleStart + TRIGGER_US + ECHO_RISE_US;
+    uint32_t fall = rise + high;
+
+    if (blocking) {
+      // pulseIn() returns at the falling edge, or gives up 30 ms after it was called
+      uint32_t waited = std::min(fall - (cycleStart + TRIGGER_US), PULSEIN_TIMEOUT_US);
+      report.stalls[cycle] += TRIGGER_US + waited;
+    } else {
+      report.stalls[cycle] += TRIGGER_US;
+      report.stalls[rise / CONTROL_PERIOD_US] += ISR_US;
+      if (fall / CONTROL_PERIOD_US < report.stalls.size()) {
+        report.stalls[fall / CONTROL_PERIOD_US] += ISR_US;
+      }
+    }
+
+    // Both designs turn the pulse width into a distance the same way
+    if (distance > 0 && high < PULSEIN_TIMEOUT_US) {
+      report.readings++;
+      int decoded = echoDistanceCm(fall - rise);
+      if (decoded < 0 || abs(decoded - distance) > 1) {
+        report.decodeErrors++;
+      }
+    } else {
+      CHECK(distance < 0);
+    }
+  }
+  return report;
+}
+
+static void print(const char *name, StallReport report) {
+  std::vector<uint32_t> sorted = report.stalls;
+  std::sort(sorted.begin(), sorted.end());
+  unsigned long long total = 0;
+  for (uint32_t stall : sorted) {
+    total += stall;
+  }
+  printf("  %-26s %9u %9u %9u %8.2f%% %8d\n", name, sorted.back(), sorted[sorted.size() * 99 / 100],
+         sorted[sorted.size() / 2], 100.0 * total / ((double)sorted.size() * CONTROL_PERIOD_US), report.readings);
+}
+
+int main(int argc, char **argv) {
+  std::vector<Sample> trace = argc > 1 ? loadTrace(argv[1]) : builtInTrace();
+  if (trace.size() < 2) {
+    fprintf(stderr, "trace needs at least two samples\n");
+    return 2;
+  }
+
+  CHECK(echoDistanceCm(0) == -1);
+  CHECK(echoDistanceCm(583) == 9);       // 10 cm would be 583.1 us
+  CHECK(echoDistanceCm(5831) == 100);
+  CHECK(echoDistanceCm(echoHighMicros(250)) == 250);
+  CHECK(echoDistanceCm(NO_ECHO_HIGH_US) == -1);
+
+  StallReport before = simulate(trace, true, OLD_INTERVAL_MS);
+  StallReport afterOld = simulate(trace, false, OLD_INTERVAL_MS);
+  StallReport after = simulate(trace, false, ULTRASONIC_INTERVAL);
+
+  printf("  %.0f s trace, stall added to each %u ms control cycle (us):\n", trace.back().timeMs / 1000.0,
+         CONTROL_PERIOD_US / 1000);
+  printf("  %-26s %9s %9s %9s %9s %8s\n", "", "max", "p99", "p50", "of time", "readings");
+  print("pulseIn, 200 ms", before);
+  print("interrupt, 200 ms", afterOld);
+  char name[32];
+  snprintf(name, sizeof(name), "interrupt, %lu ms", ULTRASONIC_INTERVAL);
+  print(name, after);
+
+  CHECK(before.decodeErrors == 0 && after.decodeErrors == 0);
+  CHECK(*std::max_element(after.stalls.begin(), after.stalls.end()) <= TRIGGER_US + 2 * ISR_US);
+  return checkResult("test_echo_timing");
+}
@@ -0,0 +1,309 @@
+/**
+ * @file test_frame_fanout.cpp
+ * @brief Fast and slow simulated viewers on the camera frame fan-out in frame_fanout.h.
+ * @details A capture thread stands in for the camera side. Every FRAME_INTERVAL_MS it takes
+ * one of FB_COUNT synthetic JPEG buffers. One thread per viewer stands in for that viewer's
+ * socket; sending a frame sleeps for frame bytes / the viewer's bandwidth. The same three
+ * viewers (two fast, one slow) are served in two ways:
+ *
+ * - broadcast: what sendCameraFrames() did before the per-viewer senders. The capture
+ *   thread writes the frame to each viewer in turn and returns the buffer after the last.
+ * - fan-out: captureFrame(), publishFrame() and viewerTask() from the sketch, re-created
+ *   around the frame_fanout.h calls. The capture thread posts each frame to every mailbox,
+ *   and each viewer thread sends the newest frame in its own mailbox.
+ *
+ * Each run reports the FPS every viewer received and the capture stall: the time from
+ * taking a buffer until the capture thread is free again. The fan-out must keep the fast
+ * viewers at the capture rate while the slow one skips frames, must never check out more
+ * than FB_COUNT buffers, must never reuse a buffer a viewer is still sending, and must
+ * return every buffer. The Makefile also builds this test with -fsanitize=thread.
+ */
+#include "frame_fanout.h"
+#include "check.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static const int FB_COUNT = 2;              ///< fb_count with PSRAM (initCamera()).
+static const unsigned long FRAME_INTERVAL_MS = 50;
+static const size_t FRAME_BYTES = 24000;    ///< A VGA JPEG at quality 10.
+static const unsigned long RUN_MS = 2000;
+
+static unsigned long micros() {
+  static const auto start = std::chrono::steady_clock::now();
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start).count();
+}
+
+static void sleepMicros(unsigned long us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+// --- Synthetic camera ----------------------------------------------------------------
+static camera_fb_t buffers[FB_COUNT];
+static uint8_t bufferData[FB_COUNT][FRAME_BYTES];
+static std::atomic<bool> bufferOut[FB_COUNT];
+static std::atomic<int> buffersOut(0);
+static std::atomic<int> buffersOutMax(0);
+static std::atomic<uint32_t> gets(0);
+static std::atomic<uint32_t> returns(0);
+
+/// Takes a free buffer and stamps the frame number into its first bytes, or NULL if all are out.
+static camera_fb_t *cameraGet(uint32_t frameNumber) {
+  for (int i = 0; i < FB_COUNT; i++) {
+    bool expected = false;
+    if (bufferOut[i].compare_exchange_strong(expected, true)) {
+      memcpy(bufferData[i], &frameNumber, sizeof(frameNumber));
+      buffers[i].buf = bufferData[i];
+      buffers[i].len = FRAME_BYTES;
+      int out = buffersOut.fetch_add(1) + 1;
+      int previous = buffersOutMax.load();
+      while (out > previous && !buffersOutMax.compare_exchange_weak(previous, out)) {
+      }
+      gets++;
+      return &buffers[i];
+    }
+  }
+  return NULL;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb) {
+  int i = (int)(fb - buffers);
+  CHECK(i >= 0 && i < FB_COUNT && bufferOut[i].load());
+  buffersOut--;
+  returns++;
+  bufferOut[i].store(false);
+}
+
+static uint32_t frameNumberOf(const camera_fb_t *fb) {
+  uint32_t number;
+  memcpy(&number, fb->buf, sizeof(number));
+  return number;
+}
+
+// --- Simulated viewers ---------------------------------------------------------------
+struct SimulatedViewer {
+  const char *name;
+  unsigned long bytesPerSecond;
+  FrameMailbox mailbox;
+  std::mutex wakeMutex;
+  std::condition_variable wake;
+  bool notified = false;
+  std::atomic<uint32_t> framesSent{0};
+  std::atomic<uint32_t> framesSkipped{0};
+  std::atomic<uint32_t> corrupted{0}; ///< Frames whose buffer was refilled while being sent.
+
+  SimulatedViewer(const char *name, unsigned long bytesPerSecond) : name(name), bytesPerSecond(bytesPerSecond) {}
+
+  /// Writing `length` bytes to this viewer's socket.
+  void send(size_t length) { sleepMicros((unsigned long)(length * 1000000ULL / bytesPerSecond)); }
+
+  /// xTaskNotifyGive()
+  void notify() {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    notified = true;
+    wake.notify_one();
+  }
+
+  /// ulTaskNotifyTake(pdTRUE, 10 ms)
+  void waitForNotify() {
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    wake.wait_for(lock, std::chrono::milliseconds(10), [this] { return notified; });
+    notified = false;
+  }
+};
+
+struct RunResult {
+  uint32_t ticks = 0;        ///< Capture intervals that produced a frame.
+  uint32_t ticksSkipped = 0; ///< Capture intervals skipped because every buffer was held.
+  std::vector<unsigned long> stalls;
+};
+
+static unsigned long percentile(std::vector<unsigned long> values, int p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, values.size() * p / 100)];
+}
+
+/// Calls `tick` every FRAME_INTERVAL_MS for RUN_MS, like the old loop(): no burst after a stall.
+template <typename Tick>
+static void captureLoop(Tick tick) {
+  unsigned long end = micros() + RUN_MS * 1000;
+  unsigned long next = micros();
+  while (micros() < end) {
+    unsigned long now = micros();
+    if (now < next) {
+      sleepMicros(next - now);
+      continue;
+    }
+    next = now - next < FRAME_INTERVAL_MS * 1000 ? next + FRAME_INTERVAL_MS * 1000 : now;
+    tick();
+  }
+}
+
+/// The pre-fan-out broadcast: every viewer is written from the capture thread.
+static RunResult runBroadcast(std::vector<SimulatedViewer *> &viewers) {
+  RunResult result;
+  uint32_t frameNumber = 0;
+  captureLoop([&] {
+    unsigned long start = micros();
+    camera_fb_t *fb = cameraGet(frameNumber++);
+    for (SimulatedViewer *viewer : viewers) {
+      viewer->send(fb->len);
+      viewer->framesSent++;
+    }
+    esp_camera_fb_return(fb);
+    result.ticks++;
+    result.stalls.push_back(micros() - start);
+  });
+  return result;
+}
+
+static FramePool pool;
+
+/// viewerTask(): send the newest pending frame until none is left, then sleep.
+static void viewerThread(SimulatedViewer &viewer, const std::atomic<bool> &running) {
+  while (running.load()) {
+    viewer.waitForNotify();
+    for (;;) {
+      SharedFrame *frame = takeFrame(viewer.mailbox);
+      if (frame == NULL) {
+        break;
+      }
+      bool intact = frameNumberOf(frame->fb) == frame->sequence;
+      viewer.send(frame->fb->len);
+      if (!intact || frameNumberOf(frame->fb) != frame->sequence) {
+        viewer.corrupted++;
+      }
+      viewer.framesSent++;
+      releaseFrame(pool, frame);
+    }
+  }
+}
+
+/// captureFrame() + publishFrame() with per-viewer sender threads.
+static RunResult runFanout(std::vector<SimulatedViewer *> &viewers) {
+  RunResult result;
+  std::atomic<bool> running(true);
+  std::vector<std::thread> senders;
+  for (SimulatedViewer *viewer : viewers) {
+    senders.emplace_back(viewerThread, std::ref(*viewer), std::cref(running));
+  }
+
+  pool.fbCount = FB_COUNT;
+  uint32_t frameNumber = 0;
+  captureLoop([&] {
+    unsigned long start = micros();
+    if (framePoolExhausted(pool)) {
+      for (SimulatedViewer *viewer : viewers) {
+        if (reclaimFrame(pool, viewer->mailbox)) {
+          viewer->framesSkipped++;
+        }
+      }
+      if (framePoolExhausted(pool)) {
+        result.ticksSkipped++;
+        return;
+      }
+    }
+    SharedFrame *frame = freeFrameSlot(pool);
+    if (frame == NULL) {
+      result.ticksSkipped++;
+      return;
+    }
+    camera_fb_t *fb = cameraGet(frameNumber);
+    CHECK(fb != NULL); // framePoolExhausted() said a driver buffer is free
+    if (fb == NULL) {
+      return;
+    }
+    frame->sequence = frameNumber++;
+    holdFrame(pool, frame, fb);
+
+    for (SimulatedViewer *viewer : viewers) {
+      if (postFrame(pool, viewer->mailbox, frame)) {
+        viewer->framesSkipped++;
+      }
+      viewer->notify();
+    }
+    releaseFrame(pool, frame);
+    result.ticks++;
+    result.stalls.push_back(micros() - start);
+  });
+
+  running = false;
+  for (std::thread &sender : senders) {
+    sender.join();
+  }
+  for (SimulatedViewer *viewer : viewers) {
+    clearMailbox(pool, viewer->mailbox); // handleClientClose()
+  }
+  return result;
+}
+
+static double fps(uint32_t frames) { return frames * 1000.0 / RUN_MS; }
+
+static void report(const char *name, const RunResult &result, const std::vector<SimulatedViewer *> &viewers) {
+  printf("  %-9s capture %5.1f FPS (%u ticks skipped)  stall p50 %7.2f ms  max %7.2f ms\n", name,
+         fps(result.ticks), result.ticksSkipped, percentile(result.stalls, 50) / 1000.0,
+         percentile(result.stalls, 100) / 1000.0);
+  for (SimulatedViewer *viewer : viewers) {
+    printf("            %-6s %5lu KB/s  %5.1f FPS  %4u skipped\n", viewer->name, viewer->bytesPerSecond / 1000,
+           fps(viewer->framesSent.load()), viewer->framesSkipped.load());
+  }
+}
+
+static void checkSingleThreaded() {
+  FramePool single;
+  single.fbCount = FB_COUNT;
+  FrameMailbox mailbox;
+  SharedFrame *a = freeFrameSlot(single);
+  holdFrame(single, a, cameraGet(1));
+  SharedFrame *b = freeFrameSlot(single);
+  CHECK(b != NULL && b != a);
+  holdFrame(single, b, cameraGet(2));
+  CHECK(framePoolExhausted(single) && freeFrameSlot(single) == NULL);
+
+  CHECK(!postFrame(single, mailbox, a));
+  releaseFrame(single, a);                         // Only the mailbox holds a now
+  CHECK(postFrame(single, mailbox, b));            // b replaces a, which goes back
+  CHECK(returns == 1 && !framePoolExhausted(single));
+  CHECK(!reclaimFrame(single, mailbox));           // Not sending: nothing to reclaim
+  CHECK(takeFrame(mailbox) == b && mailbox.sending.load());
+  CHECK(takeFrame(mailbox) == NULL && !mailbox.sending.load());
+  releaseFrame(single, b);                         // Sender done
+  releaseFrame(single, b);                         // Caller's own reference
+  CHECK(returns == 2 && single.outstanding == 0 && freeFrameSlot(single) == &single.frames[0]);
+  gets = 0;
+  returns = 0;
+  buffersOutMax = 0;
+}
+
+int main() {
+  checkSingleThreaded();
+
+  printf("  %u byte frames every %lu ms, %d driver buffers, %lu ms per run\n", (unsigned)FRAME_BYTES,
+         FRAME_INTERVAL_MS, FB_COUNT, RUN_MS);
+  SimulatedViewer fastA("fast", 2400000), fastB("fast", 2400000), slow("slow", 120000);
+  std::vector<SimulatedViewer *> viewers = { &fastA, &fastB, &slow };
+  RunResult broadcast = runBroadcast(viewers);
+  report("broadcast", broadcast, viewers);
+
+  SimulatedViewer fanA("fast", 2400000), fanB("fast", 2400000), fanSlow("slow", 120000);
+  std::vector<SimulatedViewer *> fanViewers = { &fanA, &fanB, &fanSlow };
+  RunResult fanout = runFanout(fanViewers);
+  report("fan-out", fanout, fanViewers);
+
+  double expected = 1000.0 / FRAME_INTERVAL_MS;
+  CHECK(fps(fanout.ticks) >= 0.9 * expected && fanout.ticks > 2 * broadcast.ticks);
+  CHECK(fanA.framesSent >= 0.9 * fanout.ticks && fanB.framesSent >= 0.9 * fanout.ticks);
+  CHECK(fanSlow.framesSent < fanout.ticks / 2 && fanSlow.framesSkipped > 0);
+  CHECK(percentile(fanout.stalls, 100) < 10000);
+  CHECK(fanA.corrupted == 0 && fanB.corrupted == 0 && fanSlow.corrupted == 0);
+  CHECK(buffersOutMax <= FB_COUNT && gets == returns && pool.outstanding == 0);
+  return checkResult("test_frame_fanout");
+}
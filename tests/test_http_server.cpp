@@ -0,0 +1,408 @@
+/**
+ * @file test_http_server.cpp
+ * @brief Load test of the non-blocking HTTP server in http_server.h over real sockets.
+ * @details The server runs against the socket-backed WiFiServer stand-in (tests/host) on a
+ * loopback port. One thread plays loop(): every iteration calls serviceHttpServer() and
+ * then sleeps 500 us to stand in for the rest of loop(). Client threads make real HTTP
+ * requests. The test reports request latency and how long each serviceHttpServer() call
+ * held the loop. It also reports the loop period jitter, which is how late each
+ * iteration started.
+ *
+ * Phases:
+ * - page: one client loads the page 10 times in each of four ways. It reports the wire
+ *   bytes per load and the longest loop() stall. The four ways are:
+ *   - the original handler: a blocking println() of the plain page, then delay(5)
+ *     and stop(), all inside loop(); it is re-created here in serveLikeOriginal();
+ *   - the state machine without gzip (identity);
+ *   - the state machine with gzip;
+ *   - a gzip revalidation with a matching If-None-Match (304).
+ * - clean: 3 clients each load the page 20 times.
+ * - attack: two readers request the page and then stop reading; the 5744 byte send
+ *   buffer fills and stays full. A third client dribbles its request headers one byte
+ *   every 300 ms. Meanwhile one client loads the page 20 times. The loop must keep its
+ *   timing. The dribbler must be dropped after HTTP_REQUEST_TIMEOUT, and the stalled
+ *   readers after HTTP_WRITE_TIMEOUT, before their responses complete.
+ * - limits: HTTP_MAX_CONNECTIONS idle connections fill the table, and the next client
+ *   must get a 503. An oversized request must get a 431.
+ *
+ * The page is Website/index_v2.0.0.h, gzipped by build_index_gz.py into build/index_gz.h.
+ */
+#include <Arduino.h>
+#include <WiFi.h>
+#include "../Website/index_v2.0.0.h"
+#include "index_gz.h"
+#include "http_server.h"
+#include "check.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <signal.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const HttpPage page = { HTML_CONTENT_GZ, HTML_CONTENT_GZ_LENGTH, HTML_CONTENT_GZ_ETAG, HTML_CONTENT };
+static uint16_t serverPort = 0;
+
+// --- The loop() thread --------------------------------------------------------------
+struct LoopStats {
+  std::vector<unsigned long> serviceMicros; ///< Duration of each serviceHttpServer() call.
+  std::vector<unsigned long> lateMicros;    ///< How late each iteration started vs. the previous one + nominal.
+};
+
+static const unsigned long LOOP_REST_MICROS = 500; ///< Stand-in for the rest of loop().
+
+static std::atomic<bool> loopRunning(true);
+static std::atomic<bool> originalHandler(false); ///< Serve with serveLikeOriginal() instead of serviceHttpServer().
+static std::mutex statsMutex;
+static LoopStats loopStats;
+
+/**
+ * The HTTP branch of loop() before the state machine: wait for the request, println()
+ * the whole plain page with the blocking write, delay(5), stop(). (The original read
+ * the request with readStringUntil(), which also waits for it, up to 1 s.)
+ */
+static void serveLikeOriginal(WiFiServer &server) {
+  WiFiClient client = server.available();
+  if (!client) {
+    return;
+  }
+  char request[HTTP_REQUEST_BUFFER + 1];
+  size_t length = 0;
+  request[0] = '\0';
+  while (client.connected() && strstr(request, "\r\n\r\n") == NULL && length < HTTP_REQUEST_BUFFER) {
+    int received = client.read((uint8_t *)request + length, HTTP_REQUEST_BUFFER - length);
+    if (received > 0) {
+      length += received;
+      request[length] = '\0';
+    }
+  }
+  client.print("HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n");
+  client.print(HTML_CONTENT);
+  client.print("\r\n");
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  client.stop();
+}
+
+static void serverLoop(WiFiServer &server, HttpConnection *connections) {
+  unsigned long previousStart = micros();
+  while (loopRunning.load()) {
+    unsigned long start = micros();
+    if (originalHandler.load()) {
+      serveLikeOriginal(server);
+    } else {
+      serviceHttpServer(server, connections, page, millis());
+    }
+    unsigned long serviced = micros();
+    {
+      std::lock_guard<std::mutex> lock(statsMutex);
+      loopStats.serviceMicros.push_back(serviced - start);
+      unsigned long period = start - previousStart;
+      loopStats.lateMicros.push_back(period > LOOP_REST_MICROS ? period - LOOP_REST_MICROS : 0);
+    }
+    previousStart = start;
+    std::this_thread::sleep_for(std::chrono::microseconds(LOOP_REST_MICROS));
+  }
+}
+
+static LoopStats takeLoopStats() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  LoopStats stats = loopStats;
+  loopStats = LoopStats();
+  return stats;
+}
+
+// --- Clients ---------------------------------------------------------------------------
+static int connectToServer(int receiveBuffer = 0) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (receiveBuffer > 0) {
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+  }
+  timeval timeout = { 10, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(serverPort);
+  if (connect(fd, (sockaddr *)&address, sizeof(address)) != 0) {
+    perror("connect");
+    exit(2);
+  }
+  return fd;
+}
+
+static void sendAll(int fd, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return;
+    }
+    sent += n;
+  }
+}
+
+struct Response {
+  int status = 0;
+  bool hasLength = false;
+  size_t contentLength = 0;
+  size_t bodyBytes = 0;
+  size_t wireBytes = 0; ///< Headers + body as received.
+  bool gzip = false;
+};
+
+/// Reads one response: the status line, the headers and a Content-Length body (or up to EOF).
+static Response readResponse(int fd) {
+  Response response;
+  std::string received;
+  char buffer[4096];
+  size_t headerEnd = std::string::npos;
+  for (;;) {
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n <= 0) {
+      break;
+    }
+    received.append(buffer, n);
+    if (headerEnd == std::string::npos && (headerEnd = received.find("\r\n\r\n")) != std::string::npos) {
+      sscanf(received.c_str(), "HTTP/1.1 %d", &response.status);
+      size_t length = received.find("Content-Length: ");
+      if (length != std::string::npos && length < headerEnd) {
+        response.contentLength = strtoul(received.c_str() + length + 16, NULL, 10);
+        response.hasLength = true;
+      }
+      response.gzip = received.find("Content-Encoding: gzip") < headerEnd;
+    }
+    if (headerEnd != std::string::npos && response.hasLength &&
+        received.size() - (headerEnd + 4) >= response.contentLength) {
+      break;
+    }
+  }
+  response.wireBytes = received.size();
+  if (headerEnd != std::string::npos) {
+    response.bodyBytes = received.size() - (headerEnd + 4);
+  }
+  return response;
+}
+
+static std::string getRequest(bool gzip, const char *etag) {
+  std::string request = "GET / HTTP/1.1\r\nHost: car\r\nConnection: close\r\n";
+  if (gzip) {
+    request += "Accept-Encoding: gzip, deflate\r\n";
+  }
+  if (etag) {
+    request += std::string("If-None-Match: ") + etag + "\r\n";
+  }
+  return request + "\r\n";
+}
+
+struct PageLoads {
+  std::vector<unsigned long> latencies; ///< Per request (us).
+  size_t wireBytes = 0;                 ///< Response bytes received, headers included.
+};
+
+/**
+ * @brief Loads the page `count` times and checks each response.
+ * @param gzip Send Accept-Encoding: gzip (the response must then be gzipped).
+ * @param etag If-None-Match value, or NULL.
+ * @param status Expected status; `bodyLength` is the expected body size.
+ */
+static PageLoads loadPage(int count, bool gzip, const char *etag, int status, size_t bodyLength,
+                          std::atomic<int> &failures) {
+  PageLoads loads;
+  for (int i = 0; i < count; i++) {
+    unsigned long start = micros();
+    int fd = connectToServer();
+    sendAll(fd, getRequest(gzip, etag));
+    Response response = readResponse(fd);
+    close(fd);
+    loads.latencies.push_back(micros() - start);
+    loads.wireBytes += response.wireBytes;
+    if (response.status != status || response.bodyBytes != bodyLength || (status == 200 && response.gzip != gzip)) {
+      failures++;
+    }
+  }
+  return loads;
+}
+
+static PageLoads loadGzipPage(int count, std::atomic<int> &failures) {
+  return loadPage(count, true, NULL, 200, HTML_CONTENT_GZ_LENGTH, failures);
+}
+
+// --- Reporting ------------------------------------------------------------------------
+static unsigned long percentile(std::vector<unsigned long> values, int percent) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, values.size() * percent / 100)];
+}
+
+static void report(const char *phase, const std::vector<unsigned long> &latencies, const LoopStats &stats) {
+  printf("  %-7s %3zu requests  latency p50 %6.1f ms  p95 %6.1f ms  max %6.1f ms\n", phase, latencies.size(),
+         percentile(latencies, 50) / 1000.0, percentile(latencies, 95) / 1000.0, percentile(latencies, 100) / 1000.0);
+  printf("  %-7s %6zu loops     service p50 %4lu us  p99 %5lu us  max %6lu us   late start p99 %5lu us  max %6lu us\n",
+         "", stats.serviceMicros.size(), percentile(stats.serviceMicros, 50), percentile(stats.serviceMicros, 99),
+         percentile(stats.serviceMicros, 100), percentile(stats.lateMicros, 99), percentile(stats.lateMicros, 100));
+}
+
+static void reportPageLoads(const char *name, const PageLoads &loads, const LoopStats &stats) {
+  printf("  %-10s %7zu bytes/load  latency p50 %6.1f ms  max %6.1f ms   loop stall max %7.1f ms\n", name,
+         loads.wireBytes / loads.latencies.size(), percentile(loads.latencies, 50) / 1000.0,
+         percentile(loads.latencies, 100) / 1000.0, percentile(stats.serviceMicros, 100) / 1000.0);
+}
+
+/// True once the server has closed `fd` (EOF or reset), waiting up to `timeoutMs`.
+static bool closedByServer(int fd, unsigned long timeoutMs) {
+  unsigned long deadline = millis() + timeoutMs;
+  char buffer[4096];
+  while (millis() < deadline) {
+    ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(n > 0 ? 0 : 50));
+  }
+  return false;
+}
+
+/// Reads until the server closes the connection; returns the bytes received.
+static size_t drain(int fd) {
+  char buffer[4096];
+  size_t total = 0;
+  ssize_t n;
+  while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    total += n;
+  }
+  return total;
+}
+
+int main() {
+  signal(SIGPIPE, SIG_IGN);
+  WiFiServer server(0);
+  server.begin();
+  serverPort = server.port();
+  static HttpConnection connections[HTTP_CONNECTION_SLOTS];
+  std::thread loopThread(serverLoop, std::ref(server), connections);
+  std::atomic<int> failures(0);
+
+  // --- page ---
+  size_t plainLength = strlen(HTML_CONTENT);
+  printf("  page: %zu bytes plain, %zu gzipped\n", plainLength, (size_t)HTML_CONTENT_GZ_LENGTH);
+  originalHandler = true;
+  takeLoopStats();
+  PageLoads original = loadPage(10, false, NULL, 200, plainLength + 2, failures);
+  LoopStats originalStats = takeLoopStats();
+  originalHandler = false;
+  std::this_thread::sleep_for(std::chrono::milliseconds(5)); // Let the loop switch over
+  takeLoopStats();
+  PageLoads identity = loadPage(10, false, NULL, 200, plainLength, failures);
+  LoopStats identityStats = takeLoopStats();
+  PageLoads gzipped = loadPage(10, true, NULL, 200, HTML_CONTENT_GZ_LENGTH, failures);
+  LoopStats gzipStats = takeLoopStats();
+  PageLoads revalidated = loadPage(10, true, HTML_CONTENT_GZ_ETAG, 304, 0, failures);
+  LoopStats revalidatedStats = takeLoopStats();
+  reportPageLoads("original", original, originalStats);
+  reportPageLoads("identity", identity, identityStats);
+  reportPageLoads("gzip", gzipped, gzipStats);
+  reportPageLoads("304", revalidated, revalidatedStats);
+  CHECK(failures == 0);
+  CHECK(gzipped.wireBytes * 3 < identity.wireBytes);
+  CHECK(revalidated.wireBytes / 10 < 256);
+  CHECK(percentile(gzipStats.serviceMicros, 100) < percentile(originalStats.serviceMicros, 100));
+
+  // --- clean ---
+  std::vector<unsigned long> latencies;
+  std::mutex latencyMutex;
+  std::vector<std::thread> loaders;
+  for (int i = 0; i < 3; i++) {
+    loaders.emplace_back([&] {
+      PageLoads own = loadGzipPage(20, failures);
+      std::lock_guard<std::mutex> lock(latencyMutex);
+      latencies.insert(latencies.end(), own.latencies.begin(), own.latencies.end());
+    });
+  }
+  for (std::thread &loader : loaders) {
+    loader.join();
+  }
+  LoopStats clean = takeLoopStats();
+  report("clean", latencies, clean);
+  CHECK(failures == 0);
+
+  // --- attack ---
+  unsigned long attackStart = millis();
+  int stalled[2];
+  for (int &fd : stalled) {
+    fd = connectToServer(2048);
+    sendAll(fd, getRequest(false, NULL)); // The plain page: ~100 KB that is never read
+  }
+  int dribbler = connectToServer();
+  std::atomic<bool> dribbling(true);
+  std::thread dribble([&] {
+    const char *request = "GET / HTTP/1.1\r\nHost: car\r\nX-Slow: ";
+    for (size_t i = 0; dribbling.load(); i++) {
+      char byte = i < strlen(request) ? request[i] : 'a';
+      if (send(dribbler, &byte, 1, MSG_NOSIGNAL) <= 0) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200)); // Let the stalled readers fill their buffers
+  takeLoopStats();
+  latencies = loadGzipPage(20, failures).latencies;
+  LoopStats attack = takeLoopStats();
+  report("attack", latencies, attack);
+  CHECK(failures == 0);
+  CHECK(percentile(attack.serviceMicros, 100) < 50000);
+
+  CHECK(closedByServer(dribbler, HTTP_REQUEST_TIMEOUT + 1000));
+  unsigned long dribblerDropped = millis() - attackStart;
+  dribbling = false;
+  dribble.join();
+  // Only read the stalled connections once the server must have given up on them: a
+  // dropped response ends early, a finished one would deliver the whole page
+  long wait = (long)(attackStart + HTTP_WRITE_TIMEOUT + 1000) - (long)millis();
+  if (wait > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(wait));
+  }
+  size_t stalledBytes[2];
+  for (int i = 0; i < 2; i++) {
+    stalledBytes[i] = drain(stalled[i]);
+    CHECK(stalledBytes[i] < strlen(HTML_CONTENT));
+  }
+  printf("  attack  dribbler dropped after %lu ms; stalled readers dropped after %zu and %zu of %zu bytes\n",
+         dribblerDropped, stalledBytes[0], stalledBytes[1], strlen(HTML_CONTENT));
+  close(dribbler);
+  close(stalled[0]);
+  close(stalled[1]);
+  LoopStats drop = takeLoopStats();
+  printf("  attack  loop until the drops: service max %lu us, late start max %lu us\n",
+         percentile(drop.serviceMicros, 100), percentile(drop.lateMicros, 100));
+  CHECK(percentile(drop.serviceMicros, 100) < 50000);
+
+  // --- limits ---
+  std::vector<int> idle;
+  for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+    idle.push_back(connectToServer());
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50)); // Accepted into the serving slots
+  int refused = connectToServer();
+  Response busy = readResponse(refused);
+  close(refused);
+  for (int fd : idle) {
+    close(fd);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  int oversized = connectToServer();
+  sendAll(oversized, "GET / HTTP/1.1\r\nX-Filler: " + std::string(HTTP_REQUEST_BUFFER, 'x'));
+  Response tooLarge = readResponse(oversized);
+  close(oversized);
+  printf("  limits  table full -> %d, oversized request -> %d\n", busy.status, tooLarge.status);
+  CHECK(busy.status == 503);
+  CHECK(tooLarge.status == 431);
+
+  loopRunning = false;
+  loopThread.join();
+  return checkResult("test_http_server");
+}
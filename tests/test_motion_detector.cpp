@@ -0,0 +1,265 @@
+/**
+ * @file test_motion_detector.cpp
+ * @brief Checks the camera's motion-aware capture decision in motion_detector.h, and
+ * replays recordings through it.
+ * @details Without arguments:
+ * - grid: the RGB565 to luma grid reduction at the 1/8 scale thumbnail sizes of the
+ *   framesizes the camera uses (cells stay covered when the size does not divide).
+ * - decisions: first frame, framesize change, MOTION_MIN_CELLS, the region of interest
+ *   (down to a region smaller than a cell) and the refresh frame.
+ * - scene: a synthetic 60 s scene at 20 FPS (a still view with sensor noise, an object
+ *   crossing the region of interest, then movement outside it) through the same capture
+ *   loop the replay uses. Reported: bytes sent against streaming every frame, split into
+ *   the near-duplicates suppressed and the frames never captured at the idle rate, and
+ *   the longest time the viewer's picture was out of date.
+ *
+ * Replay: motion_evaluator.py decodes a recording to thumbnails and runs
+ *   build/test_motion_detector trace.txt fps [x,y,w,h]
+ * The trace has one frame per line: "jpeg_bytes frame_width thumb_width thumb_height hex",
+ * hex being the thumbnail in RGB565, high byte first. The capture loop runs on a virtual
+ * clock: a frame is grabbed every 1000 / fps ms, or every MOTION_IDLE_INTERVAL_MS once
+ * nothing has changed for MOTION_IDLE_TIMEOUT, and always shows the recording's frame of
+ * that moment. Drive hints and wake-ups from the dashboard are not part of a recording.
+ */
+#include "motion_detector.h"
+#include "check.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const MotionRegion FULL_FRAME = { 0, 0, 100, 100 };
+
+struct Frame {
+  size_t bytes;
+  uint16_t width;
+  uint8_t grid[MOTION_GRID_CELLS];
+};
+
+/// A thumbnail filled by `shade(x, y)` (RGB565), reduced to a grid.
+template <typename Shade>
+static void gridOf(size_t width, size_t height, Shade shade, uint8_t *grid) {
+  std::vector<uint8_t> pixels(width * height * 2);
+  for (size_t y = 0; y < height; y++) {
+    for (size_t x = 0; x < width; x++) {
+      uint16_t value = shade(x, y);
+      pixels[2 * (y * width + x)] = value >> 8;
+      pixels[2 * (y * width + x) + 1] = value & 0xFF;
+    }
+  }
+  motionGridFromRgb565(pixels.data(), width, height, grid);
+}
+
+/// RGB565 of a grey level.
+static uint16_t grey(int level) {
+  return ((level & 0xF8) << 8) | ((level & 0xFC) << 3) | (level >> 3);
+}
+
+static void checkGrid() {
+  static const size_t SIZES[][2] = { { 80, 60 }, { 40, 30 }, { 50, 37 }, { 20, 15 }, { 16, 12 } }; // VGA..QQVGA / 8
+  for (const auto &size : SIZES) {
+    uint8_t grid[MOTION_GRID_CELLS];
+    gridOf(size[0], size[1], [](size_t, size_t) { return grey(200); }, grid);
+    bool flat = true;
+    for (uint8_t cell : grid) {
+      flat &= cell >= 197 && cell <= 200; // RGB565 and the integer weights lose a little
+    }
+    CHECK(flat);
+    // Left half black, right half white: the middle columns split cleanly
+    gridOf(size[0], size[1], [&](size_t x, size_t) { return x < size[0] / 2 ? grey(0) : grey(255); }, grid);
+    CHECK(grid[0] == 0 && grid[MOTION_GRID_W - 1] >= 250);
+  }
+}
+
+static void checkDecisions() {
+  uint8_t still[MOTION_GRID_CELLS], moved[MOTION_GRID_CELLS];
+  memset(still, 100, sizeof(still));
+  MotionState state;
+  CHECK(motionCheckFrame(state, still, 640, FULL_FRAME, 0) == MOTION_CHANGED); // First frame
+  CHECK(motionCheckFrame(state, still, 640, FULL_FRAME, 50) == MOTION_DUPLICATE);
+  CHECK(motionCheckFrame(state, still, 320, FULL_FRAME, 100) == MOTION_CHANGED); // Framesize change
+
+  memcpy(moved, still, sizeof(moved));
+  moved[0] = 100 + MOTION_THRESHOLD; // One cell: noise
+  CHECK(motionCheckFrame(state, moved, 320, FULL_FRAME, 150) == MOTION_DUPLICATE);
+  moved[1] = 100 - MOTION_THRESHOLD + 1; // Below the threshold
+  CHECK(motionCheckFrame(state, moved, 320, FULL_FRAME, 200) == MOTION_DUPLICATE);
+  moved[1] = 100 - MOTION_THRESHOLD;
+  CHECK(motionCheckFrame(state, moved, 320, { 50, 0, 50, 100 }, 250) == MOTION_DUPLICATE); // Left half only
+  CHECK(motionCheckFrame(state, moved, 320, { 0, 0, 20, 20 }, 300) == MOTION_CHANGED);
+  CHECK(memcmp(state.reference, moved, sizeof(moved)) == 0 && state.lastSentAt == 300);
+
+  // A region narrower than a cell still watches the cell it falls in
+  uint8_t corner[MOTION_GRID_CELLS];
+  memcpy(corner, moved, sizeof(corner));
+  corner[MOTION_GRID_CELLS - 1] += 2 * MOTION_THRESHOLD;
+  CHECK(motionChangedCells(corner, moved, { 99, 99, 1, 1 }) == 1);
+
+  // Unchanged frames are refreshed once MOTION_REFRESH_MS has passed since the last one sent
+  CHECK(motionCheckFrame(state, moved, 320, FULL_FRAME, 300 + MOTION_REFRESH_MS - 1) == MOTION_DUPLICATE);
+  CHECK(motionCheckFrame(state, moved, 320, FULL_FRAME, 300 + MOTION_REFRESH_MS) == MOTION_REFRESH);
+  CHECK(motionCheckFrame(state, moved, 320, FULL_FRAME, 400 + MOTION_REFRESH_MS) == MOTION_DUPLICATE);
+
+  CHECK(motionCaptureInterval(50, MOTION_IDLE_TIMEOUT) == 50);
+  CHECK(motionCaptureInterval(50, MOTION_IDLE_TIMEOUT + 1) == MOTION_IDLE_INTERVAL_MS);
+  CHECK(motionCaptureInterval(500, MOTION_IDLE_TIMEOUT + 1) == 500); // A slower cap or pacing stays
+}
+
+struct Replay {
+  int captured = 0, sent = 0, suppressed = 0;
+  size_t bytesAll = 0, bytesSent = 0, bytesSuppressed = 0;
+  unsigned long staleMax = 0; ///< Longest time the picture shown differed from the scene (ms).
+};
+
+/**
+ * @brief The capture loop in motion-aware mode over a recording played at `fps`.
+ * @details Every recording frame counts towards streaming everything; the picture is out
+ * of date while the recording's current frame differs (MOTION_MIN_CELLS cells in the
+ * region) from the last frame sent.
+ */
+static Replay replay(const std::vector<Frame> &frames, double fps, const MotionRegion &roi) {
+  Replay result;
+  MotionState state;
+  const double framePeriod = 1000.0 / fps;
+  const unsigned long end = (unsigned long)(frames.size() * framePeriod);
+  unsigned long lastActivity = 0, nextCapture = 0;
+  const uint8_t *shown = NULL;
+  long staleSince = -1;
+  size_t lastIndex = (size_t)-1;
+
+  for (unsigned long now = 0; now < end; now++) {
+    size_t index = (size_t)(now / framePeriod);
+    const Frame &frame = frames[index];
+    if (index != lastIndex) {
+      result.bytesAll += frame.bytes;
+      lastIndex = index;
+    }
+    if (now >= nextCapture) {
+      result.captured++;
+      MotionVerdict verdict = motionCheckFrame(state, frame.grid, frame.width, roi, now);
+      if (verdict == MOTION_CHANGED) {
+        lastActivity = now;
+      }
+      if (verdict == MOTION_DUPLICATE) {
+        result.suppressed++;
+        result.bytesSuppressed += frame.bytes;
+      } else {
+        result.sent++;
+        result.bytesSent += frame.bytes;
+        shown = frame.grid;
+      }
+      nextCapture = now + motionCaptureInterval((uint32_t)framePeriod, now - lastActivity);
+    }
+    bool stale = shown && motionChangedCells(frame.grid, shown, roi) >= MOTION_MIN_CELLS;
+    if (stale && staleSince < 0) {
+      staleSince = now;
+    } else if (!stale && staleSince >= 0) {
+      result.staleMax = std::max(result.staleMax, now - staleSince);
+      staleSince = -1;
+    }
+  }
+  return result;
+}
+
+static void printReplay(const Replay &r) {
+  size_t uncaptured = r.bytesAll - r.bytesSent - r.bytesSuppressed;
+  printf("    captured %d frames: %d sent, %d suppressed as near-duplicates\n", r.captured, r.sent, r.suppressed);
+  printf("    bytes    %zu of %zu sent, %.1f%% saved (%.1f%% suppressed, %.1f%% never captured at the idle rate)\n",
+         r.bytesSent, r.bytesAll, 100.0 * (r.bytesAll - r.bytesSent) / r.bytesAll,
+         100.0 * r.bytesSuppressed / r.bytesAll, 100.0 * uncaptured / r.bytesAll);
+  printf("    picture out of date for %lu ms at most\n", r.staleMax);
+}
+
+static uint32_t seed = 1;
+
+static uint32_t random32() {
+  seed = seed * 1103515245u + 12345u;
+  return seed >> 8;
+}
+
+/// 60 s at 20 FPS: still, an object crossing the left half (20-25 s), movement in the right half (40-45 s).
+static std::vector<Frame> scene() {
+  std::vector<Frame> frames;
+  for (int i = 0; i < 1200; i++) {
+    double t = i / 20.0;
+    int objectX = -100;
+    if (t >= 20 && t < 25) {
+      objectX = (int)((t - 20) / 5 * 40); // Left half of an 80 px wide thumbnail
+    } else if (t >= 40 && t < 45) {
+      objectX = 40 + (int)((t - 40) / 5 * 36);
+    }
+    Frame frame;
+    frame.bytes = 18000 + random32() % 4000;
+    frame.width = 640;
+    gridOf(80, 60, [&](size_t x, size_t y) {
+      int level = 90 + (int)(y / 2) + (int)(random32() % 7) - 3; // Sensor noise
+      if ((int)x >= objectX && (int)x < objectX + 8 && y >= 20 && y < 40) {
+        level = 230;
+      }
+      return grey(level);
+    }, frame.grid);
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+static void checkScene() {
+  std::vector<Frame> frames = scene();
+  printf("  scene      60 s at 20 FPS, whole frame watched\n");
+  Replay whole = replay(frames, 20, FULL_FRAME);
+  printReplay(whole);
+  printf("  scene      left half watched (movement at 40-45 s is outside it)\n");
+  Replay left = replay(frames, 20, { 0, 0, 50, 100 });
+  printReplay(left);
+
+  size_t uncaptured = whole.bytesAll - whole.bytesSent - whole.bytesSuppressed;
+  CHECK(whole.bytesSent < whole.bytesAll / 4);
+  CHECK(uncaptured > whole.bytesSuppressed); // The idle rate is the main saving
+  // Motion starting during the idle rate waits for the next capture at most
+  CHECK(whole.staleMax <= MOTION_IDLE_INTERVAL_MS);
+  CHECK(left.sent < whole.sent && left.staleMax <= MOTION_IDLE_INTERVAL_MS);
+}
+
+static bool loadTrace(const char *path, std::vector<Frame> &frames) {
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    Frame frame;
+    size_t width, height;
+    std::string hex;
+    if (!(fields >> frame.bytes >> frame.width >> width >> height >> hex) || hex.size() != width * height * 4) {
+      fprintf(stderr, "%s: bad line %zu\n", path, frames.size() + 1);
+      return false;
+    }
+    std::vector<uint8_t> pixels(width * height * 2);
+    for (size_t i = 0; i < pixels.size(); i++) {
+      pixels[i] = (uint8_t)strtoul(hex.substr(2 * i, 2).c_str(), NULL, 16);
+    }
+    motionGridFromRgb565(pixels.data(), width, height, frame.grid);
+    frames.push_back(frame);
+  }
+  return !frames.empty();
+}
+
+int main(int argc, char **argv) {
+  if (argc > 2) {
+    std::vector<Frame> frames;
+    double fps = atof(argv[2]);
+    unsigned x = 0, y = 0, w = 100, h = 100;
+    if (!loadTrace(argv[1], frames) || fps <= 0 ||
+        (argc > 3 && (sscanf(argv[3], "%u,%u,%u,%u", &x, &y, &w, &h) != 4 || w == 0 || h == 0 || x + w > 100 ||
+                      y + h > 100))) {
+      fprintf(stderr, "usage: %s trace.txt fps [x,y,w,h]\n", argv[0]);
+      return 2;
+    }
+    printf("  replay     %zu frames at %.1f FPS, region %u,%u %ux%u %%\n", frames.size(), fps, x, y, w, h);
+    printReplay(replay(frames, fps, { (uint8_t)x, (uint8_t)y, (uint8_t)w, (uint8_t)h }));
+    return 0;
+  }
+  checkGrid();
+  checkDecisions();
+  checkScene();
+  return checkResult("test_motion_detector");
+}
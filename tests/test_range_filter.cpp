@@ -0,0 +1,224 @@
+/**
+ * @file test_range_filter.cpp
+ * @brief Replays ultrasonic traces through the median + alpha-beta filter and the
+ * time-to-collision trigger from ranging.h.
+ * @details Every ULTRASONIC_INTERVAL a reading is taken from the trace, as the control
+ * task does. Each reading goes through rangeFilterUpdate() and rangeCollisionImminent(),
+ * the same calls handleObstacleAvoidance() makes. As a baseline, the raw reading is
+ * compared with STOP_DISTANCE, which is what the sketch did before the filter.
+ *
+ * The built-in traces are seeded and repeatable:
+ * - approach: driving at a wall at 100 cm/s with +-3 cm noise, 5% spikes and lost echoes.
+ *   The filter must trigger while the wall is still at least 50 cm away.
+ * - parked: a wall 150 cm ahead for a minute, with the same noise, plus single and
+ *   double 10 cm spikes. The filter must never trigger.
+ * - cut-in: open road at 300 cm, then something steps in at 20 cm and stays. The median
+ *   and the outlier gate delay the jump, but the filter must re-seed and trigger within
+ *   RANGE_MEDIAN_WINDOW readings.
+ *
+ * With a CSV of "time_ms,distance_cm" on the command line (-1 = no echo), only that trace
+ * is replayed, and every time the trigger changes state is printed.
+ *
+ * Usage: build/test_range_filter [trace.csv]
+ */
+#include "ranging.h"
+#include "check.h"
+
+#include <stdlib.h>
+#include <vector>
+
+struct Sample {
+  unsigned long timeMs;
+  int raw;  ///< Reading the sensor returned (cm), -1 for no echo.
+  int truth; ///< Real distance (cm), -1 if unknown.
+};
+
+struct ReplayResult {
+  long firstTrigger = -1;      ///< Time (ms) of the first filtered trigger, -1 if none.
+  int truthAtTrigger = -1;     ///< Real distance at the first filtered trigger.
+  long firstRawTrigger = -1;   ///< Time (ms) the raw reading first fell to STOP_DISTANCE.
+  int truthAtRawTrigger = -1;
+  int triggers = 0;            ///< Filtered idle -> imminent transitions.
+  int rawTriggers = 0;         ///< Raw idle -> below STOP_DISTANCE transitions.
+  int outliers = 0;            ///< Samples the outlier gate rejected.
+};
+
+static uint32_t seed;
+
+static int noise(int range) {
+  seed = seed * 1103515245u + 12345u;
+  return (int)((seed >> 16) % (2 * range + 1)) - range;
+}
+
+static unsigned chance() {
+  seed = seed * 1103515245u + 12345u;
+  return (seed >> 16) % 100;
+}
+
+/// Adds sensor noise, spikes and lost echoes to a true distance.
+static int sense(int truth) {
+  unsigned roll = chance();
+  if (roll < 3) {
+    return -1;                       // Lost echo
+  }
+  if (roll < 8) {
+    return 10 + (int)(chance() * 3); // Spike (multipath, a hand, the floor)
+  }
+  int raw = truth + noise(3);
+  return raw > 0 && raw < ULTRASONIC_MAX_DISTANCE ? raw : -1;
+}
+
+static std::vector<Sample> approachTrace() {
+  std::vector<Sample> trace;
+  seed = 1;
+  for (unsigned long t = 0; t <= 3000; t += ULTRASONIC_INTERVAL) {
+    int truth = 300 - (int)(t / 10); // 100 cm/s
+    if (truth <= 0) {
+      break;
+    }
+    trace.push_back({ t, sense(truth), truth });
+  }
+  return trace;
+}
+
+static std::vector<Sample> parkedTrace() {
+  std::vector<Sample> trace;
+  seed = 2;
+  for (unsigned long t = 0; t <= 60000; t += ULTRASONIC_INTERVAL) {
+    int raw = sense(150);
+    unsigned long phase = t % 5000;
+    if (phase == 2000 || phase == 3000 || phase == 3040) {
+      raw = 10;                      // Scheduled single and double spikes
+    }
+    trace.push_back({ t, raw, 150 });
+  }
+  return trace;
+}
+
+static std::vector<Sample> cutInTrace() {
+  std::vector<Sample> trace;
+  seed = 3;
+  for (unsigned long t = 0; t <= 3000; t += ULTRASONIC_INTERVAL) {
+    int truth = t < 1000 ? 300 : 20;
+    trace.push_back({ t, truth + noise(2), truth });
+  }
+  return trace;
+}
+
+static std::vector<Sample> loadTrace(const char *path) {
+  std::vector<Sample> trace;
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    exit(2);
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), file)) {
+    unsigned long timeMs;
+    int distance;
+    if (sscanf(line, "%lu,%d", &timeMs, &distance) == 2) {
+      trace.push_back({ timeMs, distance, -1 });
+    }
+  }
+  fclose(file);
+  return trace;
+}
+
+static ReplayResult replay(const std::vector<Sample> &trace, bool verbose) {
+  ReplayResult result;
+  RangeFilter filter = {};
+  RangeEstimate estimate = { 100, 0, -1 }; // lastDistance starts at a safe 100 cm
+  bool imminent = false;
+  bool rawImminent = false;
+
+  for (const Sample &sample : trace) {
+    if (sample.raw < 0) {
+      continue; // Timeout: the filter keeps its state
+    }
+    if (!rangeFilterUpdate(filter, sample.raw, sample.timeMs, estimate)) {
+      result.outliers++;
+    }
+    bool now = rangeCollisionImminent(estimate);
+    if (now && !imminent) {
+      result.triggers++;
+      if (result.firstTrigger < 0) {
+        result.firstTrigger = (long)sample.timeMs;
+        result.truthAtTrigger = sample.truth;
+      }
+    }
+    if (verbose && now != imminent) {
+      printf("  %8lu ms  raw %3d  filtered %3d cm  closing %4d cm/s  ttc %5ld ms  %s\n", sample.timeMs,
+             sample.raw, estimate.distance, estimate.closingSpeed, estimate.timeToCollision,
+             now ? "TRIGGER" : "clear");
+    }
+    imminent = now;
+
+    bool rawNow = sample.raw <= STOP_DISTANCE;
+    if (rawNow && !rawImminent) {
+      result.rawTriggers++;
+      if (result.firstRawTrigger < 0) {
+        result.firstRawTrigger = (long)sample.timeMs;
+        result.truthAtRawTrigger = sample.truth;
+      }
+    }
+    rawImminent = rawNow;
+  }
+  return result;
+}
+
+static void print(const char *name, const std::vector<Sample> &trace, const ReplayResult &result) {
+  printf("  %-9s %5zu readings  filtered: first trigger %5ld ms at %4d cm, %3d triggers, %3d outliers"
+         "  |  raw <= %d cm: first %5ld ms at %4d cm, %3d triggers\n",
+         name, trace.size(), result.firstTrigger, result.truthAtTrigger, result.triggers, result.outliers,
+         STOP_DISTANCE, result.firstRawTrigger, result.truthAtRawTrigger, result.rawTriggers);
+}
+
+static void checkFilterBasics() {
+  RangeFilter filter = {};
+  RangeEstimate estimate = { 0, 0, -1 };
+  filter.count = 3;
+  filter.window[0] = 50;
+  filter.window[1] = 10;
+  filter.window[2] = 30;
+  CHECK(rangeWindowMedian(filter) == 30);
+
+  filter = {};
+  CHECK(rangeFilterUpdate(filter, 200, 0, estimate) && estimate.distance == 200 && estimate.timeToCollision == -1);
+  for (unsigned long t = 40; t <= 400; t += 40) {
+    CHECK(rangeFilterUpdate(filter, 200, t, estimate));
+  }
+  CHECK(estimate.closingSpeed == 0 && !rangeCollisionImminent(estimate));
+
+  RangeEstimate close = { STOP_DISTANCE, 0, -1 };
+  CHECK(rangeCollisionImminent(close));
+  RangeEstimate closing = { 80, 100, 800 };
+  CHECK(rangeCollisionImminent(closing));
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    std::vector<Sample> trace = loadTrace(argv[1]);
+    ReplayResult result = replay(trace, true);
+    print("trace", trace, result);
+    return 0;
+  }
+
+  checkFilterBasics();
+
+  std::vector<Sample> approach = approachTrace();
+  ReplayResult approachResult = replay(approach, false);
+  print("approach", approach, approachResult);
+  CHECK(approachResult.firstTrigger >= 0 && approachResult.truthAtTrigger >= 50);
+
+  std::vector<Sample> parked = parkedTrace();
+  ReplayResult parkedResult = replay(parked, false);
+  print("parked", parked, parkedResult);
+  CHECK(parkedResult.triggers == 0);
+
+  std::vector<Sample> cutIn = cutInTrace();
+  ReplayResult cutInResult = replay(cutIn, false);
+  print("cut-in", cutIn, cutInResult);
+  CHECK(cutInResult.firstTrigger >= 1000 &&
+        cutInResult.firstTrigger <= 1000 + (long)(RANGE_MEDIAN_WINDOW * ULTRASONIC_INTERVAL));
+  return checkResult("test_range_filter");
+}
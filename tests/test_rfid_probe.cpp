@@ -0,0 +1,174 @@
+/**
+ * @file test_rfid_probe.cpp
+ * @brief Compares the RFID task's probe (rfid_probe.h) with the PICC_IsNewCardPresent()
+ * per loop pass it replaced, on the MFRC522 stand-in (tests/host/MFRC522.h).
+ * @details Both designs run the same 40 s timeline on the stand-in's virtual clock: a card
+ * held to the reader for 1 s at 12 s (past the fast window after boot), a wakeRfidTask()
+ * (a command rejected for missing authorization) at 30 s and a card held for 1 s at 32 s. Reported per design:
+ * SPI register accesses per second and the share of time the bus is busy, idle and in
+ * the fast window, the longest call that holds the reader, and how long each card took
+ * to be read. The figures follow from the stand-in's fixed cost per register access and
+ * its model of the library's code path; they are not measurements of the reader.
+ */
+#include "rfid_probe.h"
+#include "check.h"
+
+#include <vector>
+
+static const unsigned long SECOND_US = 1000000;
+static const unsigned long END_US = 40 * SECOND_US;
+static const unsigned long WAKE_US = 30 * SECOND_US;
+static const unsigned long LOOP_WORK_US = 1000; ///< The rest of an old loop() pass (WebSocket, sensors).
+
+struct Presentation {
+  unsigned long from, until; ///< When the card is in the field (us).
+};
+static const Presentation CARDS[] = { { 12 * SECOND_US, 13 * SECOND_US }, { 32 * SECOND_US, 33 * SECOND_US } };
+
+static bool cardInField(unsigned long us) {
+  for (const Presentation &card : CARDS) {
+    if (us >= card.from && us < card.until) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct Sample {
+  unsigned long at, accesses;
+};
+
+struct Run {
+  std::vector<Sample> samples;     ///< Access count after each pass.
+  std::vector<unsigned long> reads; ///< When each card read completed (us).
+  unsigned long longestCall = 0;   ///< Longest single call holding the reader (us).
+  unsigned long probes = 0;
+
+  void sample(const MFRC522 &reader) { samples.push_back({ reader.now, reader.accesses }); }
+
+  unsigned long accessesAt(unsigned long us) const {
+    unsigned long count = 0;
+    for (const Sample &s : samples) {
+      if (s.at > us) {
+        break;
+      }
+      count = s.accesses;
+    }
+    return count;
+  }
+
+  /// Register accesses per second between `from` and `until`.
+  double rate(unsigned long from, unsigned long until) const {
+    return (double)(accessesAt(until) - accessesAt(from)) * SECOND_US / (until - from);
+  }
+};
+
+static bool timed(MFRC522 &reader, Run &run, bool (*call)(MFRC522 &)) {
+  unsigned long start = reader.now;
+  bool result = call(reader);
+  run.longestCall = std::max(run.longestCall, reader.now - start);
+  return result;
+}
+
+/// The old checkRFID(), called once per loop() pass.
+static Run runLoopPolling() {
+  MFRC522 reader(5, 22);
+  reader.field = cardInField;
+  Run run;
+  while (reader.now < END_US) {
+    reader.sleep(LOOP_WORK_US);
+    run.probes++;
+    if (timed(reader, run, [](MFRC522 &r) { return r.PICC_IsNewCardPresent(); }) &&
+        timed(reader, run, [](MFRC522 &r) { return r.PICC_ReadCardSerial(); })) {
+      reader.PICC_HaltA();
+      reader.PCD_StopCrypto1();
+      run.reads.push_back(reader.now);
+    }
+    run.sample(reader);
+  }
+  return run;
+}
+
+/// rfidTask() from RC_Car_v2.0.0.ino, with vTaskDelay() and ulTaskNotifyTake() on the
+/// virtual clock.
+static Run runProbeTask() {
+  MFRC522 reader(5, 22);
+  reader.field = cardInField;
+  Run run;
+  unsigned long lastActivity = 0; // Boot counts as activity, as in the sketch
+  bool woken = false;
+  while (reader.now < END_US) {
+    timed(reader, run, [](MFRC522 &r) {
+      startCardProbe(r);
+      return true;
+    });
+    run.probes++;
+    reader.sleep(RFID_PROBE_WAIT_MS * 1000);
+    static RfidEvent event;
+    if (timed(reader, run, [](MFRC522 &r) { return finishCardProbe(r, event); })) {
+      CHECK(event.uidLength == 4 && memcmp(event.uid, reader.cardUid.uidByte, 4) == 0);
+      run.reads.push_back(reader.now);
+      lastActivity = reader.now / 1000;
+    }
+    run.sample(reader);
+
+    unsigned long wakeAt = reader.now + rfidProbePeriod(reader.now / 1000, lastActivity) * 1000;
+    if (!woken && wakeAt > WAKE_US) {
+      woken = true;
+      wakeAt = std::max(reader.now, WAKE_US);
+      lastActivity = wakeAt / 1000;
+    }
+    reader.sleep(wakeAt - reader.now);
+  }
+  return run;
+}
+
+static unsigned long detectionDelay(const Run &run, const Presentation &card) {
+  for (unsigned long at : run.reads) {
+    if (at >= card.from && at < card.until) {
+      return at - card.from;
+    }
+  }
+  return ~0UL;
+}
+
+static void report(const char *name, const Run &run, double idle, double fast) {
+  printf("  %-22s %6lu probes, longest call holding the reader %6.2f ms\n", name, run.probes,
+         run.longestCall / 1000.0);
+  printf("    idle  %7.0f accesses/s, bus busy %6.2f %%\n", idle, idle * MFRC522::SPI_ACCESS_US / 1e4);
+  printf("    fast  %7.0f accesses/s, bus busy %6.2f %%\n", fast, fast * MFRC522::SPI_ACCESS_US / 1e4);
+  for (const Presentation &card : CARDS) {
+    printf("    card at %4.1f s read %6.1f ms after it entered the field\n", card.from / 1e6,
+           detectionDelay(run, card) / 1000.0);
+  }
+  printf("    %zu card reads in all\n", run.reads.size());
+}
+
+int main() {
+  // Idle: once the fast window after the first card has run out. Fast: after the wake at
+  // 30 s, before the card at 32 s.
+  const unsigned long IDLE_FROM = CARDS[0].until + RFID_FAST_WINDOW * 1000, IDLE_UNTIL = WAKE_US;
+  const unsigned long FAST_FROM = WAKE_US + RFID_POLL_FAST_MS * 1000, FAST_UNTIL = CARDS[1].from;
+
+  Run polling = runLoopPolling();
+  double pollingIdle = polling.rate(IDLE_FROM, IDLE_UNTIL), pollingFast = polling.rate(FAST_FROM, FAST_UNTIL);
+  report("PICC_IsNewCardPresent", polling, pollingIdle, pollingFast);
+
+  Run task = runProbeTask();
+  double taskIdle = task.rate(IDLE_FROM, IDLE_UNTIL), taskFast = task.rate(FAST_FROM, FAST_UNTIL);
+  report("probe task", task, taskIdle, taskFast);
+
+  // Each card is read once while it stays in the field (it is halted), in both designs
+  CHECK(task.reads.size() == 2 && polling.reads.size() == 2);
+  CHECK(polling.longestCall >= MFRC522::TIMER_US);             // The loop stalled for the reader's timeout
+  CHECK(pollingIdle * MFRC522::SPI_ACCESS_US > 0.9 * SECOND_US); // and the bus was hardly ever free
+  CHECK(taskIdle * MFRC522::SPI_ACCESS_US < 0.01 * SECOND_US);   // The probes leave it idle (< 1 %)
+  CHECK(taskFast > taskIdle && taskFast * MFRC522::SPI_ACCESS_US < 0.01 * SECOND_US);
+  CHECK(task.longestCall < 1000); // No call holds the reader for a millisecond
+
+  // Detection: within one probe period, the probe wait and the UID read
+  unsigned long read = (MFRC522::READ_SERIAL_ACCESSES + 8) * MFRC522::SPI_ACCESS_US;
+  CHECK(detectionDelay(task, CARDS[0]) <= (RFID_POLL_IDLE_MS + RFID_PROBE_WAIT_MS) * 1000 + read);
+  CHECK(detectionDelay(task, CARDS[1]) <= (RFID_POLL_FAST_MS + RFID_PROBE_WAIT_MS) * 1000 + read);
+  return checkResult("test_rfid_probe");
+}
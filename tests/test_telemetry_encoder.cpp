@@ -0,0 +1,180 @@
+/**
+ * @file test_telemetry_encoder.cpp
+ * @brief Checks the telemetry encoders and benchmarks them against a heap-built baseline.
+ * @details One minute of synthetic 10 Hz telemetry is generated from a seeded drive:
+ * distance, closing speed and TTC change while moving, RSSI drifts, and avoidance runs a
+ * few times. Every tick is encoded as:
+ *
+ * - baseline: what the sketch did before the reused buffers. A JSON object is built
+ *   field by field in a heap string, then copied behind a "TELEMETRY:" prefix. The
+ *   original used StaticJsonDocument and Arduino String; ArduinoJson is not vendored in
+ *   this tree, so std::string stands in for both. The heap churn has the same shape
+ *   (a growing body plus a concatenated copy). The time is only indicative.
+ * - JSON keyframe, JSON delta and binary delta: encodeTelemetryJson() /
+ *   encodeTelemetryBinary() into fixed buffers, as sendTelemetryData() does for a
+ *   FULL-level client.
+ *
+ * For each one, the time per frame, the heap allocations per frame and the wire bytes
+ * per frame are reported.
+ */
+#include "telemetry_encoder.h"
+#include "alloc_count.h"
+#include "check.h"
+
+#include <string>
+#include <string.h>
+#include <vector>
+
+static const int TICKS = 600;   ///< One minute at 10 Hz.
+static const int PASSES = 500;
+
+static char text[TELEMETRY_TEXT_SIZE];
+static uint8_t record[TELEMETRY_BINARY_SIZE];
+static volatile size_t sink; ///< Keeps the encoders from being optimized away.
+
+static std::vector<TelemetrySnapshot> syntheticDrive() {
+  std::vector<TelemetrySnapshot> ticks;
+  uint32_t seed = 7;
+  long distance = 250, rssi = -60;
+  for (int tick = 0; tick < TICKS; tick++) {
+    seed = seed * 1103515245u + 12345u;
+    bool moving = (tick / 50) % 3 != 2;     // 5 s driving, 5 s driving, 5 s parked
+    bool avoiding = tick % 150 >= 90 && tick % 150 < 104;
+    long closing = moving && !avoiding ? 40 + (long)((seed >> 16) % 5) : 0;
+    distance = avoiding ? distance + 3 : distance - closing / 10;
+    if (distance < 20) {
+      distance = 250;
+    }
+    if (tick % 12 == 0) {
+      rssi += (long)((seed >> 20) % 3) - 1;
+    }
+    TelemetrySnapshot snapshot;
+    snapshot.values[TF_RSSI] = rssi;
+    snapshot.values[TF_AUTHORIZED] = 1;
+    snapshot.values[TF_DISTANCE] = distance;
+    snapshot.values[TF_DISTANCE_AGE] = (long)((seed >> 16) % 40);
+    snapshot.values[TF_CLOSING_SPEED] = closing;
+    snapshot.values[TF_TTC] = closing >= 5 ? distance * 1000 / closing : -1;
+    snapshot.values[TF_OBSTACLE_AVOIDANCE] = avoiding;
+    snapshot.values[TF_CURRENT_COMMAND] = moving ? CMD_FORWARD : CMD_STOP;
+    snapshot.values[TF_AVOIDANCE_STATE] = avoiding ? 1 : 0;
+    snapshot.captureTime = tick * 100000LL;
+    ticks.push_back(snapshot);
+  }
+  return ticks;
+}
+
+static void checkEncoders() {
+  TelemetrySnapshot snapshot = { { -61, 1, 87, 12, 14, 6214, 0, 1, 0 }, 0 };
+  uint16_t full = TELEMETRY_LEVEL_MASKS[TELEMETRY_LEVEL_FULL];
+
+  int length = encodeTelemetryJson(text, 7, snapshot, full, true);
+  length = finishTelemetryJson(text, length, false, 0);
+  const char *expected = "TELEMETRY:{\"seq\":7,\"key\":true,\"rssi\":-61,\"authorized\":true,\"distance\":87,"
+                         "\"closingSpeed\":14,\"ttc\":6214,\"obstacleAvoidance\":false,\"currentCommand\":1,"
+                         "\"avoidanceState\":0}";
+  CHECK(length == (int)strlen(expected) && strcmp(text, expected) == 0);
+
+  length = encodeTelemetryJson(text, 8, snapshot, TF_BIT(TF_DISTANCE), false);
+  length = finishTelemetryJson(text, length, true, 1234567890123LL);
+  CHECK(strcmp(text, "TELEMETRY:{\"seq\":8,\"distance\":87,\"t\":1234567890123}") == 0);
+
+  length = encodeTelemetryBinary(record, 0x0102, snapshot, full, true, false);
+  const uint8_t binary[] = { OP_TELEMETRY, 0x02, 0x01, (uint8_t)(full & 0xFF), (uint8_t)((full | TELEMETRY_KEYFRAME_BIT) >> 8),
+                             0xC3, 1, 87, 0, 14, 0, 0x46, 0x18, 0, 1, 0 };
+  CHECK(length == (int)sizeof(binary) && memcmp(record, binary, sizeof(binary)) == 0);
+
+  snapshot.values[TF_TTC] = -1;
+  length = encodeTelemetryBinary(record, 1, snapshot, TF_BIT(TF_TTC), false, true);
+  CHECK(length == 5 + (int)CLOCK_TIMESTAMP_LENGTH + 2);
+  CHECK(record[4] == TELEMETRY_TIMESTAMP_BIT >> 8 && record[length - 2] == 0xFF && record[length - 1] == 0xFF);
+
+  TelemetrySnapshot changed = snapshot;
+  changed.values[TF_RSSI]--;
+  changed.values[TF_AVOIDANCE_STATE] = 2;
+  CHECK(changedTelemetryFields(changed, snapshot) == (TF_BIT(TF_RSSI) | TF_BIT(TF_AVOIDANCE_STATE)));
+}
+
+/// The pre-reuse shape: a JSON body grown on the heap, then "TELEMETRY:" + body.
+static size_t encodeBaseline(uint16_t sequence, const TelemetrySnapshot &snapshot) {
+  std::string json = "{\"seq\":" + std::to_string(sequence);
+  for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+    if (!(TELEMETRY_LEVEL_MASKS[TELEMETRY_LEVEL_FULL] & TF_BIT(field))) {
+      continue;
+    }
+    json += ",\"";
+    json += TELEMETRY_FIELD_NAMES[field];
+    json += "\":";
+    if (TELEMETRY_BOOL_FIELDS & TF_BIT(field)) {
+      json += snapshot.values[field] ? "true" : "false";
+    } else {
+      json += std::to_string(snapshot.values[field]);
+    }
+  }
+  json += "}";
+  std::string message = "TELEMETRY:" + json;
+  return message.size();
+}
+
+enum Encoding { BASELINE, JSON_KEYFRAME, JSON_DELTA, BINARY_DELTA };
+
+static size_t encodeTick(Encoding encoding, const std::vector<TelemetrySnapshot> &ticks, int tick) {
+  uint16_t sequence = (uint16_t)(tick + 1);
+  const TelemetrySnapshot &snapshot = ticks[tick];
+  uint16_t mask = TELEMETRY_LEVEL_MASKS[TELEMETRY_LEVEL_FULL];
+  bool keyframe = encoding == BASELINE || encoding == JSON_KEYFRAME || tick == 0 || sequence % TELEMETRY_KEYFRAME_INTERVAL == 0;
+  if (!keyframe) {
+    mask &= changedTelemetryFields(snapshot, ticks[tick - 1]);
+    if (mask == 0) {
+      return 0; // Nothing is sent
+    }
+  }
+  switch (encoding) {
+    case BASELINE:
+      return encodeBaseline(sequence, snapshot);
+    case JSON_KEYFRAME:
+    case JSON_DELTA:
+      return finishTelemetryJson(text, encodeTelemetryJson(text, sequence, snapshot, mask, keyframe), false, 0);
+    case BINARY_DELTA:
+      return encodeTelemetryBinary(record, sequence, snapshot, mask, keyframe, false);
+  }
+  return 0;
+}
+
+static void benchmark(const char *name, Encoding encoding, const std::vector<TelemetrySnapshot> &ticks,
+                      size_t *allocationsPerFrame) {
+  size_t wireBytes = 0;
+  for (int tick = 0; tick < TICKS; tick++) {
+    wireBytes += encodeTick(encoding, ticks, tick);
+  }
+  size_t allocationsBefore = allocations;
+  size_t bytesBefore = allocatedBytes;
+  long long start = nowNanos();
+  for (int pass = 0; pass < PASSES; pass++) {
+    for (int tick = 0; tick < TICKS; tick++) {
+      sink = sink + encodeTick(encoding, ticks, tick);
+    }
+  }
+  long long elapsed = nowNanos() - start;
+  double frames = (double)TICKS * PASSES;
+  *allocationsPerFrame = (allocations - allocationsBefore) / (TICKS * PASSES);
+  printf("  %-14s %8.1f ns/frame %6.2f allocations/frame %7.1f heap bytes/frame %6.1f wire bytes/frame\n",
+         name, elapsed / frames, (allocations - allocationsBefore) / frames,
+         (allocatedBytes - bytesBefore) / frames, (double)wireBytes / TICKS);
+}
+
+int main() {
+  checkEncoders();
+
+  std::vector<TelemetrySnapshot> ticks = syntheticDrive();
+  size_t baseline, keyframes, deltas, binary;
+  printf("  %d ticks of FULL-level telemetry x %d passes:\n", TICKS, PASSES);
+  benchmark("baseline", BASELINE, ticks, &baseline);
+  benchmark("JSON keyframe", JSON_KEYFRAME, ticks, &keyframes);
+  benchmark("JSON delta", JSON_DELTA, ticks, &deltas);
+  benchmark("binary delta", BINARY_DELTA, ticks, &binary);
+
+  CHECK(baseline >= 2);
+  CHECK(keyframes == 0 && deltas == 0 && binary == 0);
+  return checkResult("test_telemetry_encoder");
+}
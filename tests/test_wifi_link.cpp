@@ -0,0 +1,203 @@
+/**
+ * @file test_wifi_link.cpp
+ * @brief Link-flap harness for the WiFi reconnect state machine in wifi_link.h.
+ * @details Runs checkWiFiConnection()'s decisions against a simulated access point and
+ * WiFi driver on a virtual clock, one loop pass per millisecond, for 10 simulated
+ * minutes of seeded link flaps (outages from a fraction of a second to two minutes).
+ * The driver model:
+ * - an attempt associates ASSOC_MS after WiFi.begin() if the access point stays up
+ *   meanwhile, and raises GOT_IP; otherwise nothing happens and the attempt times out;
+ * - the access point going away raises DISCONNECTED, and the event handler requests a
+ *   stop; every MISSED_EVENT_EVERY-th drop loses the event, so only the status()
+ *   backstop sees it.
+ * Checked: every drop is handled and stops the car, every outage ends with a reconnect
+ * within the connect timeout + the maximum backoff of the access point returning, the
+ * backoff stays within its bounds, and two cars with different jitter do not retry in
+ * lockstep (two without jitter do). The slowest stepWiFiLink() call is a host figure.
+ */
+#include "wifi_link.h"
+#include "check.h"
+
+#include <vector>
+
+static const unsigned long SIMULATED_MS = 10 * 60 * 1000;
+static const unsigned long ASSOC_MS = 1500;          ///< WiFi.begin() to GOT_IP with the access point up.
+static const unsigned MISSED_EVENT_EVERY = 5;        ///< Every n-th drop's DISCONNECTED event is lost.
+static const unsigned long LOCKSTEP_MS = 50;         ///< Attempts closer than this collide.
+
+struct Outage {
+  unsigned long from, until; ///< When the access point is gone (ms).
+};
+
+static uint32_t seed = 1;
+
+static uint32_t random32() {
+  seed = seed * 1103515245u + 12345u;
+  return seed >> 8;
+}
+
+/// Up for 3-30 s, then down for 0.2-3 s (most), 5-20 s or 40-120 s.
+static std::vector<Outage> flaps() {
+  std::vector<Outage> outages;
+  unsigned long now = 0;
+  for (;;) {
+    now += 3000 + random32() % 27000;
+    unsigned long kind = random32() % 10, length;
+    if (kind < 6) {
+      length = 200 + random32() % 2800;
+    } else if (kind < 9) {
+      length = 5000 + random32() % 15000;
+    } else {
+      length = 40000 + random32() % 80000;
+    }
+    if (now + length > SIMULATED_MS - 60000) { // Leave time for the last reconnect
+      return outages;
+    }
+    outages.push_back({ now, now + length });
+    now += length;
+  }
+}
+
+struct Car {
+  explicit Car(bool jitter) : jitter(jitter) {}
+
+  bool jitter;
+  WiFiLink link;
+  bool eventConnected = true; ///< wifiConnected, as set by the event handler.
+  bool statusConnected = true; ///< WiFi.status() == WL_CONNECTED.
+  unsigned long gotIpAt = 0;  ///< Pending association, or 0.
+  unsigned drops = 0, lostActions = 0, stops = 0, reconnects = 0, failures = 0;
+  unsigned long lastStop = 0, worstStopDelay = 0, worstReconnect = 0;
+  long long slowestStep = 0, stepNanos = 0;
+  bool backoffInBounds = true;
+  std::vector<unsigned long> attempts; ///< When each retry after a failure started.
+
+  void pass(unsigned long now, bool apUp, unsigned long apDownSince, unsigned long apUpSince) {
+    if (!apUp && statusConnected) { // The access point went away
+      statusConnected = false;
+      drops++;
+      if (drops % MISSED_EVENT_EVERY != 0) {
+        eventConnected = false; // onWiFiEvent(DISCONNECTED): requestStop()
+        stop(now, apDownSince);
+      }
+    }
+    if (gotIpAt && !apUp) {
+      gotIpAt = 0; // The association fails silently; the attempt times out
+    }
+    if (gotIpAt && now >= gotIpAt) {
+      gotIpAt = 0;
+      statusConnected = eventConnected = true; // onWiFiEvent(GOT_IP)
+    }
+
+    long long start = nowNanos();
+    WiFiLinkAction action = stepWiFiLink(link, now, eventConnected && statusConnected,
+                                         jitter ? random32() : link.backoff / 4);
+    long long took = nowNanos() - start;
+    slowestStep = std::max(slowestStep, took);
+    stepNanos += took;
+
+    switch (action) {
+      case WIFI_ACTION_LOST:
+        lostActions++;
+        stop(now, apDownSince);
+        begin(now, apUp);
+        break;
+      case WIFI_ACTION_ATTEMPT:
+        attempts.push_back(now);
+        begin(now, apUp);
+        break;
+      case WIFI_ACTION_RECONNECTED:
+        reconnects++;
+        worstReconnect = std::max(worstReconnect, now - apUpSince);
+        break;
+      case WIFI_ACTION_FAILED:
+        failures++;
+        backoffInBounds &= link.backoff >= WIFI_BACKOFF_MIN * 3 / 4 && link.backoff <= WIFI_BACKOFF_MAX;
+        break;
+      case WIFI_ACTION_NONE:
+        break;
+    }
+  }
+
+  void stop(unsigned long now, unsigned long apDownSince) {
+    if (lastStop < apDownSince || stops == 0) { // The first stop of this outage
+      worstStopDelay = std::max(worstStopDelay, now - apDownSince);
+    }
+    stops++;
+    lastStop = now;
+  }
+
+  void begin(unsigned long now, bool apUp) {
+    eventConnected = statusConnected = false; // WiFi.disconnect()
+    gotIpAt = apUp ? now + ASSOC_MS : 0;
+  }
+};
+
+/// Runs the cars through the outages, side by side.
+static void run(const std::vector<Outage> &outages, std::vector<Car> &cars) {
+  size_t next = 0;
+  unsigned long apDownSince = 0, apUpSince = 0;
+  for (Car &car : cars) {
+    wifiLinkUp(car.link, 0);
+  }
+  for (unsigned long now = 1; now <= SIMULATED_MS; now++) {
+    while (next < outages.size() && now >= outages[next].until) {
+      next++;
+    }
+    bool apUp = next >= outages.size() || now < outages[next].from;
+    if (!apUp) {
+      apDownSince = outages[next].from;
+    } else if (next > 0) {
+      apUpSince = outages[next - 1].until;
+    }
+    for (Car &car : cars) {
+      car.pass(now, apUp, apDownSince, apUpSince);
+    }
+  }
+}
+
+/// Share of b's retries that start within LOCKSTEP_MS of one of a's.
+static double lockstep(const Car &a, const Car &b) {
+  unsigned collisions = 0;
+  for (unsigned long at : b.attempts) {
+    for (unsigned long other : a.attempts) {
+      collisions += (at > other ? at - other : other - at) < LOCKSTEP_MS;
+    }
+  }
+  return b.attempts.empty() ? 0 : (double)collisions / b.attempts.size();
+}
+
+int main() {
+  std::vector<Outage> outages = flaps();
+  std::vector<Car> cars = { Car(true), Car(true), Car(false), Car(false) };
+  run(outages, cars);
+
+  unsigned long longest = 0;
+  for (const Outage &outage : outages) {
+    longest = std::max(longest, outage.until - outage.from);
+  }
+  const Car &car = cars[0];
+  printf("  %zu link flaps in %lu simulated min (longest outage %.1f s), one loop pass per ms\n", outages.size(),
+         SIMULATED_MS / 60000, longest / 1000.0);
+  printf("    %u dropped a connected car (%u with the event lost; the others hit a reconnect in progress)\n",
+         car.drops, car.drops / MISSED_EVENT_EVERY);
+  printf("    %u reconnects, %u failed attempts, %lu attempts in all\n", car.reconnects, car.failures,
+         (unsigned long)car.link.attempts);
+  printf("    stop requested %lu ms after a drop at worst; reconnected %.1f s after the access point returned at worst\n",
+         car.worstStopDelay, car.worstReconnect / 1000.0);
+  printf("    retries colliding within %lu ms: %.0f %% with jitter, %.0f %% without\n", LOCKSTEP_MS,
+         100 * lockstep(cars[0], cars[1]), 100 * lockstep(cars[2], cars[3]));
+  printf("    stepWiFiLink() on this host: %.1f ns mean, %lld ns slowest (includes scheduling noise)\n",
+         (double)car.stepNanos / SIMULATED_MS, car.slowestStep);
+
+  for (const Car &each : cars) {
+    CHECK(each.drops > outages.size() / 2);
+    CHECK(each.lostActions == each.drops && each.reconnects == each.drops); // Every drop handled and recovered
+    CHECK(each.worstStopDelay <= 1);     // The handler stops at once; the backstop on the next pass
+    CHECK(each.worstReconnect <= WIFI_CONNECT_TIMEOUT + WIFI_BACKOFF_MAX + ASSOC_MS + 1);
+    CHECK(each.backoffInBounds && each.failures > 0);
+  }
+  CHECK(lockstep(cars[0], cars[1]) < 0.2);
+  CHECK(lockstep(cars[2], cars[3]) == 1.0);
+  return checkResult("test_wifi_link");
+}